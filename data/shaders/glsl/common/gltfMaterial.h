@@ -33,6 +33,9 @@ struct Material
    float transmissionFactor;
    int transmissionTextureIndex;
 
+   // ALPHA_MASK: base color alpha below this is a miss
+   float alphaCutoff;
+
 #if CPU_SIDE_COMPILATION
    Material::Material()
       : baseColorFactor(vec4(1.0f))
@@ -47,6 +50,7 @@ struct Material
       , alphaMode(ALPHA_OPAQUE)
       , transmissionFactor(0)
       , transmissionTextureIndex(-1)
+      , alphaCutoff(0.5f)
    {
    }
 #endif
@@ -0,0 +1,25 @@
+#if CPU_SIDE_COMPILATION
+#pragma once
+using namespace glm;
+namespace genesis
+{
+#else
+#endif
+
+// small instances merged into one blas (see Tlas::addMergedInstances) lose their own model and transform.
+// one of these per geometry of the merged blas gives them back to the hit shader
+struct MergedGeometry
+{
+   mat4x3 objectToWorld;
+   mat4x3 worldToObject;
+   uint modelIndex;       // into the model buffer, what instanceCustomIndex is for instances that are not merged
+   uint geometryIndex;    // primitive of that model
+};
+
+// instanceCustomIndex of a merged blas: this bit plus the index of its first MergedGeometry
+#define MERGED_INSTANCE_BIT 0x800000
+
+#if CPU_SIDE_COMPILATION
+}
+#else
+#endif
@@ -27,6 +27,9 @@ struct PushConstants
    int cosineSampling;
    int maxBounces;
 
+   // 0 when nothing in the scene is alpha masked: the rays are then traced as opaque, which skips the any hit shader
+   int alphaTesting;
+
 #if CPU_SIDE_COMPILATION
    PushConstants()
    {
@@ -43,6 +46,8 @@ struct PushConstants
       cosineSampling = 1;
 
       maxBounces = 10;
+
+      alphaTesting = 0;
    }
 #endif
 };
@@ -0,0 +1,48 @@
+#if CPU_SIDE_COMPILATION
+#pragma once
+using namespace glm;
+namespace genesis
+{
+#else
+#endif
+
+// the scene for ray tracing without VK_KHR_ray_tracing_pipeline (see SoftwareTlas and softwareRayTracing.glsl).
+// a CpuBvh over the triangles of every instance in world space, uploaded as it is
+
+// 4 children tested together. a child with a count of 0 is an inner node, otherwise children is its first triangle.
+// unused slots have empty boxes and a child of -1
+struct BvhNode
+{
+   vec4 bounds[6];        // min x, y, z then max x, y, z, each for the 4 children
+   ivec4 children;
+   uvec4 counts;
+};
+
+// world space, edges precomputed for moller trumbore, in the order of the leaves
+struct BvhTriangle
+{
+   vec3 v0;
+   uint instanceIndex;    // into the instance buffer, with BVH_ALPHA_MASKED_BIT for the triangles that need the alpha test
+   vec3 e1;
+   uint geometryIndex;    // primitive of the model, gl_GeometryIndexEXT
+   vec3 e2;
+   uint primitiveIndex;   // triangle of the primitive, gl_PrimitiveID
+};
+
+// what the tlas instance gives the hit shader
+struct BvhInstance
+{
+   mat4x3 objectToWorld;
+   mat4x3 worldToObject;
+   uint modelIndex;       // into the model buffer, instanceCustomIndex
+};
+
+#define BVH_ALPHA_MASKED_BIT 0x80000000u
+
+// of the traversal. SoftwareTlas keeps the bvh shallow enough for it (see CpuBvh::setMaxStackSize)
+#define BVH_STACK_SIZE 64
+
+#if CPU_SIDE_COMPILATION
+}
+#else
+#endif
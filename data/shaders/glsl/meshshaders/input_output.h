@@ -46,7 +46,7 @@ struct Instance
    mat4 _xform;
    int _instanceId;
    int _modelId;
-   int pad0;
+   int _dynamic;
    int pad1;
 };
 
@@ -0,0 +1,47 @@
+#ifndef ALPHA_TEST_GLSL
+#define ALPHA_TEST_GLSL 1
+
+// the alpha test of masked materials, for the any hit shader and the software traversal (softwareRayTracing.glsl)
+
+vec2 loadUv(VertexBuffer vertexBuffer, uint index)
+{
+	// see unpack in pathtracer.glsl, the uv is in the second vec4
+	const int m = sceneUbo.vertexSizeInBytes / 16;
+	return vertexBuffer._vertices[m * index + 1].zw;
+}
+
+// false when the hit is to be ignored. attribs are the barycentrics of the hit, as in hitAttributeEXT
+bool passesAlphaTest(uint modelIndex, uint geometryIndex, uint primitiveID, vec2 attribs)
+{
+	const Model model = models._models[modelIndex];
+
+	MaterialBuffer materialBuffer = MaterialBuffer(model.materialAddress);
+	MaterialIndicesBuffer materialIndicesBuffer = MaterialIndicesBuffer(model.materialIndicesAddress);
+	const Material material = materialBuffer._materials[materialIndicesBuffer._materialIndices[geometryIndex]];
+	if (material.alphaMode != ALPHA_MASK)
+	{
+		return true;
+	}
+
+	float alpha = material.baseColorFactor.a;
+	if (material.baseColorTextureIndex != -1)
+	{
+		VertexBuffer vertexBuffer = VertexBuffer(model.vertexBufferAddress);
+		IndexBuffer indexBuffer = IndexBuffer(model.indexBufferAddress);
+		IndexIndicesBuffer indexIndicesBuffer = IndexIndicesBuffer(model.indexIndicesAddress);
+
+		const uint indicesOffset = indexIndicesBuffer._indexIndices[geometryIndex] + 3 * primitiveID;
+		const vec3 barycentricCoords = vec3(1.0f - attribs.x - attribs.y, attribs.x, attribs.y);
+		const vec2 uv = loadUv(vertexBuffer, indexBuffer._indices[indicesOffset]) * barycentricCoords.x
+			+ loadUv(vertexBuffer, indexBuffer._indices[indicesOffset + 1]) * barycentricCoords.y
+			+ loadUv(vertexBuffer, indexBuffer._indices[indicesOffset + 2]) * barycentricCoords.z;
+
+		// no derivatives here, the finest resident level
+		const uint samplerIndex = uint(model.textureOffset) + material.baseColorTextureIndex;
+		alpha *= textureLod(samplers[nonuniformEXT(samplerIndex)], uv, 0.0).a;
+	}
+
+	return !(alpha < material.alphaCutoff);
+}
+
+#endif
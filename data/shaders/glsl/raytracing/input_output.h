@@ -10,6 +10,13 @@ layout(set = 0, binding = 0) uniform SceneUboBuffer
    SceneUbo sceneUbo;
 };
 layout(set = 0, binding = 1) uniform samplerCube environmentMap;
+
+// see textureFeedback.glsl
+layout(set = 0, binding = 2, std430) buffer TextureFeedbackBuffer
+{
+   uint _enabled;
+   uint _requestedResolution[];
+} textureFeedback;
 layout(push_constant) uniform _PushConstants { PushConstants pushConstants; };
 #endif
 
@@ -46,7 +53,7 @@ struct Instance
    mat4 _xform;
    int _instanceId;
    int _modelId;
-   int pad0;
+   int _dynamic;
    int pad1;
 };
 
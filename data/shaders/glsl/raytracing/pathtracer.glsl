@@ -5,8 +5,31 @@
 
 #define MIN_BOUNCES_FOR_RUSSIAN_ROULETTE 3
 
+#if SOFTWARE_RAY_TRACING
+HitPayload payLoad;
+
+#include "softwareRayTracing.glsl"
+#else
 layout(location = 0) rayPayloadEXT HitPayload payLoad;
 
+// alpha masked geometry is not flagged opaque, these rays let the any hit shader see it
+uint rayFlags()
+{
+	return (pushConstants.alphaTesting != 0) ? gl_RayFlagsNoneEXT : gl_RayFlagsOpaqueEXT;
+}
+#endif
+
+// the closest hit goes to payLoad, hitT stays INFINITY on a miss
+void traceScene(const Ray ray)
+{
+	payLoad.hitT = INFINITY;
+#if SOFTWARE_RAY_TRACING
+	traceSoftwareRay(ray.origin, T_MIN, ray.direction, T_MAX, pushConstants.alphaTesting != 0);
+#else
+	traceRayEXT(topLevelAS, rayFlags(), 0xff, 0, 0, 0, ray.origin, T_MIN, ray.direction, T_MAX, 0);
+#endif
+}
+
 vec3 pathTrace()
 {
    vec3 radiance = vec3(0.0);
@@ -33,7 +56,8 @@ Vertex unpack(uint index, int vertexSizeInBytes, VertexBuffer vertexBuffer)
 	return v;
 }
 
-Vertex loadVertex(in Model model, out vec3 geometryNormal)
+// uvPerWorldUnit: texture coordinate units per world unit on the hit triangle, for texture feedback
+Vertex loadVertex(in Model model, out vec3 geometryNormal, out float uvPerWorldUnit)
 {
 	VertexBuffer vertexBuffer = VertexBuffer(model.vertexBufferAddress);
 	IndexBuffer indexBuffer = IndexBuffer(model.indexBufferAddress);
@@ -60,14 +84,23 @@ Vertex loadVertex(in Model model, out vec3 geometryNormal)
 
 	geometryNormal = normalize(cross(edge02, edge01));
 
+	// ratio of the triangle areas in texture and world space, as in ray cones
+	const float worldArea = length(cross(mat3(payLoad.objectToWorld) * edge01, mat3(payLoad.objectToWorld) * edge02));
+	const vec2 uv01 = v1.uv - v0.uv;
+	const vec2 uv02 = v2.uv - v0.uv;
+	const float uvArea = abs(uv01.x * uv02.y - uv01.y * uv02.x);
+	uvPerWorldUnit = (worldArea > 0.0) ? sqrt(uvArea / worldArea) : 0.0;
+
 	return vertex;
 }
 
-MaterialProperties loadMaterialProperties(in Model model, in Vertex vertex)
+// uvFootprint: texture coordinate units covered by the ray, 0 to not record texture feedback
+MaterialProperties loadMaterialProperties(in Model model, in Vertex vertex, float uvFootprint)
 {
 	MaterialBuffer  materialBuffer = MaterialBuffer(model.materialAddress);
 	MaterialIndicesBuffer  materialIndicesBuffer = MaterialIndicesBuffer(model.materialIndicesAddress);
 	const Material material = materialBuffer._materials[materialIndicesBuffer._materialIndices[payLoad.geometryIndex]];
+	recordMaterialFeedback(material, uvFootprint);
 	const uint64_t textureOffset = model.textureOffset;
 	const uint samplerIndex = uint(textureOffset)+material.baseColorTextureIndex;
 
@@ -174,10 +207,21 @@ Ray calculateRay(const ivec2 imageCoords, const ivec2 imageSize)
 	return ray;
 }
 
+// angle covered by a pixel, the spread of the ray cones
+float pixelSpreadAngle(const ivec2 imageSize)
+{
+	return 2.0 / (abs(sceneUbo.projectionMatrix[1][1]) * float(imageSize.y));
+}
+
 vec3 pathTrace(const ivec2 imageCoords, const ivec2 imageSize)
 {
 	Ray ray = calculateRay(imageCoords, imageSize);
 
+	// the cone only widens with distance, surfaces do not change its spread
+	const bool textureFeedbackPixel = isTextureFeedbackPixel(imageCoords, pushConstants.frameIndex);
+	const float spreadAngle = pixelSpreadAngle(imageSize);
+	float coneWidth = 0.0;
+
 	vec3 weight = vec3(0.0);
 
 	vec3 throughput = vec3(1);
@@ -186,8 +230,7 @@ vec3 pathTrace(const ivec2 imageCoords, const ivec2 imageSize)
 	int maxBounces = pushConstants.maxBounces;
 	for (int depth = 0; depth < maxBounces; ++depth)
 	{
-		payLoad.hitT = INFINITY;
-		traceRayEXT(topLevelAS, gl_RayFlagsOpaqueEXT, 0xff, 0, 0, 0, ray.origin, T_MIN, ray.direction, T_MAX, 0);
+		traceScene(ray);
 
 		if (payLoad.hitT == INFINITY)
 		{
@@ -199,9 +242,12 @@ vec3 pathTrace(const ivec2 imageCoords, const ivec2 imageSize)
 
 		const Model model = models._models[payLoad.instanceCustomIndex];
 
+		coneWidth += payLoad.hitT * spreadAngle;
+
 		vec3 geometryNormal;
-		const Vertex vertex = loadVertex(model, geometryNormal);
-		const MaterialProperties materialProperties = loadMaterialProperties(model, vertex);
+		float uvPerWorldUnit;
+		const Vertex vertex = loadVertex(model, geometryNormal, uvPerWorldUnit);
+		const MaterialProperties materialProperties = loadMaterialProperties(model, vertex, textureFeedbackPixel ? coneWidth * uvPerWorldUnit : 0.0);
 
 		const vec3 worldPosition = vec3(payLoad.objectToWorld * vec4(vertex.position, 1.0));
 		vec3 worldNormal = normalize(vec3(vertex.normal * payLoad.worldToObject));
@@ -306,8 +352,7 @@ vec3 rasterizationEmulatedByRayTrace(const ivec2 imageCoords, const ivec2 imageS
 	vec3 hitValue = vec3(0.0);
 	vec3 weight = vec3(0.0);
 
-	payLoad.hitT = INFINITY;
-	traceRayEXT(topLevelAS, gl_RayFlagsOpaqueEXT, 0xff, 0, 0, 0, ray.origin, T_MIN, ray.direction, T_MAX, 0);
+	traceScene(ray);
 
 	if (payLoad.hitT == INFINITY)
 	{
@@ -320,8 +365,10 @@ vec3 rasterizationEmulatedByRayTrace(const ivec2 imageCoords, const ivec2 imageS
 	const Model model = models._models[payLoad.instanceCustomIndex];
 
 	vec3 geometryNormal;
-	const Vertex vertex = loadVertex(model, geometryNormal);
-	const MaterialProperties materialProperties = loadMaterialProperties(model, vertex);
+	float uvPerWorldUnit;
+	const Vertex vertex = loadVertex(model, geometryNormal, uvPerWorldUnit);
+	const float uvFootprint = payLoad.hitT * pixelSpreadAngle(imageSize) * uvPerWorldUnit;
+	const MaterialProperties materialProperties = loadMaterialProperties(model, vertex, isTextureFeedbackPixel(imageCoords, pushConstants.frameIndex) ? uvFootprint : 0.0);
 
 	// early out
 	if (pushConstants.materialComponentViz > 0)
@@ -352,4 +399,39 @@ vec3 rasterizationEmulatedByRayTrace(const ivec2 imageCoords, const ivec2 imageS
 	hitValue = final;
 
 	return hitValue;
-}
\ No newline at end of file
+}
+
+// the path tracer accumulates into the intermediate image, both write the final one. payLoad.seed is set
+void renderPixel(const ivec2 imageCoords, const ivec2 imageSize)
+{
+	if (pushConstants.pathTracer > 0)
+	{
+		vec3 radiance = pathTrace(imageCoords, imageSize);
+
+		vec4 valueToWrite = vec4(0,0,0,0);
+		// do all computations at 32 bit resolution
+		if (pushConstants.frameIndex > 0)
+		{
+			float a         = 1.0f / float(pushConstants.frameIndex + 1);
+			vec3  oldColor = imageLoad(intermediateImage, imageCoords).xyz;
+
+			valueToWrite = vec4(mix(oldColor, radiance, a), 1.f);
+			imageStore(intermediateImage, imageCoords,valueToWrite );
+		}
+		else
+		{
+			valueToWrite = vec4(radiance, 0.0);
+			imageStore(intermediateImage, imageCoords, valueToWrite);
+		}
+
+		// write the final value to the 8 bit resolution after tonemapping, etc
+		float one_by_gamma = 1.0/2.2f;
+		valueToWrite = pow(valueToWrite, vec4(one_by_gamma));
+		imageStore(finalImage, imageCoords, valueToWrite);
+	}
+	else
+	{
+		vec3 radiance = rasterizationEmulatedByRayTrace(imageCoords, imageSize);
+		imageStore(finalImage, imageCoords, vec4(radiance, 0.0));
+	}
+}
@@ -12,6 +12,7 @@
 #include "../common/gltfMaterial.h"
 #include "../common/gltfModelDesc.h"
 #include "input_output.h"
+#include "textureFeedback.glsl"
 
 layout (location = 0) in vec2 inUV;
 layout (location = 1) in vec3 inColor;
@@ -163,6 +164,13 @@ void main()
 	const uint64_t textureOffset = model.textureOffset;
 	const uint samplerIndex = uint(textureOffset) + material.baseColorTextureIndex;
 
+	// the command buffers are recorded once, so the feedback pixels do not rotate with the frame index
+	const vec2 uvFootprint = max(abs(dFdx(inUV)), abs(dFdy(inUV)));
+	if (isTextureFeedbackPixel(ivec2(gl_FragCoord.xy), 0))
+	{
+		recordMaterialFeedback(material, max(uvFootprint.x, uvFootprint.y));
+	}
+
 	float occlusion = 1.0; // no occlusion
 	float roughness = 1;
 	float metalness = 1;
@@ -11,8 +11,18 @@ using namespace glm;
 #include "../common/gltfMaterial.h"
 #include "../common/gltfModelDesc.h"
 #include "../common/sceneUbo.h"
+#include "../common/mergedGeometry.h"
+#include "../common/softwareBvh.h"
 
+#if SOFTWARE_RAY_TRACING
+// see SoftwareTlas, in place of the tlas
+layout(set = 0, binding = 0, scalar) readonly buffer BvhNodeBuffer
+{
+   BvhNode _nodes[];
+} bvhNodes;
+#else
 layout(set = 0, binding = 0) uniform accelerationStructureEXT topLevelAS;
+#endif
 layout(set = 0, binding = 1, rgba32f) uniform image2D intermediateImage;
 layout(set = 0, binding = 2, rgba8) uniform image2D finalImage;
 layout(set = 0, binding = 3) uniform SceneUboBuffer
@@ -22,6 +32,30 @@ layout(set = 0, binding = 3) uniform SceneUboBuffer
 
 layout(set = 0, binding = 4) uniform samplerCube environmentMap;
 
+// see textureFeedback.glsl
+layout(set = 0, binding = 5, std430) buffer TextureFeedbackBuffer
+{
+   uint _enabled;
+   uint _requestedResolution[];
+} textureFeedback;
+
+#if SOFTWARE_RAY_TRACING
+layout(set = 0, binding = 6, scalar) readonly buffer BvhTriangleBuffer
+{
+   BvhTriangle _triangles[];
+} bvhTriangles;
+
+layout(set = 0, binding = 7, scalar) readonly buffer BvhInstanceBuffer
+{
+   BvhInstance _instances[];
+} bvhInstances;
+#else
+layout(set = 0, binding = 6, scalar) buffer MergedGeometryBuffer
+{
+   MergedGeometry _geometries[];
+} mergedGeometries;
+#endif
+
 layout(push_constant) uniform _PushConstants { PushConstants pushConstants; };
 
 struct Model
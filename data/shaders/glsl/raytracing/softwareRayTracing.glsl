@@ -0,0 +1,137 @@
+#ifndef SOFTWARE_RAY_TRACING_GLSL
+#define SOFTWARE_RAY_TRACING_GLSL 1
+
+// ray tracing without VK_KHR_ray_tracing_pipeline: the closest hit in the bvh of SoftwareTlas,
+// written to the payload the way closesthit.rchit does. the traversal follows CpuBvh::intersect
+
+#include "alphaTest.glsl"
+
+// moller trumbore, both sides as the pipeline does not cull either
+bool intersectTriangle(const BvhTriangle triangle, const vec3 origin, const vec3 direction, const float tMin, const float tMax, out float t, out vec2 attribs)
+{
+	const vec3 p = cross(direction, triangle.e2);
+	const float det = dot(triangle.e1, p);
+	if (abs(det) < 1e-12)
+	{
+		return false;
+	}
+	const float invDet = 1.0 / det;
+	const vec3 s = origin - triangle.v0;
+	attribs.x = dot(s, p) * invDet;
+	if (attribs.x < 0.0 || attribs.x > 1.0)
+	{
+		return false;
+	}
+	const vec3 q = cross(s, triangle.e1);
+	attribs.y = dot(direction, q) * invDet;
+	if (attribs.y < 0.0 || attribs.x + attribs.y > 1.0)
+	{
+		return false;
+	}
+	t = dot(triangle.e2, q) * invDet;
+	return t > tMin && t < tMax;
+}
+
+// alphaTesting: the triangles with BVH_ALPHA_MASKED_BIT go through the alpha test, like rays that are not opaque.
+// payLoad.hitT is left alone on a miss
+void traceSoftwareRay(const vec3 origin, const float tMin, const vec3 direction, const float tMax, const bool alphaTesting)
+{
+	// no infinities: 0 * inf in the slabs of axis aligned rays would be nan
+	const vec3 invDirection = vec3(1.0) / mix(direction, vec3(1e-20), lessThan(abs(direction), vec3(1e-20)));
+
+	// the near plane of each axis is the min or the max, depending on the sign of the direction.
+	// that way the empty slots (min > max) never pass
+	const ivec3 nearPlanes = ivec3(invDirection.x >= 0.0 ? 0 : 3, invDirection.y >= 0.0 ? 1 : 4, invDirection.z >= 0.0 ? 2 : 5);
+	const ivec3 farPlanes = ivec3(invDirection.x >= 0.0 ? 3 : 0, invDirection.y >= 0.0 ? 4 : 1, invDirection.z >= 0.0 ? 5 : 2);
+
+	int stackNodes[BVH_STACK_SIZE];
+	float stackTNear[BVH_STACK_SIZE];
+	stackNodes[0] = 0;
+	stackTNear[0] = tMin;
+	int stackSize = 1;
+
+	float closestT = tMax;
+	int closestTriangle = -1;
+	vec2 closestAttribs = vec2(0.0);
+
+	while (stackSize > 0)
+	{
+		--stackSize;
+		if (stackTNear[stackSize] >= closestT)
+		{
+			continue;
+		}
+
+		const BvhNode node = bvhNodes._nodes[stackNodes[stackSize]];
+
+		const vec4 tNear = max(max((node.bounds[nearPlanes.x] - origin.x) * invDirection.x, (node.bounds[nearPlanes.y] - origin.y) * invDirection.y)
+			, max((node.bounds[nearPlanes.z] - origin.z) * invDirection.z, vec4(tMin)));
+		const vec4 tFar = min(min((node.bounds[farPlanes.x] - origin.x) * invDirection.x, (node.bounds[farPlanes.y] - origin.y) * invDirection.y)
+			, min((node.bounds[farPlanes.z] - origin.z) * invDirection.z, vec4(closestT)));
+		const bvec4 childHit = lessThanEqual(tNear, tFar);
+
+		// leaves right away, inner nodes go on the stack with the closest on top
+		const int firstInner = stackSize;
+		for (int i = 0; i < 4; ++i)
+		{
+			if (!childHit[i] || node.children[i] < 0)
+			{
+				continue;
+			}
+			if (node.counts[i] > 0)
+			{
+				for (uint j = 0; j < node.counts[i]; ++j)
+				{
+					const int triangleIndex = node.children[i] + int(j);
+					const BvhTriangle triangle = bvhTriangles._triangles[triangleIndex];
+
+					float t;
+					vec2 attribs;
+					if (!intersectTriangle(triangle, origin, direction, tMin, closestT, t, attribs))
+					{
+						continue;
+					}
+					if (alphaTesting && (triangle.instanceIndex & BVH_ALPHA_MASKED_BIT) != 0)
+					{
+						const uint modelIndex = bvhInstances._instances[triangle.instanceIndex & ~BVH_ALPHA_MASKED_BIT].modelIndex;
+						if (!passesAlphaTest(modelIndex, triangle.geometryIndex, triangle.primitiveIndex, attribs))
+						{
+							continue;
+						}
+					}
+					closestT = t;
+					closestTriangle = triangleIndex;
+					closestAttribs = attribs;
+				}
+			}
+			else
+			{
+				int k = stackSize++;
+				for (; k > firstInner && stackTNear[k - 1] < tNear[i]; --k)
+				{
+					stackNodes[k] = stackNodes[k - 1];
+					stackTNear[k] = stackTNear[k - 1];
+				}
+				stackNodes[k] = node.children[i];
+				stackTNear[k] = tNear[i];
+			}
+		}
+	}
+
+	if (closestTriangle < 0)
+	{
+		return;
+	}
+
+	const BvhTriangle triangle = bvhTriangles._triangles[closestTriangle];
+	const BvhInstance instance = bvhInstances._instances[triangle.instanceIndex & ~BVH_ALPHA_MASKED_BIT];
+	payLoad.hitT = closestT;
+	payLoad.instanceCustomIndex = int(instance.modelIndex);
+	payLoad.geometryIndex = int(triangle.geometryIndex);
+	payLoad.primitiveID = int(triangle.primitiveIndex);
+	payLoad.objectToWorld = instance.objectToWorld;
+	payLoad.worldToObject = instance.worldToObject;
+	payLoad.attribs = closestAttribs;
+}
+
+#endif
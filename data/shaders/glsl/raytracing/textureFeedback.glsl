@@ -0,0 +1,31 @@
+// Feedback for the TextureStreamer: every texture keeps the highest resolution it was sampled at,
+// as log2 of the texels needed per unit of texture coordinates. The streamer turns that into the
+// first mip level that has to be resident, independently of what is resident right now.
+// Only one pixel in 16 writes, the rest would just fight over the same atomics.
+
+bool isTextureFeedbackPixel(ivec2 pixel, int frameIndex)
+{
+	return textureFeedback._enabled != 0 && (pixel & 3) == ivec2(frameIndex & 3, (frameIndex >> 2) & 3);
+}
+
+// uvFootprint: texture coordinate units covered by the pixel
+void recordTextureFeedback(int textureIndex, float uvFootprint)
+{
+	if (textureIndex < 0 || uvFootprint <= 0.0)
+	{
+		return;
+	}
+	const uint resolution = uint(clamp(ceil(-log2(uvFootprint)), 0.0, 31.0));
+	if (textureFeedback._requestedResolution[textureIndex] < resolution)
+	{
+		atomicMax(textureFeedback._requestedResolution[textureIndex], resolution);
+	}
+}
+
+void recordMaterialFeedback(Material material, float uvFootprint)
+{
+	recordTextureFeedback(material.baseColorTextureIndex, uvFootprint);
+	recordTextureFeedback(material.occlusionRoughnessMetalnessTextureIndex, uvFootprint);
+	recordTextureFeedback(material.normalTextureIndex, uvFootprint);
+	recordTextureFeedback(material.emissiveTextureIndex, uvFootprint);
+}
@@ -28,6 +28,13 @@
 #include "Cell.h"
 #include "CellManager.h"
 #include "IndirectLayout.h"
+#include "GltfJsonParser.h"
+#include "MipMapGenerator.h"
+#include "TextureStreamer.h"
+#include "PixelConversion.h"
+#include "AccelerationStructureCache.h"
+#include "CpuPathTracer.h"
+#include "SoftwareTlas.h"
 
 #include <chrono>
 #include <sstream>
@@ -142,6 +149,126 @@ RayTracing::RayTracing()
 		{
 			_srgb = true;
 		}
+		else if (arg == "--lods")
+		{
+			_lods = true;
+		}
+		else if (arg == "--lodHysteresis" && (i + 1) < _args.size())
+		{
+			std::stringstream ss;
+			ss << _args[i + 1];
+			ss >> _lodHysteresis;
+			++i;
+		}
+		else if (arg == "--weldVertices")
+		{
+			_weldVertices = true;
+		}
+		else if (arg == "--mergePrimitives")
+		{
+			_mergePrimitives = true;
+		}
+		else if (arg == "--printStats")
+		{
+			_printStats = true;
+		}
+		else if (arg == "--fastJsonParser")
+		{
+			_fastJsonParser = true;
+		}
+		else if (arg == "--benchmarkGltfParsing")
+		{
+			_benchmarkGltfParsing = true;
+		}
+		else if (arg == "--benchmarkPixelConversion")
+		{
+			_benchmarkPixelConversion = true;
+		}
+		else if (arg == "--compressTextures")
+		{
+			_compressTextures = true;
+		}
+		else if (arg == "--immutableSamplers")
+		{
+			_immutableSamplers = true;
+		}
+		else if (arg == "--computeMipMaps")
+		{
+			_computeMipMaps = true;
+		}
+		else if (arg == "--maxTextureSize" && (i + 1) < _args.size())
+		{
+			std::stringstream ss;
+			ss << _args[i + 1];
+			ss >> _maxTextureSize;
+			++i;
+		}
+		else if (arg == "--streamTextures")
+		{
+			_streamTextures = true;
+		}
+		else if (arg == "--cacheAccelerationStructures")
+		{
+			_cacheAccelerationStructures = true;
+		}
+		else if (arg == "--asyncAccelerationStructureBuilds")
+		{
+			_asyncAccelerationStructureBuilds = true;
+		}
+		else if (arg == "--softwareRayTracing")
+		{
+			_softwareRayTracing = true;
+		}
+		else if (arg == "--cpuReference" && (i + 1) < _args.size())
+		{
+			std::stringstream ss;
+			ss << _args[i + 1];
+			ss >> _cpuReferenceSamples;
+			++i;
+		}
+		else if (arg == "--animateInstances")
+		{
+			_animateInstances = true;
+		}
+		else if (arg == "--mergeInstances")
+		{
+			_instanceMerging._enabled = true;
+		}
+		else if (arg == "--mergeMaxRadius" && (i + 1) < _args.size())
+		{
+			std::stringstream ss;
+			ss << _args[i + 1];
+			ss >> _instanceMerging._maxInstanceRadius;
+			++i;
+		}
+		else if (arg == "--mergeClusterSize" && (i + 1) < _args.size())
+		{
+			std::stringstream ss;
+			ss << _args[i + 1];
+			ss >> _instanceMerging._clusterSize;
+			++i;
+		}
+		else if (arg == "--mergeMaxTriangles" && (i + 1) < _args.size())
+		{
+			std::stringstream ss;
+			ss << _args[i + 1];
+			ss >> _instanceMerging._maxTrianglesPerCluster;
+			++i;
+		}
+		else if (arg == "--mergeMinInstances" && (i + 1) < _args.size())
+		{
+			std::stringstream ss;
+			ss << _args[i + 1];
+			ss >> _instanceMerging._minInstancesPerCluster;
+			++i;
+		}
+		else if (arg == "--textureBudgetMB" && (i + 1) < _args.size())
+		{
+			std::stringstream ss;
+			ss << _args[i + 1];
+			ss >> _textureBudgetInMB;
+			++i;
+		}
 	}
 
 	_sampleCount = (_mode == RASTERIZATION) ? _sampleCountForRasterization : 1;
@@ -155,8 +282,10 @@ RayTracing::RayTracing()
 
 	resetCamera();
 
-	// Require Vulkan 1.3
-	apiVersion = VK_API_VERSION_1_3;
+	// Require Vulkan 1.3 for the ray tracing pipeline (its shaders target it), 1.2 is enough to trace in software.
+	// a device found in enableFeatures to lack ray tracing may be 1.2 under a 1.3 instance, that is fine
+	// as long as nothing of 1.3 is used on it, which the software path does not
+	apiVersion = (_softwareRayTracing) ? VK_API_VERSION_1_2 : VK_API_VERSION_1_3;
 
 	// Ray tracing related extensions required by this sample
 	_deviceExtensionsToEnable.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
@@ -194,22 +323,66 @@ void RayTracing::enableFeatures()
 	// This is required for multi draw indirect
 	_physicalDeviceFeaturesToEnable.multiDrawIndirect = VK_TRUE;
 
+	// The rasterization fragment shader writes texture feedback
+	_physicalDeviceFeaturesToEnable.fragmentStoresAndAtomics = VK_TRUE;
+
 	// Enable anisotropic filtering if supported
 	if (_physicalDevice->physicalDeviceFeatures().samplerAnisotropy)
 	{
 		_physicalDeviceFeaturesToEnable.samplerAnisotropy = VK_TRUE;
 	}
 
+	// Block compressed textures (ktx/ktx2 files)
+	if (_physicalDevice->physicalDeviceFeatures().textureCompressionBC)
+	{
+		_physicalDeviceFeaturesToEnable.textureCompressionBC = VK_TRUE;
+	}
+	if (_physicalDevice->physicalDeviceFeatures().textureCompressionASTC_LDR)
+	{
+		_physicalDeviceFeaturesToEnable.textureCompressionASTC_LDR = VK_TRUE;
+	}
+
 	// This is required for wireframe display
 	if (_physicalDevice->physicalDeviceFeatures().fillModeNonSolid)
 	{
 		_physicalDeviceFeaturesToEnable.fillModeNonSolid = VK_TRUE;
 	}
 
+	// without the ray tracing pipeline, the rays are traced in a compute shader
+	if (!_physicalDevice->extensionSupported(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME) || !_physicalDevice->extensionSupported(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME))
+	{
+		std::cout << "no ray tracing pipeline, tracing in software" << std::endl;
+		_softwareRayTracing = true;
+	}
+
 	ADD_FIRST(_enabledBufferDeviceAddressFeatures);
 	_enabledBufferDeviceAddressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
 	_enabledBufferDeviceAddressFeatures.bufferDeviceAddress = VK_TRUE;
 
+	_physicalDeviceDescriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	_physicalDeviceDescriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	_physicalDeviceDescriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+	_physicalDeviceDescriptorIndexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+	_physicalDeviceDescriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+
+	_timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	_timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+
+	if (_softwareRayTracing)
+	{
+		// a vulkan 1.2 device: no shader clock, and dynamic rendering only when asked for
+		ADD_NEXT(_enabledBufferDeviceAddressFeatures, _physicalDeviceDescriptorIndexingFeatures);
+		ADD_NEXT(_physicalDeviceDescriptorIndexingFeatures, _timelineSemaphoreFeatures);
+		if (_dynamicRendering)
+		{
+			ADD_NEXT(_timelineSemaphoreFeatures, _dynamicRenderingFeatures);
+			_dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+			_dynamicRenderingFeatures.pNext = nullptr;
+			_dynamicRenderingFeatures.dynamicRendering = true;
+		}
+		return;
+	}
+
 	ADD_NEXT(_enabledBufferDeviceAddressFeatures, _enabledRayTracingPipelineFeatures);
 	_enabledRayTracingPipelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR;
 	_enabledRayTracingPipelineFeatures.rayTracingPipeline = VK_TRUE;
@@ -219,11 +392,6 @@ void RayTracing::enableFeatures()
 	_enabledAccelerationStructureFeatures.accelerationStructure = VK_TRUE;
 
 	ADD_NEXT(_enabledAccelerationStructureFeatures, _physicalDeviceDescriptorIndexingFeatures);
-	_physicalDeviceDescriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
-	_physicalDeviceDescriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
-	_physicalDeviceDescriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
-	_physicalDeviceDescriptorIndexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
-	_physicalDeviceDescriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
 
 	ADD_NEXT(_physicalDeviceDescriptorIndexingFeatures, _physicalDeviceShaderClockFeaturesKHR);
 	_physicalDeviceShaderClockFeaturesKHR.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_CLOCK_FEATURES_KHR;
@@ -233,6 +401,9 @@ void RayTracing::enableFeatures()
 	ADD_NEXT(_physicalDeviceShaderClockFeaturesKHR, _dynamicRenderingFeatures);
 	_dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
 	_dynamicRenderingFeatures.dynamicRendering = true;
+
+	// Async acceleration structure builds signal a timeline semaphore
+	ADD_NEXT(_dynamicRenderingFeatures, _timelineSemaphoreFeatures);
 }
 
 void RayTracing::destroyRasterizationPipelines(void)
@@ -281,8 +452,27 @@ void RayTracing::destroyRayTracingDescriptorSets()
 
 void RayTracing::destroyCommonStuff()
 {
+	delete _textureStreamer;
+	_textureStreamer = nullptr;
+
+	delete _disabledTextureFeedback;
+	_disabledTextureFeedback = nullptr;
+
 	delete _cellManager;
 
+	if (_mipMapGenerator)
+	{
+		_device->setMipMapGenerator(nullptr);
+		delete _mipMapGenerator;
+	}
+
+	if (_accelerationStructureCache)
+	{
+		_device->setAccelerationStructureCache(nullptr);
+		delete _accelerationStructureCache;
+		_accelerationStructureCache = nullptr;
+	}
+
 	delete _skyBoxManager;
 
 	delete _sceneUbo;
@@ -300,12 +490,21 @@ RayTracing::~RayTracing()
 
 void RayTracing::createAndUpdateRayTracingDescriptorSets()
 {
+	// in software, the bvh nodes take the place of the tlas and the triangles and instances that of the merged geometries
 	std::vector<VkDescriptorPoolSize> poolSizes = {
-	{ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1 },
 	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 },
 	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
 	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
 	};
+	if (_softwareRayTracing)
+	{
+		poolSizes.push_back({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 });
+	}
+	else
+	{
+		poolSizes.push_back({ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1 });
+		poolSizes.push_back({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 });
+	}
 	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = genesis::vkInitializers::descriptorPoolCreateInfo(poolSizes, 1);
 	VK_CHECK_RESULT(vkCreateDescriptorPool(_device->vulkanDevice(), &descriptorPoolCreateInfo, nullptr, &_rayTracingDescriptorPool));
 
@@ -313,20 +512,39 @@ void RayTracing::createAndUpdateRayTracingDescriptorSets()
 	VK_CHECK_RESULT(vkAllocateDescriptorSets(_device->vulkanDevice(), &descriptorSetAllocateInfo, &_rayTracingDescriptorSet));
 
 	VkWriteDescriptorSetAccelerationStructureKHR descriptorAccelerationStructureInfo = genesis::vkInitializers::writeDescriptorSetAccelerationStructureKHR();
-	descriptorAccelerationStructureInfo.accelerationStructureCount = 1;
-	descriptorAccelerationStructureInfo.pAccelerationStructures = &(_cellManager->cell(0)->tlas()->handle());
+	if (!_softwareRayTracing)
+	{
+		descriptorAccelerationStructureInfo.accelerationStructureCount = 1;
+		descriptorAccelerationStructureInfo.pAccelerationStructures = &(_cellManager->cell(0)->tlas()->handle());
+	}
 
 	VkDescriptorImageInfo intermediateImageDescriptor = genesis::vkInitializers::descriptorImageInfo(VK_NULL_HANDLE, _rayTracingIntermediateImage->vulkanImageView(), VK_IMAGE_LAYOUT_GENERAL);
 	VkDescriptorImageInfo finalImageDescriptor = genesis::vkInitializers::descriptorImageInfo(VK_NULL_HANDLE, _rayTracingFinalImageToPresent->vulkanImageView(), VK_IMAGE_LAYOUT_GENERAL);
 
 	int bindingIndex = 0;
-	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-	genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, bindingIndex++, &descriptorAccelerationStructureInfo)
-	, genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, bindingIndex++, &intermediateImageDescriptor)
-	, genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, bindingIndex++, &finalImageDescriptor)
-	, genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bindingIndex++, _sceneUbo->descriptorPtr())
-	, genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bindingIndex++, _skyCubeMapTexture->descriptorPtr())
-	};
+	std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+	if (_softwareRayTracing)
+	{
+		writeDescriptorSets.push_back(genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bindingIndex++, _cellManager->cell(0)->softwareTlas()->nodesDescriptorPtr()));
+	}
+	else
+	{
+		writeDescriptorSets.push_back(genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, bindingIndex++, &descriptorAccelerationStructureInfo));
+	}
+	writeDescriptorSets.push_back(genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, bindingIndex++, &intermediateImageDescriptor));
+	writeDescriptorSets.push_back(genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, bindingIndex++, &finalImageDescriptor));
+	writeDescriptorSets.push_back(genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bindingIndex++, _sceneUbo->descriptorPtr()));
+	writeDescriptorSets.push_back(genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bindingIndex++, _skyCubeMapTexture->descriptorPtr()));
+	writeDescriptorSets.push_back(genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bindingIndex++, textureFeedbackDescriptorPtr()));
+	if (_softwareRayTracing)
+	{
+		writeDescriptorSets.push_back(genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bindingIndex++, _cellManager->cell(0)->softwareTlas()->trianglesDescriptorPtr()));
+		writeDescriptorSets.push_back(genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bindingIndex++, _cellManager->cell(0)->softwareTlas()->instancesDescriptorPtr()));
+	}
+	else
+	{
+		writeDescriptorSets.push_back(genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bindingIndex++, _cellManager->cell(0)->tlas()->mergedGeometryDescriptorPtr()));
+	}
 
 	vkUpdateDescriptorSets(_device->vulkanDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, VK_NULL_HANDLE);
 }
@@ -336,6 +554,7 @@ void RayTracing::createAndUpdateRasterizationDescriptorSets()
 	std::vector<VkDescriptorPoolSize> poolSizes = {
 	{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1}
 	,  {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}
+	,  {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1}
 	};
 
 	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = genesis::vkInitializers::descriptorPoolCreateInfo(poolSizes, 1);
@@ -348,6 +567,7 @@ void RayTracing::createAndUpdateRasterizationDescriptorSets()
 	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
 	genesis::vkInitializers::writeDescriptorSet(_rasterizationDescriptorSet,VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bindingIndex++,&_sceneUbo->descriptor())
 	,  genesis::vkInitializers::writeDescriptorSet(_rasterizationDescriptorSet,VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, bindingIndex++,&_skyCubeMapTexture->descriptor())
+	,  genesis::vkInitializers::writeDescriptorSet(_rasterizationDescriptorSet,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bindingIndex++,textureFeedbackDescriptorPtr())
 	};
 
 	vkUpdateDescriptorSets(_device->vulkanDevice(), static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
@@ -367,6 +587,9 @@ void RayTracing::reloadShaders(bool destroyExistingStuff)
 	command = glslValidator + " " + "--target-env vulkan1.2 -V -o ../data/shaders/glsl/raytracing/raygen.rgen.spv ../data/shaders/glsl/raytracing/raygen.rgen";
 	system(command.c_str());
 
+	command = glslValidator + " " + "--target-env vulkan1.2 -V -o ../data/shaders/glsl/raytracing/softwareRaytrace.comp.spv ../data/shaders/glsl/raytracing/softwareRaytrace.comp";
+	system(command.c_str());
+
 	std::string glslc = strVulkanDir + "\\bin\\glslc.exe";
 
 	command = glslc + " " + "-o ../data/shaders/glsl/raytracing/rasterizationPath.vert.spv ../data/shaders/glsl/raytracing/rasterizationPath.vert";
@@ -405,15 +628,28 @@ Create our ray tracing pipeline
 */
 void RayTracing::createRayTracingPipeline()
 {
+	// in software all of it happens in the one compute shader (softwareRaytrace.comp)
+	auto stages = [this](VkShaderStageFlags rayTracingStages) -> VkShaderStageFlags
+	{
+		return (_softwareRayTracing) ? VK_SHADER_STAGE_COMPUTE_BIT : rayTracingStages;
+	};
+
 	int bindingIndex = 0;
 
 	std::vector<VkDescriptorSetLayoutBinding> descriptorSetLayoutBindings = {
-	genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, VK_SHADER_STAGE_RAYGEN_BIT_KHR, bindingIndex++)
-	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_RAYGEN_BIT_KHR, bindingIndex++)
-	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_RAYGEN_BIT_KHR, bindingIndex++)
-	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, bindingIndex++)
-	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR, bindingIndex++)
+	genesis::vkInitializers::descriptorSetLayoutBinding((_softwareRayTracing) ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, stages(VK_SHADER_STAGE_RAYGEN_BIT_KHR), bindingIndex++)
+	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, stages(VK_SHADER_STAGE_RAYGEN_BIT_KHR), bindingIndex++)
+	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, stages(VK_SHADER_STAGE_RAYGEN_BIT_KHR), bindingIndex++)
+	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, stages(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR), bindingIndex++)
+	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stages(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR), bindingIndex++)
+	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stages(VK_SHADER_STAGE_RAYGEN_BIT_KHR), bindingIndex++)
+	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stages(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR), bindingIndex++)
 	};
+	if (_softwareRayTracing)
+	{
+		// the bvh instances
+		descriptorSetLayoutBindings.push_back(genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, bindingIndex++));
+	}
 
 	VkDescriptorSetLayoutCreateInfo descriptorSetlayoutInfo = genesis::vkInitializers::descriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
 	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(_device->vulkanDevice(), &descriptorSetlayoutInfo, nullptr, &_rayTracingDescriptorSetLayout));
@@ -423,7 +659,8 @@ void RayTracing::createRayTracingPipeline()
 	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = genesis::vkInitializers::pipelineLayoutCreateInfo(vecDescriptorSetLayout.data(), (uint32_t)vecDescriptorSetLayout.size());
 
 	// Push constant: we want to be able to update constants used by the shaders
-	VkPushConstantRange pushConstant{ VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR,
+	_rayTracingPushConstantStages = stages(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR);
+	VkPushConstantRange pushConstant{ _rayTracingPushConstantStages,
 	0, sizeof(PushConstants) };
 
 	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
@@ -431,6 +668,18 @@ void RayTracing::createRayTracingPipeline()
 
 	VK_CHECK_RESULT(vkCreatePipelineLayout(_device->vulkanDevice(), &pipelineLayoutCreateInfo, nullptr, &_rayTracingPipelineLayout));
 
+	// fully opaque scenes keep the hit group without an any hit shader, and trace opaque rays
+	_pushConstants.alphaTesting = _cellManager->hasAlphaMaskedPrimitives() ? 1 : 0;
+
+	if (_softwareRayTracing)
+	{
+		Shader* softwareRaytraceShader = loadShader(getShadersPath() + "raytracing/softwareRaytrace.comp.spv", genesis::ST_COMPUTE_SHADER);
+		VkComputePipelineCreateInfo computePipelineCreateInfo = genesis::vkInitializers::computePipelineCreateInfo(_rayTracingPipelineLayout);
+		computePipelineCreateInfo.stage = softwareRaytraceShader->pipelineShaderStageCreateInfo();
+		VK_CHECK_RESULT(vkCreateComputePipelines(_device->vulkanDevice(), VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &_rayTracingPipeline));
+		return;
+	}
+
 	/*
 	SBT Layout used in this sample:
 
@@ -447,6 +696,11 @@ void RayTracing::createRayTracingPipeline()
 	_shaderBindingTable->addShader(getShadersPath() + "raytracing/miss.rmiss.spv", genesis::ST_RT_MISS);
 	_shaderBindingTable->addShader(getShadersPath() + "raytracing/closesthit.rchit.spv", genesis::ST_RT_CLOSEST_HIT);
 
+	if (_pushConstants.alphaTesting)
+	{
+		_shaderBindingTable->addShader(getShadersPath() + "raytracing/anyhit.rahit.spv", genesis::ST_RT_ANY_HIT);
+	}
+
 	// create the ray tracing pipeline
 	VkRayTracingPipelineCreateInfoKHR rayTracingPipelineCreateInfo{};
 	rayTracingPipelineCreateInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
@@ -468,6 +722,7 @@ void RayTracing::createRasterizationPipeline()
 	{
 	genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, bindingIndex++)
 	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, bindingIndex++)
+	,  genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, bindingIndex++)
 	};
 	VkDescriptorSetLayoutCreateInfo set0LayoutInfo = genesis::vkInitializers::descriptorSetLayoutCreateInfo(set0Bindings.data(), static_cast<uint32_t>(set0Bindings.size()));
 	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(_device->vulkanDevice(), &set0LayoutInfo, nullptr, &_rasterizationDescriptorSetLayout));
@@ -592,31 +847,43 @@ void RayTracing::rayTrace(int commandBufferIndex)
 
 	VK_CHECK_RESULT(vkBeginCommandBuffer(_drawCommandBuffers[commandBufferIndex], &cmdBufInfo));
 
-	vkCmdBindPipeline(_drawCommandBuffers[commandBufferIndex], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _rayTracingPipeline);
-	vkCmdBindDescriptorSets(_drawCommandBuffers[commandBufferIndex], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _rayTracingPipelineLayout, 0, 1, &_rayTracingDescriptorSet, 0, 0);
+	updateTlas(_drawCommandBuffers[commandBufferIndex]);
+
+	const VkPipelineBindPoint bindPoint = (_softwareRayTracing) ? VK_PIPELINE_BIND_POINT_COMPUTE : VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR;
+
+	vkCmdBindPipeline(_drawCommandBuffers[commandBufferIndex], bindPoint, _rayTracingPipeline);
+	vkCmdBindDescriptorSets(_drawCommandBuffers[commandBufferIndex], bindPoint, _rayTracingPipelineLayout, 0, 1, &_rayTracingDescriptorSet, 0, 0);
 
 	std::uint32_t firstSet = 1;
-	vkCmdBindDescriptorSets(_drawCommandBuffers[commandBufferIndex], VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, _rayTracingPipelineLayout, firstSet, std::uint32_t(_cellManager->cell(0)->layout()->descriptorSets().size()), _cellManager->cell(0)->layout()->descriptorSets().data(), 0, nullptr);
+	vkCmdBindDescriptorSets(_drawCommandBuffers[commandBufferIndex], bindPoint, _rayTracingPipelineLayout, firstSet, std::uint32_t(_cellManager->cell(0)->layout()->descriptorSets().size()), _cellManager->cell(0)->layout()->descriptorSets().data(), 0, nullptr);
 
 	++_pushConstants.frameIndex;
 	_pushConstants.clearColor = genesis::Vector4_32(1, 1, 1, 1);
 	vkCmdPushConstants(
 		_drawCommandBuffers[commandBufferIndex],
 		_rayTracingPipelineLayout,
-		VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR,
+		_rayTracingPushConstantStages,
 		0,
 		sizeof(PushConstants),
 		&_pushConstants);
 
-	_device->extensions().vkCmdTraceRaysKHR(
-		_drawCommandBuffers[commandBufferIndex]
-		, &_shaderBindingTable->raygenEntry()
-		, &_shaderBindingTable->missEntry()
-		, &_shaderBindingTable->hitEntry()
-		, &_shaderBindingTable->callableEntry()
-		, _width
-		, _height
-		, 1);
+	if (_softwareRayTracing)
+	{
+		// 8x8 pixels per work group, see softwareRaytrace.comp
+		vkCmdDispatch(_drawCommandBuffers[commandBufferIndex], (_width + 7) / 8, (_height + 7) / 8, 1);
+	}
+	else
+	{
+		_device->extensions().vkCmdTraceRaysKHR(
+			_drawCommandBuffers[commandBufferIndex]
+			, &_shaderBindingTable->raygenEntry()
+			, &_shaderBindingTable->missEntry()
+			, &_shaderBindingTable->hitEntry()
+			, &_shaderBindingTable->callableEntry()
+			, _width
+			, _height
+			, 1);
+	}
 
 	// Prepare current swap chain image as transfer destination
 	VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
@@ -1023,6 +1290,9 @@ void RayTracing::render()
 		return;
 	}
 
+	updateTextureStreaming();
+	updateDrawLods();
+
 	PlatformApplication::prepareFrame();
 
 	if (_mode == RAYTRACE)
@@ -1036,7 +1306,32 @@ void RayTracing::render()
 
 	_submitInfo.commandBufferCount = 1;
 	_submitInfo.pCommandBuffers = &_drawCommandBuffers[_currentFrameBufferIndex];
-	VK_CHECK_RESULT(vkQueueSubmit(_device->graphicsQueue(), 1, &_submitInfo, VK_NULL_HANDLE));
+
+	// the first frame tracing against an asynchronously built tlas waits for the build, on the gpu
+	const uint64_t tlasWaitValue = (_mode == RAYTRACE) ? _cellManager->takeTlasWaitValue() : 0;
+	if (tlasWaitValue != 0)
+	{
+		VkSemaphore waitSemaphores[] = { _semaphores.presentComplete, _device->asyncComputeTimeline() };
+		VkPipelineStageFlags waitStages[] = { submitPipelineStages, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR };
+		// the value for the binary semaphore is ignored
+		uint64_t waitValues[] = { 0, tlasWaitValue };
+
+		VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo{};
+		timelineSemaphoreSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineSemaphoreSubmitInfo.waitSemaphoreValueCount = 2;
+		timelineSemaphoreSubmitInfo.pWaitSemaphoreValues = waitValues;
+
+		VkSubmitInfo submitInfo = _submitInfo;
+		submitInfo.pNext = &timelineSemaphoreSubmitInfo;
+		submitInfo.waitSemaphoreCount = 2;
+		submitInfo.pWaitSemaphores = waitSemaphores;
+		submitInfo.pWaitDstStageMask = waitStages;
+		VK_CHECK_RESULT(vkQueueSubmit(_device->graphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE));
+	}
+	else
+	{
+		VK_CHECK_RESULT(vkQueueSubmit(_device->graphicsQueue(), 1, &_submitInfo, VK_NULL_HANDLE));
+	}
 	PlatformApplication::submitFrame();
 
 #if 1
@@ -1150,10 +1445,78 @@ void RayTracing::createCells(void)
 	{
 		glTFLoadingFlags |= genesis::VulkanGltfModel::ColorTexturesAreSrgb;
 	}
+
+	if (_lods)
+	{
+		glTFLoadingFlags |= genesis::VulkanGltfModel::GenerateLods;
+	}
+
+	if (_weldVertices)
+	{
+		glTFLoadingFlags |= genesis::VulkanGltfModel::WeldVertices;
+	}
+
+	if (_mergePrimitives)
+	{
+		glTFLoadingFlags |= genesis::VulkanGltfModel::MergePrimitivesByMaterial;
+	}
+
+	if (_printStats)
+	{
+		glTFLoadingFlags |= genesis::VulkanGltfModel::PrintStats;
+	}
+
+	if (_fastJsonParser)
+	{
+		glTFLoadingFlags |= genesis::VulkanGltfModel::FastJsonParser;
+	}
+
+	if (_compressTextures)
+	{
+		glTFLoadingFlags |= genesis::VulkanGltfModel::CompressTextures;
+	}
+
+	if (_benchmarkGltfParsing)
+	{
+		genesis::GltfJsonParser::benchmark(gltfModel, 10);
+	}
+
+	if (_benchmarkPixelConversion)
+	{
+		genesis::pixelconversion::benchmark(4096, 4096, 10);
+	}
 	
+	if (_computeMipMaps && _mipMapGenerator == nullptr)
+	{
+		_mipMapGenerator = new genesis::MipMapGenerator(_device, getShadersPath() + "raytracing/mipmapgen.comp.spv");
+		_device->setMipMapGenerator(_mipMapGenerator);
+	}
+
+	_device->setMaxTextureSize(_maxTextureSize);
+	_device->setStreamedTextureSize(_streamTextures ? _streamedTextureSize : 0);
+
+	if (_cacheAccelerationStructures && _accelerationStructureCache == nullptr)
+	{
+		_accelerationStructureCache = new genesis::AccelerationStructureCache(_device, "accelerationStructureCache");
+		_device->setAccelerationStructureCache(_accelerationStructureCache);
+	}
+
 	_cellManager = new genesis::CellManager(_device, glTFLoadingFlags);
+	_cellManager->setImmutableSamplers(_immutableSamplers);
 
-	_cellManager->addInstance(gltfModel, mat4());
+	if (_lods)
+	{
+		_cellManager->setLodSelection(lodSelection());
+	}
+
+	_cellManager->setInstanceMerging(_instanceMerging);
+
+	_instanceIds.clear();
+	_instanceXforms.clear();
+
+	// the animated instances must not be merged, they could not be moved then
+	_instanceIds.push_back(_cellManager->addInstance(gltfModel, mat4(), _animateInstances));
+	_instanceXforms.push_back(mat4());
 
 #if 0
 	gltfModel2 = getAssetsPath() + "../../glTF-Sample-Models/2.0//WaterBottle//glTF/WaterBottle.gltf";
@@ -1162,9 +1525,143 @@ void RayTracing::createCells(void)
 	_cellManager->addInstance(gltfModel2, glm::translate(glm::mat4(), glm::vec3(-3, -2.0f, 0.0f)));
 #endif
 
-	_cellManager->buildTlases();
+	if (_softwareRayTracing)
+	{
+		_cellManager->buildSoftwareTlases();
+	}
+	else
+	{
+		_cellManager->buildTlases(_asyncAccelerationStructureBuilds);
+	}
 	_cellManager->buildDrawBuffers();
 	_cellManager->buildLayouts();
+
+	if (_streamTextures)
+	{
+		if (_textureStreamer == nullptr)
+		{
+			_textureStreamer = new genesis::TextureStreamer(_device, (VkDeviceSize)_textureBudgetInMB * 1024 * 1024);
+		}
+		_textureStreamer->setTextures(_cellManager->cell(0)->layout()->textures());
+	}
+	else if (_disabledTextureFeedback == nullptr)
+	{
+		_disabledTextureFeedback = new genesis::Buffer(_device, genesis::BT_SBO, sizeof(uint32_t), true);
+		memset(_disabledTextureFeedback->stagingBuffer(), 0, sizeof(uint32_t));
+		_disabledTextureFeedback->syncToGpu(true);
+	}
+
+	_cellManager->reportTextureMemory();
+}
+
+const VkDescriptorBufferInfo* RayTracing::textureFeedbackDescriptorPtr(void) const
+{
+	if (_textureStreamer)
+	{
+		return _textureStreamer->feedbackDescriptorPtr();
+	}
+	return _disabledTextureFeedback->descriptorPtr();
+}
+
+void RayTracing::updateTextureStreaming(void)
+{
+	if (_textureStreamer == nullptr)
+	{
+		return;
+	}
+	// the descriptor set can be written again here: submitFrame waited for the last frame.
+	// the views the streamer replaced are destroyed later on, by itself
+	if (_textureStreamer->update())
+	{
+		_cellManager->cell(0)->layout()->updateTextureDescriptors();
+		if (_mode == RASTERIZATION)
+		{
+			buildCommandBuffers();
+		}
+	}
+}
+
+void RayTracing::updateDrawLods(void)
+{
+	if (!_lods || _mode != RASTERIZATION)
+	{
+		return;
+	}
+	// the queue is idle here: submitFrame waited for the last frame, the draw buffers can be replaced
+	_cellManager->setLodSelection(lodSelection());
+	if (_cellManager->buildDrawBuffers())
+	{
+		buildCommandBuffers();
+	}
+}
+
+void RayTracing::updateTlas(VkCommandBuffer commandBuffer)
+{
+	// the software bvh is built once, from lod 0 of the instances where they started
+	if (_softwareRayTracing)
+	{
+		return;
+	}
+
+	if (_animateInstances)
+	{
+		_animationAngle += _frameTimer * 0.5f;
+		const glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), _animationAngle, glm::vec3(0.0f, 1.0f, 0.0f));
+		for (size_t i = 0; i < _instanceIds.size(); ++i)
+		{
+			_cellManager->updateInstanceTransform(_instanceIds[i], rotation * _instanceXforms[i]);
+		}
+		// the accumulated samples are of the old positions
+		_pushConstants.frameIndex = -1;
+	}
+
+	if (_lods)
+	{
+		// distant instances switch to cheaper blases, the draw buffer is rebuilt for rasterization (see updateDrawLods)
+		_cellManager->setLodSelection(lodSelection());
+		if (_cellManager->selectTlasLods() > 0)
+		{
+			_pushConstants.frameIndex = -1;
+		}
+	}
+
+	// the queue is idle here, the descriptor set can be written before it is bound
+	if (_cellManager->recordTlasUpdates(commandBuffer))
+	{
+		VkWriteDescriptorSetAccelerationStructureKHR descriptorAccelerationStructureInfo = genesis::vkInitializers::writeDescriptorSetAccelerationStructureKHR();
+		descriptorAccelerationStructureInfo.accelerationStructureCount = 1;
+		descriptorAccelerationStructureInfo.pAccelerationStructures = &(_cellManager->cell(0)->tlas()->handle());
+
+		VkWriteDescriptorSet writeDescriptorSet = genesis::vkInitializers::writeDescriptorSet(_rayTracingDescriptorSet, 0, &descriptorAccelerationStructureInfo);
+		vkUpdateDescriptorSets(_device->vulkanDevice(), 1, &writeDescriptorSet, 0, VK_NULL_HANDLE);
+	}
+}
+
+genesis::LodSelection RayTracing::lodSelection(void) const
+{
+	genesis::LodSelection lodSelection;
+	lodSelection._enabled = true;
+	lodSelection._eyePosition = glm::vec3(glm::inverse(_camera.matrices.view)[3]);
+	lodSelection._projectionScale = genesis::LodSelection::projectionScale(_camera.matrices.perspective, (float)_height);
+	lodSelection._hysteresis = _lodHysteresis;
+	return lodSelection;
+}
+
+void RayTracing::renderCpuReference(void)
+{
+	genesis::CpuPathTracer cpuPathTracer(_device);
+	cpuPathTracer.addCell(_cellManager->cell(0));
+	cpuPathTracer.buildBvh();
+
+	genesis::CpuPathTracer::Settings settings;
+	settings._samplesPerPixel = _cpuReferenceSamples;
+	settings._maxBounces = _pushConstants.maxBounces;
+	settings._contributionFromEnvironment = _pushConstants.contributionFromEnvironment;
+	settings._cosineSampling = (_pushConstants.cosineSampling != 0);
+	settings._printStats = _printStats;
+
+	cpuPathTracer.render(glm::inverse(_camera.matrices.view), glm::inverse(_camera.matrices.perspective), _width, _height, settings);
+	cpuPathTracer.saveImage("..\\autotest\\" + _mainModel + "_cpu_reference" + ".png");
 }
 
 void RayTracing::createSkyBox(void)
@@ -1217,6 +1714,10 @@ void RayTracing::prepare()
 	createScene();
 	createStorageImages();
 	createSceneUbo();
+	if (_cpuReferenceSamples > 0)
+	{
+		renderCpuReference();
+	}
 	if (_mode == RAYTRACE)
 	{
 		createRayTracingPipeline();
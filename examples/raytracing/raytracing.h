@@ -8,6 +8,8 @@
 #include "../genesis/PlatformApplication.h"
 #include "GenMath.h"
 #include "Camera.h"
+#include "InstanceMerging.h"
+#include "LodSelection.h"
 
 #define CPU_SIDE_COMPILATION 1
 #include "../data/shaders/glsl/raytracing/rayTracingInputOutput.h"
@@ -30,6 +32,9 @@ namespace genesis
    class IndirectLayout;
    class CellManager;
    class ShaderBindingTable;
+   class MipMapGenerator;
+   class TextureStreamer;
+   class AccelerationStructureCache;
 }
 
 class RayTracing : public genesis::PlatformApplication
@@ -97,6 +102,22 @@ protected:
    virtual void beginDynamicRendering(int swapChainImageIndex, VkAttachmentLoadOp colorLoadOp);
    virtual void endDynamicRendering(int swapChainImageIndex);
 
+   //! the streamer's feedback buffer, or a disabled one when textures are not streamed
+   virtual const VkDescriptorBufferInfo* textureFeedbackDescriptorPtr(void) const;
+   virtual void updateTextureStreaming(void);
+
+   //! picks the lods of the draw buffer again from the current camera, when rasterizing
+   virtual void updateDrawLods(void);
+
+   //! moves the animated instances and records the tlas refit ahead of the tracing
+   virtual void updateTlas(VkCommandBuffer commandBuffer);
+
+   //! renders the scene with genesis::CpuPathTracer from the current camera and saves it next to the autotest images
+   virtual void renderCpuReference(void);
+
+   //! for the current camera
+   virtual genesis::LodSelection lodSelection(void) const;
+
 protected:
    VkPhysicalDeviceBufferDeviceAddressFeatures _enabledBufferDeviceAddressFeatures{};
    VkPhysicalDeviceRayTracingPipelineFeaturesKHR _enabledRayTracingPipelineFeatures{};
@@ -104,6 +125,7 @@ protected:
    VkPhysicalDeviceDescriptorIndexingFeaturesEXT _physicalDeviceDescriptorIndexingFeatures{};
    VkPhysicalDeviceShaderClockFeaturesKHR _physicalDeviceShaderClockFeaturesKHR{};
    VkPhysicalDeviceDynamicRenderingFeatures _dynamicRenderingFeatures;
+   VkPhysicalDeviceTimelineSemaphoreFeatures _timelineSemaphoreFeatures{};
    
 
    // Ray tracing
@@ -114,6 +136,9 @@ protected:
 
    VkDescriptorPool _rayTracingDescriptorPool = VK_NULL_HANDLE;
 
+   //! of the push constants, the compute stage when ray tracing in software
+   VkShaderStageFlags _rayTracingPushConstantStages = 0;
+
    genesis::ShaderBindingTable* _shaderBindingTable = nullptr;
 
    genesis::StorageImage* _rayTracingFinalImageToPresent;
@@ -164,6 +189,76 @@ protected:
 
    uint32_t _glTFLoadingFlags = 0;
 
+   //! generate lods and pick them per instance from the camera every frame, for the draw buffer and the tlas
+   bool _lods = false;
+
+   //! see genesis::LodSelection::_hysteresis, the tlas picks the lods again as the camera moves
+   float _lodHysteresis = 0.0f;
+
+   //! merge the identical vertices of each primitive on load, _lods does it as well
+   bool _weldVertices = false;
+
+   //! one primitive per material in each node, on load
+   bool _mergePrimitives = false;
+
+   //! print what the load passes did, and the rays per second of the cpu reference
+   bool _printStats = false;
+
+   //! parse the gltf with GltfJsonParser instead of tinygltf's json
+   bool _fastJsonParser = false;
+
+   //! time both parsers on the main model before loading it
+   bool _benchmarkGltfParsing = false;
+
+   //! time the pixel conversion kernels (scalar against simd) on a 4k image before loading
+   bool _benchmarkPixelConversion = false;
+
+   //! bc7/bc5 encode the gltf textures (cached on disk)
+   bool _compressTextures = false;
+
+   //! bake the texture samplers into the descriptor set layout
+   bool _immutableSamplers = false;
+
+   //! generate the texture mips with mipmapgen.comp instead of blits
+   bool _computeMipMaps = false;
+   genesis::MipMapGenerator* _mipMapGenerator = nullptr;
+
+   //! larger side of the textures loaded from files, 0 for no cap (see Device::setMaxTextureSize)
+   int _maxTextureSize = 0;
+
+   //! keep only the mip levels the shaders ask for resident, within _textureBudgetInMB.
+   //! the textures are loaded with only their levels up to _streamedTextureSize resident
+   bool _streamTextures = false;
+   int _textureBudgetInMB = 256;
+   int _streamedTextureSize = 64;
+   genesis::TextureStreamer* _textureStreamer = nullptr;
+
+   //! bound instead of the feedback buffer when not streaming: zeroed, so feedback is off
+   genesis::Buffer* _disabledTextureFeedback = nullptr;
+
+   //! load the blases from disk instead of building them, when the driver can use what is there
+   bool _cacheAccelerationStructures = false;
+   genesis::AccelerationStructureCache* _accelerationStructureCache = nullptr;
+
+   //! build the acceleration structures on the async compute queue, the first frame tracing waits for them on the gpu
+   bool _asyncAccelerationStructureBuilds = false;
+
+   //! trace in a compute shader through a bvh built on the cpu (see genesis::SoftwareTlas) instead of the ray tracing pipeline.
+   //! on by itself when the device does not have it
+   bool _softwareRayTracing = false;
+
+   //! samples per pixel of the cpu reference rendered once the scene is loaded, 0 to not render it
+   int _cpuReferenceSamples = 0;
+
+   //! spin the instances about the vertical axis every frame, which refits the tlas
+   bool _animateInstances = false;
+   float _animationAngle = 0.0f;
+   std::vector<uint32_t> _instanceIds;
+   std::vector<glm::mat4> _instanceXforms;
+
+   //! small instances close to each other share blases, see genesis::InstanceMerging for the thresholds
+   genesis::InstanceMerging _instanceMerging;
+
    //! Anti-aliasing is only needed for rasterization
    int _sampleCountForRasterization = 1;
 };
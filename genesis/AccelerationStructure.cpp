@@ -15,6 +15,7 @@ namespace genesis
    AccelerationStructure::AccelerationStructure(Device* device, VkAccelerationStructureTypeKHR type, uint64_t sizeInBytes, const std::string& incomingName)
       : _device(device)
       , _type(type)
+      , _sizeInBytes(sizeInBytes)
    {
       
       std::string actualName;
@@ -64,4 +65,9 @@ namespace genesis
       accelerationStructureDeviceAddressInfo.accelerationStructure = _handle;
       return _device->extensions().vkGetAccelerationStructureDeviceAddressKHR(_device->vulkanDevice(), &accelerationStructureDeviceAddressInfo);
    }
+
+   uint64_t AccelerationStructure::sizeInBytes(void) const
+   {
+      return _sizeInBytes;
+   }
 }
\ No newline at end of file
@@ -24,11 +24,15 @@ namespace genesis
    public:
       virtual const VkAccelerationStructureKHR& handle(void) const;
       virtual uint64_t deviceAddress(void) const;
+
+      //! size of the backing buffer
+      virtual uint64_t sizeInBytes(void) const;
    protected:
       VulkanBuffer* _buffer = nullptr;
 
       VkAccelerationStructureKHR _handle = 0;
       VkAccelerationStructureTypeKHR _type;
+      uint64_t _sizeInBytes;
 
       Device* _device;
 
@@ -0,0 +1,130 @@
+#include "AccelerationStructureCache.h"
+#include "Device.h"
+#include "VkExtensions.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace genesis
+{
+   const uint64_t AccelerationStructureCache::s_version = 1;
+
+   // driver uuid, compatibility uuid, serialized size, deserialized size, number of handles
+   static const size_t s_headerSize = 2 * VK_UUID_SIZE + 3 * sizeof(uint64_t);
+
+   AccelerationStructureCache::AccelerationStructureCache(Device* device, const std::string& directory)
+      : _device(device)
+      , _directory(directory)
+   {
+#if defined(_WIN32)
+      _mkdir(_directory.c_str());
+#else
+      mkdir(_directory.c_str(), 0755);
+#endif
+   }
+
+   AccelerationStructureCache::~AccelerationStructureCache()
+   {
+      // nothing else to do
+   }
+
+   uint64_t AccelerationStructureCache::hash(const void* data, size_t size, uint64_t seed)
+   {
+      // fnv-1a
+      const uint8_t* bytes = (const uint8_t*)data;
+      uint64_t hash = seed ^ 0xcbf29ce484222325ull;
+      for (size_t i = 0; i < size; ++i)
+      {
+         hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+      }
+      return hash;
+   }
+
+   std::string AccelerationStructureCache::fileName(uint64_t key) const
+   {
+      std::stringstream ss;
+      ss << _directory << "/" << std::hex << std::setw(16) << std::setfill('0') << hash(&s_version, sizeof(s_version), key) << ".as";
+      return ss.str();
+   }
+
+   uint64_t AccelerationStructureCache::deserializedSize(const std::vector<std::uint8_t>& serialized)
+   {
+      if (serialized.size() < s_headerSize)
+      {
+         return 0;
+      }
+      uint64_t size;
+      memcpy(&size, serialized.data() + 2 * VK_UUID_SIZE + sizeof(uint64_t), sizeof(size));
+      return size;
+   }
+
+   bool AccelerationStructureCache::compatible(const std::vector<std::uint8_t>& serialized) const
+   {
+      if (serialized.size() < s_headerSize)
+      {
+         return false;
+      }
+
+      uint64_t serializedSize;
+      memcpy(&serializedSize, serialized.data() + 2 * VK_UUID_SIZE, sizeof(serializedSize));
+      if (serializedSize != serialized.size())
+      {
+         return false;
+      }
+
+      VkAccelerationStructureVersionInfoKHR versionInfo{};
+      versionInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR;
+      versionInfo.pVersionData = serialized.data();
+
+      VkAccelerationStructureCompatibilityKHR compatibility = VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
+      _device->extensions().vkGetDeviceAccelerationStructureCompatibilityKHR(_device->vulkanDevice(), &versionInfo, &compatibility);
+      return compatibility == VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR;
+   }
+
+   bool AccelerationStructureCache::load(uint64_t key, std::vector<std::uint8_t>& serialized) const
+   {
+      std::ifstream file(fileName(key).c_str(), std::ios::binary | std::ios::ate);
+      if (!file.good())
+      {
+         return false;
+      }
+
+      const std::streamsize size = file.tellg();
+      file.seekg(0, std::ios::beg);
+      serialized.resize((size_t)size);
+      if (!file.read((char*)serialized.data(), size))
+      {
+         serialized.clear();
+         return false;
+      }
+
+      // written by another gpu or driver
+      if (!compatible(serialized))
+      {
+         serialized.clear();
+         return false;
+      }
+      return true;
+   }
+
+   void AccelerationStructureCache::store(uint64_t key, const std::vector<std::uint8_t>& serialized) const
+   {
+      const std::string name = fileName(key);
+      std::ofstream file(name.c_str(), std::ios::binary | std::ios::trunc);
+      if (!file.good())
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "could not write " << name << std::endl;
+         return;
+      }
+      file.write((const char*)serialized.data(), serialized.size());
+   }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace genesis
+{
+   class Device;
+
+   //! serialized acceleration structures on disk, one file per key.
+   //! the data starts with the driver and compatibility uuids (vkCmdCopyAccelerationStructureToMemoryKHR),
+   //! entries written by another device or driver are ignored and get written again
+   class AccelerationStructureCache
+   {
+   public:
+      AccelerationStructureCache(Device* device, const std::string& directory);
+      virtual ~AccelerationStructureCache();
+   public:
+      //! the serialized acceleration structure stored under key, if this device can deserialize it
+      virtual bool load(uint64_t key, std::vector<std::uint8_t>& serialized) const;
+
+      virtual void store(uint64_t key, const std::vector<std::uint8_t>& serialized) const;
+
+      //! size of the acceleration structure the serialized data deserializes to
+      static uint64_t deserializedSize(const std::vector<std::uint8_t>& serialized);
+
+      //! mixes size bytes of data into seed, for building keys
+      static uint64_t hash(const void* data, size_t size, uint64_t seed);
+   protected:
+      virtual std::string fileName(uint64_t key) const;
+
+      virtual bool compatible(const std::vector<std::uint8_t>& serialized) const;
+   protected:
+      Device* _device;
+      std::string _directory;
+
+      //! bump when what goes into the keys changes
+      static const uint64_t s_version;
+   };
+}
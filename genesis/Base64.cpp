@@ -0,0 +1,186 @@
+#include "Base64.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define GEN_BASE64_SSSE3 1
+#include <tmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(GEN_BASE64_SSSE3) && (defined(__GNUC__) || defined(__clang__))
+#define GEN_TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define GEN_TARGET_SSSE3
+#endif
+
+namespace genesis
+{
+   namespace base64
+   {
+      static const uint8_t s_invalid = 0xff;
+
+      struct DecodeTable
+      {
+         uint8_t values[256];
+
+         DecodeTable()
+         {
+            memset(values, s_invalid, sizeof(values));
+            const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            for (uint8_t i = 0; i < 64; ++i)
+            {
+               values[(uint8_t)alphabet[i]] = i;
+            }
+         }
+      };
+
+      static const DecodeTable s_decodeTable;
+
+      size_t decodedSize(const char* text, size_t length)
+      {
+         while (length > 0 && text[length - 1] == '=')
+         {
+            --length;
+         }
+         return (length / 4) * 3 + ((length % 4) * 3) / 4;
+      }
+
+      //! decodes whole groups of 4 characters. returns the number of characters consumed,
+      //! stops early at the first invalid character
+      static size_t decodeScalar(const uint8_t* src, size_t length, uint8_t* dst)
+      {
+         size_t i = 0;
+         for (; i + 4 <= length; i += 4)
+         {
+            const uint32_t a = s_decodeTable.values[src[i + 0]];
+            const uint32_t b = s_decodeTable.values[src[i + 1]];
+            const uint32_t c = s_decodeTable.values[src[i + 2]];
+            const uint32_t d = s_decodeTable.values[src[i + 3]];
+            // valid values fit in 6 bits
+            if ((a | b | c | d) & 0xc0)
+            {
+               break;
+            }
+            const uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+            *dst++ = (uint8_t)(triple >> 16);
+            *dst++ = (uint8_t)(triple >> 8);
+            *dst++ = (uint8_t)(triple);
+         }
+         return i;
+      }
+
+#if defined(GEN_BASE64_SSSE3)
+      static bool cpuHasSsse3(void)
+      {
+#if defined(_MSC_VER)
+         int info[4];
+         __cpuid(info, 1);
+         return (info[2] & (1 << 9)) != 0;
+#else
+         return __builtin_cpu_supports("ssse3") != 0;
+#endif
+      }
+
+      static const bool s_hasSsse3 = cpuHasSsse3();
+
+      //! 16 characters to 12 bytes per iteration (W. Mula, D. Lemire: "Faster Base64 Encoding and Decoding using AVX2 Instructions").
+      //! writes 16 bytes per iteration, dst needs 4 bytes of slack.
+      //! returns the number of characters consumed, stops early at the first block with an invalid character
+      GEN_TARGET_SSSE3 static size_t decodeSsse3(const uint8_t* src, size_t length, uint8_t* dst)
+      {
+         const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+         const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+         const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+         const __m128i mask2F = _mm_set1_epi8(0x2f);
+         const __m128i mask0F = _mm_set1_epi8(0x0f);
+         const __m128i packShuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+         size_t i = 0;
+         for (; i + 16 <= length; i += 16)
+         {
+            const __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+            const __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask0F);
+            const __m128i loNibbles = _mm_and_si128(in, mask0F);
+
+            const __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+            const __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+            if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+            {
+               // padding or an invalid character, leave it to the scalar path
+               break;
+            }
+
+            const __m128i eq2F = _mm_cmpeq_epi8(in, mask2F);
+            const __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+            const __m128i sextets = _mm_add_epi8(in, roll);
+
+            const __m128i mergedPairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+            const __m128i mergedQuads = _mm_madd_epi16(mergedPairs, _mm_set1_epi32(0x00011000));
+            _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi8(mergedQuads, packShuffle));
+            dst += 12;
+         }
+         return i;
+      }
+#endif
+
+      bool decode(const char* text, size_t length, std::vector<unsigned char>& out)
+      {
+         const uint8_t* src = (const uint8_t*)text;
+
+         size_t unpaddedLength = length;
+         while (unpaddedLength > 0 && src[unpaddedLength - 1] == '=')
+         {
+            --unpaddedLength;
+         }
+         const size_t size = decodedSize(text, length);
+
+         // slack for the 16 byte stores of the simd path
+         out.resize(size + 16);
+         uint8_t* dst = out.data();
+
+         size_t consumed = 0;
+#if defined(GEN_BASE64_SSSE3)
+         if (s_hasSsse3)
+         {
+            consumed = decodeSsse3(src, unpaddedLength, dst);
+         }
+#endif
+         consumed += decodeScalar(src + consumed, unpaddedLength - consumed, dst + (consumed / 4) * 3);
+
+         // the last 2 or 3 characters
+         const size_t remaining = unpaddedLength - consumed;
+         if (remaining >= 4 || remaining == 1)
+         {
+            out.clear();
+            return false;
+         }
+         uint32_t triple = 0;
+         for (size_t i = 0; i < remaining; ++i)
+         {
+            const uint8_t value = s_decodeTable.values[src[consumed + i]];
+            if (value == s_invalid)
+            {
+               out.clear();
+               return false;
+            }
+            triple |= uint32_t(value) << (18 - 6 * i);
+         }
+         uint8_t* tail = dst + (consumed / 4) * 3;
+         if (remaining >= 2)
+         {
+            tail[0] = (uint8_t)(triple >> 16);
+         }
+         if (remaining == 3)
+         {
+            tail[1] = (uint8_t)(triple >> 8);
+         }
+
+         out.resize(size);
+         return true;
+      }
+   }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace genesis
+{
+   namespace base64
+   {
+      //! number of bytes the base64 text decodes to (padding is taken into account)
+      size_t decodedSize(const char* text, size_t length);
+
+      //! decodes standard (not url safe) base64 text, padded or not.
+      //! uses ssse3 for the bulk of the text where available.
+      //! returns false if the text has characters outside the alphabet
+      bool decode(const char* text, size_t length, std::vector<unsigned char>& out);
+   }
+}
@@ -5,72 +5,119 @@
 #include "Device.h"
 #include "AccelerationStructure.h"
 #include "VkExtensions.h"
+#include "PhysicalDevice.h"
+#include "VulkanDebug.h"
+#include "AccelerationStructureCache.h"
 
 #include <vector>
 #include <deque>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
 
 namespace genesis
 {
-   Blas::Blas(Device* device, const VulkanGltfModel* model)
+   const VkDeviceSize Blas::s_maxScratchBatchSize = 128 * 1024 * 1024;
+   const VkBuildAccelerationStructureFlagsKHR Blas::s_buildFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+
+   Blas::Blas(Device* device, const VulkanGltfModel* model, int lod)
       : _device(device)
-      , _model(model)
    {
-      build();
+      Part part{};
+      part._model = model;
+      part._lod = lod;
+      _parts.push_back(part);
+
+      prepareBuild();
+   }
+
+   Blas::Blas(Device* device, const std::vector<Part>& parts)
+      : _device(device)
+      , _parts(parts)
+      , _transformed(true)
+   {
+      prepareBuild();
    }
 
    Blas::~Blas()
    {
       delete _blas;
+      delete _transformsBuffer;
    }
 
-   void Blas::build()
+   void Blas::prepareBuild()
    {
-      VkDeviceOrHostAddressConstKHR vertexBufferDeviceAddress{};
-      VkDeviceOrHostAddressConstKHR indexBufferDeviceAddress{};
+      VkDeviceOrHostAddressConstKHR transformsDeviceAddress{};
+      if (_transformed)
+      {
+         std::vector<VkTransformMatrixKHR> transforms;
+         for (const Part& part : _parts)
+         {
+            transforms.push_back(part._transform);
+         }
+         _transformsBuffer = new VulkanBuffer(_device
+            , VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR
+            , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+            , transforms.size() * sizeof(VkTransformMatrixKHR)
+            , transforms.data());
+         transformsDeviceAddress.deviceAddress = _transformsBuffer->deviceAddress();
+      }
 
-      vertexBufferDeviceAddress.deviceAddress = _model->vertexBuffer()->bufferAddress();
-      indexBufferDeviceAddress.deviceAddress = _model->indexBuffer()->bufferAddress();
+      std::vector<uint32_t> primitiveCounts;
 
-      VkAccelerationStructureGeometryTrianglesDataKHR    triangles{};
-      triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
-      triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-      triangles.vertexData = vertexBufferDeviceAddress;
-      triangles.vertexStride = (uint32_t)sizeof(Vertex);
-      triangles.maxVertex = (uint32_t)_model->numVertices();
-      triangles.indexType = VK_INDEX_TYPE_UINT32;
-      triangles.indexData = indexBufferDeviceAddress;
+      for (size_t partIndex = 0; partIndex < _parts.size(); ++partIndex)
+      {
+         const VulkanGltfModel* model = _parts[partIndex]._model;
+         const int lod = _parts[partIndex]._lod;
 
-      VkAccelerationStructureGeometryKHR accelerationStructureGeometry = vkInitializers::accelerationStructureGeometryKHR();
-      accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
-      accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-      accelerationStructureGeometry.geometry.triangles = triangles;
+         VkDeviceOrHostAddressConstKHR vertexBufferDeviceAddress{};
+         VkDeviceOrHostAddressConstKHR indexBufferDeviceAddress{};
 
-      VkAccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo{};
+         vertexBufferDeviceAddress.deviceAddress = model->vertexBuffer()->bufferAddress();
+         indexBufferDeviceAddress.deviceAddress = model->indexBuffer()->bufferAddress();
 
-      std::vector<VkAccelerationStructureGeometryKHR> vecAccelerationStructureGeometries;
-      std::vector<VkAccelerationStructureBuildRangeInfoKHR> vecAccelerationStructureBuildRangeInfos;
-      std::vector<uint32_t> primitiveCounts;
+         VkAccelerationStructureGeometryTrianglesDataKHR    triangles{};
+         triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+         triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+         triangles.vertexData = vertexBufferDeviceAddress;
+         triangles.vertexStride = (uint32_t)sizeof(Vertex);
+         triangles.maxVertex = (uint32_t)model->numVertices();
+         triangles.indexType = VK_INDEX_TYPE_UINT32;
+         triangles.indexData = indexBufferDeviceAddress;
+         triangles.transformData = transformsDeviceAddress;
 
-      _model->forEachPrimitive(
-         [&](const Primitive& primitive)
-         {
-            accelerationStructureBuildRangeInfo.primitiveCount = primitive.indexCount / 3;
-            accelerationStructureBuildRangeInfo.primitiveOffset = primitive.firstIndex * sizeof(uint32_t);
-            accelerationStructureBuildRangeInfo.firstVertex = 0;
-            accelerationStructureBuildRangeInfo.transformOffset = 0;
-
-            vecAccelerationStructureGeometries.push_back(accelerationStructureGeometry);
-            vecAccelerationStructureBuildRangeInfos.push_back(accelerationStructureBuildRangeInfo);
-            primitiveCounts.push_back(accelerationStructureBuildRangeInfo.primitiveCount);
-         }
-      );
+         VkAccelerationStructureGeometryKHR accelerationStructureGeometry = vkInitializers::accelerationStructureGeometryKHR();
+         accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+         accelerationStructureGeometry.geometry.triangles = triangles;
+
+         VkAccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo{};
+
+         model->forEachPrimitive(
+            [&](const Primitive& primitive)
+            {
+               // geometries stay one per primitive for every lod, so the geometry index
+               // in the shader still refers to the same primitive
+               accelerationStructureBuildRangeInfo.primitiveCount = primitive.lodIndexCount(lod) / 3;
+               accelerationStructureBuildRangeInfo.primitiveOffset = primitive.lodFirstIndex(lod) * sizeof(uint32_t);
+               accelerationStructureBuildRangeInfo.firstVertex = 0;
+               accelerationStructureBuildRangeInfo.transformOffset = _transformed ? (uint32_t)(partIndex * sizeof(VkTransformMatrixKHR)) : 0;
+
+               // opaque geometry never runs the any hit shader, only alpha masked primitives pay for the test
+               accelerationStructureGeometry.flags = model->alphaMasked(primitive) ? 0 : VK_GEOMETRY_OPAQUE_BIT_KHR;
+
+               _geometries.push_back(accelerationStructureGeometry);
+               _buildRangeInfos.push_back(accelerationStructureBuildRangeInfo);
+               primitiveCounts.push_back(accelerationStructureBuildRangeInfo.primitiveCount);
+            }
+         );
+      }
 
       // Get size info
       VkAccelerationStructureBuildGeometryInfoKHR accelerationStructureBuildGeometryInfo = vkInitializers::accelerationStructureBuildGeometryInfoKHR();
       accelerationStructureBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-      accelerationStructureBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-      accelerationStructureBuildGeometryInfo.geometryCount = (uint32_t)vecAccelerationStructureGeometries.size();
-      accelerationStructureBuildGeometryInfo.pGeometries = vecAccelerationStructureGeometries.data();
+      accelerationStructureBuildGeometryInfo.flags = s_buildFlags;
+      accelerationStructureBuildGeometryInfo.geometryCount = (uint32_t)_geometries.size();
+      accelerationStructureBuildGeometryInfo.pGeometries = _geometries.data();
 
       VkAccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo = vkInitializers::accelerationStructureBuildSizesInfoKHR();
       _device->extensions().vkGetAccelerationStructureBuildSizesKHR(
@@ -81,33 +128,333 @@ namespace genesis
          &accelerationStructureBuildSizesInfo);
 
       _blas = new AccelerationStructure(_device, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, accelerationStructureBuildSizesInfo.accelerationStructureSize);
+      _buildScratchSize = accelerationStructureBuildSizesInfo.buildScratchSize;
+   }
 
-      VkBufferUsageFlags flags = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-
-      Buffer* scratchBuffer = new Buffer(_device, BT_SBO, (int)accelerationStructureBuildSizesInfo.buildScratchSize, false, flags);
-
+   VkAccelerationStructureBuildGeometryInfoKHR Blas::buildGeometryInfo(uint64_t scratchAddress) const
+   {
       VkAccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo = vkInitializers::accelerationStructureBuildGeometryInfoKHR();
       accelerationBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-      accelerationBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+      // has to match the flags the sizes were queried with
+      accelerationBuildGeometryInfo.flags = s_buildFlags;
       accelerationBuildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
       accelerationBuildGeometryInfo.dstAccelerationStructure = _blas->handle();
-      accelerationBuildGeometryInfo.geometryCount = (uint32_t)vecAccelerationStructureGeometries.size();
-      accelerationBuildGeometryInfo.pGeometries = vecAccelerationStructureGeometries.data();
-      accelerationBuildGeometryInfo.scratchData.deviceAddress = scratchBuffer->bufferAddress();
-
-      std::vector<VkAccelerationStructureBuildRangeInfoKHR*> accelerationBuildStructureRangeInfos = { vecAccelerationStructureBuildRangeInfos.data() };
-
-      // Build the acceleration structure on the device via a one-time command buffer submission
-      // Some implementations may support acceleration structure building on the host (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands), but we prefer device builds
-      VkCommandBuffer commandBuffer = _device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-      _device->extensions().vkCmdBuildAccelerationStructuresKHR(
-         commandBuffer,
-         1,
-         &accelerationBuildGeometryInfo
-         , accelerationBuildStructureRangeInfos.data());
-      _device->flushCommandBuffer(commandBuffer);
-
-      delete scratchBuffer;
+      accelerationBuildGeometryInfo.geometryCount = (uint32_t)_geometries.size();
+      accelerationBuildGeometryInfo.pGeometries = _geometries.data();
+      accelerationBuildGeometryInfo.scratchData.deviceAddress = scratchAddress;
+      return accelerationBuildGeometryInfo;
+   }
+
+   VkDeviceSize Blas::buildScratchSize(void) const
+   {
+      return _buildScratchSize;
+   }
+
+   static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+   {
+      return (value + alignment - 1) & ~(alignment - 1);
+   }
+
+   VulkanBuffer* Blas::recordBuilds(Device* device, VkCommandBuffer commandBuffer, const std::vector<Blas*>& blases)
+   {
+      if (blases.empty())
+      {
+         return nullptr;
+      }
+
+      const VkDeviceSize alignment = std::max<VkDeviceSize>(1, device->physicalDevice()->accelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment);
+
+      // split into batches whose scratch fits next to each other, the scratch buffer is as large as the largest batch
+      std::vector<size_t> batchEnds;
+      std::vector<VkDeviceSize> scratchOffsets;
+      VkDeviceSize batchSize = 0;
+      VkDeviceSize scratchBufferSize = 0;
+      for (size_t i = 0; i < blases.size(); ++i)
+      {
+         const VkDeviceSize scratchSize = alignUp(blases[i]->buildScratchSize(), alignment);
+         if (batchSize > 0 && batchSize + scratchSize > s_maxScratchBatchSize)
+         {
+            batchEnds.push_back(i);
+            batchSize = 0;
+         }
+         scratchOffsets.push_back(batchSize);
+         batchSize += scratchSize;
+         scratchBufferSize = std::max(scratchBufferSize, batchSize);
+      }
+      batchEnds.push_back(blases.size());
+
+      // room to align the start, the buffer itself may be less strictly aligned
+      VulkanBuffer* scratchBuffer = new VulkanBuffer(device
+         , VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+         , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, scratchBufferSize + alignment, nullptr, "blasScratch");
+      const uint64_t scratchAddress = alignUp(scratchBuffer->deviceAddress(), alignment);
+
+      std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos;
+      std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> buildRangeInfos;
+
+      size_t batchBegin = 0;
+      for (size_t batchEnd : batchEnds)
+      {
+         if (batchBegin > 0)
+         {
+            // the previous batch has to be done with the scratch memory
+            VkMemoryBarrier memoryBarrier = vkInitializers::memoryBarrier();
+            memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+            memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+         }
+
+         buildGeometryInfos.clear();
+         buildRangeInfos.clear();
+         for (size_t i = batchBegin; i < batchEnd; ++i)
+         {
+            buildGeometryInfos.push_back(blases[i]->buildGeometryInfo(scratchAddress + scratchOffsets[i]));
+            buildRangeInfos.push_back(blases[i]->_buildRangeInfos.data());
+         }
+
+         device->extensions().vkCmdBuildAccelerationStructuresKHR(
+            commandBuffer,
+            (uint32_t)buildGeometryInfos.size(),
+            buildGeometryInfos.data(),
+            buildRangeInfos.data());
+
+         batchBegin = batchEnd;
+      }
+
+      return scratchBuffer;
+   }
+
+   VkQueryPool Blas::recordCompactedSizeQueries(Device* device, VkCommandBuffer commandBuffer, const std::vector<Blas*>& blases)
+   {
+      return recordPropertyQueries(device, commandBuffer, blases, VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR);
+   }
+
+   VkQueryPool Blas::recordPropertyQueries(Device* device, VkCommandBuffer commandBuffer, const std::vector<Blas*>& blases, VkQueryType queryType)
+   {
+      if (blases.empty())
+      {
+         return VK_NULL_HANDLE;
+      }
+
+      VkQueryPoolCreateInfo queryPoolCreateInfo{};
+      queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      queryPoolCreateInfo.queryType = queryType;
+      queryPoolCreateInfo.queryCount = (uint32_t)blases.size();
+
+      VkQueryPool queryPool = VK_NULL_HANDLE;
+      VK_CHECK_RESULT(vkCreateQueryPool(device->vulkanDevice(), &queryPoolCreateInfo, nullptr, &queryPool));
+      vkCmdResetQueryPool(commandBuffer, queryPool, 0, queryPoolCreateInfo.queryCount);
+
+      // the properties are only known once the builds (or copies) are done
+      VkMemoryBarrier memoryBarrier = vkInitializers::memoryBarrier();
+      memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+      memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+      std::vector<VkAccelerationStructureKHR> handles;
+      for (const Blas* blas : blases)
+      {
+         handles.push_back(blas->_blas->handle());
+      }
+
+      device->extensions().vkCmdWriteAccelerationStructuresPropertiesKHR(commandBuffer
+         , (uint32_t)handles.size(), handles.data()
+         , queryType, queryPool, 0);
+
+      return queryPool;
+   }
+
+   std::vector<VkDeviceSize> Blas::queryResults(Device* device, VkQueryPool queryPool, size_t numQueries)
+   {
+      std::vector<VkDeviceSize> results(numQueries);
+      VK_CHECK_RESULT(vkGetQueryPoolResults(device->vulkanDevice(), queryPool, 0, (uint32_t)numQueries
+         , results.size() * sizeof(VkDeviceSize), results.data(), sizeof(VkDeviceSize)
+         , VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+      vkDestroyQueryPool(device->vulkanDevice(), queryPool, nullptr);
+      return results;
+   }
+
+   void Blas::compact(Device* device, VkQueryPool queryPool, const std::vector<Blas*>& blases)
+   {
+      if (queryPool == VK_NULL_HANDLE)
+      {
+         return;
+      }
+
+      const std::vector<VkDeviceSize> compactedSizes = queryResults(device, queryPool, blases.size());
+
+      uint64_t sizeBefore = 0;
+      uint64_t sizeAfter = 0;
+
+      std::vector<AccelerationStructure*> originals;
+
+      VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+      for (size_t i = 0; i < blases.size(); ++i)
+      {
+         Blas* blas = blases[i];
+         sizeBefore += blas->_blas->sizeInBytes();
+
+         if (compactedSizes[i] == 0 || compactedSizes[i] >= blas->_blas->sizeInBytes())
+         {
+            sizeAfter += blas->_blas->sizeInBytes();
+            continue;
+         }
+
+         AccelerationStructure* compacted = new AccelerationStructure(device, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, compactedSizes[i]);
+
+         VkCopyAccelerationStructureInfoKHR copyInfo{};
+         copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+         copyInfo.src = blas->_blas->handle();
+         copyInfo.dst = compacted->handle();
+         copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+         device->extensions().vkCmdCopyAccelerationStructureKHR(commandBuffer, &copyInfo);
+
+         originals.push_back(blas->_blas);
+         blas->_blas = compacted;
+         sizeAfter += compacted->sizeInBytes();
+      }
+      device->flushCommandBuffer(commandBuffer);
+
+      for (AccelerationStructure* original : originals)
+      {
+         delete original;
+      }
+
+      const double toMB = 1.0 / (1024.0 * 1024.0);
+      std::cout << "Compacted " << blases.size() << " blases: " << sizeBefore * toMB << " MB -> " << sizeAfter * toMB << " MB";
+      if (sizeBefore > 0)
+      {
+         std::cout << " (" << 100.0 * (1.0 - double(sizeAfter) / double(sizeBefore)) << "% saved)";
+      }
+      std::cout << std::endl;
+   }
+
+   uint64_t Blas::cacheKey(void) const
+   {
+      // the geometry, which parts of it the lods use, and where it is placed
+      uint64_t key = AccelerationStructureCache::hash(&s_buildFlags, sizeof(s_buildFlags), _transformed ? 1 : 0);
+      for (const Part& part : _parts)
+      {
+         const uint64_t description[] = { part._model->geometryHash(), (uint64_t)part._model->numVertices() };
+         key = AccelerationStructureCache::hash(description, sizeof(description), key);
+         if (_transformed)
+         {
+            key = AccelerationStructureCache::hash(&part._transform, sizeof(part._transform), key);
+         }
+      }
+      for (const VkAccelerationStructureGeometryKHR& geometry : _geometries)
+      {
+         key = AccelerationStructureCache::hash(&geometry.flags, sizeof(geometry.flags), key);
+      }
+      return AccelerationStructureCache::hash(_buildRangeInfos.data(), _buildRangeInfos.size() * sizeof(VkAccelerationStructureBuildRangeInfoKHR), key);
+   }
+
+   // the copies to and from memory want 256 byte aligned addresses
+   static const VkDeviceSize s_serializationAlignment = 256;
+
+   VulkanBuffer* Blas::recordDeserializations(Device* device, VkCommandBuffer commandBuffer, const std::vector<Blas*>& blases, const std::vector<std::vector<uint8_t> >& serialized)
+   {
+      if (blases.empty())
+      {
+         return nullptr;
+      }
+
+      std::vector<VkDeviceSize> offsets;
+      VkDeviceSize totalSize = 0;
+      for (const std::vector<uint8_t>& data : serialized)
+      {
+         offsets.push_back(totalSize);
+         totalSize = alignUp(totalSize + data.size(), s_serializationAlignment);
+      }
+
+      VulkanBuffer* serializedBuffer = new VulkanBuffer(device
+         , VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR
+         , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+         , totalSize + s_serializationAlignment, nullptr, "blasSerialized");
+      const uint64_t address = serializedBuffer->deviceAddress();
+      const uint64_t alignedAddress = alignUp(address, s_serializationAlignment);
+
+      VK_CHECK_RESULT(serializedBuffer->map());
+      for (size_t i = 0; i < blases.size(); ++i)
+      {
+         Blas* blas = blases[i];
+         memcpy((uint8_t*)serializedBuffer->_mapped + (alignedAddress - address) + offsets[i], serialized[i].data(), serialized[i].size());
+
+         // the one made for the build has the wrong size, and was never built
+         delete blas->_blas;
+         blas->_blas = new AccelerationStructure(device, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, AccelerationStructureCache::deserializedSize(serialized[i]));
+
+         VkCopyMemoryToAccelerationStructureInfoKHR copyInfo{};
+         copyInfo.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR;
+         copyInfo.src.deviceAddress = alignedAddress + offsets[i];
+         copyInfo.dst = blas->_blas->handle();
+         copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR;
+         device->extensions().vkCmdCopyMemoryToAccelerationStructureKHR(commandBuffer, &copyInfo);
+      }
+      serializedBuffer->unmap();
+
+      return serializedBuffer;
+   }
+
+   void Blas::serialize(Device* device, const std::vector<Blas*>& blases, std::vector<std::vector<uint8_t> >& serialized)
+   {
+      serialized.clear();
+      if (blases.empty())
+      {
+         return;
+      }
+
+      VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+      VkQueryPool queryPool = recordPropertyQueries(device, commandBuffer, blases, VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR);
+      device->flushCommandBuffer(commandBuffer);
+      const std::vector<VkDeviceSize> serializedSizes = queryResults(device, queryPool, blases.size());
+
+      std::vector<VkDeviceSize> offsets;
+      VkDeviceSize totalSize = 0;
+      for (VkDeviceSize size : serializedSizes)
+      {
+         offsets.push_back(totalSize);
+         totalSize = alignUp(totalSize + size, s_serializationAlignment);
+      }
+
+      VulkanBuffer* serializedBuffer = new VulkanBuffer(device
+         , VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+         , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+         , totalSize + s_serializationAlignment, nullptr, "blasSerialized");
+      const uint64_t address = serializedBuffer->deviceAddress();
+      const uint64_t alignedAddress = alignUp(address, s_serializationAlignment);
+
+      commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+      for (size_t i = 0; i < blases.size(); ++i)
+      {
+         VkCopyAccelerationStructureToMemoryInfoKHR copyInfo{};
+         copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR;
+         copyInfo.src = blases[i]->_blas->handle();
+         copyInfo.dst.deviceAddress = alignedAddress + offsets[i];
+         copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR;
+         device->extensions().vkCmdCopyAccelerationStructureToMemoryKHR(commandBuffer, &copyInfo);
+      }
+
+      VkMemoryBarrier memoryBarrier = vkInitializers::memoryBarrier();
+      memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+      device->flushCommandBuffer(commandBuffer);
+
+      VK_CHECK_RESULT(serializedBuffer->map());
+      for (size_t i = 0; i < blases.size(); ++i)
+      {
+         const uint8_t* data = (const uint8_t*)serializedBuffer->_mapped + (alignedAddress - address) + offsets[i];
+         serialized.push_back(std::vector<uint8_t>(data, data + serializedSizes[i]));
+      }
+      serializedBuffer->unmap();
+
+      delete serializedBuffer;
+   }
+
+   uint64_t Blas::sizeInBytes(void) const
+   {
+      return _blas->sizeInBytes();
    }
 
    uint64_t Blas::deviceAddress(void) const
@@ -2,27 +2,97 @@
 
 #include <vulkan/vulkan.h>
 
+#include <cstdint>
+#include <vector>
+
 namespace genesis
 {
    class Device;
    class VulkanGltfModel;
    class AccelerationStructure;
+   class VulkanBuffer;
 
    class Blas
    {
    public:
-      //! construct from a given model
-      Blas(Device* device, const VulkanGltfModel* model);
+      //! a model, with the index ranges of one of its lods, placed in the blas with a transform
+      struct Part
+      {
+         const VulkanGltfModel* _model;
+         int _lod;
+         VkTransformMatrixKHR _transform;
+      };
+   public:
+      //! construct from a given model, using the index ranges of the given lod.
+      //! the acceleration structure is created (so deviceAddress is valid) but not built, see recordBuilds
+      Blas(Device* device, const VulkanGltfModel* model, int lod = 0);
+
+      //! several models baked into one blas with their transforms. the geometries are the primitives of
+      //! the first part, then those of the second and so on
+      Blas(Device* device, const std::vector<Part>& parts);
 
       //! destructor
       virtual ~Blas();
    public:
       virtual uint64_t deviceAddress(void) const;
+
+      //! scratch memory the build needs
+      virtual VkDeviceSize buildScratchSize(void) const;
+
+      //! records the builds of all the blases into commandBuffer. they share one scratch buffer:
+      //! blases whose scratch fits in it together are built by one command, with a barrier only before the scratch is reused.
+      //! the returned scratch buffer has to be deleted once the command buffer has executed
+      static VulkanBuffer* recordBuilds(Device* device, VkCommandBuffer commandBuffer, const std::vector<Blas*>& blases);
+
+      //! records, after the builds, the queries for the compacted sizes of the blases.
+      //! the returned pool goes to compact once the command buffer has executed
+      static VkQueryPool recordCompactedSizeQueries(Device* device, VkCommandBuffer commandBuffer, const std::vector<Blas*>& blases);
+
+      //! copies each blas into an acceleration structure of its compacted size and releases the original.
+      //! deviceAddress changes. destroys the query pool
+      static void compact(Device* device, VkQueryPool queryPool, const std::vector<Blas*>& blases);
+
+      //! video memory of the acceleration structure
+      virtual uint64_t sizeInBytes(void) const;
+
+      //! identifies what the blas is built from, for AccelerationStructureCache
+      virtual uint64_t cacheKey(void) const;
+
+      //! records copies of serialized data (see serialize) into the blases instead of building them.
+      //! the returned buffer has to be deleted once the command buffer has executed
+      static VulkanBuffer* recordDeserializations(Device* device, VkCommandBuffer commandBuffer, const std::vector<Blas*>& blases, const std::vector<std::vector<uint8_t> >& serialized);
+
+      //! reads the built blases back in the device independent serialized form. waits for the gpu
+      static void serialize(Device* device, const std::vector<Blas*>& blases, std::vector<std::vector<uint8_t> >& serialized);
    protected:
-      virtual void build();
+      virtual void prepareBuild(void);
+
+      //! build info for a build using the scratch memory at scratchAddress
+      virtual VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo(uint64_t scratchAddress) const;
+
+      //! one query of the given type per blas, after a barrier for the builds
+      static VkQueryPool recordPropertyQueries(Device* device, VkCommandBuffer commandBuffer, const std::vector<Blas*>& blases, VkQueryType queryType);
+
+      //! waits for the results and destroys the pool
+      static std::vector<VkDeviceSize> queryResults(Device* device, VkQueryPool queryPool, size_t numQueries);
    protected:
       Device* _device = nullptr;
-      const VulkanGltfModel* _model = nullptr;
+      std::vector<Part> _parts;
       AccelerationStructure* _blas = nullptr;
+
+      //! whether the part transforms are applied, they are in _transformsBuffer then
+      bool _transformed = false;
+      VulkanBuffer* _transformsBuffer = nullptr;
+
+      //! one per primitive, kept for the build
+      std::vector<VkAccelerationStructureGeometryKHR> _geometries;
+      std::vector<VkAccelerationStructureBuildRangeInfoKHR> _buildRangeInfos;
+
+      VkDeviceSize _buildScratchSize = 0;
+
+      //! blases built by one command share at most this much scratch. a larger blas gets the scratch buffer to itself
+      static const VkDeviceSize s_maxScratchBatchSize;
+
+      static const VkBuildAccelerationStructureFlagsKHR s_buildFlags;
    };
-}
\ No newline at end of file
+}
@@ -0,0 +1,467 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace genesis
+{
+   namespace blockcompression
+   {
+      //! bc7 interpolation weights for 4 bit indices
+      static const int s_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+      //! nearest 4 bit index for a weight in [0, 64]
+      struct NearestWeightTable
+      {
+         uint8_t indices[65];
+
+         NearestWeightTable()
+         {
+            for (int w = 0; w <= 64; ++w)
+            {
+               int best = 0;
+               for (int i = 1; i < 16; ++i)
+               {
+                  if (std::abs(s_weights4[i] - w) < std::abs(s_weights4[best] - w))
+                  {
+                     best = i;
+                  }
+               }
+               indices[w] = (uint8_t)best;
+            }
+         }
+      };
+
+      static const NearestWeightTable s_nearestWeight;
+
+      struct SrgbTable
+      {
+         float toLinear[256];
+
+         SrgbTable()
+         {
+            for (int i = 0; i < 256; ++i)
+            {
+               const float c = i / 255.0f;
+               toLinear[i] = (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+         }
+      };
+
+      static const SrgbTable s_srgbTable;
+
+      static uint8_t linearToSrgb(float c)
+      {
+         c = std::min(1.0f, std::max(0.0f, c));
+         const float s = (c <= 0.0031308f) ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+         return (uint8_t)(s * 255.0f + 0.5f);
+      }
+
+      //! writes bits lsb first
+      struct BitWriter
+      {
+         uint8_t* out;
+         int position;
+
+         void write(uint32_t value, int numBits)
+         {
+            for (int i = 0; i < numBits; ++i, ++position)
+            {
+               if ((value >> i) & 1)
+               {
+                  out[position >> 3] |= (uint8_t)(1 << (position & 7));
+               }
+            }
+         }
+      };
+
+      static void encodeBc4Block(const uint8_t values[16], uint8_t* out)
+      {
+         int minValue = 255;
+         int maxValue = 0;
+         for (int i = 0; i < 16; ++i)
+         {
+            minValue = std::min(minValue, (int)values[i]);
+            maxValue = std::max(maxValue, (int)values[i]);
+         }
+
+         // red0 > red1 selects the 8 value palette
+         int palette[8];
+         palette[0] = maxValue;
+         palette[1] = minValue;
+         for (int i = 2; i < 8; ++i)
+         {
+            palette[i] = ((8 - i) * maxValue + (i - 1) * minValue + 3) / 7;
+         }
+
+         uint64_t indices = 0;
+         if (maxValue != minValue)
+         {
+            for (int i = 0; i < 16; ++i)
+            {
+               int best = 0;
+               for (int p = 1; p < 8; ++p)
+               {
+                  if (std::abs(palette[p] - values[i]) < std::abs(palette[best] - values[i]))
+                  {
+                     best = p;
+                  }
+               }
+               indices |= (uint64_t)best << (3 * i);
+            }
+         }
+
+         out[0] = (uint8_t)maxValue;
+         out[1] = (uint8_t)minValue;
+         for (int i = 0; i < 6; ++i)
+         {
+            out[2 + i] = (uint8_t)(indices >> (8 * i));
+         }
+      }
+
+      static void encodeBc5Block(const uint8_t rgba[64], uint8_t* out)
+      {
+         uint8_t red[16];
+         uint8_t green[16];
+         for (int i = 0; i < 16; ++i)
+         {
+            red[i] = rgba[i * 4 + 0];
+            green[i] = rgba[i * 4 + 1];
+         }
+         encodeBc4Block(red, out);
+         encodeBc4Block(green, out + 8);
+      }
+
+      //! 7 bit endpoint plus the p bit shared by all channels of the endpoint.
+      //! the p bit that fits the unquantized endpoint best is taken
+      static void quantizeEndpoint(const float endpoint[4], int quantized[4])
+      {
+         float bestError = 0.0f;
+         for (int p = 0; p < 2; ++p)
+         {
+            int candidate[4];
+            float error = 0.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+               const int q = std::min(127, std::max(0, (int)std::floor((endpoint[c] - p) * 0.5f + 0.5f)));
+               candidate[c] = (q << 1) | p;
+               error += (candidate[c] - endpoint[c]) * (candidate[c] - endpoint[c]);
+            }
+            if (p == 0 || error < bestError)
+            {
+               bestError = error;
+               memcpy(quantized, candidate, sizeof(candidate));
+            }
+         }
+      }
+
+      //! indices by projection onto the endpoint axis. returns the squared error
+      static int assignIndices(const uint8_t rgba[64], const int e0[4], const int e1[4], uint8_t indices[16])
+      {
+         int palette[16][4];
+         for (int i = 0; i < 16; ++i)
+         {
+            for (int c = 0; c < 4; ++c)
+            {
+               palette[i][c] = ((64 - s_weights4[i]) * e0[c] + s_weights4[i] * e1[c] + 32) >> 6;
+            }
+         }
+
+         int axis[4];
+         int axisLengthSquared = 0;
+         for (int c = 0; c < 4; ++c)
+         {
+            axis[c] = e1[c] - e0[c];
+            axisLengthSquared += axis[c] * axis[c];
+         }
+
+         int totalError = 0;
+         for (int i = 0; i < 16; ++i)
+         {
+            int index = 0;
+            if (axisLengthSquared > 0)
+            {
+               int dot = 0;
+               for (int c = 0; c < 4; ++c)
+               {
+                  dot += (rgba[i * 4 + c] - e0[c]) * axis[c];
+               }
+               const int weight = std::min(64, std::max(0, (dot * 64 + axisLengthSquared / 2) / axisLengthSquared));
+               index = s_nearestWeight.indices[weight];
+            }
+            indices[i] = (uint8_t)index;
+            for (int c = 0; c < 4; ++c)
+            {
+               const int d = rgba[i * 4 + c] - palette[index][c];
+               totalError += d * d;
+            }
+         }
+         return totalError;
+      }
+
+      //! least squares endpoints for a fixed set of indices. false if the system is singular
+      static bool refineEndpoints(const uint8_t rgba[64], const uint8_t indices[16], float e0[4], float e1[4])
+      {
+         float a = 0.0f, b = 0.0f, c = 0.0f;
+         float d0[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+         float d1[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+         for (int i = 0; i < 16; ++i)
+         {
+            const float t = s_weights4[indices[i]] / 64.0f;
+            const float s = 1.0f - t;
+            a += s * s;
+            b += s * t;
+            c += t * t;
+            for (int ch = 0; ch < 4; ++ch)
+            {
+               d0[ch] += s * rgba[i * 4 + ch];
+               d1[ch] += t * rgba[i * 4 + ch];
+            }
+         }
+         const float determinant = a * c - b * b;
+         if (std::fabs(determinant) < 1e-6f)
+         {
+            return false;
+         }
+         for (int ch = 0; ch < 4; ++ch)
+         {
+            e0[ch] = std::min(255.0f, std::max(0.0f, (c * d0[ch] - b * d1[ch]) / determinant));
+            e1[ch] = std::min(255.0f, std::max(0.0f, (a * d1[ch] - b * d0[ch]) / determinant));
+         }
+         return true;
+      }
+
+      static void encodeBc7Block(const uint8_t rgba[64], uint8_t* out)
+      {
+         // principal axis of the block by power iteration on the covariance
+         float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+         for (int i = 0; i < 16; ++i)
+         {
+            for (int c = 0; c < 4; ++c)
+            {
+               mean[c] += rgba[i * 4 + c] / 16.0f;
+            }
+         }
+         float covariance[4][4] = {};
+         for (int i = 0; i < 16; ++i)
+         {
+            float d[4];
+            for (int c = 0; c < 4; ++c)
+            {
+               d[c] = rgba[i * 4 + c] - mean[c];
+            }
+            for (int r = 0; r < 4; ++r)
+            {
+               for (int c = 0; c < 4; ++c)
+               {
+                  covariance[r][c] += d[r] * d[c];
+               }
+            }
+         }
+         float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+         for (int iteration = 0; iteration < 8; ++iteration)
+         {
+            float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int r = 0; r < 4; ++r)
+            {
+               for (int c = 0; c < 4; ++c)
+               {
+                  next[r] += covariance[r][c] * axis[c];
+               }
+            }
+            const float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+            if (length < 1e-6f)
+            {
+               break;
+            }
+            for (int c = 0; c < 4; ++c)
+            {
+               axis[c] = next[c] / length;
+            }
+         }
+
+         float minT = 0.0f;
+         float maxT = 0.0f;
+         for (int i = 0; i < 16; ++i)
+         {
+            float t = 0.0f;
+            for (int c = 0; c < 4; ++c)
+            {
+               t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+            }
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+         }
+
+         float e0[4];
+         float e1[4];
+         for (int c = 0; c < 4; ++c)
+         {
+            e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + minT * axis[c]));
+            e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + maxT * axis[c]));
+         }
+
+         int q0[4];
+         int q1[4];
+         uint8_t indices[16];
+         quantizeEndpoint(e0, q0);
+         quantizeEndpoint(e1, q1);
+         int error = assignIndices(rgba, q0, q1, indices);
+
+         // one least squares pass, kept if it is better
+         if (error > 0 && refineEndpoints(rgba, indices, e0, e1))
+         {
+            int r0[4];
+            int r1[4];
+            uint8_t refinedIndices[16];
+            quantizeEndpoint(e0, r0);
+            quantizeEndpoint(e1, r1);
+            const int refinedError = assignIndices(rgba, r0, r1, refinedIndices);
+            if (refinedError < error)
+            {
+               memcpy(q0, r0, sizeof(q0));
+               memcpy(q1, r1, sizeof(q1));
+               memcpy(indices, refinedIndices, sizeof(indices));
+            }
+         }
+
+         // the msb of the first index is implicit (zero)
+         if (indices[0] & 8)
+         {
+            for (int c = 0; c < 4; ++c)
+            {
+               std::swap(q0[c], q1[c]);
+            }
+            for (int i = 0; i < 16; ++i)
+            {
+               indices[i] = (uint8_t)(15 - indices[i]);
+            }
+         }
+
+         memset(out, 0, 16);
+         BitWriter writer = { out, 0 };
+         writer.write(1 << 6, 7);
+         for (int c = 0; c < 4; ++c)
+         {
+            writer.write((uint32_t)(q0[c] >> 1), 7);
+            writer.write((uint32_t)(q1[c] >> 1), 7);
+         }
+         writer.write((uint32_t)(q0[0] & 1), 1);
+         writer.write((uint32_t)(q1[0] & 1), 1);
+         writer.write(indices[0], 3);
+         for (int i = 1; i < 16; ++i)
+         {
+            writer.write(indices[i], 4);
+         }
+      }
+
+      size_t blockSize(Codec codec)
+      {
+         switch (codec)
+         {
+         case CODEC_BC5: // two 8 byte bc4 blocks
+         case CODEC_BC7:
+            return 16;
+         }
+         return 0;
+      }
+
+      size_t levelSize(Codec codec, int width, int height)
+      {
+         return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * blockSize(codec);
+      }
+
+      void encodeBlockRows(Codec codec, const uint8_t* rgba, int width, int height, int firstBlockRow, int endBlockRow, uint8_t* out)
+      {
+         const int blocksX = (width + 3) / 4;
+         const size_t bytesPerBlock = blockSize(codec);
+         uint8_t block[64];
+         for (int by = firstBlockRow; by < endBlockRow; ++by)
+         {
+            for (int bx = 0; bx < blocksX; ++bx)
+            {
+               for (int y = 0; y < 4; ++y)
+               {
+                  const int py = std::min(by * 4 + y, height - 1);
+                  for (int x = 0; x < 4; ++x)
+                  {
+                     const int px = std::min(bx * 4 + x, width - 1);
+                     memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t)py * width + px) * 4], 4);
+                  }
+               }
+               uint8_t* dst = out + ((size_t)by * blocksX + bx) * bytesPerBlock;
+               if (codec == CODEC_BC5)
+               {
+                  encodeBc5Block(block, dst);
+               }
+               else
+               {
+                  encodeBc7Block(block, dst);
+               }
+            }
+         }
+      }
+
+      void downsample(const uint8_t* rgba, int width, int height, bool srgb, bool normalMap, std::vector<uint8_t>& out)
+      {
+         const int dstWidth = std::max(1, width / 2);
+         const int dstHeight = std::max(1, height / 2);
+         out.resize((size_t)dstWidth * dstHeight * 4);
+         for (int y = 0; y < dstHeight; ++y)
+         {
+            const int y0 = std::min(y * 2, height - 1);
+            const int y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < dstWidth; ++x)
+            {
+               const int x0 = std::min(x * 2, width - 1);
+               const int x1 = std::min(x * 2 + 1, width - 1);
+               const uint8_t* src[4] = {
+                    &rgba[((size_t)y0 * width + x0) * 4]
+                  , &rgba[((size_t)y0 * width + x1) * 4]
+                  , &rgba[((size_t)y1 * width + x0) * 4]
+                  , &rgba[((size_t)y1 * width + x1) * 4] };
+               uint8_t* dst = &out[((size_t)y * dstWidth + x) * 4];
+
+               float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+               for (int s = 0; s < 4; ++s)
+               {
+                  for (int c = 0; c < 4; ++c)
+                  {
+                     if (srgb && c < 3)
+                     {
+                        sum[c] += s_srgbTable.toLinear[src[s][c]];
+                     }
+                     else if (normalMap && c < 3)
+                     {
+                        sum[c] += src[s][c] / 127.5f - 1.0f;
+                     }
+                     else
+                     {
+                        sum[c] += src[s][c];
+                     }
+                  }
+               }
+
+               if (normalMap)
+               {
+                  const float length = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                  for (int c = 0; c < 3; ++c)
+                  {
+                     const float n = (length > 0.0f) ? sum[c] / length : (c == 2 ? 1.0f : 0.0f);
+                     dst[c] = (uint8_t)std::min(255.0f, std::max(0.0f, (n * 0.5f + 0.5f) * 255.0f + 0.5f));
+                  }
+               }
+               else
+               {
+                  for (int c = 0; c < 3; ++c)
+                  {
+                     dst[c] = srgb ? linearToSrgb(sum[c] * 0.25f) : (uint8_t)(sum[c] * 0.25f + 0.5f);
+                  }
+               }
+               dst[3] = (uint8_t)(sum[3] * 0.25f + 0.5f);
+            }
+         }
+      }
+   }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace genesis
+{
+   //! cpu encoders for block compressed textures. 4x4 texel blocks, rgba8 input
+   namespace blockcompression
+   {
+      enum Codec
+      {
+           CODEC_BC5 = 0 //!< red and green, two bc4 blocks. for normal maps
+         , CODEC_BC7      //!< rgba, mode 6 only
+      };
+
+      //! bytes per 4x4 block
+      size_t blockSize(Codec codec);
+
+      //! bytes for a whole level
+      size_t levelSize(Codec codec, int width, int height);
+
+      //! encodes the block rows [firstBlockRow, endBlockRow) of a level into out, which holds the whole level.
+      //! blocks that hang over the edge repeat the last row/column.
+      //! rows are independent, so a level can be split across threads
+      void encodeBlockRows(Codec codec, const uint8_t* rgba, int width, int height, int firstBlockRow, int endBlockRow, uint8_t* out);
+
+      //! 2x2 box filter to the next mip level. srgb data is averaged in linear space,
+      //! normal maps are renormalized
+      void downsample(const uint8_t* rgba, int width, int height, bool srgb, bool normalMap, std::vector<uint8_t>& out);
+   }
+}
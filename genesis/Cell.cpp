@@ -2,8 +2,10 @@
 #include "ModelRegistry.h"
 #include "InstanceContainer.h"
 #include "Tlas.h"
+#include "SoftwareTlas.h"
 #include "IndirectLayout.h"
 #include "ModelInfo.h"
+#include "VulkanGltf.h"
 
 #include <iostream>
 
@@ -22,15 +24,41 @@ namespace genesis
 
       delete _tlas;
 
+      delete _softwareTlas;
+
       delete _instanceContainer;
    }
 
-   void Cell::addInstance(int modelId, const glm::mat4& xform)
+   uint32_t Cell::addInstance(int modelId, const glm::mat4& xform, bool dynamic)
+   {
+      return _instanceContainer->addInstance(modelId, xform, dynamic);
+   }
+
+   void Cell::updateInstanceTransform(uint32_t instanceId, const glm::mat4& xform)
+   {
+      _instanceContainer->setTransform(instanceId, xform);
+      if (_tlas)
+      {
+         _tlas->updateInstanceTransform(instanceId, xform);
+      }
+   }
+
+   void Cell::setLodSelection(const LodSelection& lodSelection)
+   {
+      _lodSelection = lodSelection;
+   }
+
+   void Cell::setImmutableSamplers(bool immutableSamplers)
+   {
+      _immutableSamplers = immutableSamplers;
+   }
+
+   void Cell::setInstanceMerging(const InstanceMerging& instanceMerging)
    {
-      _instanceContainer->addInstance(modelId, xform);
+      _instanceMerging = instanceMerging;
    }
 
-   void Cell::buildTlas()
+   void Cell::buildTlas(bool async)
    {
       if (_tlas)
       {
@@ -40,13 +68,52 @@ namespace genesis
       _tlas = new Tlas(_device, _modelRegistry);
 
       const auto& instances = _instanceContainer->instances();
-      int instanceId = 0;
+
+      std::vector<int> lods;
       for (const Instance& instance : instances)
       {
-         _tlas->addInstance(instance);
+         const ModelInfo* modelInfo = _modelRegistry->findModel(instance._modelId);
+         lods.push_back((modelInfo) ? selectLod(modelInfo->model(), instance._xform, _lodSelection) : 0);
+      }
+
+      // small instances close to each other go in shared blases
+      std::vector<bool> merged(instances.size(), false);
+      const std::vector<std::vector<size_t> > clusters = clusterInstances(instances, _modelRegistry, _instanceMerging);
+      size_t numMerged = 0;
+      for (const std::vector<size_t>& cluster : clusters)
+      {
+         std::vector<const Instance*> clusterInstances;
+         std::vector<int> clusterLods;
+         for (size_t instanceIndex : cluster)
+         {
+            clusterInstances.push_back(&instances[instanceIndex]);
+            clusterLods.push_back(lods[instanceIndex]);
+            merged[instanceIndex] = true;
+         }
+         _tlas->addMergedInstances(clusterInstances, clusterLods);
+         numMerged += cluster.size();
+      }
+      if (!clusters.empty())
+      {
+         std::cout << "Merged " << numMerged << " instances into " << clusters.size() << " blases" << std::endl;
       }
 
-      _tlas->build();
+      for (size_t i = 0; i < instances.size(); ++i)
+      {
+         if (!merged[i])
+         {
+            _tlas->addInstance(instances[i], lods[i]);
+         }
+      }
+
+      if (async)
+      {
+         _tlas->buildAsync();
+      }
+      else
+      {
+         _tlas->build();
+      }
    }
 
    const Tlas* Cell::tlas(void) const
@@ -54,11 +121,65 @@ namespace genesis
       return _tlas;
    }
 
+   void Cell::buildSoftwareTlas(void)
+   {
+      if (_softwareTlas)
+      {
+         std::cout << "already built!!" << std::endl;
+         return;
+      }
+      _softwareTlas = new SoftwareTlas(_device);
+      _softwareTlas->build(this);
+   }
+
+   const SoftwareTlas* Cell::softwareTlas(void) const
+   {
+      return _softwareTlas;
+   }
+
+   const InstanceContainer* Cell::instanceContainer(void) const
+   {
+      return _instanceContainer;
+   }
+
+   const ModelRegistry* Cell::modelRegistry(void) const
+   {
+      return _modelRegistry;
+   }
+
+   bool Cell::recordTlasUpdate(VkCommandBuffer commandBuffer)
+   {
+      if (!_tlas)
+      {
+         return false;
+      }
+      return _tlas->recordUpdate(commandBuffer);
+   }
+
+   int Cell::selectTlasLods(void)
+   {
+      if (!_tlas)
+      {
+         return 0;
+      }
+      return _tlas->selectLods(_lodSelection);
+   }
+
+   uint64_t Cell::takeTlasWaitValue(void)
+   {
+      if (!_tlas)
+      {
+         return 0;
+      }
+      return _tlas->takeWaitValue();
+   }
+
    void Cell::buildLayout()
    {
       if (!_indirectLayout)
       {
          _indirectLayout = new IndirectLayout(_device);
+         _indirectLayout->setImmutableSamplers(_immutableSamplers);
       }
       
       std::vector<const VulkanGltfModel*> models;
@@ -79,13 +200,14 @@ namespace genesis
       return _indirectLayout;
    }
 
-   void Cell::buildDrawBuffer(void)
+   bool Cell::buildDrawBuffer(void)
    {  
       if (!_indirectLayout)
       {
          _indirectLayout = new IndirectLayout(_device);
+         _indirectLayout->setImmutableSamplers(_immutableSamplers);
       }
-      _indirectLayout->buildDrawBuffer(_modelRegistry, _instanceContainer);
+      return _indirectLayout->buildDrawBuffer(_modelRegistry, _instanceContainer, _lodSelection);
    }
 
    void Cell::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const
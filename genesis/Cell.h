@@ -1,6 +1,8 @@
 #pragma once
 
 #include "GenMath.h"
+#include "LodSelection.h"
+#include "InstanceMerging.h"
 
 #include <vulkan/vulkan.h>
 
@@ -18,6 +20,7 @@ namespace genesis
    class InstanceContainer;
 
    class Tlas;
+   class SoftwareTlas;
    class IndirectLayout;
 
    //! A cell is a world cell. It contains
@@ -37,15 +40,47 @@ namespace genesis
       Cell& operator=(const Cell& rhs) = delete;
       Cell(Device* device) = delete;
    public:
-      virtual void addInstance(int modelId, const glm::mat4& xform);
+      //! returns the instance id. dynamic: see InstanceContainer::addInstance
+      virtual uint32_t addInstance(int modelId, const glm::mat4& xform, bool dynamic = false);
 
-      virtual void buildTlas(void);
+      //! the tlas follows with the next recordTlasUpdate. the draw buffer keeps the transform it was built with
+      virtual void updateInstanceTransform(uint32_t instanceId, const glm::mat4& xform);
+
+      //! used when building the tlas and the draw buffer
+      virtual void setLodSelection(const LodSelection& lodSelection);
+
+      //! see IndirectLayout::setImmutableSamplers
+      virtual void setImmutableSamplers(bool immutableSamplers);
+
+      //! used when building the tlas. the draw buffer still has every instance
+      virtual void setInstanceMerging(const InstanceMerging& instanceMerging);
+
+      //! async: see Tlas::buildAsync
+      virtual void buildTlas(bool async = false);
       virtual const Tlas* tlas(void) const;
 
+      //! instead of the tlas, for devices without ray tracing. lod 0 of every instance, which do not move after this
+      virtual void buildSoftwareTlas(void);
+      virtual const SoftwareTlas* softwareTlas(void) const;
+
+      //! the instances with their current transforms, and the models they refer to. see CpuPathTracer::addCell
+      virtual const InstanceContainer* instanceContainer(void) const;
+      virtual const ModelRegistry* modelRegistry(void) const;
+
+      //! see Tlas::recordUpdate
+      virtual bool recordTlasUpdate(VkCommandBuffer commandBuffer);
+
+      //! see Tlas::selectLods, with the lod selection of the cell
+      virtual int selectTlasLods(void);
+
+      //! see Tlas::takeWaitValue
+      virtual uint64_t takeTlasWaitValue(void);
+
       virtual void buildLayout(void);
       virtual const IndirectLayout* layout(void) const;
 
-      virtual void buildDrawBuffer(void);
+      //! see IndirectLayout::buildDrawBuffer, with the lod selection of the cell. call again to pick the lods again
+      virtual bool buildDrawBuffer(void);
       virtual void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
    protected:
       Device* _device;
@@ -54,8 +89,16 @@ namespace genesis
 
       Tlas* _tlas = nullptr;
 
+      SoftwareTlas* _softwareTlas = nullptr;
+
       const ModelRegistry* _modelRegistry = nullptr;
 
       IndirectLayout* _indirectLayout = nullptr;
+
+      LodSelection _lodSelection;
+
+      InstanceMerging _instanceMerging;
+
+      bool _immutableSamplers = false;
    };
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "Cell.h"
 
 #include <iostream>
+#include <algorithm>
 
 namespace genesis
 {
@@ -21,11 +22,14 @@ namespace genesis
       delete _modelRegistry;
    }
 
-   void CellManager::addInstance(const std::string& modelFileName, const glm::mat4& xform)
+   uint32_t CellManager::addInstance(const std::string& modelFileName, const glm::mat4& xform, bool dynamic)
    {
       if (_cells.empty())
       {
          _cells.push_back(new Cell(_device, _modelRegistry));
+         _cells.back()->setLodSelection(_lodSelection);
+         _cells.back()->setImmutableSamplers(_immutableSamplers);
+         _cells.back()->setInstanceMerging(_instanceMerging);
       }
       Cell* cell = _cells[0];
 
@@ -35,15 +39,90 @@ namespace genesis
       }
       const int modelId = _modelRegistry->modelId(modelFileName);
 
-      cell->addInstance(modelId, xform);
+      return cell->addInstance(modelId, xform, dynamic);
    }
 
-   void CellManager::buildTlases()
+   void CellManager::updateInstanceTransform(uint32_t instanceId, const glm::mat4& xform)
    {
+      // all the instances go into the first cell for now
+      if (_cells.empty())
+      {
+         return;
+      }
+      _cells[0]->updateInstanceTransform(instanceId, xform);
+   }
+
+   void CellManager::setLodSelection(const LodSelection& lodSelection)
+   {
+      _lodSelection = lodSelection;
+      for (Cell* cell : _cells)
+      {
+         cell->setLodSelection(_lodSelection);
+      }
+   }
+
+   void CellManager::setImmutableSamplers(bool immutableSamplers)
+   {
+      _immutableSamplers = immutableSamplers;
+      for (Cell* cell : _cells)
+      {
+         cell->setImmutableSamplers(_immutableSamplers);
+      }
+   }
+
+   void CellManager::setInstanceMerging(const InstanceMerging& instanceMerging)
+   {
+      _instanceMerging = instanceMerging;
+      for (Cell* cell : _cells)
+      {
+         cell->setInstanceMerging(_instanceMerging);
+      }
+   }
+
+   void CellManager::buildTlases(bool async)
+   {
+      for (Cell* cell : _cells)
+      {
+         cell->buildTlas(async);
+      }
+   }
+
+   void CellManager::buildSoftwareTlases(void)
+   {
+      for (Cell* cell : _cells)
+      {
+         cell->buildSoftwareTlas();
+      }
+   }
+
+   bool CellManager::recordTlasUpdates(VkCommandBuffer commandBuffer)
+   {
+      bool handleChanged = false;
       for (Cell* cell : _cells)
       {
-         cell->buildTlas();
+         handleChanged = cell->recordTlasUpdate(commandBuffer) || handleChanged;
       }
+      return handleChanged;
+   }
+
+   int CellManager::selectTlasLods(void)
+   {
+      int numChanged = 0;
+      for (Cell* cell : _cells)
+      {
+         numChanged += cell->selectTlasLods();
+      }
+      return numChanged;
+   }
+
+   uint64_t CellManager::takeTlasWaitValue(void)
+   {
+      uint64_t waitValue = 0;
+      for (Cell* cell : _cells)
+      {
+         waitValue = std::max(waitValue, cell->takeTlasWaitValue());
+      }
+      return waitValue;
    }
 
    void CellManager::buildLayouts(void)
@@ -64,12 +143,14 @@ namespace genesis
       return _cells[cellIndex];
    }
 
-   void CellManager::buildDrawBuffers(void)
+   bool CellManager::buildDrawBuffers(void)
    {
+      bool changed = false;
       for (Cell* cell : _cells)
       {
-         cell->buildDrawBuffer();
+         changed |= cell->buildDrawBuffer();
       }
+      return changed;
    }
    
    void CellManager::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const
@@ -79,4 +160,14 @@ namespace genesis
          cell->draw(commandBuffer, pipelineLayout);
       }
    }
+
+   bool CellManager::hasAlphaMaskedPrimitives(void) const
+   {
+      return _modelRegistry->hasAlphaMaskedPrimitives();
+   }
+
+   void CellManager::reportTextureMemory(void) const
+   {
+      _modelRegistry->reportTextureMemory();
+   }
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "GenMath.h"
+#include "LodSelection.h"
+#include "InstanceMerging.h"
 
 #include <vulkan/vulkan.h>
 
@@ -22,19 +24,58 @@ namespace genesis
       CellManager(Device* device, int modelLoadingFlags);
       virtual ~CellManager();
    public:
-      virtual void addInstance(const std::string& modelFileName, const glm::mat4& xform);
+      //! returns the instance id. dynamic: the instance is going to be moved with updateInstanceTransform
+      virtual uint32_t addInstance(const std::string& modelFileName, const glm::mat4& xform, bool dynamic = false);
 
-      virtual void buildTlases(void);
+      //! see Cell::updateInstanceTransform
+      virtual void updateInstanceTransform(uint32_t instanceId, const glm::mat4& xform);
+
+      //! applies to all cells, call before building the tlases and draw buffers
+      virtual void setLodSelection(const LodSelection& lodSelection);
+
+      //! applies to all cells, call before building the layouts and draw buffers
+      virtual void setImmutableSamplers(bool immutableSamplers);
+
+      //! applies to all cells, call before building the tlases
+      virtual void setInstanceMerging(const InstanceMerging& instanceMerging);
+
+      //! async: see Tlas::buildAsync
+      virtual void buildTlases(bool async = false);
+
+      //! see Cell::buildSoftwareTlas, instead of buildTlases
+      virtual void buildSoftwareTlases(void);
+
+      //! see Tlas::recordUpdate. true if a tlas handle changed
+      virtual bool recordTlasUpdates(VkCommandBuffer commandBuffer);
+
+      //! see Tlas::selectLods. call setLodSelection first with the new eye position. the number of instances that changed
+      virtual int selectTlasLods(void);
+
+      //! see Tlas::takeWaitValue. the largest of all the cells, the timeline only goes up
+      virtual uint64_t takeTlasWaitValue(void);
       virtual void buildLayouts(void);
 
       virtual const Cell* cell(int cellIndex) const;
 
-      virtual void buildDrawBuffers(void);
+      //! see Cell::buildDrawBuffer. true if a draw buffer changed
+      virtual bool buildDrawBuffers(void);
       virtual void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
+
+      //! see ModelRegistry::hasAlphaMaskedPrimitives
+      virtual bool hasAlphaMaskedPrimitives(void) const;
+
+      //! see ModelRegistry::reportTextureMemory
+      virtual void reportTextureMemory(void) const;
    protected:
       Device* _device;
       std::vector<Cell*> _cells;
 
       ModelRegistry* _modelRegistry;
+
+      LodSelection _lodSelection;
+
+      InstanceMerging _instanceMerging;
+
+      bool _immutableSamplers = false;
    };
 }
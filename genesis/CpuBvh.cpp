@@ -0,0 +1,549 @@
+#include "CpuBvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define GEN_BVH_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace genesis
+{
+   const uint32_t CpuBvh::s_minTrianglesPerTask = 16 * 1024;
+   const uint32_t CpuBvh::s_maxTrianglesPerLeaf = 8;
+   const int CpuBvh::s_numBins = 16;
+   const int CpuBvh::s_stackSize = 256;
+
+   struct CpuBvh::BuildNode
+   {
+      ~BuildNode()
+      {
+         delete _children[0];
+         delete _children[1];
+      }
+
+      bool isLeaf(void) const
+      {
+         return _children[0] == nullptr;
+      }
+
+      float area(void) const
+      {
+         const glm::vec3 extent = _max - _min;
+         return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+      }
+
+      glm::vec3 _min;
+      glm::vec3 _max;
+      BuildNode* _children[2] = { nullptr, nullptr };
+
+      //! leaves: the range in BuildState::_order
+      uint32_t _first = 0;
+      uint32_t _count = 0;
+   };
+
+   struct CpuBvh::BuildState
+   {
+      std::vector<glm::vec3> _boundsMin;
+      std::vector<glm::vec3> _boundsMax;
+      std::vector<glm::vec3> _centroids;
+
+      //! triangle ids, each subtree partitions its own range
+      std::vector<uint32_t> _order;
+
+      //! deeper than this, the children are built on the same thread
+      int _maxTaskDepth = 0;
+
+      //! nodes this deep are leaves, see setMaxStackSize
+      int _maxDepth = 0;
+   };
+
+   static float halfArea(const glm::vec3& min, const glm::vec3& max)
+   {
+      const glm::vec3 extent = max - min;
+      return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+   }
+
+   CpuBvh::CpuBvh()
+      : _maxStackSize(s_stackSize)
+   {
+   }
+
+   CpuBvh::~CpuBvh()
+   {
+   }
+
+   int CpuBvh::numTriangles(void) const
+   {
+      return (int)_triangles.size();
+   }
+
+   int CpuBvh::numNodes(void) const
+   {
+      return (int)_nodes.size();
+   }
+
+   void CpuBvh::setMaxStackSize(int maxStackSize)
+   {
+      _maxStackSize = maxStackSize;
+   }
+
+   int CpuBvh::depth(void) const
+   {
+      return _depth;
+   }
+
+   const std::vector<CpuBvh::Node>& CpuBvh::nodes(void) const
+   {
+      return _nodes;
+   }
+
+   const std::vector<CpuBvh::Triangle>& CpuBvh::triangles(void) const
+   {
+      return _triangles;
+   }
+
+   const std::vector<uint32_t>& CpuBvh::triangleIds(void) const
+   {
+      return _triangleIds;
+   }
+
+   void CpuBvh::build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const std::vector<uint8_t>& needsAnyHit)
+   {
+      _nodes.clear();
+      _triangles.clear();
+      _triangleIds.clear();
+      _needsAnyHit.clear();
+      _depth = 0;
+
+      const uint32_t numTriangles = (uint32_t)(indices.size() / 3);
+      if (numTriangles == 0)
+      {
+         return;
+      }
+
+      BuildState state;
+      state._boundsMin.resize(numTriangles);
+      state._boundsMax.resize(numTriangles);
+      state._centroids.resize(numTriangles);
+      state._order.resize(numTriangles);
+      for (uint32_t i = 0; i < numTriangles; ++i)
+      {
+         const glm::vec3& v0 = positions[indices[3 * i + 0]];
+         const glm::vec3& v1 = positions[indices[3 * i + 1]];
+         const glm::vec3& v2 = positions[indices[3 * i + 2]];
+         state._boundsMin[i] = glm::min(v0, glm::min(v1, v2));
+         state._boundsMax[i] = glm::max(v0, glm::max(v1, v2));
+         state._centroids[i] = (state._boundsMin[i] + state._boundsMax[i]) * 0.5f;
+         state._order[i] = i;
+      }
+
+      // a task per subtree until every thread has one
+      const unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+      while ((1u << state._maxTaskDepth) < numThreads)
+      {
+         ++state._maxTaskDepth;
+      }
+
+      // the collapsed tree is no deeper than the binary one, whose inner nodes stop above _maxDepth
+      state._maxDepth = std::max(1, (_maxStackSize + 2) / 3);
+
+      BuildNode* root = buildRange(state, 0, numTriangles, 0);
+
+      _triangles.resize(numTriangles);
+      _triangleIds = state._order;
+      _needsAnyHit.resize(numTriangles, 0);
+      for (uint32_t i = 0; i < numTriangles; ++i)
+      {
+         const uint32_t id = state._order[i];
+         const glm::vec3& v0 = positions[indices[3 * id + 0]];
+         _triangles[i]._v0 = v0;
+         _triangles[i]._e1 = positions[indices[3 * id + 1]] - v0;
+         _triangles[i]._e2 = positions[indices[3 * id + 2]] - v0;
+         if (!needsAnyHit.empty())
+         {
+            _needsAnyHit[i] = needsAnyHit[id];
+         }
+      }
+
+      if (root->isLeaf())
+      {
+         // the root has to be a node, with the leaf as its only child
+         BuildNode* leaf = root;
+         root = new BuildNode();
+         root->_min = leaf->_min;
+         root->_max = leaf->_max;
+         root->_children[0] = leaf;
+         root->_children[1] = new BuildNode();
+         root->_children[1]->_min = glm::vec3(FLT_MAX);
+         root->_children[1]->_max = glm::vec3(-FLT_MAX);
+         root->_children[1]->_first = leaf->_first;
+      }
+      collapse(root, 1);
+      delete root;
+   }
+
+   CpuBvh::BuildNode* CpuBvh::buildRange(BuildState& state, uint32_t begin, uint32_t end, int depth)
+   {
+      BuildNode* node = new BuildNode();
+      node->_min = glm::vec3(FLT_MAX);
+      node->_max = glm::vec3(-FLT_MAX);
+      glm::vec3 centroidMin(FLT_MAX);
+      glm::vec3 centroidMax(-FLT_MAX);
+      for (uint32_t i = begin; i < end; ++i)
+      {
+         const uint32_t id = state._order[i];
+         node->_min = glm::min(node->_min, state._boundsMin[id]);
+         node->_max = glm::max(node->_max, state._boundsMax[id]);
+         centroidMin = glm::min(centroidMin, state._centroids[id]);
+         centroidMax = glm::max(centroidMax, state._centroids[id]);
+      }
+
+      const uint32_t count = end - begin;
+      node->_first = begin;
+      node->_count = count;
+      if (count <= 2 || depth >= state._maxDepth)
+      {
+         return node;
+      }
+
+      // binned sah: cost of a split is 1 (the node) + (area left * count left + area right * count right) / area
+      struct Bin
+      {
+         glm::vec3 _min = glm::vec3(FLT_MAX);
+         glm::vec3 _max = glm::vec3(-FLT_MAX);
+         uint32_t _count = 0;
+      };
+
+      float bestCost = FLT_MAX;
+      int bestAxis = -1;
+      int bestSplit = 0;
+      const float nodeArea = std::max(FLT_MIN, node->area());
+      for (int axis = 0; axis < 3; ++axis)
+      {
+         const float extent = centroidMax[axis] - centroidMin[axis];
+         if (extent <= 0.0f)
+         {
+            continue;
+         }
+
+         Bin bins[s_numBins];
+         const float scale = (s_numBins / extent) * 0.99999f;
+         for (uint32_t i = begin; i < end; ++i)
+         {
+            const uint32_t id = state._order[i];
+            const int b = std::min(s_numBins - 1, (int)((state._centroids[id][axis] - centroidMin[axis]) * scale));
+            bins[b]._min = glm::min(bins[b]._min, state._boundsMin[id]);
+            bins[b]._max = glm::max(bins[b]._max, state._boundsMax[id]);
+            ++bins[b]._count;
+         }
+
+         // right to left sweep for the right sides, then left to right for the costs
+         float rightAreas[s_numBins];
+         uint32_t rightCounts[s_numBins];
+         glm::vec3 rightMin(FLT_MAX);
+         glm::vec3 rightMax(-FLT_MAX);
+         uint32_t rightCount = 0;
+         for (int b = s_numBins - 1; b > 0; --b)
+         {
+            rightMin = glm::min(rightMin, bins[b]._min);
+            rightMax = glm::max(rightMax, bins[b]._max);
+            rightCount += bins[b]._count;
+            rightAreas[b] = (rightCount > 0) ? halfArea(rightMin, rightMax) : 0.0f;
+            rightCounts[b] = rightCount;
+         }
+
+         glm::vec3 leftMin(FLT_MAX);
+         glm::vec3 leftMax(-FLT_MAX);
+         uint32_t leftCount = 0;
+         for (int b = 1; b < s_numBins; ++b)
+         {
+            leftMin = glm::min(leftMin, bins[b - 1]._min);
+            leftMax = glm::max(leftMax, bins[b - 1]._max);
+            leftCount += bins[b - 1]._count;
+            if (leftCount == 0 || rightCounts[b] == 0)
+            {
+               continue;
+            }
+            const float cost = 1.0f + (halfArea(leftMin, leftMax) * leftCount + rightAreas[b] * rightCounts[b]) / nodeArea;
+            if (cost < bestCost)
+            {
+               bestCost = cost;
+               bestAxis = axis;
+               bestSplit = b;
+            }
+         }
+      }
+
+      uint32_t middle = begin;
+      if (bestAxis >= 0)
+      {
+         if (bestCost >= (float)count && count <= s_maxTrianglesPerLeaf)
+         {
+            return node;
+         }
+
+         const float scale = (s_numBins / (centroidMax[bestAxis] - centroidMin[bestAxis])) * 0.99999f;
+         middle = (uint32_t)(std::partition(state._order.begin() + begin, state._order.begin() + end
+            , [&](uint32_t id)
+            {
+               const int b = std::min(s_numBins - 1, (int)((state._centroids[id][bestAxis] - centroidMin[bestAxis]) * scale));
+               return b < bestSplit;
+            }) - state._order.begin());
+      }
+      else if (count <= s_maxTrianglesPerLeaf)
+      {
+         // all the centroids in one place, nothing to split on
+         return node;
+      }
+
+      if (middle == begin || middle == end)
+      {
+         middle = begin + count / 2;
+      }
+
+      node->_count = 0;
+      if (depth < state._maxTaskDepth && count >= s_minTrianglesPerTask)
+      {
+         std::thread leftThread([&]()
+         {
+            node->_children[0] = buildRange(state, begin, middle, depth + 1);
+         });
+         node->_children[1] = buildRange(state, middle, end, depth + 1);
+         leftThread.join();
+      }
+      else
+      {
+         node->_children[0] = buildRange(state, begin, middle, depth + 1);
+         node->_children[1] = buildRange(state, middle, end, depth + 1);
+      }
+      return node;
+   }
+
+   int CpuBvh::collapse(const BuildNode* buildNode, int depth)
+   {
+      _depth = std::max(_depth, depth);
+      const int index = (int)_nodes.size();
+      _nodes.push_back(Node());
+
+      // pull up the grand children of the largest inner children until there are 4
+      const BuildNode* children[4] = { buildNode->_children[0], buildNode->_children[1], nullptr, nullptr };
+      int numChildren = 2;
+      while (numChildren < 4)
+      {
+         int largest = -1;
+         float largestArea = -1.0f;
+         for (int i = 0; i < numChildren; ++i)
+         {
+            if (!children[i]->isLeaf() && children[i]->area() > largestArea)
+            {
+               largest = i;
+               largestArea = children[i]->area();
+            }
+         }
+         if (largest < 0)
+         {
+            break;
+         }
+         const BuildNode* expanded = children[largest];
+         children[largest] = expanded->_children[0];
+         children[numChildren++] = expanded->_children[1];
+      }
+
+      for (int i = 0; i < 4; ++i)
+      {
+         glm::vec3 min(FLT_MAX);
+         glm::vec3 max(-FLT_MAX);
+         int32_t child = -1;
+         uint32_t count = 0;
+         if (i < numChildren)
+         {
+            min = children[i]->_min;
+            max = children[i]->_max;
+            if (children[i]->isLeaf())
+            {
+               child = (children[i]->_count > 0) ? (int32_t)children[i]->_first : -1;
+               count = children[i]->_count;
+            }
+            else
+            {
+               // the recursion grows _nodes, so no references into it are held across it
+               child = collapse(children[i], depth + 1);
+            }
+         }
+
+         Node& node = _nodes[index];
+         for (int axis = 0; axis < 3; ++axis)
+         {
+            node._bounds[axis][i] = min[axis];
+            node._bounds[3 + axis][i] = max[axis];
+         }
+         node._children[i] = child;
+         node._counts[i] = count;
+      }
+      return index;
+   }
+
+   bool CpuBvh::intersectLeaf(const Ray& ray, uint32_t first, uint32_t count, Hit& hit, const AnyHit* anyHit) const
+   {
+      bool found = false;
+      for (uint32_t i = first; i < first + count; ++i)
+      {
+         // moller trumbore, both sides
+         const Triangle& triangle = _triangles[i];
+         const glm::vec3 p = glm::cross(ray._direction, triangle._e2);
+         const float det = glm::dot(triangle._e1, p);
+         if (std::fabs(det) < 1e-12f)
+         {
+            continue;
+         }
+         const float invDet = 1.0f / det;
+         const glm::vec3 s = ray._origin - triangle._v0;
+         const float u = glm::dot(s, p) * invDet;
+         if (u < 0.0f || u > 1.0f)
+         {
+            continue;
+         }
+         const glm::vec3 q = glm::cross(s, triangle._e1);
+         const float v = glm::dot(ray._direction, q) * invDet;
+         if (v < 0.0f || u + v > 1.0f)
+         {
+            continue;
+         }
+         const float t = glm::dot(triangle._e2, q) * invDet;
+         if (t <= ray._tMin || t >= hit._t)
+         {
+            continue;
+         }
+         if (anyHit != nullptr && _needsAnyHit[i] != 0 && !anyHit->accept(_triangleIds[i], u, v))
+         {
+            continue;
+         }
+         hit._t = t;
+         hit._u = u;
+         hit._v = v;
+         hit._triangle = _triangleIds[i];
+         found = true;
+      }
+      return found;
+   }
+
+   bool CpuBvh::intersect(const Ray& ray, Hit& hit, const AnyHit* anyHit) const
+   {
+      if (_nodes.empty())
+      {
+         return false;
+      }
+
+      hit._t = ray._tMax;
+      bool found = false;
+
+      const glm::vec3 invDirection = 1.0f / ray._direction;
+
+      // the near plane of each axis is the min or the max, depending on the sign of the direction.
+      // that way the empty slots (min > max) never pass
+      int nearPlanes[3];
+      int farPlanes[3];
+      for (int axis = 0; axis < 3; ++axis)
+      {
+         nearPlanes[axis] = (ray._direction[axis] >= 0.0f) ? axis : 3 + axis;
+         farPlanes[axis] = (ray._direction[axis] >= 0.0f) ? 3 + axis : axis;
+      }
+
+#if defined(GEN_BVH_SIMD)
+      const __m128 originX = _mm_set1_ps(ray._origin.x);
+      const __m128 originY = _mm_set1_ps(ray._origin.y);
+      const __m128 originZ = _mm_set1_ps(ray._origin.z);
+      const __m128 invDirectionX = _mm_set1_ps(invDirection.x);
+      const __m128 invDirectionY = _mm_set1_ps(invDirection.y);
+      const __m128 invDirectionZ = _mm_set1_ps(invDirection.z);
+      const __m128 tMin = _mm_set1_ps(ray._tMin);
+#endif
+
+      struct StackEntry
+      {
+         int32_t _node;
+         float _tNear;
+      };
+      StackEntry stack[s_stackSize];
+      int stackSize = 0;
+      stack[stackSize++] = { 0, ray._tMin };
+
+      while (stackSize > 0)
+      {
+         const StackEntry entry = stack[--stackSize];
+         if (entry._tNear >= hit._t)
+         {
+            continue;
+         }
+
+         const Node& node = _nodes[entry._node];
+
+         alignas(16) float tNear[4];
+         int hitMask = 0;
+#if defined(GEN_BVH_SIMD)
+         {
+            // min and max pick the non nan operand second, so 0 * inf from axis aligned rays drops out
+            const __m128 tNearX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node._bounds[nearPlanes[0]]), originX), invDirectionX);
+            const __m128 tNearY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node._bounds[nearPlanes[1]]), originY), invDirectionY);
+            const __m128 tNearZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node._bounds[nearPlanes[2]]), originZ), invDirectionZ);
+            const __m128 tFarX = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node._bounds[farPlanes[0]]), originX), invDirectionX);
+            const __m128 tFarY = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node._bounds[farPlanes[1]]), originY), invDirectionY);
+            const __m128 tFarZ = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node._bounds[farPlanes[2]]), originZ), invDirectionZ);
+
+            const __m128 near4 = _mm_max_ps(tNearX, _mm_max_ps(tNearY, _mm_max_ps(tNearZ, tMin)));
+            const __m128 far4 = _mm_min_ps(tFarX, _mm_min_ps(tFarY, _mm_min_ps(tFarZ, _mm_set1_ps(hit._t))));
+            hitMask = _mm_movemask_ps(_mm_cmple_ps(near4, far4));
+            _mm_store_ps(tNear, near4);
+         }
+#else
+         for (int i = 0; i < 4; ++i)
+         {
+            float entryT = ray._tMin;
+            float exitT = hit._t;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+               const float t0 = (node._bounds[nearPlanes[axis]][i] - ray._origin[axis]) * invDirection[axis];
+               const float t1 = (node._bounds[farPlanes[axis]][i] - ray._origin[axis]) * invDirection[axis];
+               entryT = (t0 > entryT) ? t0 : entryT;
+               exitT = (t1 < exitT) ? t1 : exitT;
+            }
+            tNear[i] = entryT;
+            hitMask |= (entryT <= exitT) ? (1 << i) : 0;
+         }
+#endif
+
+         // leaves right away, inner nodes go on the stack with the closest on top
+         StackEntry inner[4];
+         int numInner = 0;
+         for (int i = 0; i < 4; ++i)
+         {
+            if ((hitMask & (1 << i)) == 0 || node._children[i] < 0)
+            {
+               continue;
+            }
+            if (node._counts[i] > 0)
+            {
+               found |= intersectLeaf(ray, (uint32_t)node._children[i], node._counts[i], hit, anyHit);
+            }
+            else
+            {
+               int j = numInner++;
+               for (; j > 0 && inner[j - 1]._tNear < tNear[i]; --j)
+               {
+                  inner[j] = inner[j - 1];
+               }
+               inner[j] = { node._children[i], tNear[i] };
+            }
+         }
+         for (int i = 0; i < numInner; ++i)
+         {
+            stack[stackSize++] = inner[i];
+         }
+      }
+      return found;
+   }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "GenMath.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace genesis
+{
+   //! bounding volume hierarchy over triangles, for the cpu path tracer (see CpuPathTracer) and the compute shader one (see SoftwareTlas).
+   //! a binary tree is built with binned sah, the upper levels on worker threads, and then collapsed
+   //! into nodes with 4 children whose boxes are tested together with sse (scalar loops elsewhere)
+   class CpuBvh
+   {
+   public:
+      struct Ray
+      {
+         glm::vec3 _origin;
+         glm::vec3 _direction;
+         float _tMin;
+         float _tMax;
+      };
+
+      //! u and v weigh the second and third vertex of the triangle, like the hit attributes of the ray tracing pipeline
+      struct Hit
+      {
+         float _t;
+         float _u;
+         float _v;
+         uint32_t _triangle;
+      };
+
+      //! called for the triangles flagged in build, like an any hit shader. false ignores the intersection
+      class AnyHit
+      {
+      public:
+         virtual ~AnyHit() {}
+         virtual bool accept(uint32_t triangle, float u, float v) const = 0;
+      };
+
+      //! a child with a count of 0 is an inner node, otherwise _children is the first of its triangles.
+      //! unused slots have empty boxes and a child of -1
+      struct Node
+      {
+         //! min x, y, z then max x, y, z, each for the 4 children
+         alignas(16) float _bounds[6][4];
+         int32_t _children[4];
+         uint32_t _counts[4];
+      };
+
+      //! edges precomputed for moller trumbore, in the order of the leaves
+      struct Triangle
+      {
+         glm::vec3 _v0;
+         glm::vec3 _e1;
+         glm::vec3 _e2;
+      };
+   public:
+      CpuBvh();
+      virtual ~CpuBvh();
+   public:
+      //! three indices per triangle. needsAnyHit is empty or has a flag per triangle
+      virtual void build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const std::vector<uint8_t>& needsAnyHit);
+
+      //! closest hit between the ray's tMin and tMax
+      virtual bool intersect(const Ray& ray, Hit& hit, const AnyHit* anyHit) const;
+
+      //! for the builds from here on: traversals with a stack of this many nodes can not overflow it.
+      //! a node pushes at most 3 more than it pops, so below the depth that would need more the triangles go into one leaf.
+      //! the size of the stack of intersect by default
+      virtual void setMaxStackSize(int maxStackSize);
+
+      //! nodes from the root to the deepest one, 0 if empty. a traversal needs a stack of 3 * depth - 2
+      virtual int depth(void) const;
+
+      virtual int numTriangles(void) const;
+      virtual int numNodes(void) const;
+
+      //! the root is the first node. for traversing the bvh elsewhere (see SoftwareTlas)
+      virtual const std::vector<Node>& nodes(void) const;
+      virtual const std::vector<Triangle>& triangles(void) const;
+
+      //! leaf order to the order given to build
+      virtual const std::vector<uint32_t>& triangleIds(void) const;
+   protected:
+      struct BuildNode;
+      struct BuildState;
+   protected:
+      virtual BuildNode* buildRange(BuildState& state, uint32_t begin, uint32_t end, int depth);
+
+      //! returns the index of the node for an inner build node, depth is its own
+      virtual int collapse(const BuildNode* buildNode, int depth);
+
+      virtual bool intersectLeaf(const Ray& ray, uint32_t first, uint32_t count, Hit& hit, const AnyHit* anyHit) const;
+   protected:
+      std::vector<Node> _nodes;
+      std::vector<Triangle> _triangles;
+
+      //! leaf order to the order given to build
+      std::vector<uint32_t> _triangleIds;
+      std::vector<uint8_t> _needsAnyHit;
+
+      int _maxStackSize;
+      int _depth = 0;
+
+      //! subtrees with fewer triangles than this are built on the thread that got to them
+      static const uint32_t s_minTrianglesPerTask;
+
+      static const uint32_t s_maxTrianglesPerLeaf;
+
+      static const int s_numBins;
+
+      //! of intersect
+      static const int s_stackSize;
+   };
+}
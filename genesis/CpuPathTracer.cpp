@@ -0,0 +1,783 @@
+#include "CpuPathTracer.h"
+#include "Device.h"
+#include "Cell.h"
+#include "InstanceContainer.h"
+#include "ModelRegistry.h"
+#include "ModelInfo.h"
+#include "VulkanGltf.h"
+#include "Texture.h"
+#include "Image.h"
+#include "Buffer.h"
+#include "ImageTransitions.h"
+#include "PixelConversion.h"
+#include "VulkanDebug.h"
+
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace genesis
+{
+   const int CpuPathTracer::s_tileSize = 16;
+
+   // see globals.glsl, sampling.glsl, math.glsl and brdf.glsl. the names and the constants are the same,
+   // so that the two can be compared line by line. the seeds are those of raygen.rgen, see render
+
+   static const float PI = 3.141592f;
+   static const float T_MIN = 0.001f;
+   static const float T_MAX = 10000.0f;
+   static const float F0_DIELECTRICS = 0.04f;
+   static const int MIN_BOUNCES_FOR_RUSSIAN_ROULETTE = 3;
+
+   static const int DIFFUSE_TYPE = 1;
+   static const int SPECULAR_TYPE = 2;
+
+   struct MaterialProperties
+   {
+      glm::vec3 baseColor;
+      glm::vec3 emissive;
+      float metalness;
+      float roughness;
+      float occlusion;
+      float alpha;
+      float transmission;
+   };
+
+   static uint32_t tea(uint32_t val0, uint32_t val1)
+   {
+      uint32_t v0 = val0;
+      uint32_t v1 = val1;
+      uint32_t s0 = 0;
+
+      for (uint32_t n = 0; n < 16; n++)
+      {
+         s0 += 0x9e3779b9;
+         v0 += ((v1 << 4) + 0xa341316c) ^ (v1 + s0) ^ ((v1 >> 5) + 0xc8013ea4);
+         v1 += ((v0 << 4) + 0xad90777d) ^ (v0 + s0) ^ ((v0 >> 5) + 0x7e95761e);
+      }
+
+      return v0;
+   }
+
+   static uint32_t lcg(uint32_t& prev)
+   {
+      const uint32_t LCG_A = 1664525u;
+      const uint32_t LCG_C = 1013904223u;
+      prev = (LCG_A * prev + LCG_C);
+      return prev & 0x00FFFFFF;
+   }
+
+   static float rnd(uint32_t& prev)
+   {
+      return ((float)lcg(prev) / (float)0x01000000);
+   }
+
+   static float saturate(float value)
+   {
+      return std::min(1.0f, std::max(0.0f, value));
+   }
+
+   static float luminance(const glm::vec3& rgb)
+   {
+      return glm::dot(rgb, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+   }
+
+   static glm::vec4 getRotationToZAxis(const glm::vec3& inVec)
+   {
+      if (inVec.z < -0.99999f)
+      {
+         return glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+      }
+      return glm::normalize(glm::vec4(inVec.y, -inVec.x, 0.0f, 1.0f + inVec.z));
+   }
+
+   static glm::vec3 rotatePoint(const glm::vec4& q, const glm::vec3& v)
+   {
+      const glm::vec3 qAxis(q.x, q.y, q.z);
+      return 2.0f * glm::dot(qAxis, v) * qAxis + (q.w * q.w - glm::dot(qAxis, qAxis)) * v + 2.0f * q.w * glm::cross(qAxis, v);
+   }
+
+   static glm::vec4 invertRotation(const glm::vec4& q)
+   {
+      return glm::vec4(-q.x, -q.y, -q.z, q.w);
+   }
+
+   static void createCoordinateSystem(const glm::vec3& N, glm::vec3& Nt, glm::vec3& Nb)
+   {
+      if (std::fabs(N.x) > std::fabs(N.y))
+      {
+         Nt = glm::vec3(N.z, 0, -N.x) / std::sqrt(N.x * N.x + N.z * N.z);
+      }
+      else
+      {
+         Nt = glm::vec3(0, -N.z, N.y) / std::sqrt(N.y * N.y + N.z * N.z);
+      }
+      Nb = glm::cross(N, Nt);
+   }
+
+   static glm::vec3 cosineSampleHemisphere(const glm::vec2& u)
+   {
+      const float sqrt_u0 = std::sqrt(u.x);
+      const float two_pi_u1 = 2 * PI * u.y;
+      return glm::vec3(sqrt_u0 * std::cos(two_pi_u1), sqrt_u0 * std::sin(two_pi_u1), std::sqrt(1.0f - u.x));
+   }
+
+   static glm::vec3 uniformSampleHemisphere(const glm::vec2& u)
+   {
+      const float r = std::sqrt(std::max(0.0f, 1.0f - u.x * u.x));
+      const float phi = 2 * PI * u.y;
+      return glm::vec3(r * std::cos(phi), r * std::sin(phi), u.x);
+   }
+
+   static glm::vec3 diffuseReflectance(const MaterialProperties& material)
+   {
+      return material.baseColor * (1.0f - material.metalness);
+   }
+
+   //! the pdfs cancel out, see diffuseBrdfWeight in brdf.glsl
+   static glm::vec3 diffuseBrdfWeight(bool cosineSampling, const MaterialProperties& material, const glm::vec3& N, const glm::vec3& L)
+   {
+      if (cosineSampling)
+      {
+         return diffuseReflectance(material);
+      }
+      const float cosTheta = glm::dot(N, L);
+      return diffuseReflectance(material) * cosTheta * 2.0f;
+   }
+
+   static float Smith_G1_GGX(float alpha, float alphaSquared, float NdotS, float NdotSSquared)
+   {
+      return 2.0f / (std::sqrt(((alphaSquared * (1.0f - NdotSSquared)) + NdotSSquared) / NdotSSquared) + 1.0f);
+   }
+
+   static float Smith_G2_Over_G1_Height_Correlated(float alpha, float alphaSquared, float NdotL, float NdotV)
+   {
+      const float G1V = Smith_G1_GGX(alpha, alphaSquared, NdotV, NdotV * NdotV);
+      const float G1L = Smith_G1_GGX(alpha, alphaSquared, NdotL, NdotL * NdotL);
+      return G1L / (G1V + G1L - G1V * G1L);
+   }
+
+   static glm::vec3 fresnelSchlick(const glm::vec3& f0, float f90, float NdotV)
+   {
+      return f0 + (f90 - f0) * std::pow(1.0f - NdotV, 5.0f);
+   }
+
+   static glm::vec3 sampleGGXVNDF(const glm::vec3& Ve, const glm::vec2& alpha2D, const glm::vec2& u)
+   {
+      const glm::vec3 Vh = glm::normalize(glm::vec3(alpha2D.x * Ve.x, alpha2D.y * Ve.y, Ve.z));
+
+      const float lensq = Vh.x * Vh.x + Vh.y * Vh.y;
+      const glm::vec3 T1 = lensq > 0.0f ? glm::vec3(-Vh.y, Vh.x, 0.0f) * (1.0f / std::sqrt(lensq)) : glm::vec3(1.0f, 0.0f, 0.0f);
+      const glm::vec3 T2 = glm::cross(Vh, T1);
+
+      const float r = std::sqrt(u.x);
+      const float phi = 2.0f * PI * u.y;
+      const float t1 = r * std::cos(phi);
+      float t2 = r * std::sin(phi);
+      const float s = 0.5f * (1.0f + Vh.z);
+      t2 = glm::mix(std::sqrt(1.0f - t1 * t1), t2, s);
+
+      const glm::vec3 Nh = t1 * T1 + t2 * T2 + std::sqrt(std::max(0.0f, 1.0f - t1 * t1 - t2 * t2)) * Vh;
+
+      return glm::normalize(glm::vec3(alpha2D.x * Nh.x, alpha2D.y * Nh.y, std::max(0.0f, Nh.z)));
+   }
+
+   static glm::vec3 calculateSpecularF0(const MaterialProperties& material)
+   {
+      return glm::mix(glm::vec3(F0_DIELECTRICS), material.baseColor, material.metalness);
+   }
+
+   static float calculateSpecularF90(const glm::vec3& specularF0)
+   {
+      const float t = (1.0f / F0_DIELECTRICS);
+      return std::min(1.0f, t * luminance(specularF0));
+   }
+
+   static glm::vec3 specularBrdfWeightAndDirection(const MaterialProperties& material
+      , const glm::vec3& N, const glm::vec3& V, const glm::vec2& u, glm::vec3& newRayDirection)
+   {
+      const float alpha = material.roughness * material.roughness;
+      const float alphaSquared = alpha * alpha;
+
+      const glm::vec4 qRotationToZ = getRotationToZAxis(N);
+      const glm::vec3 Vlocal = rotatePoint(qRotationToZ, V);
+
+      glm::vec3 Hlocal;
+      if (alpha == 0.0f)
+      {
+         Hlocal = glm::vec3(0.0f, 0.0f, 1.0f);
+      }
+      else
+      {
+         Hlocal = sampleGGXVNDF(Vlocal, glm::vec2(alpha, alpha), u);
+      }
+
+      const glm::vec3 Llocal = glm::reflect(-Vlocal, Hlocal);
+      newRayDirection = glm::normalize(rotatePoint(invertRotation(qRotationToZ), Llocal));
+
+      const float HdotL = std::max(0.00001f, std::min(1.0f, glm::dot(Hlocal, Llocal)));
+      const glm::vec3 Nlocal(0.0f, 0.0f, 1.0f);
+      const float NdotL = std::max(0.00001f, std::min(1.0f, glm::dot(Nlocal, Llocal)));
+      const float NdotV = std::max(0.00001f, std::min(1.0f, glm::dot(Nlocal, Vlocal)));
+
+      const float G2_over_G1 = Smith_G2_Over_G1_Height_Correlated(alpha, alphaSquared, NdotL, NdotV);
+
+      const glm::vec3 specularF0 = calculateSpecularF0(material);
+      const float specularF90 = calculateSpecularF90(specularF0);
+
+      const glm::vec3 F = fresnelSchlick(specularF0, specularF90, HdotL);
+
+      return F * G2_over_G1;
+   }
+
+   static float getBrdfProbability(const MaterialProperties& material, const glm::vec3& V, const glm::vec3& shadingNormal)
+   {
+      const float specularF0 = luminance(calculateSpecularF0(material));
+      const float NdotV = std::max(0.0f, glm::dot(V, shadingNormal));
+      const float fresnel = saturate(luminance(fresnelSchlick(glm::vec3(specularF0), calculateSpecularF90(glm::vec3(specularF0)), NdotV)));
+
+      const float specular = fresnel;
+      const float diffuse = luminance(diffuseReflectance(material)) * (1.0f - fresnel);
+
+      const float p = (specular / std::max(0.0001f, (specular + diffuse)));
+      return std::min(0.9f, std::max(0.1f, p));
+   }
+
+   static bool evaluateBrdf(int brdfType, bool cosineSampling, const glm::vec2& u
+      , const MaterialProperties& material, const glm::vec3& shadingNormal, const glm::vec3& geometryNormal, const glm::vec3& V
+      , const glm::vec3& T, const glm::vec3& B, const glm::vec3& N
+      , glm::vec3& newRayDirection, glm::vec3& weight)
+   {
+      if (brdfType == DIFFUSE_TYPE)
+      {
+         newRayDirection = cosineSampling ? cosineSampleHemisphere(u) : uniformSampleHemisphere(u);
+         newRayDirection = newRayDirection.x * T + newRayDirection.y * B + newRayDirection.z * N;
+         weight = diffuseBrdfWeight(cosineSampling, material, shadingNormal, newRayDirection);
+      }
+      else
+      {
+         weight = specularBrdfWeightAndDirection(material, shadingNormal, V, u, newRayDirection);
+      }
+
+      // no directions under the triangle
+      return glm::dot(geometryNormal, newRayDirection) > 0.0f;
+   }
+
+   //! the any hit shader (anyhit.rahit) for the alpha masked triangles
+   class CpuPathTracer::AlphaTest : public CpuBvh::AnyHit
+   {
+   public:
+      AlphaTest(const CpuPathTracer* pathTracer)
+         : _pathTracer(pathTracer)
+      {
+      }
+
+      virtual bool accept(uint32_t triangle, float u, float v) const
+      {
+         const CpuMaterial& material = _pathTracer->_materials[_pathTracer->_triangleMaterials[triangle]];
+         float alpha = material._material.baseColorFactor.a;
+         if (material._baseColorTexture != -1)
+         {
+            alpha *= _pathTracer->sample(material._baseColorTexture, _pathTracer->interpolateUv(triangle, u, v)).a;
+         }
+         return alpha >= material._material.alphaCutoff;
+      }
+   protected:
+      const CpuPathTracer* _pathTracer;
+   };
+
+   //! tiles left for one worker. the owner takes them from the front, the others steal from the back
+   struct TileQueue
+   {
+      std::mutex _mutex;
+      std::deque<int> _tiles;
+   };
+
+   static bool takeTile(std::vector<TileQueue>& queues, size_t worker, int& tile)
+   {
+      for (size_t i = 0; i < queues.size(); ++i)
+      {
+         TileQueue& queue = queues[(worker + i) % queues.size()];
+         std::lock_guard<std::mutex> lock(queue._mutex);
+         if (queue._tiles.empty())
+         {
+            continue;
+         }
+         if (i == 0)
+         {
+            tile = queue._tiles.front();
+            queue._tiles.pop_front();
+         }
+         else
+         {
+            tile = queue._tiles.back();
+            queue._tiles.pop_back();
+         }
+         return true;
+      }
+      return false;
+   }
+
+   CpuPathTracer::CpuPathTracer(Device* device)
+      : _device(device)
+   {
+   }
+
+   CpuPathTracer::~CpuPathTracer()
+   {
+   }
+
+   void CpuPathTracer::addCell(const Cell* cell)
+   {
+      struct ModelData
+      {
+         std::vector<Vertex> _vertices;
+         std::vector<uint32_t> _indices;
+         uint32_t _firstMaterial = 0;
+      };
+      std::unordered_map<int, ModelData> modelData;
+
+      for (const Instance& instance : cell->instanceContainer()->instances())
+      {
+         const VulkanGltfModel* model = cell->modelRegistry()->findModel(instance._modelId)->model();
+
+         auto found = modelData.find(instance._modelId);
+         if (found == modelData.end())
+         {
+            found = modelData.insert({ instance._modelId, ModelData() }).first;
+            ModelData& data = found->second;
+            if (!model->readBackGeometry(data._vertices, data._indices))
+            {
+               std::cout << "Warning: " << __FUNCTION__ << ": " << "no geometry for model " << instance._modelId << std::endl;
+            }
+
+            // the loader warns about texture indices past the end, the shaders would sample nothing either
+            const std::vector<Texture*>& textures = model->textures();
+            auto textureAt = [&](int index)
+            {
+               return (index >= 0 && index < (int)textures.size()) ? addTexture(textures[index]) : -1;
+            };
+
+            data._firstMaterial = (uint32_t)_materials.size();
+            for (const Material& material : model->materials())
+            {
+               CpuMaterial cpuMaterial;
+               cpuMaterial._material = material;
+               cpuMaterial._baseColorTexture = textureAt(material.baseColorTextureIndex);
+               cpuMaterial._emissiveTexture = textureAt(material.emissiveTextureIndex);
+               cpuMaterial._occlusionRoughnessMetalnessTexture = textureAt(material.occlusionRoughnessMetalnessTextureIndex);
+               _materials.push_back(cpuMaterial);
+            }
+         }
+         const ModelData& data = found->second;
+         if (data._indices.empty())
+         {
+            continue;
+         }
+
+         // normals go through the inverse transpose, like vertex.normal * worldToObject in the shader
+         const glm::mat3 normalXform = glm::transpose(glm::inverse(glm::mat3(instance._xform)));
+         const uint32_t firstVertex = (uint32_t)_vertices.size();
+         for (const Vertex& vertex : data._vertices)
+         {
+            Vertex worldVertex = vertex;
+            worldVertex.position = glm::vec3(instance._xform * glm::vec4(vertex.position, 1.0f));
+            worldVertex.normal = normalXform * vertex.normal;
+            _vertices.push_back(worldVertex);
+         }
+
+         // lod 0 of every primitive, the indices are into the vertices of the whole model
+         model->forEachPrimitive(
+            [&](const Primitive& primitive)
+            {
+               const uint8_t alphaMasked = model->alphaMasked(primitive) ? 1 : 0;
+               for (uint32_t i = 0; i + 3 <= primitive.indexCount; i += 3)
+               {
+                  for (uint32_t j = 0; j < 3; ++j)
+                  {
+                     _indices.push_back(firstVertex + data._indices[primitive.firstIndex + i + j]);
+                  }
+                  _triangleMaterials.push_back(data._firstMaterial + (uint32_t)primitive.materialIndex);
+                  _alphaMasked.push_back(alphaMasked);
+               }
+            }
+         );
+      }
+   }
+
+   void CpuPathTracer::buildBvh(void)
+   {
+      const auto start = std::chrono::high_resolution_clock::now();
+
+      std::vector<glm::vec3> positions(_vertices.size());
+      for (size_t i = 0; i < _vertices.size(); ++i)
+      {
+         positions[i] = _vertices[i].position;
+      }
+      _bvh.build(positions, _indices, _alphaMasked);
+
+      const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+      std::cout << "cpu path tracer: bvh of " << _bvh.numTriangles() << " triangles, " << _bvh.numNodes() << " nodes, built in " << ms << " ms" << std::endl;
+   }
+
+   int CpuPathTracer::addTexture(const Texture* texture)
+   {
+      auto found = _textureIndices.find(texture);
+      if (found != _textureIndices.end())
+      {
+         return found->second;
+      }
+
+      int textureIndex = -1;
+      const Image* image = texture->image();
+      const VkFormat format = image->vulkanFormat();
+      const bool srgb = (format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_B8G8R8A8_SRGB);
+      const bool bgra = (format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB);
+      if (image->isCubeMap() || !(srgb || bgra || format == VK_FORMAT_R8G8B8A8_UNORM))
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "format " << format << " is not read, the texture is left out" << std::endl;
+      }
+      else
+      {
+         const int level = image->firstResidentLevel();
+         CpuTexture cpuTexture;
+         cpuTexture._width = std::max(1, image->width() >> level);
+         cpuTexture._height = std::max(1, image->height() >> level);
+         const size_t numTexels = (size_t)cpuTexture._width * cpuTexture._height;
+         const VkDeviceSize sizeInBytes = numTexels * 4;
+
+         VulkanBuffer readBackBuffer(_device, VK_BUFFER_USAGE_TRANSFER_DST_BIT
+            , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeInBytes);
+
+         VkBufferImageCopy copy = {};
+         copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)level, 0, 1 };
+         copy.imageExtent = { (uint32_t)cpuTexture._width, (uint32_t)cpuTexture._height, 1 };
+
+         VkCommandBuffer commandBuffer = _device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+         const VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)level, 1, 0, 1 };
+         transitions::setImageLayout(commandBuffer, image->vulkanImage(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, range);
+         vkCmdCopyImageToBuffer(commandBuffer, image->vulkanImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readBackBuffer.vulkanBuffer(), 1, &copy);
+         transitions::setImageLayout(commandBuffer, image->vulkanImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range);
+         _device->flushCommandBuffer(commandBuffer);
+
+         std::vector<std::uint8_t> texels((size_t)sizeInBytes);
+         VK_CHECK_RESULT(readBackBuffer.map());
+         memcpy(texels.data(), readBackBuffer._mapped, (size_t)sizeInBytes);
+         readBackBuffer.unmap();
+
+         if (bgra)
+         {
+            pixelconversion::swapRedBlue(texels.data(), texels.data(), numTexels);
+         }
+
+         // what the sampler returns: srgb is decoded, unorm is only scaled
+         cpuTexture._texels.resize(numTexels);
+         if (srgb)
+         {
+            pixelconversion::srgbToLinear(texels.data(), &cpuTexture._texels[0].x, numTexels);
+         }
+         else
+         {
+            for (size_t i = 0; i < numTexels; ++i)
+            {
+               cpuTexture._texels[i] = glm::vec4(texels[4 * i + 0], texels[4 * i + 1], texels[4 * i + 2], texels[4 * i + 3]) * (1.0f / 255.0f);
+            }
+         }
+
+         _textures.push_back(cpuTexture);
+         textureIndex = (int)_textures.size() - 1;
+      }
+
+      _textureIndices[texture] = textureIndex;
+      return textureIndex;
+   }
+
+   glm::vec4 CpuPathTracer::sample(int textureIndex, const glm::vec2& uv) const
+   {
+      const CpuTexture& texture = _textures[textureIndex];
+
+      // bilinear, texel centers at the halves
+      const float x = uv.x * texture._width - 0.5f;
+      const float y = uv.y * texture._height - 0.5f;
+      const float x0 = std::floor(x);
+      const float y0 = std::floor(y);
+      const float fx = x - x0;
+      const float fy = y - y0;
+
+      auto wrap = [](int value, int size)
+      {
+         const int wrapped = value % size;
+         return (wrapped < 0) ? wrapped + size : wrapped;
+      };
+
+      // large coordinates lose the texel, but the fraction is all that is left of them anyway
+      const int ix = (int)std::fmod(x0, (float)texture._width);
+      const int iy = (int)std::fmod(y0, (float)texture._height);
+      const int ix0 = wrap(ix, texture._width);
+      const int ix1 = wrap(ix + 1, texture._width);
+      const int iy0 = wrap(iy, texture._height);
+      const int iy1 = wrap(iy + 1, texture._height);
+
+      const glm::vec4& t00 = texture._texels[(size_t)iy0 * texture._width + ix0];
+      const glm::vec4& t10 = texture._texels[(size_t)iy0 * texture._width + ix1];
+      const glm::vec4& t01 = texture._texels[(size_t)iy1 * texture._width + ix0];
+      const glm::vec4& t11 = texture._texels[(size_t)iy1 * texture._width + ix1];
+      return glm::mix(glm::mix(t00, t10, fx), glm::mix(t01, t11, fx), fy);
+   }
+
+   glm::vec2 CpuPathTracer::interpolateUv(uint32_t triangle, float u, float v) const
+   {
+      const Vertex& v0 = _vertices[_indices[3 * triangle + 0]];
+      const Vertex& v1 = _vertices[_indices[3 * triangle + 1]];
+      const Vertex& v2 = _vertices[_indices[3 * triangle + 2]];
+      return v0.uv * (1.0f - u - v) + v1.uv * u + v2.uv * v;
+   }
+
+   glm::vec3 CpuPathTracer::pathTrace(const glm::vec3& origin, const glm::vec3& direction, const Settings& settings, uint32_t& seed, uint64_t& numRays) const
+   {
+      const AlphaTest alphaTest(this);
+
+      CpuBvh::Ray ray;
+      ray._origin = origin;
+      ray._direction = direction;
+      ray._tMin = T_MIN;
+      ray._tMax = T_MAX;
+
+      glm::vec3 throughput(1.0f);
+      glm::vec3 radiance(0.0f);
+
+      for (int depth = 0; depth < settings._maxBounces; ++depth)
+      {
+         CpuBvh::Hit hit;
+         ++numRays;
+         if (!_bvh.intersect(ray, hit, &alphaTest))
+         {
+            return radiance + glm::vec3(settings._contributionFromEnvironment) * throughput;
+         }
+
+         // loadVertex
+         const Vertex& v0 = _vertices[_indices[3 * hit._triangle + 0]];
+         const Vertex& v1 = _vertices[_indices[3 * hit._triangle + 1]];
+         const Vertex& v2 = _vertices[_indices[3 * hit._triangle + 2]];
+         const glm::vec3 barycentricCoords(1.0f - hit._u - hit._v, hit._u, hit._v);
+
+         const glm::vec3 worldPosition = v0.position * barycentricCoords.x + v1.position * barycentricCoords.y + v2.position * barycentricCoords.z;
+         glm::vec3 worldNormal = glm::normalize(v0.normal * barycentricCoords.x + v1.normal * barycentricCoords.y + v2.normal * barycentricCoords.z);
+         const glm::vec2 uv = v0.uv * barycentricCoords.x + v1.uv * barycentricCoords.y + v2.uv * barycentricCoords.z;
+         const glm::vec4 color = v0.color * barycentricCoords.x + v1.color * barycentricCoords.y + v2.color * barycentricCoords.z;
+         glm::vec3 worldGeometryNormal = glm::normalize(glm::cross(v2.position - v0.position, v1.position - v0.position));
+
+         // loadMaterialProperties
+         const CpuMaterial& material = _materials[_triangleMaterials[hit._triangle]];
+         MaterialProperties materialProperties;
+         materialProperties.emissive = material._material.emissiveFactor;
+         if (material._emissiveTexture != -1)
+         {
+            materialProperties.emissive *= glm::vec3(sample(material._emissiveTexture, uv));
+         }
+         materialProperties.occlusion = 1.0f;
+         materialProperties.roughness = material._material.roughness;
+         materialProperties.metalness = material._material.metalness;
+         if (material._occlusionRoughnessMetalnessTexture != -1)
+         {
+            const glm::vec4 omr = sample(material._occlusionRoughnessMetalnessTexture, uv);
+            materialProperties.occlusion *= omr.r;
+            materialProperties.roughness *= omr.g;
+            materialProperties.metalness *= omr.b;
+         }
+         const glm::vec3 colorFromTexture = (material._baseColorTexture == -1) ? glm::vec3(1.0f) : glm::vec3(sample(material._baseColorTexture, uv));
+         materialProperties.baseColor = colorFromTexture * glm::vec3(material._material.baseColorFactor) * glm::vec3(color);
+         materialProperties.alpha = 1.0f;
+         materialProperties.transmission = material._material.transmissionFactor;
+
+         glm::vec3 worldTangent;
+         glm::vec3 worldBiNormal;
+         createCoordinateSystem(worldNormal, worldTangent, worldBiNormal);
+
+         if (rnd(seed) > materialProperties.alpha || rnd(seed) > (1.0f - materialProperties.transmission))
+         {
+            ray._origin = worldPosition;
+            continue;
+         }
+
+         radiance += materialProperties.emissive * throughput;
+
+         if (depth == settings._maxBounces - 1)
+         {
+            break;
+         }
+
+         if (depth > MIN_BOUNCES_FOR_RUSSIAN_ROULETTE)
+         {
+            const float rrProbability = std::min(0.95f, luminance(throughput));
+            if (rrProbability < rnd(seed))
+            {
+               break;
+            }
+            throughput /= rrProbability;
+         }
+
+         const glm::vec3 V = -ray._direction;
+
+         if (glm::dot(worldGeometryNormal, V) < 0.0f)
+         {
+            worldGeometryNormal = -worldGeometryNormal;
+         }
+         if (glm::dot(worldGeometryNormal, worldNormal) < 0.0f)
+         {
+            worldNormal = -worldNormal;
+         }
+
+         int brdfType = DIFFUSE_TYPE;
+         if (materialProperties.metalness == 1.0f && materialProperties.roughness == 0.0f)
+         {
+            brdfType = SPECULAR_TYPE;
+         }
+         else
+         {
+            const float brdfProbability = getBrdfProbability(materialProperties, V, worldNormal);
+            if (rnd(seed) < brdfProbability)
+            {
+               brdfType = SPECULAR_TYPE;
+               throughput /= brdfProbability;
+            }
+            else
+            {
+               brdfType = DIFFUSE_TYPE;
+               throughput /= (1.0f - brdfProbability);
+            }
+         }
+
+         glm::vec2 u;
+         u.x = rnd(seed);
+         u.y = rnd(seed);
+
+         glm::vec3 weight;
+         if (!evaluateBrdf(brdfType, settings._cosineSampling, u
+            , materialProperties, worldNormal, worldGeometryNormal, V
+            , worldTangent, worldBiNormal, worldNormal
+            , ray._direction, weight))
+         {
+            break;
+         }
+
+         ray._origin = worldPosition;
+
+         throughput *= weight;
+      }
+      return radiance;
+   }
+
+   void CpuPathTracer::render(const glm::mat4& viewInverse, const glm::mat4& projectionInverse, int width, int height, const Settings& settings)
+   {
+      _width = width;
+      _height = height;
+      _pixels.assign((size_t)width * height, glm::vec3(0.0f));
+
+      const int tilesX = (width + s_tileSize - 1) / s_tileSize;
+      const int tilesY = (height + s_tileSize - 1) / s_tileSize;
+      const int numTiles = tilesX * tilesY;
+
+      // each worker starts with a run of neighbouring tiles, which tend to cost about the same
+      const size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+      std::vector<TileQueue> queues(numThreads);
+      for (int tile = 0; tile < numTiles; ++tile)
+      {
+         queues[(size_t)tile * numThreads / numTiles]._tiles.push_back(tile);
+      }
+
+      const glm::vec3 rayOrigin = glm::vec3(viewInverse * glm::vec4(0, 0, 0, 1));
+      const int samplesPerPixel = std::max(1, settings._samplesPerPixel);
+
+      std::atomic<uint64_t> totalRays(0);
+      auto worker = [&](size_t workerIndex)
+      {
+         uint64_t numRays = 0;
+         int tile = 0;
+         while (takeTile(queues, workerIndex, tile))
+         {
+            const int beginX = (tile % tilesX) * s_tileSize;
+            const int beginY = (tile / tilesX) * s_tileSize;
+            for (int y = beginY; y < std::min(height, beginY + s_tileSize); ++y)
+            {
+               for (int x = beginX; x < std::min(width, beginX + s_tileSize); ++x)
+               {
+                  // calculateRay
+                  const glm::vec2 inUV = (glm::vec2((float)x, (float)y) + glm::vec2(0.5f)) * glm::vec2(1.0f / width, 1.0f / height);
+                  glm::vec2 d = inUV * 2.0f - glm::vec2(1.0f);
+                  d.y = -d.y;
+                  const glm::vec4 target = projectionInverse * glm::vec4(d.x, d.y, 1, 1);
+                  const glm::vec3 rayDirection = glm::vec3(viewInverse * glm::vec4(glm::normalize(glm::vec3(target)), 0));
+
+                  // one sample per frame on the gpu: sample s is seeded with the frame index it has there,
+                  // which counts from 0 once the accumulation restarts
+                  glm::vec3 radiance(0.0f);
+                  for (int s = 0; s < samplesPerPixel; ++s)
+                  {
+                     uint32_t seed = tea((uint32_t)(y * width + x), (uint32_t)s);
+                     radiance += pathTrace(rayOrigin, rayDirection, settings, seed, numRays);
+                  }
+                  _pixels[(size_t)y * width + x] = radiance / (float)samplesPerPixel;
+               }
+            }
+         }
+         totalRays += numRays;
+      };
+
+      const auto start = std::chrono::high_resolution_clock::now();
+
+      std::vector<std::thread> threads;
+      for (size_t i = 1; i < numThreads; ++i)
+      {
+         threads.push_back(std::thread(worker, i));
+      }
+      worker(0);
+      for (std::thread& thread : threads)
+      {
+         thread.join();
+      }
+
+      const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+      _raysPerSecond = (seconds > 0.0) ? totalRays / seconds : 0.0;
+
+      if (settings._printStats)
+      {
+         std::cout << "cpu path tracer: " << width << "x" << height << ", " << samplesPerPixel << " samples per pixel, "
+            << totalRays << " rays in " << seconds << " s on " << numThreads << " threads: " << _raysPerSecond / 1e6 << " Mrays/s" << std::endl;
+      }
+   }
+
+   bool CpuPathTracer::saveImage(const std::string& fileName) const
+   {
+      std::vector<std::uint8_t> rgb((size_t)_width * _height * 3);
+      for (size_t i = 0; i < _pixels.size(); ++i)
+      {
+         for (int c = 0; c < 3; ++c)
+         {
+            // the final image is unorm, it clamps
+            const float value = std::pow(std::max(0.0f, _pixels[i][c]), 1.0f / 2.2f);
+            rgb[3 * i + c] = (std::uint8_t)(std::min(1.0f, value) * 255.0f + 0.5f);
+         }
+      }
+
+      if (stbi_write_png(fileName.c_str(), _width, _height, 3, rgb.data(), _width * 3) == 0)
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "could not write " << fileName << std::endl;
+         return false;
+      }
+      return true;
+   }
+
+   double CpuPathTracer::raysPerSecond(void) const
+   {
+      return _raysPerSecond;
+   }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "GenMath.h"
+#include "Vertex.h"
+#include "CpuBvh.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#define CPU_SIDE_COMPILATION 1
+#include "../data/shaders/glsl/common/gltfMaterial.h"
+
+namespace genesis
+{
+   class Device;
+   class Cell;
+   class Texture;
+
+   //! renders cells on the cpu with the brdf and the sampling of pathtracer.glsl, as a reference for the gpu images.
+   //! the instances are flattened into one bvh (see CpuBvh). the image is cut into tiles, each worker thread
+   //! starts with a run of them and steals from the others once it is out.
+   //! textures are sampled bilinearly from their finest resident level, only the uncompressed 8 bit formats are read
+   class CpuPathTracer
+   {
+   public:
+      struct Settings
+      {
+         int _samplesPerPixel = 64;
+
+         //! as in PushConstants
+         int _maxBounces = 10;
+         float _contributionFromEnvironment = 1.0f;
+         bool _cosineSampling = true;
+
+         //! print the rays per second once done
+         bool _printStats = false;
+      };
+   public:
+      CpuPathTracer(Device* device);
+      virtual ~CpuPathTracer();
+   public:
+      //! the instances of the cell with their current transforms.
+      //! geometry and textures the models only have on the gpu are read back
+      virtual void addCell(const Cell* cell);
+
+      //! over everything added so far
+      virtual void buildBvh(void);
+
+      //! the camera as in the scene ubo
+      virtual void render(const glm::mat4& viewInverse, const glm::mat4& projectionInverse, int width, int height, const Settings& settings);
+
+      //! gamma corrected like raygen.rgen, written as a png
+      virtual bool saveImage(const std::string& fileName) const;
+
+      //! of the last render, every ray traced counts
+      virtual double raysPerSecond(void) const;
+   protected:
+      //! linear rgba, as the samplers return it
+      struct CpuTexture
+      {
+         int _width = 0;
+         int _height = 0;
+         std::vector<glm::vec4> _texels;
+      };
+
+      //! the textures are indices into _textures, -1 for none
+      struct CpuMaterial
+      {
+         Material _material;
+         int _baseColorTexture = -1;
+         int _emissiveTexture = -1;
+         int _occlusionRoughnessMetalnessTexture = -1;
+      };
+
+      class AlphaTest;
+   protected:
+      //! returns the index into _textures, -1 if the format is not one that can be read
+      virtual int addTexture(const Texture* texture);
+
+      //! repeat addressing
+      virtual glm::vec4 sample(int textureIndex, const glm::vec2& uv) const;
+
+      virtual glm::vec2 interpolateUv(uint32_t triangle, float u, float v) const;
+
+      virtual glm::vec3 pathTrace(const glm::vec3& origin, const glm::vec3& direction, const Settings& settings, uint32_t& seed, uint64_t& numRays) const;
+   protected:
+      Device* _device;
+
+      //! world space. the normals are not normalized, like the ones pathtracer.glsl interpolates
+      std::vector<Vertex> _vertices;
+      std::vector<uint32_t> _indices;
+
+      //! per triangle
+      std::vector<uint32_t> _triangleMaterials;
+      std::vector<uint8_t> _alphaMasked;
+
+      std::vector<CpuMaterial> _materials;
+      std::vector<CpuTexture> _textures;
+      std::unordered_map<const Texture*, int> _textureIndices;
+
+      CpuBvh _bvh;
+
+      int _width = 0;
+      int _height = 0;
+      std::vector<glm::vec3> _pixels;
+
+      double _raysPerSecond = 0.0;
+
+      static const int s_tileSize;
+   };
+}
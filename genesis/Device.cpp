@@ -2,6 +2,9 @@
 #include "PhysicalDevice.h"
 #include "VulkanInitializers.h"
 #include "VulkanDebug.h"
+#include "SamplerCache.h"
+
+#include <algorithm>
 
 namespace genesis
 {
@@ -17,9 +20,11 @@ namespace genesis
          VkDeviceQueueCreateInfo queueInfo{};
          queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
          queueInfo.queueFamilyIndex = _queueFamilyIndices.graphics;
-         queueInfo.queueCount = 1;
-         queueInfo.pQueuePriorities = &_defaultQueuePriority;
+         // a second queue for async compute, in the same family so resources do not need ownership transfers
+         queueInfo.queueCount = std::min<uint32_t>(2, _physicalDevice->queueFamilyProperties()[_queueFamilyIndices.graphics].queueCount);
+         queueInfo.pQueuePriorities = _graphicsQueuePriorities;
          _queueCreateInfos.push_back(queueInfo);
+         _asyncComputeQueueIndex = queueInfo.queueCount - 1;
       }
       else
       {
@@ -77,6 +82,16 @@ namespace genesis
       : _physicalDevice(physicalDevice)
       , _enableDebugMarkers(false)
       , _logicalDevice(0)
+      , _samplerCache(nullptr)
+      , _mipMapGenerator(nullptr)
+      , _maxTextureSize(0)
+      , _streamedTextureSize(0)
+      , _accelerationStructureCache(nullptr)
+      , _asyncComputeQueue(VK_NULL_HANDLE)
+      , _asyncComputeQueueIndex(0)
+      , _asyncComputeCommandPool(VK_NULL_HANDLE)
+      , _asyncComputeTimeline(VK_NULL_HANDLE)
+      , _asyncComputeValue(0)
    {
       initQueueFamilyIndices(requestedQueueTypes);
 
@@ -108,6 +123,8 @@ namespace genesis
 
       }
 
+      _enabledExtensions.assign(finalExtensions.begin(), finalExtensions.end());
+
       VkDeviceCreateInfo deviceCreateInfo = {};
       deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
       deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(_queueCreateInfos.size());;
@@ -150,11 +167,52 @@ namespace genesis
       // Get a graphics queue from the device
       vkGetDeviceQueue(_logicalDevice, _queueFamilyIndices.graphics, 0, &_graphicsQueue);
 
+      vkGetDeviceQueue(_logicalDevice, _queueFamilyIndices.graphics, _asyncComputeQueueIndex, &_asyncComputeQueue);
+      _asyncComputeCommandPool = createCommandPool(_queueFamilyIndices.graphics);
+
+      // the timeline semaphore needs the feature, look for it in what was enabled
+      bool timelineSemaphores = false;
+      for (const VkBaseInStructure* feature = (const VkBaseInStructure*)pNextChain; feature; feature = feature->pNext)
+      {
+         if (feature->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES)
+         {
+            timelineSemaphores |= (((const VkPhysicalDeviceTimelineSemaphoreFeatures*)feature)->timelineSemaphore == VK_TRUE);
+         }
+         else if (feature->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES)
+         {
+            timelineSemaphores |= (((const VkPhysicalDeviceVulkan12Features*)feature)->timelineSemaphore == VK_TRUE);
+         }
+      }
+      if (timelineSemaphores)
+      {
+         VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo{};
+         semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+         semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+         semaphoreTypeCreateInfo.initialValue = 0;
+
+         VkSemaphoreCreateInfo semaphoreCreateInfo = vkInitializers::semaphoreCreateInfo();
+         semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+         VK_CHECK_RESULT(vkCreateSemaphore(_logicalDevice, &semaphoreCreateInfo, nullptr, &_asyncComputeTimeline));
+      }
+
       _vulkanFunctions.initialize(this);
+
+      _samplerCache = new SamplerCache(this);
    }
 
    Device::~Device()
    {
+      delete _samplerCache;
+
+      if (_asyncComputeTimeline)
+      {
+         waitForAsyncCompute(_asyncComputeValue);
+         vkDestroySemaphore(_logicalDevice, _asyncComputeTimeline, nullptr);
+      }
+      if (_asyncComputeCommandPool)
+      {
+         vkDestroyCommandPool(_logicalDevice, _asyncComputeCommandPool, nullptr);
+      }
       if (_graphicsCommandPool)
       {
          vkDestroyCommandPool(_logicalDevice, _graphicsCommandPool, nullptr);
@@ -175,6 +233,51 @@ namespace genesis
       return _physicalDevice;
    }
 
+   SamplerCache* Device::samplerCache(void) const
+   {
+      return _samplerCache;
+   }
+
+   void Device::setMipMapGenerator(MipMapGenerator* mipMapGenerator)
+   {
+      _mipMapGenerator = mipMapGenerator;
+   }
+
+   MipMapGenerator* Device::mipMapGenerator(void) const
+   {
+      return _mipMapGenerator;
+   }
+
+   void Device::setMaxTextureSize(int maxTextureSize)
+   {
+      _maxTextureSize = maxTextureSize;
+   }
+
+   int Device::maxTextureSize(void) const
+   {
+      return _maxTextureSize;
+   }
+
+   void Device::setStreamedTextureSize(int streamedTextureSize)
+   {
+      _streamedTextureSize = streamedTextureSize;
+   }
+
+   int Device::streamedTextureSize(void) const
+   {
+      return _streamedTextureSize;
+   }
+
+   void Device::setAccelerationStructureCache(AccelerationStructureCache* accelerationStructureCache)
+   {
+      _accelerationStructureCache = accelerationStructureCache;
+   }
+
+   AccelerationStructureCache* Device::accelerationStructureCache(void) const
+   {
+      return _accelerationStructureCache;
+   }
+
    VkCommandBuffer Device::createCommandBuffer(VkCommandBufferLevel level, bool begin)
    {
       VkCommandBuffer cmdBuffer;
@@ -251,6 +354,95 @@ namespace genesis
       return _graphicsQueue;
    }
 
+   bool Device::asyncComputeSupported(void) const
+   {
+      return _asyncComputeTimeline != VK_NULL_HANDLE;
+   }
+
+   VkQueue Device::asyncComputeQueue(void) const
+   {
+      return _asyncComputeQueue;
+   }
+
+   VkCommandBuffer Device::createAsyncComputeCommandBuffer(void)
+   {
+      VkCommandBuffer commandBuffer;
+      VkCommandBufferAllocateInfo commandBufferAllocateInfo = vkInitializers::commandBufferAllocateInfo(_asyncComputeCommandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+      VK_CHECK_RESULT(vkAllocateCommandBuffers(_logicalDevice, &commandBufferAllocateInfo, &commandBuffer));
+
+      VkCommandBufferBeginInfo commandBufferBeginInfo = vkInitializers::commandBufferBeginInfo();
+      VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+      return commandBuffer;
+   }
+
+   uint64_t Device::submitAsyncCompute(VkCommandBuffer commandBuffer)
+   {
+      VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+      freeFinishedAsyncCompute();
+
+      const uint64_t value = ++_asyncComputeValue;
+
+      VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo{};
+      timelineSemaphoreSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+      timelineSemaphoreSubmitInfo.signalSemaphoreValueCount = 1;
+      timelineSemaphoreSubmitInfo.pSignalSemaphoreValues = &value;
+
+      VkSubmitInfo submitInfo = vkInitializers::submitInfo();
+      submitInfo.pNext = &timelineSemaphoreSubmitInfo;
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers = &commandBuffer;
+      submitInfo.signalSemaphoreCount = 1;
+      submitInfo.pSignalSemaphores = &_asyncComputeTimeline;
+      VK_CHECK_RESULT(vkQueueSubmit(_asyncComputeQueue, 1, &submitInfo, VK_NULL_HANDLE));
+
+      _asyncComputeCommandBuffers.push_back(std::make_pair(value, commandBuffer));
+      return value;
+   }
+
+   VkSemaphore Device::asyncComputeTimeline(void) const
+   {
+      return _asyncComputeTimeline;
+   }
+
+   bool Device::asyncComputeDone(uint64_t value)
+   {
+      uint64_t currentValue = 0;
+      VK_CHECK_RESULT(vkGetSemaphoreCounterValue(_logicalDevice, _asyncComputeTimeline, &currentValue));
+      return currentValue >= value;
+   }
+
+   void Device::waitForAsyncCompute(uint64_t value)
+   {
+      VkSemaphoreWaitInfo semaphoreWaitInfo{};
+      semaphoreWaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+      semaphoreWaitInfo.semaphoreCount = 1;
+      semaphoreWaitInfo.pSemaphores = &_asyncComputeTimeline;
+      semaphoreWaitInfo.pValues = &value;
+      VK_CHECK_RESULT(vkWaitSemaphores(_logicalDevice, &semaphoreWaitInfo, DEFAULT_FENCE_TIMEOUT));
+
+      freeFinishedAsyncCompute();
+   }
+
+   void Device::freeFinishedAsyncCompute(void)
+   {
+      uint64_t currentValue = 0;
+      VK_CHECK_RESULT(vkGetSemaphoreCounterValue(_logicalDevice, _asyncComputeTimeline, &currentValue));
+
+      auto finished = std::partition(_asyncComputeCommandBuffers.begin(), _asyncComputeCommandBuffers.end()
+         , [currentValue](const std::pair<uint64_t, VkCommandBuffer>& submitted) { return submitted.first > currentValue; });
+      for (auto it = finished; it != _asyncComputeCommandBuffers.end(); ++it)
+      {
+         vkFreeCommandBuffers(_logicalDevice, _asyncComputeCommandPool, 1, &it->second);
+      }
+      _asyncComputeCommandBuffers.erase(finished, _asyncComputeCommandBuffers.end());
+   }
+
+   VkCommandPool Device::graphicsCommandPool(void) const
+   {
+      return _graphicsCommandPool;
+   }
+
    bool Device::enableDebugMarkers(void) const
    {
       return _enableDebugMarkers;
@@ -261,6 +453,11 @@ namespace genesis
       return _vulkanFunctions;
    }
 
+   bool Device::extensionEnabled(const std::string& extension) const
+   {
+      return std::find(_enabledExtensions.begin(), _enabledExtensions.end(), extension) != _enabledExtensions.end();
+   }
+
    SemaphoreHandle Device::semaphoreHandle(VkSemaphore semaphore) const
    {
 #if _WIN32
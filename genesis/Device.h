@@ -2,6 +2,8 @@
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <string>
+#include <utility>
 
 #include "VkExtensions.h"
 
@@ -10,6 +12,9 @@ namespace genesis
    class Buffer;
    class PhysicalDevice;
    class VulkanBuffer;
+   class SamplerCache;
+   class MipMapGenerator;
+   class AccelerationStructureCache;
 
 #if _WIN32
    typedef HANDLE SemaphoreHandle;
@@ -36,6 +41,9 @@ namespace genesis
 
       virtual VkQueue graphicsQueue(void) const;
 
+      //! the pool createCommandBuffer allocates from
+      virtual VkCommandPool graphicsCommandPool(void) const;
+
       virtual VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, bool begin);
 
       //! use specified queue
@@ -46,9 +54,34 @@ namespace genesis
 
       virtual VkCommandPool createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags createFlags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
+      //! true if the pNext chain enabled timeline semaphores, which the async compute submits signal
+      virtual bool asyncComputeSupported(void) const;
+
+      //! a second queue of the graphics family if it has one, so nothing changes owner. else the graphics queue
+      virtual VkQueue asyncComputeQueue(void) const;
+
+      //! begun, from the async compute pool
+      virtual VkCommandBuffer createAsyncComputeCommandBuffer(void);
+
+      //! ends and submits the command buffer without waiting. returns the value the timeline semaphore reaches
+      //! when it is done. the command buffer is freed once it is
+      virtual uint64_t submitAsyncCompute(VkCommandBuffer commandBuffer);
+
+      //! signaled by submitAsyncCompute, for other submits to wait on
+      virtual VkSemaphore asyncComputeTimeline(void) const;
+
+      //! true once the submit that returned value is done
+      virtual bool asyncComputeDone(uint64_t value);
+
+      //! cpu wait
+      virtual void waitForAsyncCompute(uint64_t value);
+
       virtual bool enableDebugMarkers(void) const;
 
       virtual const vkExtensions& extensions() const;
+
+      //! requested when the device was created, and supported
+      virtual bool extensionEnabled(const std::string& extension) const;
       
       //! handle to a semaphore
       virtual SemaphoreHandle semaphoreHandle(VkSemaphore semaphore) const;
@@ -56,8 +89,32 @@ namespace genesis
       //! handle to memory
       virtual MemoryHandle memoryHandle(VkDeviceMemory memory) const;
 
+      //! samplers shared by everything created on this device
+      virtual SamplerCache* samplerCache(void) const;
+
+      //! used by model loading to generate the mips of the textures on the gpu. not owned, can be nullptr
+      virtual void setMipMapGenerator(MipMapGenerator* mipMapGenerator);
+      virtual MipMapGenerator* mipMapGenerator(void) const;
+
+      //! textures loaded from files are capped to this many texels on their larger side:
+      //! the top levels of ktx files are skipped, other files are downsampled on load. 0 for no cap
+      virtual void setMaxTextureSize(int maxTextureSize);
+      virtual int maxTextureSize(void) const;
+
+      //! texture streaming: textures loaded from here on only get their levels up to this size resident,
+      //! the finer ones are kept in system memory for a TextureStreamer. 0 (the default) loads the whole chain
+      virtual void setStreamedTextureSize(int streamedTextureSize);
+      virtual int streamedTextureSize(void) const;
+
+      //! blases are loaded from (and stored to) this cache instead of being built. not owned, can be nullptr
+      virtual void setAccelerationStructureCache(AccelerationStructureCache* accelerationStructureCache);
+      virtual AccelerationStructureCache* accelerationStructureCache(void) const;
+
    protected:
       virtual void initQueueFamilyIndices(VkQueueFlags requestedQueueTypes);
+
+      //! frees the async compute command buffers that are done
+      virtual void freeFinishedAsyncCompute(void);
    public:
       const PhysicalDevice* _physicalDevice;
 
@@ -66,6 +123,17 @@ namespace genesis
       VkCommandPool _graphicsCommandPool;
       VkQueue _graphicsQueue;
 
+      VkQueue _asyncComputeQueue;
+      uint32_t _asyncComputeQueueIndex;
+      VkCommandPool _asyncComputeCommandPool;
+
+      //! VK_NULL_HANDLE if timeline semaphores are not enabled
+      VkSemaphore _asyncComputeTimeline;
+      uint64_t _asyncComputeValue;
+
+      //! submitted and not known to be done yet, with the value they signal
+      std::vector<std::pair<uint64_t, VkCommandBuffer> > _asyncComputeCommandBuffers;
+
       std::vector<VkDeviceQueueCreateInfo> _queueCreateInfos{};
 
       struct
@@ -79,6 +147,21 @@ namespace genesis
 
       const float _defaultQueuePriority = 0.0f;
 
+      //! the graphics family can have two queues
+      const float _graphicsQueuePriorities[2] = { 0.0f, 0.0f };
+
       vkExtensions _vulkanFunctions;
+
+      std::vector<std::string> _enabledExtensions;
+
+      SamplerCache* _samplerCache;
+
+      MipMapGenerator* _mipMapGenerator;
+
+      int _maxTextureSize;
+
+      int _streamedTextureSize;
+
+      AccelerationStructureCache* _accelerationStructureCache;
    };
 }
\ No newline at end of file
@@ -0,0 +1,1463 @@
+#include "GltfJsonParser.h"
+#include "Base64.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#include "tiny_gltf.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define GEN_JSON_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace genesis
+{
+   static const int s_maxJsonDepth = 512;
+
+   enum JsonType : uint8_t
+   {
+        JT_NULL = 0
+      , JT_FALSE
+      , JT_TRUE
+      , JT_NUMBER
+      , JT_STRING
+      , JT_ARRAY
+      , JT_OBJECT
+   };
+
+   //! one entry of the tape. the children of a container follow it directly,
+   //! object members are stored as a key string followed by the value
+   struct JsonNode
+   {
+      JsonType type;
+      //! string has backslash escapes and has to be unescaped before use
+      bool escaped;
+      //! tape index one past the last descendant, the next sibling starts there
+      uint32_t end;
+      //! elements of an array, members of an object
+      uint32_t count;
+      //! strings: first character after the opening quote. numbers: first character
+      const char* text;
+      uint32_t length;
+   };
+
+#if defined(GEN_JSON_SSE2)
+   static int firstSetBit(int mask)
+   {
+#if defined(_MSC_VER)
+      unsigned long index;
+      _BitScanForward(&index, (unsigned long)mask);
+      return (int)index;
+#else
+      return __builtin_ctz((unsigned int)mask);
+#endif
+   }
+#endif
+
+   //! the bodies of strings are the bulk of a gltf (names, uris and whole base64 buffers),
+   //! so the closing quote is searched for 16 characters at a time
+   static const char* findQuoteOrBackslash(const char* p, const char* end)
+   {
+#if defined(GEN_JSON_SSE2)
+      const __m128i quote = _mm_set1_epi8('"');
+      const __m128i backslash = _mm_set1_epi8('\\');
+      while (p + 16 <= end)
+      {
+         const __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+         const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+         if (mask != 0)
+         {
+            return p + firstSetBit(mask);
+         }
+         p += 16;
+      }
+#endif
+      while (p < end && *p != '"' && *p != '\\')
+      {
+         ++p;
+      }
+      return p;
+   }
+
+   //! single pass recursive descent tokenizer, no values are converted here
+   class JsonTape
+   {
+   public:
+      virtual bool parse(const char* text, size_t length, std::string* error);
+   public:
+      std::vector<JsonNode> _nodes;
+   protected:
+      virtual bool parseValue(int depth);
+      virtual bool parseString(void);
+      virtual bool fail(const char* message);
+
+      void skipWhitespace(void)
+      {
+         while (_cursor < _end && (*_cursor == ' ' || *_cursor == '\n' || *_cursor == '\r' || *_cursor == '\t'))
+         {
+            ++_cursor;
+         }
+      }
+
+      uint32_t pushNode(JsonType type, const char* text, uint32_t length)
+      {
+         JsonNode node;
+         node.type = type;
+         node.escaped = false;
+         node.end = (uint32_t)_nodes.size() + 1;
+         node.count = 0;
+         node.text = text;
+         node.length = length;
+         _nodes.push_back(node);
+         return (uint32_t)_nodes.size() - 1;
+      }
+   protected:
+      const char* _begin = nullptr;
+      const char* _cursor = nullptr;
+      const char* _end = nullptr;
+      std::string* _error = nullptr;
+   };
+
+   bool JsonTape::parse(const char* text, size_t length, std::string* error)
+   {
+      _begin = text;
+      _cursor = text;
+      _end = text + length;
+      _error = error;
+      _nodes.clear();
+      // a rough guess, most of the text of a gltf is in few long strings
+      _nodes.reserve(length / 16 + 16);
+
+      if (!parseValue(0))
+      {
+         return false;
+      }
+      skipWhitespace();
+      if (_cursor != _end)
+      {
+         return fail("trailing characters");
+      }
+      return true;
+   }
+
+   bool JsonTape::fail(const char* message)
+   {
+      if (_error)
+      {
+         std::stringstream ss;
+         ss << "json: " << message << " at offset " << (_cursor - _begin) << "\n";
+         (*_error) += ss.str();
+      }
+      return false;
+   }
+
+   bool JsonTape::parseString(void)
+   {
+      // _cursor is on the opening quote
+      const char* start = ++_cursor;
+      bool escaped = false;
+      while (true)
+      {
+         _cursor = findQuoteOrBackslash(_cursor, _end);
+         if (_cursor >= _end)
+         {
+            return fail("unterminated string");
+         }
+         if (*_cursor == '"')
+         {
+            break;
+         }
+         // skip the escaped character, \uXXXX digits never contain a quote
+         escaped = true;
+         _cursor += 2;
+      }
+      const uint32_t index = pushNode(JT_STRING, start, (uint32_t)(_cursor - start));
+      _nodes[index].escaped = escaped;
+      ++_cursor;
+      return true;
+   }
+
+   bool JsonTape::parseValue(int depth)
+   {
+      if (depth > s_maxJsonDepth)
+      {
+         return fail("nesting too deep");
+      }
+
+      skipWhitespace();
+      if (_cursor >= _end)
+      {
+         return fail("unexpected end of text");
+      }
+
+      switch (*_cursor)
+      {
+      case '{':
+      case '[':
+      {
+         const bool isObject = (*_cursor == '{');
+         const char closing = isObject ? '}' : ']';
+         const uint32_t index = pushNode(isObject ? JT_OBJECT : JT_ARRAY, _cursor, 0);
+         ++_cursor;
+         skipWhitespace();
+         uint32_t count = 0;
+         if (_cursor < _end && *_cursor == closing)
+         {
+            ++_cursor;
+         }
+         else
+         {
+            while (true)
+            {
+               if (isObject)
+               {
+                  skipWhitespace();
+                  if (_cursor >= _end || *_cursor != '"')
+                  {
+                     return fail("expected a member name");
+                  }
+                  if (!parseString())
+                  {
+                     return false;
+                  }
+                  skipWhitespace();
+                  if (_cursor >= _end || *_cursor != ':')
+                  {
+                     return fail("expected ':'");
+                  }
+                  ++_cursor;
+               }
+               if (!parseValue(depth + 1))
+               {
+                  return false;
+               }
+               ++count;
+               skipWhitespace();
+               if (_cursor < _end && *_cursor == ',')
+               {
+                  ++_cursor;
+                  continue;
+               }
+               if (_cursor < _end && *_cursor == closing)
+               {
+                  ++_cursor;
+                  break;
+               }
+               return fail(isObject ? "expected ',' or '}'" : "expected ',' or ']'");
+            }
+         }
+         _nodes[index].end = (uint32_t)_nodes.size();
+         _nodes[index].count = count;
+         return true;
+      }
+      case '"':
+         return parseString();
+      case 't':
+         if (_end - _cursor >= 4 && memcmp(_cursor, "true", 4) == 0)
+         {
+            pushNode(JT_TRUE, _cursor, 4);
+            _cursor += 4;
+            return true;
+         }
+         return fail("invalid literal");
+      case 'f':
+         if (_end - _cursor >= 5 && memcmp(_cursor, "false", 5) == 0)
+         {
+            pushNode(JT_FALSE, _cursor, 5);
+            _cursor += 5;
+            return true;
+         }
+         return fail("invalid literal");
+      case 'n':
+         if (_end - _cursor >= 4 && memcmp(_cursor, "null", 4) == 0)
+         {
+            pushNode(JT_NULL, _cursor, 4);
+            _cursor += 4;
+            return true;
+         }
+         return fail("invalid literal");
+      default:
+      {
+         const char* start = _cursor;
+         if (*_cursor == '-')
+         {
+            ++_cursor;
+         }
+         if (_cursor >= _end || *_cursor < '0' || *_cursor > '9')
+         {
+            return fail("invalid value");
+         }
+         while (_cursor < _end && ((*_cursor >= '0' && *_cursor <= '9') || *_cursor == '.' || *_cursor == 'e' || *_cursor == 'E' || *_cursor == '+' || *_cursor == '-'))
+         {
+            ++_cursor;
+         }
+         pushNode(JT_NUMBER, start, (uint32_t)(_cursor - start));
+         return true;
+      }
+      }
+   }
+
+   //! powers of ten that are exact in a double
+   static const double s_exactPowersOfTen[] =
+   {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+      1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+   };
+
+   //! numbers with up to 15 significant digits and a small exponent are converted exactly
+   //! with a single multiplication or division, the rest go through strtod
+   static double parseDouble(const char* text, uint32_t length)
+   {
+      const char* p = text;
+      const char* end = text + length;
+      bool negative = false;
+      if (p < end && *p == '-')
+      {
+         negative = true;
+         ++p;
+      }
+
+      uint64_t mantissa = 0;
+      int digits = 0;
+      int exponent = 0;
+      while (p < end && *p >= '0' && *p <= '9')
+      {
+         mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+         digits += (mantissa != 0);
+         ++p;
+      }
+      if (p < end && *p == '.')
+      {
+         ++p;
+         while (p < end && *p >= '0' && *p <= '9')
+         {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += (mantissa != 0);
+            --exponent;
+            ++p;
+         }
+      }
+      if (p < end && (*p == 'e' || *p == 'E'))
+      {
+         ++p;
+         bool negativeExponent = false;
+         if (p < end && (*p == '+' || *p == '-'))
+         {
+            negativeExponent = (*p == '-');
+            ++p;
+         }
+         int value = 0;
+         while (p < end && *p >= '0' && *p <= '9')
+         {
+            if (value < 100000)
+            {
+               value = value * 10 + (*p - '0');
+            }
+            ++p;
+         }
+         exponent += negativeExponent ? -value : value;
+      }
+
+      if (digits <= 15 && exponent >= -22 && exponent <= 22)
+      {
+         double value = (double)mantissa;
+         value = (exponent < 0) ? value / s_exactPowersOfTen[-exponent] : value * s_exactPowersOfTen[exponent];
+         return negative ? -value : value;
+      }
+
+      // the text is always followed by a delimiter, strtod stops there
+      return strtod(text, nullptr);
+   }
+
+   static void appendUtf8(std::string& out, uint32_t codePoint)
+   {
+      if (codePoint < 0x80)
+      {
+         out += (char)codePoint;
+      }
+      else if (codePoint < 0x800)
+      {
+         out += (char)(0xc0 | (codePoint >> 6));
+         out += (char)(0x80 | (codePoint & 0x3f));
+      }
+      else if (codePoint < 0x10000)
+      {
+         out += (char)(0xe0 | (codePoint >> 12));
+         out += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+         out += (char)(0x80 | (codePoint & 0x3f));
+      }
+      else
+      {
+         out += (char)(0xf0 | (codePoint >> 18));
+         out += (char)(0x80 | ((codePoint >> 12) & 0x3f));
+         out += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+         out += (char)(0x80 | (codePoint & 0x3f));
+      }
+   }
+
+   static uint32_t parseHex4(const char* p)
+   {
+      uint32_t value = 0;
+      for (int i = 0; i < 4; ++i)
+      {
+         const char c = p[i];
+         value <<= 4;
+         if (c >= '0' && c <= '9') value |= (uint32_t)(c - '0');
+         else if (c >= 'a' && c <= 'f') value |= (uint32_t)(c - 'a' + 10);
+         else if (c >= 'A' && c <= 'F') value |= (uint32_t)(c - 'A' + 10);
+      }
+      return value;
+   }
+
+   static std::string unescape(const char* text, uint32_t length)
+   {
+      std::string out;
+      out.reserve(length);
+      const char* end = text + length;
+      for (const char* p = text; p < end; ++p)
+      {
+         if (*p != '\\' || p + 1 >= end)
+         {
+            out += *p;
+            continue;
+         }
+         ++p;
+         switch (*p)
+         {
+         case 'b': out += '\b'; break;
+         case 'f': out += '\f'; break;
+         case 'n': out += '\n'; break;
+         case 'r': out += '\r'; break;
+         case 't': out += '\t'; break;
+         case 'u':
+         {
+            if (p + 4 >= end)
+            {
+               return out;
+            }
+            uint32_t codePoint = parseHex4(p + 1);
+            p += 4;
+            // surrogate pair
+            if (codePoint >= 0xd800 && codePoint < 0xdc00 && p + 6 < end && p[1] == '\\' && p[2] == 'u')
+            {
+               const uint32_t low = parseHex4(p + 3);
+               if (low >= 0xdc00 && low < 0xe000)
+               {
+                  codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                  p += 6;
+               }
+            }
+            appendUtf8(out, codePoint);
+            break;
+         }
+         default:
+            // \" \\ \/
+            out += *p;
+            break;
+         }
+      }
+      return out;
+   }
+
+   //! read only view of one value on the tape
+   class JsonValue
+   {
+   public:
+      JsonValue()
+         : _nodes(nullptr), _index(0)
+      {
+      }
+
+      JsonValue(const std::vector<JsonNode>* nodes, uint32_t index)
+         : _nodes(nodes), _index(index)
+      {
+      }
+
+      bool valid(void) const { return _nodes != nullptr; }
+      const JsonNode& node(void) const { return (*_nodes)[_index]; }
+      JsonType type(void) const { return valid() ? node().type : JT_NULL; }
+      bool isNumber(void) const { return type() == JT_NUMBER; }
+      bool isString(void) const { return type() == JT_STRING; }
+      bool isArray(void) const { return type() == JT_ARRAY; }
+      bool isObject(void) const { return type() == JT_OBJECT; }
+      bool isBool(void) const { return type() == JT_TRUE || type() == JT_FALSE; }
+      uint32_t size(void) const { return (isArray() || isObject()) ? node().count : 0; }
+
+      //! objects in a gltf are small, a linear search is cheaper than building a map
+      JsonValue member(const char* key) const
+      {
+         if (!isObject())
+         {
+            return JsonValue();
+         }
+         const size_t keyLength = strlen(key);
+         uint32_t i = _index + 1;
+         const uint32_t end = node().end;
+         while (i < end)
+         {
+            const JsonNode& keyNode = (*_nodes)[i];
+            const uint32_t valueIndex = i + 1;
+            if (keyNode.escaped ? unescape(keyNode.text, keyNode.length) == key
+               : (keyNode.length == keyLength && memcmp(keyNode.text, key, keyLength) == 0))
+            {
+               return JsonValue(_nodes, valueIndex);
+            }
+            i = (*_nodes)[valueIndex].end;
+         }
+         return JsonValue();
+      }
+
+      //! func(JsonValue element)
+      template<typename Func>
+      void forEachElement(Func func) const
+      {
+         if (!isArray())
+         {
+            return;
+         }
+         for (uint32_t i = _index + 1; i < node().end; i = (*_nodes)[i].end)
+         {
+            func(JsonValue(_nodes, i));
+         }
+      }
+
+      //! func(const std::string& key, JsonValue value)
+      template<typename Func>
+      void forEachMember(Func func) const
+      {
+         if (!isObject())
+         {
+            return;
+         }
+         uint32_t i = _index + 1;
+         while (i < node().end)
+         {
+            const JsonValue key(_nodes, i);
+            const JsonValue value(_nodes, i + 1);
+            func(key.asString(), value);
+            i = value.node().end;
+         }
+      }
+
+      double asDouble(double fallback = 0.0) const
+      {
+         return isNumber() ? parseDouble(node().text, node().length) : fallback;
+      }
+
+      bool isInteger(void) const
+      {
+         if (!isNumber())
+         {
+            return false;
+         }
+         for (uint32_t i = 0; i < node().length; ++i)
+         {
+            const char c = node().text[i];
+            if (c == '.' || c == 'e' || c == 'E')
+            {
+               return false;
+            }
+         }
+         return true;
+      }
+
+      int asInt(int fallback = 0) const
+      {
+         if (!isNumber())
+         {
+            return fallback;
+         }
+         if (!isInteger())
+         {
+            return (int)asDouble();
+         }
+         const char* p = node().text;
+         const char* end = p + node().length;
+         const bool negative = (*p == '-');
+         if (negative)
+         {
+            ++p;
+         }
+         int64_t value = 0;
+         for (; p < end; ++p)
+         {
+            value = value * 10 + (*p - '0');
+         }
+         return (int)(negative ? -value : value);
+      }
+
+      bool asBool(bool fallback = false) const
+      {
+         return isBool() ? (type() == JT_TRUE) : fallback;
+      }
+
+      std::string asString(void) const
+      {
+         if (!isString())
+         {
+            return std::string();
+         }
+         return node().escaped ? unescape(node().text, node().length) : std::string(node().text, node().length);
+      }
+   protected:
+      const std::vector<JsonNode>* _nodes;
+      uint32_t _index;
+   };
+
+   static void readString(const JsonValue& object, const char* key, std::string& out)
+   {
+      const JsonValue value = object.member(key);
+      if (value.isString())
+      {
+         out = value.asString();
+      }
+   }
+
+   static void readInt(const JsonValue& object, const char* key, int& out)
+   {
+      const JsonValue value = object.member(key);
+      if (value.isNumber())
+      {
+         out = value.asInt();
+      }
+   }
+
+   static void readSize(const JsonValue& object, const char* key, size_t& out)
+   {
+      const JsonValue value = object.member(key);
+      if (value.isNumber())
+      {
+         out = (size_t)value.asDouble();
+      }
+   }
+
+   static void readDouble(const JsonValue& object, const char* key, double& out)
+   {
+      const JsonValue value = object.member(key);
+      if (value.isNumber())
+      {
+         out = value.asDouble();
+      }
+   }
+
+   static void readBool(const JsonValue& object, const char* key, bool& out)
+   {
+      const JsonValue value = object.member(key);
+      if (value.isBool())
+      {
+         out = value.asBool();
+      }
+   }
+
+   //! like tinygltf, the whole array is rejected if one element is not a number
+   static bool readDoubleArray(const JsonValue& array, std::vector<double>& out)
+   {
+      if (!array.isArray())
+      {
+         return false;
+      }
+      bool allNumbers = true;
+      array.forEachElement([&](const JsonValue& element) { allNumbers = allNumbers && element.isNumber(); });
+      if (!allNumbers)
+      {
+         return false;
+      }
+      out.clear();
+      out.reserve(array.size());
+      array.forEachElement([&](const JsonValue& element) { out.push_back(element.asDouble()); });
+      return true;
+   }
+
+   static void readIntArray(const JsonValue& array, std::vector<int>& out)
+   {
+      out.clear();
+      out.reserve(array.size());
+      array.forEachElement([&](const JsonValue& element)
+      {
+         if (element.isNumber())
+         {
+            out.push_back(element.asInt());
+         }
+      });
+   }
+
+   static void readAttributes(const JsonValue& object, std::map<std::string, int>& out)
+   {
+      object.forEachMember([&](const std::string& key, const JsonValue& value)
+      {
+         if (value.isNumber())
+         {
+            out[key] = value.asInt();
+         }
+      });
+   }
+
+   static tinygltf::Value toValue(const JsonValue& json)
+   {
+      switch (json.type())
+      {
+      case JT_TRUE:
+      case JT_FALSE:
+         return tinygltf::Value(json.asBool());
+      case JT_NUMBER:
+         return json.isInteger() ? tinygltf::Value(json.asInt()) : tinygltf::Value(json.asDouble());
+      case JT_STRING:
+         return tinygltf::Value(json.asString());
+      case JT_ARRAY:
+      {
+         tinygltf::Value::Array array;
+         array.reserve(json.size());
+         json.forEachElement([&](const JsonValue& element) { array.push_back(toValue(element)); });
+         return tinygltf::Value(std::move(array));
+      }
+      case JT_OBJECT:
+      {
+         tinygltf::Value::Object object;
+         json.forEachMember([&](const std::string& key, const JsonValue& value) { object[key] = toValue(value); });
+         return tinygltf::Value(std::move(object));
+      }
+      default:
+         return tinygltf::Value();
+      }
+   }
+
+   static void readExtensions(const JsonValue& object, tinygltf::ExtensionMap& out)
+   {
+      const JsonValue extensions = object.member("extensions");
+      extensions.forEachMember([&](const std::string& key, const JsonValue& value)
+      {
+         if (value.isObject())
+         {
+            out[key] = toValue(value);
+         }
+      });
+   }
+
+   static void readExtras(const JsonValue& object, tinygltf::Value& out)
+   {
+      const JsonValue extras = object.member("extras");
+      if (extras.valid())
+      {
+         out = toValue(extras);
+      }
+   }
+
+   //! same precedence as tinygltf's ParseParameterProperty
+   static bool readParameter(const JsonValue& value, tinygltf::Parameter& parameter)
+   {
+      if (value.isString())
+      {
+         parameter.string_value = value.asString();
+         return true;
+      }
+      if (readDoubleArray(value, parameter.number_array))
+      {
+         return true;
+      }
+      if (value.isNumber())
+      {
+         parameter.number_value = value.asDouble();
+         parameter.has_number_value = true;
+         return true;
+      }
+      if (value.isObject())
+      {
+         value.forEachMember([&](const std::string& key, const JsonValue& member)
+         {
+            if (member.isNumber())
+            {
+               parameter.json_double_value[key] = member.asDouble();
+            }
+         });
+         return true;
+      }
+      if (value.isBool())
+      {
+         parameter.bool_value = value.asBool();
+         return true;
+      }
+      return false;
+   }
+
+   static void readTextureInfo(const JsonValue& object, tinygltf::TextureInfo& info)
+   {
+      readInt(object, "index", info.index);
+      readInt(object, "texCoord", info.texCoord);
+      readExtensions(object, info.extensions);
+      readExtras(object, info.extras);
+   }
+
+   static void readMaterial(const JsonValue& object, tinygltf::Material& material)
+   {
+      readString(object, "name", material.name);
+      if (!readDoubleArray(object.member("emissiveFactor"), material.emissiveFactor))
+      {
+         material.emissiveFactor = { 0.0, 0.0, 0.0 };
+      }
+      readString(object, "alphaMode", material.alphaMode);
+      readDouble(object, "alphaCutoff", material.alphaCutoff);
+      readBool(object, "doubleSided", material.doubleSided);
+
+      const JsonValue pbr = object.member("pbrMetallicRoughness");
+      if (pbr.isObject())
+      {
+         tinygltf::PbrMetallicRoughness& target = material.pbrMetallicRoughness;
+         readDoubleArray(pbr.member("baseColorFactor"), target.baseColorFactor);
+         readTextureInfo(pbr.member("baseColorTexture"), target.baseColorTexture);
+         readDouble(pbr, "metallicFactor", target.metallicFactor);
+         readDouble(pbr, "roughnessFactor", target.roughnessFactor);
+         readTextureInfo(pbr.member("metallicRoughnessTexture"), target.metallicRoughnessTexture);
+         readExtensions(pbr, target.extensions);
+         readExtras(pbr, target.extras);
+      }
+
+      const JsonValue normal = object.member("normalTexture");
+      readInt(normal, "index", material.normalTexture.index);
+      readInt(normal, "texCoord", material.normalTexture.texCoord);
+      readDouble(normal, "scale", material.normalTexture.scale);
+      readExtensions(normal, material.normalTexture.extensions);
+      readExtras(normal, material.normalTexture.extras);
+
+      const JsonValue occlusion = object.member("occlusionTexture");
+      readInt(occlusion, "index", material.occlusionTexture.index);
+      readInt(occlusion, "texCoord", material.occlusionTexture.texCoord);
+      readDouble(occlusion, "strength", material.occlusionTexture.strength);
+      readExtensions(occlusion, material.occlusionTexture.extensions);
+      readExtras(occlusion, material.occlusionTexture.extras);
+
+      readTextureInfo(object.member("emissiveTexture"), material.emissiveTexture);
+
+      // the older parameter maps, the loader still reads those
+      object.forEachMember([&](const std::string& key, const JsonValue& value)
+      {
+         if (key == "pbrMetallicRoughness")
+         {
+            value.forEachMember([&](const std::string& pbrKey, const JsonValue& pbrValue)
+            {
+               tinygltf::Parameter parameter;
+               if (readParameter(pbrValue, parameter))
+               {
+                  material.values.emplace(pbrKey, std::move(parameter));
+               }
+            });
+         }
+         else if (key != "extensions" && key != "extras" && key != "name")
+         {
+            tinygltf::Parameter parameter;
+            if (readParameter(value, parameter))
+            {
+               material.additionalValues.emplace(key, std::move(parameter));
+            }
+         }
+      });
+
+      readExtensions(object, material.extensions);
+
+      readExtras(object, material.extras);
+   }
+
+   static void readNode(const JsonValue& object, tinygltf::Node& node)
+   {
+      readString(object, "name", node.name);
+      readInt(object, "camera", node.camera);
+      readInt(object, "skin", node.skin);
+      readInt(object, "mesh", node.mesh);
+      readIntArray(object.member("children"), node.children);
+      readDoubleArray(object.member("rotation"), node.rotation);
+      readDoubleArray(object.member("scale"), node.scale);
+      readDoubleArray(object.member("translation"), node.translation);
+      readDoubleArray(object.member("matrix"), node.matrix);
+      readDoubleArray(object.member("weights"), node.weights);
+      readExtensions(object, node.extensions);
+      readExtras(object, node.extras);
+   }
+
+   static void readMesh(const JsonValue& object, tinygltf::Mesh& mesh)
+   {
+      readString(object, "name", mesh.name);
+      readDoubleArray(object.member("weights"), mesh.weights);
+      object.member("primitives").forEachElement([&](const JsonValue& element)
+      {
+         tinygltf::Primitive primitive;
+         readAttributes(element.member("attributes"), primitive.attributes);
+         readInt(element, "material", primitive.material);
+         readInt(element, "indices", primitive.indices);
+         primitive.mode = TINYGLTF_MODE_TRIANGLES;
+         readInt(element, "mode", primitive.mode);
+         element.member("targets").forEachElement([&](const JsonValue& target)
+         {
+            primitive.targets.push_back(std::map<std::string, int>());
+            readAttributes(target, primitive.targets.back());
+         });
+         readExtensions(element, primitive.extensions);
+         readExtras(element, primitive.extras);
+         mesh.primitives.push_back(std::move(primitive));
+      });
+      readExtensions(object, mesh.extensions);
+      readExtras(object, mesh.extras);
+   }
+
+   static int accessorType(const std::string& type)
+   {
+      if (type == "SCALAR") return TINYGLTF_TYPE_SCALAR;
+      if (type == "VEC2") return TINYGLTF_TYPE_VEC2;
+      if (type == "VEC3") return TINYGLTF_TYPE_VEC3;
+      if (type == "VEC4") return TINYGLTF_TYPE_VEC4;
+      if (type == "MAT2") return TINYGLTF_TYPE_MAT2;
+      if (type == "MAT3") return TINYGLTF_TYPE_MAT3;
+      if (type == "MAT4") return TINYGLTF_TYPE_MAT4;
+      return -1;
+   }
+
+   static bool readAccessor(const JsonValue& object, tinygltf::Accessor& accessor, std::string* error)
+   {
+      if (object.member("sparse").valid())
+      {
+         if (error)
+         {
+            (*error) += "sparse accessors are not supported\n";
+         }
+         return false;
+      }
+      readString(object, "name", accessor.name);
+      readInt(object, "bufferView", accessor.bufferView);
+      readSize(object, "byteOffset", accessor.byteOffset);
+      readBool(object, "normalized", accessor.normalized);
+      readInt(object, "componentType", accessor.componentType);
+      readSize(object, "count", accessor.count);
+      std::string type;
+      readString(object, "type", type);
+      accessor.type = accessorType(type);
+      readDoubleArray(object.member("min"), accessor.minValues);
+      readDoubleArray(object.member("max"), accessor.maxValues);
+      readExtensions(object, accessor.extensions);
+      readExtras(object, accessor.extras);
+      return true;
+   }
+
+   static bool setBufferViewTarget(tinygltf::Model& model, int accessorIndex, int target, std::string* error)
+   {
+      if (accessorIndex < 0)
+      {
+         return true;
+      }
+      const int bufferView = (accessorIndex < (int)model.accessors.size()) ? model.accessors[accessorIndex].bufferView : -1;
+      if (bufferView < 0 || bufferView >= (int)model.bufferViews.size())
+      {
+         if (error)
+         {
+            (*error) += "accessor[" + std::to_string(accessorIndex) + "] invalid bufferView\n";
+         }
+         return false;
+      }
+      model.bufferViews[bufferView].target = target;
+      return true;
+   }
+
+   static void readBufferView(const JsonValue& object, tinygltf::BufferView& view)
+   {
+      readString(object, "name", view.name);
+      readInt(object, "buffer", view.buffer);
+      readSize(object, "byteOffset", view.byteOffset);
+      readSize(object, "byteLength", view.byteLength);
+      readSize(object, "byteStride", view.byteStride);
+      readInt(object, "target", view.target);
+      readExtensions(object, view.extensions);
+      readExtras(object, view.extras);
+   }
+
+   static void readSampler(const JsonValue& object, tinygltf::Sampler& sampler)
+   {
+      readString(object, "name", sampler.name);
+      readInt(object, "minFilter", sampler.minFilter);
+      readInt(object, "magFilter", sampler.magFilter);
+      readInt(object, "wrapS", sampler.wrapS);
+      readInt(object, "wrapT", sampler.wrapT);
+      readExtensions(object, sampler.extensions);
+      readExtras(object, sampler.extras);
+   }
+
+   static void readTexture(const JsonValue& object, tinygltf::Texture& texture)
+   {
+      readString(object, "name", texture.name);
+      texture.sampler = -1;
+      texture.source = -1;
+      readInt(object, "sampler", texture.sampler);
+      readInt(object, "source", texture.source);
+      readExtensions(object, texture.extensions);
+      readExtras(object, texture.extras);
+   }
+
+   static bool readLight(const JsonValue& object, tinygltf::Light& light, std::string* error)
+   {
+      readString(object, "type", light.type);
+      if (light.type == "spot")
+      {
+         const JsonValue spot = object.member("spot");
+         if (!spot.isObject())
+         {
+            if (error)
+            {
+               (*error) += "spot light description not found\n";
+            }
+            return false;
+         }
+         readDouble(spot, "innerConeAngle", light.spot.innerConeAngle);
+         readDouble(spot, "outerConeAngle", light.spot.outerConeAngle);
+      }
+      readString(object, "name", light.name);
+      readDoubleArray(object.member("color"), light.color);
+      readDouble(object, "range", light.range);
+      readDouble(object, "intensity", light.intensity);
+      readExtensions(object, light.extensions);
+      readExtras(object, light.extras);
+      return true;
+   }
+
+   static std::string urlDecode(const std::string& uri)
+   {
+      std::string out;
+      out.reserve(uri.size());
+      for (size_t i = 0; i < uri.size(); ++i)
+      {
+         if (uri[i] == '%' && i + 2 < uri.size())
+         {
+            out += (char)strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+         }
+         else
+         {
+            out += uri[i];
+         }
+      }
+      return out;
+   }
+
+   static bool readFile(const std::string& fileName, std::string& contents)
+   {
+      std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+      if (!file.is_open())
+      {
+         return false;
+      }
+      const std::streamoff size = file.tellg();
+      file.seekg(0, std::ios::beg);
+      contents.resize((size_t)size);
+      if (size > 0)
+      {
+         file.read(&contents[0], size);
+      }
+      return file.good() || file.eof();
+   }
+
+   static bool readFile(const std::string& fileName, std::vector<unsigned char>& contents)
+   {
+      std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+      if (!file.is_open())
+      {
+         return false;
+      }
+      const std::streamoff size = file.tellg();
+      file.seekg(0, std::ios::beg);
+      contents.resize((size_t)size);
+      if (size > 0)
+      {
+         file.read((char*)contents.data(), size);
+      }
+      return file.good() || file.eof();
+   }
+
+   //! data:[<mime type>][;base64],<data>
+   static bool decodeDataUri(const std::string& uri, std::vector<unsigned char>& out, std::string* mimeType)
+   {
+      const size_t comma = uri.find(',');
+      const size_t marker = uri.find(";base64,");
+      if (uri.compare(0, 5, "data:") != 0 || comma == std::string::npos || marker == std::string::npos || marker + 7 != comma)
+      {
+         return false;
+      }
+      if (mimeType)
+      {
+         *mimeType = uri.substr(5, marker - 5);
+      }
+      return base64::decode(uri.data() + comma + 1, uri.size() - comma - 1, out);
+   }
+
+   static std::string joinPath(const std::string& basePath, const std::string& uri)
+   {
+      return basePath.empty() ? uri : basePath + "/" + uri;
+   }
+
+   static bool readBuffer(const JsonValue& object, const std::string& basePath, tinygltf::Buffer& buffer, std::string* error)
+   {
+      readString(object, "name", buffer.name);
+      readExtensions(object, buffer.extensions);
+      readExtras(object, buffer.extras);
+
+      size_t byteLength = 0;
+      readSize(object, "byteLength", byteLength);
+
+      // the data uri is read straight off the tape, no copy of the text is made
+      const JsonValue uri = object.member("uri");
+      if (!uri.isString())
+      {
+         if (error)
+         {
+            (*error) += "buffer without uri (only .glb files may have one)\n";
+         }
+         return false;
+      }
+      const JsonNode& node = uri.node();
+      if (!node.escaped && node.length > 5 && memcmp(node.text, "data:", 5) == 0)
+      {
+         const char* comma = (const char*)memchr(node.text, ',', node.length);
+         if (comma == nullptr || !base64::decode(comma + 1, node.length - (uint32_t)(comma + 1 - node.text), buffer.data))
+         {
+            if (error)
+            {
+               (*error) += "could not decode the data uri of buffer " + buffer.name + "\n";
+            }
+            return false;
+         }
+      }
+      else
+      {
+         buffer.uri = uri.asString();
+         if (!readFile(joinPath(basePath, urlDecode(buffer.uri)), buffer.data))
+         {
+            if (error)
+            {
+               (*error) += "could not read buffer file: " + buffer.uri + "\n";
+            }
+            return false;
+         }
+      }
+
+      if (buffer.data.size() < byteLength)
+      {
+         if (error)
+         {
+            (*error) += "buffer " + buffer.uri + " is smaller than its byteLength\n";
+         }
+         return false;
+      }
+      buffer.data.resize(byteLength);
+      return true;
+   }
+
+   static bool readImage(const JsonValue& object, int imageIndex, const tinygltf::Model& model, const std::string& basePath
+      , GltfImageLoader imageLoader, void* imageLoaderUserData, tinygltf::Image& image, std::string* error, std::string* warning)
+   {
+      readString(object, "name", image.name);
+      readExtensions(object, image.extensions);
+      readExtras(object, image.extras);
+
+      std::vector<unsigned char> bytes;
+      const JsonValue bufferView = object.member("bufferView");
+      if (bufferView.isNumber())
+      {
+         image.bufferView = bufferView.asInt();
+         readString(object, "mimeType", image.mimeType);
+         readInt(object, "width", image.width);
+         readInt(object, "height", image.height);
+         if (image.bufferView < 0 || image.bufferView >= (int)model.bufferViews.size())
+         {
+            return false;
+         }
+         const tinygltf::BufferView& view = model.bufferViews[image.bufferView];
+         if (view.buffer < 0 || view.buffer >= (int)model.buffers.size())
+         {
+            return false;
+         }
+         const tinygltf::Buffer& buffer = model.buffers[view.buffer];
+         if (view.byteOffset + view.byteLength > buffer.data.size())
+         {
+            return false;
+         }
+         bytes.assign(buffer.data.begin() + view.byteOffset, buffer.data.begin() + view.byteOffset + view.byteLength);
+      }
+      else
+      {
+         const std::string uri = object.member("uri").asString();
+         if (uri.empty())
+         {
+            if (error)
+            {
+               (*error) += "image without uri or bufferView\n";
+            }
+            return false;
+         }
+         if (uri.compare(0, 5, "data:") == 0)
+         {
+            if (!decodeDataUri(uri, bytes, &image.mimeType))
+            {
+               if (error)
+               {
+                  (*error) += "could not decode the data uri of image " + image.name + "\n";
+               }
+               return false;
+            }
+         }
+         else
+         {
+            image.uri = uri;
+            if (!readFile(joinPath(basePath, urlDecode(uri)), bytes) || bytes.empty())
+            {
+               // tinygltf only warns about missing image files
+               if (warning)
+               {
+                  (*warning) += "could not read image file: " + uri + "\n";
+               }
+               return true;
+            }
+         }
+      }
+
+      if (bytes.empty())
+      {
+         return false;
+      }
+      return imageLoader(&image, imageIndex, error, warning, 0, 0, bytes.data(), (int)bytes.size(), imageLoaderUserData);
+   }
+
+   GltfJsonParser::GltfJsonParser()
+   {
+      // nothing to do
+   }
+
+   GltfJsonParser::~GltfJsonParser()
+   {
+      // nothing to do
+   }
+
+   bool GltfJsonParser::loadFromFile(tinygltf::Model* model, const std::string& fileName, GltfImageLoader imageLoader, void* imageLoaderUserData, std::string* error)
+   {
+      if (fileName.find(".glb") != std::string::npos)
+      {
+         if (error)
+         {
+            (*error) += "binary gltf is not supported\n";
+         }
+         return false;
+      }
+
+      std::string text;
+      if (!readFile(fileName, text))
+      {
+         if (error)
+         {
+            (*error) += "could not read file: " + fileName + "\n";
+         }
+         return false;
+      }
+
+      JsonTape tape;
+      if (!tape.parse(text.data(), text.size(), error))
+      {
+         return false;
+      }
+      const JsonValue root(&tape._nodes, 0);
+      if (!root.isObject())
+      {
+         if (error)
+         {
+            (*error) += "root is not an object\n";
+         }
+         return false;
+      }
+
+      const size_t slash = fileName.find_last_of("/\\");
+      const std::string basePath = (slash == std::string::npos) ? std::string() : fileName.substr(0, slash);
+
+      *model = tinygltf::Model();
+
+      const JsonValue asset = root.member("asset");
+      readString(asset, "version", model->asset.version);
+      readString(asset, "generator", model->asset.generator);
+      readString(asset, "minVersion", model->asset.minVersion);
+      readString(asset, "copyright", model->asset.copyright);
+
+      root.member("extensionsUsed").forEachElement([&](const JsonValue& element) { model->extensionsUsed.push_back(element.asString()); });
+      root.member("extensionsRequired").forEachElement([&](const JsonValue& element) { model->extensionsRequired.push_back(element.asString()); });
+
+      bool ok = true;
+
+      model->buffers.resize(root.member("buffers").size());
+      int index = 0;
+      root.member("buffers").forEachElement([&](const JsonValue& element)
+      {
+         ok = ok && readBuffer(element, basePath, model->buffers[index++], error);
+      });
+      if (!ok)
+      {
+         return false;
+      }
+
+      model->bufferViews.resize(root.member("bufferViews").size());
+      index = 0;
+      root.member("bufferViews").forEachElement([&](const JsonValue& element) { readBufferView(element, model->bufferViews[index++]); });
+
+      model->accessors.resize(root.member("accessors").size());
+      index = 0;
+      root.member("accessors").forEachElement([&](const JsonValue& element)
+      {
+         ok = ok && readAccessor(element, model->accessors[index++], error);
+      });
+      if (!ok)
+      {
+         return false;
+      }
+
+      model->meshes.resize(root.member("meshes").size());
+      index = 0;
+      root.member("meshes").forEachElement([&](const JsonValue& element) { readMesh(element, model->meshes[index++]); });
+
+      // like tinygltf, the views used by the primitives get their target filled in
+      for (const tinygltf::Mesh& mesh : model->meshes)
+      {
+         for (const tinygltf::Primitive& primitive : mesh.primitives)
+         {
+            ok = ok && setBufferViewTarget(*model, primitive.indices, TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER, error);
+            for (const auto& attribute : primitive.attributes)
+            {
+               ok = ok && setBufferViewTarget(*model, attribute.second, TINYGLTF_TARGET_ARRAY_BUFFER, error);
+            }
+            for (const auto& target : primitive.targets)
+            {
+               for (const auto& attribute : target)
+               {
+                  ok = ok && setBufferViewTarget(*model, attribute.second, TINYGLTF_TARGET_ARRAY_BUFFER, error);
+               }
+            }
+         }
+      }
+      if (!ok)
+      {
+         return false;
+      }
+
+      model->nodes.resize(root.member("nodes").size());
+      index = 0;
+      root.member("nodes").forEachElement([&](const JsonValue& element) { readNode(element, model->nodes[index++]); });
+
+      model->defaultScene = -1;
+      readInt(root, "scene", model->defaultScene);
+      model->scenes.resize(root.member("scenes").size());
+      index = 0;
+      root.member("scenes").forEachElement([&](const JsonValue& element)
+      {
+         tinygltf::Scene& scene = model->scenes[index++];
+         readString(element, "name", scene.name);
+         readIntArray(element.member("nodes"), scene.nodes);
+         readExtensions(element, scene.extensions);
+         readExtras(element, scene.extras);
+      });
+
+      model->materials.resize(root.member("materials").size());
+      index = 0;
+      root.member("materials").forEachElement([&](const JsonValue& element) { readMaterial(element, model->materials[index++]); });
+
+      model->samplers.resize(root.member("samplers").size());
+      index = 0;
+      root.member("samplers").forEachElement([&](const JsonValue& element) { readSampler(element, model->samplers[index++]); });
+
+      model->textures.resize(root.member("textures").size());
+      index = 0;
+      root.member("textures").forEachElement([&](const JsonValue& element) { readTexture(element, model->textures[index++]); });
+
+      readExtensions(root, model->extensions);
+      readExtras(root, model->extras);
+      const JsonValue lights = root.member("extensions").member("KHR_lights_punctual").member("lights");
+      model->lights.resize(lights.size());
+      index = 0;
+      lights.forEachElement([&](const JsonValue& element)
+      {
+         ok = ok && readLight(element, model->lights[index++], error);
+      });
+      if (!ok)
+      {
+         return false;
+      }
+
+      // images last, they can point into the buffers
+      std::string warning;
+      model->images.resize(root.member("images").size());
+      index = 0;
+      root.member("images").forEachElement([&](const JsonValue& element)
+      {
+         if (ok)
+         {
+            ok = readImage(element, index, *model, basePath, imageLoader, imageLoaderUserData, model->images[index], error, &warning);
+         }
+         ++index;
+      });
+      if (!warning.empty())
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << warning;
+      }
+      return ok;
+   }
+
+   static bool benchmarkImageLoader(tinygltf::Image*, const int, std::string*, std::string*, int, int, const unsigned char*, int, void*)
+   {
+      return true;
+   }
+
+   void GltfJsonParser::benchmark(const std::string& fileName, int numIterations)
+   {
+      typedef std::chrono::high_resolution_clock Clock;
+      numIterations = std::max(1, numIterations);
+
+      double tinyGltfMs = 0.0;
+      for (int i = 0; i < numIterations; ++i)
+      {
+         tinygltf::Model model;
+         tinygltf::TinyGLTF context;
+         context.SetImageLoader(benchmarkImageLoader, nullptr);
+         std::string error, warning;
+         const auto start = Clock::now();
+         const bool loaded = context.LoadASCIIFromFile(&model, &error, &warning, fileName);
+         tinyGltfMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+         if (!loaded)
+         {
+            std::cout << "Warning: " << __FUNCTION__ << ": " << "tinygltf could not load: " << fileName << std::endl;
+            return;
+         }
+      }
+
+      double fastMs = 0.0;
+      for (int i = 0; i < numIterations; ++i)
+      {
+         tinygltf::Model model;
+         GltfJsonParser parser;
+         std::string error;
+         const auto start = Clock::now();
+         const bool loaded = parser.loadFromFile(&model, fileName, benchmarkImageLoader, nullptr, &error);
+         fastMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+         if (!loaded)
+         {
+            std::cout << "Warning: " << __FUNCTION__ << ": " << "could not load: " << fileName << ": " << error << std::endl;
+            return;
+         }
+      }
+
+      tinyGltfMs /= numIterations;
+      fastMs /= numIterations;
+      std::cout << "gltf parsing: " << fileName << " (" << numIterations << " iterations)" << std::endl;
+      std::cout << "\t tinygltf:       " << tinyGltfMs << " ms" << std::endl;
+      std::cout << "\t GltfJsonParser: " << fastMs << " ms" << std::endl;
+      std::cout << "\t speedup:        " << (fastMs > 0.0 ? tinyGltfMs / fastMs : 0.0) << "x" << std::endl;
+   }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+namespace tinygltf
+{
+   class Model;
+   struct Image;
+}
+
+namespace genesis
+{
+   //! same signature as tinygltf::LoadImageDataFunction
+   typedef bool (*GltfImageLoader)(tinygltf::Image*, const int, std::string*, std::string*, int, int, const unsigned char*, int, void*);
+
+   //! fills a tinygltf::Model from a .gltf file without going through nlohmann::json.
+   //! the text is tokenized once into a flat tape (string bodies are scanned 16 bytes at a time),
+   //! numbers and strings are only converted when they are read, and base64 data uris
+   //! are decoded with the simd decoder.
+   //! covers what the loader needs: scenes, nodes, meshes, accessors, buffer views, buffers,
+   //! materials, textures, samplers, images and punctual lights. animations, skins and cameras
+   //! are not read, sparse accessors and .glb files are refused so the caller can fall back to tinygltf.
+   //! Buffer::uri is left empty for data uris, there is no point in keeping a copy of the text
+   class GltfJsonParser
+   {
+   public:
+      GltfJsonParser();
+      virtual ~GltfJsonParser();
+   public:
+      //! images are handed to imageLoader the same way tinygltf does it
+      virtual bool loadFromFile(tinygltf::Model* model, const std::string& fileName, GltfImageLoader imageLoader, void* imageLoaderUserData, std::string* error);
+
+      //! times tinygltf and this parser on the same file, images are read but not decoded
+      static void benchmark(const std::string& fileName, int numIterations);
+   };
+}
@@ -11,6 +11,7 @@
 #include "VulkanInitializers.h"
 #include "VulkanDebug.h"
 #include "ImageTransitions.h"
+#include "PixelConversion.h"
 
 #include "GenAssert.h"
 
@@ -23,7 +24,10 @@
 #include "tiffiop.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <fstream>
+#include <thread>
 
 namespace genesis
 {
@@ -55,9 +59,11 @@ namespace genesis
 	void Image::allocateImageAndMemory(VkImageUsageFlags usageFlags
 		, VkMemoryPropertyFlags memoryPropertyFlags
 		, VkImageTiling imageTiling
-		, int arrayLayers, int sampleCount, bool exportMemory)
+		, int arrayLayers, int sampleCount, bool exportMemory
+		, VkImageCreateFlags imageCreateFlags)
 	{
 		VkImageCreateInfo imageCreateInfo = vkInitializers::imageCreateInfo();
+		imageCreateInfo.flags = imageCreateFlags;
 		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
 		imageCreateInfo.format = _format;
 		imageCreateInfo.extent = { static_cast<uint32_t>(_width), static_cast<uint32_t>(_height), 1 };
@@ -104,28 +110,48 @@ namespace genesis
 		_allocationSize = memoryRequirements.size;
 	}
 
-	bool Image::copyFromRawDataIntoImage(void* pSrcData, VkDeviceSize pSrcDataSize, const std::vector<int>& mipMapDataOffsetsAllFaces, uint32_t numFaces)
+	VulkanBuffer* Image::createStagingBuffer(VkDeviceSize sizeInBytes)
 	{
 		VulkanBuffer* stagingBuffer = new VulkanBuffer(_device
 			, VK_BUFFER_USAGE_TRANSFER_SRC_BIT
 			, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-			, (int)pSrcDataSize);
-		uint8_t* pDstData = 0;
-		VK_CHECK_RESULT(vkMapMemory(_device->vulkanDevice(), stagingBuffer->_deviceMemory, 0, pSrcDataSize, 0, (void**)&pDstData));
-		memcpy(pDstData, pSrcData, pSrcDataSize);
-		vkUnmapMemory(_device->vulkanDevice(), stagingBuffer->_deviceMemory);
+			, sizeInBytes);
+		VK_CHECK_RESULT(stagingBuffer->map(sizeInBytes));
+		return stagingBuffer;
+	}
+
+	bool Image::copyFromRawDataIntoImage(void* pSrcData, VkDeviceSize pSrcDataSize, const std::vector<int>& mipMapDataOffsetsAllFaces, uint32_t numFaces)
+	{
+		VulkanBuffer* stagingBuffer = createStagingBuffer(pSrcDataSize);
+		memcpy(stagingBuffer->_mapped, pSrcData, pSrcDataSize);
+		return copyFromStagingBufferIntoImage(stagingBuffer, mipMapDataOffsetsAllFaces, numFaces);
+	}
+
+	bool Image::copyFromStagingBufferIntoImage(VulkanBuffer* stagingBuffer, const std::vector<int>& mipMapDataOffsetsAllFaces, uint32_t numFaces)
+	{
+		if (numFaces == 1 && copyFromStagingBufferIntoImageStreamed(stagingBuffer, mipMapDataOffsetsAllFaces))
+		{
+			return true;
+		}
+
+		stagingBuffer->unmap();
 
 		const bool generatingMipMaps = (mipMapDataOffsetsAllFaces.size() / numFaces != _numMipMapLevels);
+		_mipMapsPending = generatingMipMaps && _deferMipMapGeneration && numFaces == 1;
 
-		VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		if (generatingMipMaps)
+		// transfer source for blitting mips, and for texture streaming to copy levels out
+		VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		VkImageCreateFlags imageCreateFlags = 0;
+		if (_mipMapsPending)
 		{
-			imageUsageFlags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			// the generator writes through unorm views, srgb is converted in the shader
+			imageUsageFlags |= VK_IMAGE_USAGE_STORAGE_BIT;
+			imageCreateFlags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT;
 		}
 
 		allocateImageAndMemory(imageUsageFlags
 			, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT // on the gpu
-			, VK_IMAGE_TILING_OPTIMAL, numFaces, 1, false);
+			, VK_IMAGE_TILING_OPTIMAL, numFaces, 1, false, imageCreateFlags);
 
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
 
@@ -148,8 +174,9 @@ namespace genesis
 				bufferImageCopy.imageSubresource.layerCount = 1;
 
 				bufferImageCopy.imageOffset = { 0,0,0 };
-				bufferImageCopy.imageExtent.width = _width >> mipLevel;
-				bufferImageCopy.imageExtent.height = _height >> mipLevel;
+				// in texels, also for block compressed formats (the last block of a row may be partial)
+				bufferImageCopy.imageExtent.width = std::max(1, _width >> mipLevel);
+				bufferImageCopy.imageExtent.height = std::max(1, _height >> mipLevel);
 				bufferImageCopy.imageExtent.depth = 1;
 
 				bufferCopyRegions.push_back(bufferImageCopy);
@@ -173,7 +200,11 @@ namespace genesis
 		VkImageLayout newImageLayout = (generatingMipMaps) ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
 			: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		transitions::setImageLayout(commandBuffer, _image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, newImageLayout, subresourceRange);
+		// deferred mips: the generator takes it from here
+		if (_mipMapsPending == false)
+		{
+			transitions::setImageLayout(commandBuffer, _image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, newImageLayout, subresourceRange);
+		}
 
 		_device->flushCommandBuffer(commandBuffer);
 
@@ -184,29 +215,453 @@ namespace genesis
 		return true;
 	}
 
+	//! srgb twin of a unorm format, the format itself if there is none
+	static VkFormat toSrgb(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM: return VK_FORMAT_R8G8B8A8_SRGB;
+		case VK_FORMAT_B8G8R8A8_UNORM: return VK_FORMAT_B8G8R8A8_SRGB;
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK: return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+		case VK_FORMAT_BC2_UNORM_BLOCK: return VK_FORMAT_BC2_SRGB_BLOCK;
+		case VK_FORMAT_BC3_UNORM_BLOCK: return VK_FORMAT_BC3_SRGB_BLOCK;
+		case VK_FORMAT_BC7_UNORM_BLOCK: return VK_FORMAT_BC7_SRGB_BLOCK;
+		case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK: return VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK;
+		case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK: return VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK;
+		case VK_FORMAT_ASTC_4x4_UNORM_BLOCK: return VK_FORMAT_ASTC_4x4_SRGB_BLOCK;
+		default: return format;
+		}
+	}
+
 	VkFormat toVulkanFormat(uint32_t glInternalFormat, bool srgb)
 	{
-		// This is GL_RGBA8
-		if (glInternalFormat == 32856)
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		switch (glInternalFormat)
+		{
+		case 0x8058: format = VK_FORMAT_R8G8B8A8_UNORM; break; // GL_RGBA8
+		case 0x8C43: format = VK_FORMAT_R8G8B8A8_SRGB; break; // GL_SRGB8_ALPHA8
+		case 0x881A: format = VK_FORMAT_R16G16B16A16_SFLOAT; break; // GL_RGBA16F_ARB
+		case 0x8814: format = VK_FORMAT_R32G32B32A32_SFLOAT; break; // GL_RGBA32F_ARB
+		case 0x83F0: format = VK_FORMAT_BC1_RGB_UNORM_BLOCK; break; // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+		case 0x83F1: format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK; break; // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+		case 0x83F2: format = VK_FORMAT_BC2_UNORM_BLOCK; break; // GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+		case 0x83F3: format = VK_FORMAT_BC3_UNORM_BLOCK; break; // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+		case 0x8C4C: format = VK_FORMAT_BC1_RGB_SRGB_BLOCK; break; // GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+		case 0x8C4D: format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK; break; // GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+		case 0x8C4E: format = VK_FORMAT_BC2_SRGB_BLOCK; break; // GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT
+		case 0x8C4F: format = VK_FORMAT_BC3_SRGB_BLOCK; break; // GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+		case 0x8DBB: format = VK_FORMAT_BC4_UNORM_BLOCK; break; // GL_COMPRESSED_RED_RGTC1
+		case 0x8DBC: format = VK_FORMAT_BC4_SNORM_BLOCK; break; // GL_COMPRESSED_SIGNED_RED_RGTC1
+		case 0x8DBD: format = VK_FORMAT_BC5_UNORM_BLOCK; break; // GL_COMPRESSED_RG_RGTC2
+		case 0x8DBE: format = VK_FORMAT_BC5_SNORM_BLOCK; break; // GL_COMPRESSED_SIGNED_RG_RGTC2
+		case 0x8E8C: format = VK_FORMAT_BC7_UNORM_BLOCK; break; // GL_COMPRESSED_RGBA_BPTC_UNORM
+		case 0x8E8D: format = VK_FORMAT_BC7_SRGB_BLOCK; break; // GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+		case 0x8E8E: format = VK_FORMAT_BC6H_SFLOAT_BLOCK; break; // GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT
+		case 0x8E8F: format = VK_FORMAT_BC6H_UFLOAT_BLOCK; break; // GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT
+		case 0x9274: format = VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK; break; // GL_COMPRESSED_RGB8_ETC2
+		case 0x9275: format = VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK; break; // GL_COMPRESSED_SRGB8_ETC2
+		case 0x9278: format = VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK; break; // GL_COMPRESSED_RGBA8_ETC2_EAC
+		case 0x9279: format = VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK; break; // GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC
+		case 0x93B0: format = VK_FORMAT_ASTC_4x4_UNORM_BLOCK; break; // GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+		case 0x93D0: format = VK_FORMAT_ASTC_4x4_SRGB_BLOCK; break; // GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR
+		default: break;
+		}
+
+		if (format == VK_FORMAT_UNDEFINED)
+		{
+			std::cout << __FUNCTION__ << ": unknown format!" << std::endl;
+			return VK_FORMAT_UNDEFINED;
+		}
+
+		return srgb ? toSrgb(format) : format;
+	}
+
+	VkExtent2D Image::blockExtent(VkFormat format)
+	{
+		if (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK)
+		{
+			// all of BCn, ETC2 and EAC
+			return { 4, 4 };
+		}
+		if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK)
+		{
+			// unorm and srgb pairs, in this order
+			static const VkExtent2D s_astcExtents[] = {
+				{ 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 }
+				, { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 } };
+			return s_astcExtents[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+		}
+		return { 1, 1 };
+	}
+
+	bool Image::isBlockCompressed(VkFormat format)
+	{
+		const VkExtent2D extent = blockExtent(format);
+		return extent.width > 1 || extent.height > 1;
+	}
+
+	VkDeviceSize Image::blockSizeInBytes(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+			return 4;
+		case VK_FORMAT_R16G16B16A16_UNORM:
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC4_SNORM_BLOCK:
+			return 8;
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+		case VK_FORMAT_BC2_UNORM_BLOCK:
+		case VK_FORMAT_BC2_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+		case VK_FORMAT_BC5_SNORM_BLOCK:
+		case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+		case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	VkDeviceSize Image::levelSizeInBytes(VkFormat format, int width, int height)
+	{
+		const VkExtent2D extent = blockExtent(format);
+		const VkDeviceSize blocksX = (width + extent.width - 1) / extent.width;
+		const VkDeviceSize blocksY = (height + extent.height - 1) / extent.height;
+		return blocksX * blocksY * blockSizeInBytes(format);
+	}
+
+	static float halfToFloat(std::uint16_t half)
+	{
+		const std::uint32_t sign = (std::uint32_t)(half & 0x8000) << 16;
+		std::uint32_t exponent = (half >> 10) & 0x1F;
+		std::uint32_t mantissa = half & 0x3FF;
+		std::uint32_t bits;
+		if (exponent == 0x1F)
 		{
-			if (srgb)
+			bits = sign | 0x7F800000 | (mantissa << 13);
+		}
+		else if (exponent != 0)
+		{
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		else if (mantissa == 0)
+		{
+			bits = sign;
+		}
+		else
+		{
+			// denormal, normalize it
+			exponent = 113;
+			while ((mantissa & 0x400) == 0)
 			{
-				return VK_FORMAT_R8G8B8A8_SRGB;
+				mantissa <<= 1;
+				--exponent;
 			}
-			else
+			bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+		}
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	//! rounds to nearest, overflows to infinity and flushes what is too small for a denormal to zero
+	static std::uint16_t floatToHalf(float value)
+	{
+		std::uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		const std::uint16_t sign = (std::uint16_t)((bits >> 16) & 0x8000);
+		const int exponent = (int)((bits >> 23) & 0xFF) - 112;
+		const std::uint32_t mantissa = bits & 0x7FFFFF;
+		if (((bits >> 23) & 0xFF) == 0xFF)
+		{
+			return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+		}
+		if (exponent >= 0x1F)
+		{
+			return sign | 0x7C00;
+		}
+		if (exponent <= 0)
+		{
+			if (exponent < -10)
 			{
-				return VK_FORMAT_R8G8B8A8_UNORM;
+				return sign;
 			}
+			const std::uint32_t fullMantissa = mantissa | 0x800000;
+			const int shift = 14 - exponent;
+			return sign | (std::uint16_t)((fullMantissa + (1u << (shift - 1))) >> shift);
 		}
+		// a carry out of the mantissa correctly bumps the exponent
+		return sign | (std::uint16_t)(((exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+	}
 
-		// This is GL_RGBA16F_ARB
-		if (glInternalFormat == 34842)
+	struct SrgbToLinearTable
+	{
+		SrgbToLinearTable()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				const float c = i / 255.0f;
+				_values[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+		}
+		float _values[256];
+	};
+	static const SrgbToLinearTable s_srgbToLinear;
+
+	//! one 2x2 box filter step, in place: every destination texel is behind the source texels still to be read.
+	//! odd sides clamp, so that their last texel is averaged with itself
+	template <typename Load, typename Store>
+	static void halveInPlace(std::uint8_t* pixels, int width, int height, int texelSize, Load load, Store store)
+	{
+		const int newWidth = std::max(1, width / 2);
+		const int newHeight = std::max(1, height / 2);
+		for (int y = 0; y < newHeight; ++y)
 		{
-			return VK_FORMAT_R16G16B16A16_SFLOAT;
+			const std::uint8_t* row0 = pixels + (size_t)std::min(2 * y, height - 1) * width * texelSize;
+			const std::uint8_t* row1 = pixels + (size_t)std::min(2 * y + 1, height - 1) * width * texelSize;
+			for (int x = 0; x < newWidth; ++x)
+			{
+				const int x0 = std::min(2 * x, width - 1) * texelSize;
+				const int x1 = std::min(2 * x + 1, width - 1) * texelSize;
+				float sum[4];
+				for (int c = 0; c < 4; ++c)
+				{
+					sum[c] = load(row0 + x0, c) + load(row0 + x1, c) + load(row1 + x0, c) + load(row1 + x1, c);
+				}
+				std::uint8_t* dst = pixels + ((size_t)y * newWidth + x) * texelSize;
+				for (int c = 0; c < 4; ++c)
+				{
+					store(dst, c, sum[c] * 0.25f);
+				}
+			}
 		}
+	}
 
-		std::cout << __FUNCTION__ << ": unknown format!" << std::endl;
-		return VK_FORMAT_UNDEFINED;
+	//! the next mip level of rgba/bgra 8 bit (srgb ones averaged in linear space), rgba 16 bit unorm, 16 and 32 bit float pixels, in place.
+	//! false, with the pixels untouched, for the other formats
+	static bool halveLevelInPlace(std::uint8_t* bytes, VkFormat format, int width, int height)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+			halveInPlace(bytes, width, height, 4
+				, [](const std::uint8_t* texel, int c) { return (float)texel[c]; }
+				, [](std::uint8_t* texel, int c, float value) { texel[c] = (std::uint8_t)(value + 0.5f); });
+			break;
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+			halveInPlace(bytes, width, height, 4
+				, [](const std::uint8_t* texel, int c) { return (c == 3) ? texel[c] / 255.0f : s_srgbToLinear._values[texel[c]]; }
+				, [](std::uint8_t* texel, int c, float value)
+				{
+					if (c != 3)
+					{
+						value = (value <= 0.0031308f) ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+					}
+					texel[c] = (std::uint8_t)(std::min(1.0f, std::max(0.0f, value)) * 255.0f + 0.5f);
+				});
+			break;
+		case VK_FORMAT_R16G16B16A16_UNORM:
+			halveInPlace(bytes, width, height, 8
+				, [](const std::uint8_t* texel, int c) { return (float)((const std::uint16_t*)texel)[c]; }
+				, [](std::uint8_t* texel, int c, float value) { ((std::uint16_t*)texel)[c] = (std::uint16_t)(value + 0.5f); });
+			break;
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+			halveInPlace(bytes, width, height, 8
+				, [](const std::uint8_t* texel, int c) { return halfToFloat(((const std::uint16_t*)texel)[c]); }
+				, [](std::uint8_t* texel, int c, float value) { ((std::uint16_t*)texel)[c] = floatToHalf(value); });
+			break;
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			halveInPlace(bytes, width, height, 16
+				, [](const std::uint8_t* texel, int c) { return ((const float*)texel)[c]; }
+				, [](std::uint8_t* texel, int c, float value) { ((float*)texel)[c] = value; });
+			break;
+		default:
+			return false;
+		}
+		return true;
+	}
+
+	bool Image::downsampleToMaxSize(void* pixels, VkFormat format, int& width, int& height, int maxSize)
+	{
+		if (maxSize <= 0 || std::max(width, height) <= maxSize)
+		{
+			return false;
+		}
+
+		std::uint8_t* bytes = (std::uint8_t*)pixels;
+		while (std::max(width, height) > maxSize)
+		{
+			if (!halveLevelInPlace(bytes, format, width, height))
+			{
+				return false;
+			}
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		return true;
+	}
+
+	int Image::numLevelsToSkip(int width, int height, int numLevels) const
+	{
+		const int maxSize = _device->maxTextureSize();
+		int numLevelsToSkip = 0;
+		while (maxSize > 0 && numLevelsToSkip < numLevels - 1 && std::max(width >> numLevelsToSkip, height >> numLevelsToSkip) > maxSize)
+		{
+			++numLevelsToSkip;
+		}
+		return numLevelsToSkip;
+	}
+
+	void Image::capResolution(void* pixels, const std::string& fileName)
+	{
+		const int maxSize = _device->maxTextureSize();
+		if (maxSize <= 0 || std::max(_width, _height) <= maxSize)
+		{
+			return;
+		}
+		if (!downsampleToMaxSize(pixels, _format, _width, _height, maxSize))
+		{
+			std::cout << "Warning: " << __FUNCTION__ << ": " << "can not downsample this format, loaded at full size: " << fileName << std::endl;
+		}
+	}
+
+	int Image::numLevelsToStream(void) const
+	{
+		const int streamedSize = _device->streamedTextureSize();
+		int numLevelsToStream = 0;
+		while (streamedSize > 0 && numLevelsToStream < _numMipMapLevels - 1 && std::max(_width >> numLevelsToStream, _height >> numLevelsToStream) > streamedSize)
+		{
+			++numLevelsToStream;
+		}
+		return numLevelsToStream;
+	}
+
+	bool Image::copyFromStagingBufferIntoImageStreamed(VulkanBuffer* stagingBuffer, const std::vector<int>& mipMapDataOffsets)
+	{
+		const int firstLevel = numLevelsToStream();
+		if (firstLevel == 0 || blockSizeInBytes(_format) == 0)
+		{
+			return false;
+		}
+
+		std::vector<VkDeviceSize> levelOffsets(_numMipMapLevels + 1, 0);
+		for (int level = 0; level < _numMipMapLevels; ++level)
+		{
+			levelOffsets[level + 1] = levelOffsets[level] + levelSizeInBytes(_format, std::max(1, _width >> level), std::max(1, _height >> level));
+		}
+
+		// all the levels, tightly packed. the ones that come with the data are gathered, the others are generated
+		// on the cpu, the mip generators only work on the resident levels
+		std::vector<std::uint8_t> levels((size_t)levelOffsets[_numMipMapLevels]);
+		const std::uint8_t* src = (const std::uint8_t*)stagingBuffer->_mapped;
+		if (mipMapDataOffsets.size() == (size_t)_numMipMapLevels)
+		{
+			for (int level = 0; level < _numMipMapLevels; ++level)
+			{
+				memcpy(levels.data() + levelOffsets[level], src + mipMapDataOffsets[level], (size_t)(levelOffsets[level + 1] - levelOffsets[level]));
+			}
+		}
+		else if (mipMapDataOffsets.size() == 1 && isBlockCompressed() == false)
+		{
+			memcpy(levels.data(), src + mipMapDataOffsets[0], (size_t)levelOffsets[1]);
+			for (int level = 1; level < _numMipMapLevels; ++level)
+			{
+				const int width = std::max(1, _width >> (level - 1));
+				const int height = std::max(1, _height >> (level - 1));
+				std::uint8_t* dst = levels.data() + levelOffsets[level];
+				memcpy(dst, levels.data() + levelOffsets[level - 1], (size_t)(levelOffsets[level] - levelOffsets[level - 1]));
+				if (!halveLevelInPlace(dst, _format, width, height))
+				{
+					return false;
+				}
+			}
+		}
+		else
+		{
+			return false;
+		}
+
+		// the coarse levels are uploaded from a buffer of their own, the finer ones are kept for the TextureStreamer
+		delete stagingBuffer;
+		const VkDeviceSize residentSize = levelOffsets[_numMipMapLevels] - levelOffsets[firstLevel];
+		stagingBuffer = createStagingBuffer(residentSize);
+		memcpy(stagingBuffer->_mapped, levels.data() + levelOffsets[firstLevel], (size_t)residentSize);
+		stagingBuffer->unmap();
+
+		levels.resize((size_t)levelOffsets[firstLevel]);
+		levelOffsets.resize(firstLevel + 1);
+		_streamedLevelData.swap(levels);
+		_streamedLevelOffsets.swap(levelOffsets);
+
+		_firstResidentLevel = firstLevel;
+		_mipMapsPending = false;
+		_isCubeMap = false;
+		allocateImageAndMemoryFromLevel(firstLevel, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+		std::vector<VkBufferImageCopy> bufferCopyRegions;
+		VkDeviceSize bufferOffset = 0;
+		for (int level = firstLevel; level < _numMipMapLevels; ++level)
+		{
+			const int width = std::max(1, _width >> level);
+			const int height = std::max(1, _height >> level);
+
+			VkBufferImageCopy bufferImageCopy = {};
+			bufferImageCopy.bufferOffset = bufferOffset;
+			bufferImageCopy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)(level - firstLevel), 0, 1 };
+			bufferImageCopy.imageExtent = { (uint32_t)width, (uint32_t)height, 1 };
+			bufferCopyRegions.push_back(bufferImageCopy);
+
+			bufferOffset += levelSizeInBytes(_format, width, height);
+		}
+
+		VkCommandBuffer commandBuffer = _device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		const VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, (uint32_t)(_numMipMapLevels - firstLevel), 0, 1 };
+		transitions::setImageLayout(commandBuffer, _image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer->vulkanBuffer(), _image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)bufferCopyRegions.size(), bufferCopyRegions.data());
+		transitions::setImageLayout(commandBuffer, _image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+		_device->flushCommandBuffer(commandBuffer);
+
+		delete stagingBuffer;
+
+		return true;
+	}
+
+	void Image::allocateImageAndMemoryFromLevel(int firstLevel, VkImageUsageFlags usageFlags)
+	{
+		// allocateImageAndMemory works off the members, which describe the full chain
+		const int fullWidth = _width;
+		const int fullHeight = _height;
+		const int fullNumMipMapLevels = _numMipMapLevels;
+		_width = std::max(1, fullWidth >> firstLevel);
+		_height = std::max(1, fullHeight >> firstLevel);
+		_numMipMapLevels = fullNumMipMapLevels - firstLevel;
+		allocateImageAndMemory(usageFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_IMAGE_TILING_OPTIMAL, 1, 1, false);
+		_width = fullWidth;
+		_height = fullHeight;
+		_numMipMapLevels = fullNumMipMapLevels;
+	}
+
+	bool Image::isFormatSupported(VkFormat format) const
+	{
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(_device->physicalDevice()->vulkanPhysicalDevice(), format, &formatProperties);
+		return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
 	}
 
 	bool Image::s_FreeImageInitialized = false;
@@ -215,6 +670,91 @@ namespace genesis
 		std::cout << "error: " << message << std::endl;
 	}
 
+	//! one row of 1 to 4 channel pixels into 4 channels. gray is replicated to rgb,
+	//! a missing alpha is set to one (bytesPerSample bytes)
+	static void expandRowTo4Channels(const std::uint8_t* src, std::uint8_t* dst, int width, int numChannels, int bytesPerSample = 1, const std::uint8_t* one = nullptr)
+	{
+		static const std::uint8_t s_one8 = 255;
+		if (numChannels == 4)
+		{
+			memcpy(dst, src, width * 4 * bytesPerSample);
+			return;
+		}
+		if (numChannels == 3 && bytesPerSample == 1)
+		{
+			pixelconversion::expandRgbToRgba(src, dst, width);
+			return;
+		}
+
+		one = one ? one : &s_one8;
+
+		// source channel of each destination channel, -1 for one
+		static const int s_channels[4][4] = { { 0, 0, 0, -1 }, { 0, 0, 0, 1 }, { 0, 1, 2, -1 }, { 0, 1, 2, 3 } };
+		const int* channels = s_channels[numChannels - 1];
+		for (int x = 0; x < width; ++x)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				const std::uint8_t* value = (channels[c] < 0) ? one : src + (x * numChannels + channels[c]) * bytesPerSample;
+				memcpy(dst + (x * 4 + c) * bytesPerSample, value, bytesPerSample);
+			}
+		}
+	}
+
+	//! how a tiff is cut into separately compressed chunks (strips or tiles), and how its pixels
+	//! end up in the staging buffer
+	struct TiffLayout
+	{
+		int _width;
+		int _height;
+		int _samplesPerPixel;
+		int _bytesPerSample;
+		std::uint8_t _one[4];
+
+		bool _tiled;
+		int _chunkWidth;
+		int _chunkHeight;
+		int _chunksAcross;
+		std::uint32_t _numChunks;
+		tmsize_t _chunkSize;
+	};
+
+	//! decodes chunks [begin, end) into the staging buffer, flipped vertically
+	static bool decodeTiffChunks(TIFF* tif, const TiffLayout& layout, std::uint32_t begin, std::uint32_t end, std::uint8_t* dstPixels)
+	{
+		const tmsize_t srcRowSize = (tmsize_t)layout._chunkWidth * layout._samplesPerPixel * layout._bytesPerSample;
+		const tmsize_t dstPixelSize = 4 * layout._bytesPerSample;
+		const tmsize_t dstRowSize = (tmsize_t)layout._width * dstPixelSize;
+
+		bool ok = true;
+		tdata_t srcBuffer = _TIFFmalloc(layout._chunkSize);
+		for (std::uint32_t chunk = begin; chunk < end; ++chunk)
+		{
+			const int x0 = (int)(chunk % layout._chunksAcross) * layout._chunkWidth;
+			const int y0 = (int)(chunk / layout._chunksAcross) * layout._chunkHeight;
+			const int numColumns = std::min(layout._chunkWidth, layout._width - x0);
+			const int numRows = std::min(layout._chunkHeight, layout._height - y0);
+
+			// edge tiles are always full size, the last strip may be short
+			const tmsize_t decoded = layout._tiled ? TIFFReadEncodedTile(tif, chunk, srcBuffer, layout._chunkSize)
+				: TIFFReadEncodedStrip(tif, chunk, srcBuffer, numRows * srcRowSize);
+			if (decoded < 0)
+			{
+				ok = false;
+				continue;
+			}
+
+			for (int row = 0; row < numRows; ++row)
+			{
+				const std::uint8_t* src = (const std::uint8_t*)srcBuffer + row * srcRowSize;
+				std::uint8_t* dst = dstPixels + (layout._height - 1 - (y0 + row)) * dstRowSize + x0 * dstPixelSize;
+				expandRowTo4Channels(src, dst, numColumns, layout._samplesPerPixel, layout._bytesPerSample, layout._one);
+			}
+		}
+		_TIFFfree(srcBuffer);
+		return ok;
+	}
+
 	bool Image::copyFromFileIntoImageViaLibTiff(const std::string& fileName, bool srgb, uint32_t numFaces)
 	{
 		TIFF* tif = TIFFOpen(fileName.c_str(), "r");
@@ -224,79 +764,135 @@ namespace genesis
 			return false;
 		}
 
-		GEN_ASSERT(isTiled(tif) == false);
-
 		TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &_width);
 		TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &_height);
 
-		int tileWidth = 0;
-		int tileHeight = 0;
-		int compressionType = 0;
-		int planarConfig = 0;
-		int samplesPerPixel = 0;
-		TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tileWidth);
-		TIFFGetField(tif, TIFFTAG_TILELENGTH, &tileHeight);
-		TIFFGetField(tif, TIFFTAG_COMPRESSION, &compressionType);
+		std::uint16_t planarConfig = PLANARCONFIG_CONTIG;
+		std::uint16_t samplesPerPixel = 1;
+		std::uint16_t bps = 0;
+		std::uint16_t sampleFormat = SAMPLEFORMAT_UINT;
 		TIFFGetField(tif, TIFFTAG_PLANARCONFIG, &planarConfig);
 		TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
-
-		int bps = 0;
 		TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bps);
+		TIFFGetField(tif, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+
+		TiffLayout layout = {};
+		layout._width = _width;
+		layout._height = _height;
+		layout._samplesPerPixel = samplesPerPixel;
+		layout._bytesPerSample = bps / 8;
 
-		if (bps == 8)
+		_format = VK_FORMAT_UNDEFINED;
+		if (sampleFormat == SAMPLEFORMAT_UINT && bps == 8)
 		{
 			_format = VK_FORMAT_R8G8B8A8_UNORM;
+			layout._one[0] = 0xFF;
 		}
-		else
+		else if (sampleFormat == SAMPLEFORMAT_UINT && bps == 16)
 		{
-			std::cout << "could not load: " << fileName << std::endl;
+			_format = VK_FORMAT_R16G16B16A16_UNORM;
+			const std::uint16_t one = 0xFFFF;
+			memcpy(layout._one, &one, sizeof(one));
+		}
+		else if (sampleFormat == SAMPLEFORMAT_IEEEFP && bps == 16)
+		{
+			_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+			const std::uint16_t one = 0x3C00;
+			memcpy(layout._one, &one, sizeof(one));
+		}
+		else if (sampleFormat == SAMPLEFORMAT_IEEEFP && bps == 32)
+		{
+			_format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			const float one = 1.0f;
+			memcpy(layout._one, &one, sizeof(one));
+		}
+
+		// planar tiffs and the rest are left to FreeImage
+		if (_format == VK_FORMAT_UNDEFINED || samplesPerPixel < 1 || samplesPerPixel > 4 || planarConfig != PLANARCONFIG_CONTIG
+			|| !isFormatSupported(_format))
+		{
+			std::cout << __FUNCTION__ << ": unsupported layout: " << fileName << std::endl;
+			TIFFClose(tif);
 			return false;
 		}
 
+		layout._tiled = TIFFIsTiled(tif) != 0;
+		if (layout._tiled)
+		{
+			std::uint32_t tileWidth = 0;
+			std::uint32_t tileHeight = 0;
+			TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tileWidth);
+			TIFFGetField(tif, TIFFTAG_TILELENGTH, &tileHeight);
+			layout._chunkWidth = (int)tileWidth;
+			layout._chunkHeight = (int)tileHeight;
+			layout._chunksAcross = (_width + layout._chunkWidth - 1) / layout._chunkWidth;
+			layout._numChunks = TIFFNumberOfTiles(tif);
+			layout._chunkSize = TIFFTileSize(tif);
+		}
+		else
+		{
+			std::uint32_t rowsPerStrip = (std::uint32_t)_height;
+			TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+			layout._chunkWidth = _width;
+			layout._chunkHeight = (int)std::min(rowsPerStrip, (std::uint32_t)_height);
+			layout._chunksAcross = 1;
+			layout._numChunks = TIFFNumberOfStrips(tif);
+			layout._chunkSize = TIFFStripSize(tif);
+		}
+
 		_numMipMapLevels = 1;
 
-		std::vector<std::uint8_t> pixelData;
-		pixelData.resize(_width * _height * 4);
+		// chunks are decoded into a small buffer per worker and written flipped (and expanded to 4 channels)
+		// straight into the mapped staging buffer
+		VulkanBuffer* stagingBuffer = createStagingBuffer((VkDeviceSize)_width * _height * 4 * layout._bytesPerSample);
+		std::uint8_t* dstPixels = (std::uint8_t*)stagingBuffer->_mapped;
 
-		std::uint8_t* dstPointer = pixelData.data();
+		// libtiff handles can not be shared, every worker opens the file again
+		const std::uint32_t numThreads = std::min(layout._numChunks, std::max(1u, std::thread::hardware_concurrency()));
 
-		tmsize_t stripSize = TIFFStripSize(tif);
-		tdata_t srcBuffer = _TIFFmalloc(stripSize);
-		uint32_t numStrips = TIFFNumberOfStrips(tif);
-		int rowsPerStrip = (int)stripSize / (_width * 4);
-		for (tstrip_t currentStrip = 0; currentStrip < numStrips; currentStrip++)
+		bool ok = true;
+		if (numThreads <= 1)
 		{
-			TIFFReadEncodedStrip(tif, currentStrip, srcBuffer, (tsize_t)-1);
-
-			if (currentStrip == numStrips - 1)
+			ok = decodeTiffChunks(tif, layout, 0, layout._numChunks, dstPixels);
+		}
+		else
+		{
+			const std::uint32_t chunksPerThread = (layout._numChunks + numThreads - 1) / numThreads;
+			std::atomic<bool> allOk(true);
+			std::vector<std::thread> threads;
+			for (std::uint32_t begin = 0; begin < layout._numChunks; begin += chunksPerThread)
 			{
-				int rowsRemaining = _height - rowsPerStrip * currentStrip;
-				memcpy(dstPointer, srcBuffer, rowsRemaining*_width*4);
+				const std::uint32_t end = std::min(layout._numChunks, begin + chunksPerThread);
+				threads.push_back(std::thread([&, begin, end]()
+					{
+						TIFF* workerTif = TIFFOpen(fileName.c_str(), "r");
+						if (workerTif == nullptr || !decodeTiffChunks(workerTif, layout, begin, end, dstPixels))
+						{
+							allOk = false;
+						}
+						if (workerTif)
+						{
+							TIFFClose(workerTif);
+						}
+					}));
 			}
-			else
+			for (std::thread& thread : threads)
 			{
-				memcpy(dstPointer, srcBuffer, stripSize);
+				thread.join();
 			}
-			
-			dstPointer += stripSize;
+			ok = allOk;
 		}
-		_TIFFfree(srcBuffer);
 		TIFFClose(tif);
 
-		std::vector<std::uint8_t> flippedPixelData;
-		flippedPixelData.resize(pixelData.size());
-		for (size_t r = 0; r < _height; r++) {
-			auto src = &pixelData[r * 4 * _width];
-			auto dst = &flippedPixelData[(_height - r - 1) * 4 * _width];
-			std::copy(src, src + 4 * _width, dst);
+		if (!ok)
+		{
+			std::cout << __FUNCTION__ << ": could not decode all the " << (layout._tiled ? "tiles" : "strips") << ": " << fileName << std::endl;
 		}
 
-		pixelData.swap(flippedPixelData);
+		capResolution(stagingBuffer->_mapped, fileName);
 
 		std::vector<int> dataOffsets = { 0 };
-		copyFromRawDataIntoImage(pixelData.data(), pixelData.size(), dataOffsets, 1);
-
-		return true;
+		return copyFromStagingBufferIntoImage(stagingBuffer, dataOffsets, 1);
 	}
 
 
@@ -309,9 +905,10 @@ namespace genesis
 			s_FreeImageInitialized = true;
 		}
 
-		if (s_TifPreferLibTiff && fileName.find(".tif") != std::string::npos)
+		// tiled, 16 bit and float tiffs need libtiff. what it does not take falls through to FreeImage
+		if (s_TifPreferLibTiff && fileName.find(".tif") != std::string::npos && copyFromFileIntoImageViaLibTiff(fileName, srgb, numFaces))
 		{
-			return copyFromFileIntoImageViaLibTiff(fileName, srgb, numFaces);
+			return true;
 		}
 
 		FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(fileName.c_str());
@@ -336,6 +933,7 @@ namespace genesis
 		else
 		{
 			std::cout << "unknown format!!" << fileName << std::endl;
+			FreeImage_Unload(bitmap);
 			return false;
 		}
 
@@ -343,51 +941,26 @@ namespace genesis
 
 		const int imageNumChannels = bpp / 8;
 
-		int srcSize = _width * _height * imageNumChannels;
+		// the scan lines go straight into the mapped staging buffer, skipping the pitch padding
+		// and expanding to 4 channels on the way
+		VulkanBuffer* stagingBuffer = createStagingBuffer((VkDeviceSize)_width * _height * 4);
+		std::uint8_t* dstPixels = (std::uint8_t*)stagingBuffer->_mapped;
 
-		std::vector<std::uint8_t> pixelData;
-		pixelData.resize(srcSize);
-
-		std::uint32_t pitch = FreeImage_GetPitch(bitmap);
-		std::uint32_t line = FreeImage_GetLine(bitmap);
-
-		std::uint32_t rowSize = _width * imageNumChannels;
-		if (rowSize != pitch)
+		const std::uint32_t dstRowSize = _width * 4;
+		pixelconversion::forRowRanges(_height, dstRowSize, [&](int begin, int end)
 		{
-			std::uint8_t* dstPixels = pixelData.data();
-			for (int y = 0; y < _height; ++y)
+			for (int y = begin; y < end; ++y)
 			{
-				std::uint8_t* tmp = FreeImage_GetScanLine(bitmap, y);
-				memcpy(dstPixels, tmp, rowSize);
-				dstPixels += rowSize;
+				expandRowTo4Channels(FreeImage_GetScanLine(bitmap, y), dstPixels + y * dstRowSize, _width, imageNumChannels);
 			}
-		}
-		else
-		{
-			memcpy(pixelData.data(), FreeImage_GetBits(bitmap), pixelData.size());
-		}
+		});
 
-		if (imageNumChannels == 3)
-		{
-			std::vector<std::uint8_t> pixelData4Channels;
-			pixelData4Channels.resize(_width * _height * 4);
+		FreeImage_Unload(bitmap);
 
-			for (int i = 0; i < _width * _height; ++i)
-			{
-				pixelData4Channels[4 * i + 0] = pixelData[3 * i + 0];
-				pixelData4Channels[4 * i + 1] = pixelData[3 * i + 1];
-				pixelData4Channels[4 * i + 2] = pixelData[3 * i + 2];
-				pixelData4Channels[4 * i + 3] = 255;
-			}
-			pixelData.swap(pixelData4Channels);
-		}
+		capResolution(stagingBuffer->_mapped, fileName);
 
 		std::vector<int> dataOffsets = { 0 };
-		copyFromRawDataIntoImage(pixelData.data(), pixelData.size(), dataOffsets, 1);
-
-		FreeImage_Unload(bitmap);
-
-		return true;
+		return copyFromStagingBufferIntoImage(stagingBuffer, dataOffsets, 1);
 	}
 
 	bool Image::copyFromFileIntoImageKtx(const std::string& fileName, bool srgb, uint32_t numFaces)
@@ -414,11 +987,23 @@ namespace genesis
 		_width = ktxTexture->baseWidth;
 		_height = ktxTexture->baseHeight;
 		_format = toVulkanFormat(ktxTexture->glInternalformat, srgb);
+		if (_format == VK_FORMAT_UNDEFINED || !isFormatSupported(_format))
+		{
+			std::cout << __FUNCTION__ << ": format not supported by the device: " << fileName << std::endl;
+			ktxTexture_Destroy(ktxTexture);
+			return false;
+		}
+
+		// the levels above the size cap are not uploaded at all
+		const int firstLevel = numLevelsToSkip(_width, _height, _numMipMapLevels);
+		_width = std::max(1, _width >> firstLevel);
+		_height = std::max(1, _height >> firstLevel);
+		_numMipMapLevels -= firstLevel;
 
 		std::vector<int> dataOffsets;
 		for (uint32_t face = 0; face < numFaces; ++face)
 		{
-			for (uint32_t i = 0; i < (uint32_t)_numMipMapLevels; ++i)
+			for (uint32_t i = firstLevel; i < (uint32_t)(firstLevel + _numMipMapLevels); ++i)
 			{
 				ktx_size_t offset = 0;
 				KTX_error_code ret = ktxTexture_GetImageOffset(ktxTexture, i, 0, face, &offset);
@@ -436,17 +1021,288 @@ namespace genesis
 			std::cout << __FUNCTION__ << "numMipMapLevels != dataOffsets.size()/numFaces" << std::endl;
 		}
 
-		copyFromRawDataIntoImage(ktxTextureData, ktxTextureSize, dataOffsets, numFaces);
+		// the largest levels come first in ktx files, the skipped ones do not have to be staged
+		const int firstOffset = *std::min_element(dataOffsets.begin(), dataOffsets.end());
+		for (int& offset : dataOffsets)
+		{
+			offset -= firstOffset;
+		}
+		copyFromRawDataIntoImage(ktxTextureData + firstOffset, ktxTextureSize - firstOffset, dataOffsets, numFaces);
 
 		ktxTexture_Destroy(ktxTexture);
 
 		return true;
 	}
 
+	//! ktx2 file header, see the KTX 2.0 specification
+	struct Ktx2Header
+	{
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+
+	static const std::uint8_t s_ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	//! follows the header, one per mip level starting at the base level
+	struct Ktx2LevelIndex
+	{
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	bool Image::copyFromFileIntoImageKtx2(const std::string& fileName, bool srgb, uint32_t numFaces)
+	{
+		std::ifstream file(fileName.c_str(), std::ios::binary | std::ios::ate);
+		if (file.fail())
+		{
+			std::cout << "could not load: " << fileName << std::endl;
+			return false;
+		}
+		const std::streamoff fileSize = file.tellg();
+		file.seekg(0, std::ios::beg);
+		std::vector<std::uint8_t> fileData((size_t)fileSize);
+		file.read((char*)fileData.data(), fileSize);
+
+		Ktx2Header header;
+		if (fileData.size() < sizeof(header))
+		{
+			std::cout << __FUNCTION__ << ": file too small: " << fileName << std::endl;
+			return false;
+		}
+		memcpy(&header, fileData.data(), sizeof(header));
+		if (memcmp(header.identifier, s_ktx2Identifier, sizeof(s_ktx2Identifier)) != 0)
+		{
+			std::cout << __FUNCTION__ << ": not a ktx2 file: " << fileName << std::endl;
+			return false;
+		}
+
+		// basis universal payloads (etc1s with basislz, or uastc) have no vulkan format of their own, they would have
+		// to be transcoded to a format of the device first. that is not done here, the data is uploaded as it is
+		if (header.vkFormat == VK_FORMAT_UNDEFINED)
+		{
+			std::cout << __FUNCTION__ << ": basis universal ktx2 files are not supported, there is no transcoder: " << fileName << std::endl;
+			return false;
+		}
+		if (header.supercompressionScheme != 0)
+		{
+			std::cout << __FUNCTION__ << ": supercompressed ktx2 files (scheme " << header.supercompressionScheme << ") are not supported: " << fileName << std::endl;
+			return false;
+		}
+
+		if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != numFaces)
+		{
+			std::cout << __FUNCTION__ << ": only 2d textures and cube maps are supported: " << fileName << std::endl;
+			return false;
+		}
+
+		const uint32_t levelCount = std::max(1u, header.levelCount);
+		if (fileData.size() < sizeof(header) + levelCount * sizeof(Ktx2LevelIndex))
+		{
+			std::cout << __FUNCTION__ << ": file too small: " << fileName << std::endl;
+			return false;
+		}
+
+		_width = (int)header.pixelWidth;
+		_height = (int)header.pixelHeight;
+		_numMipMapLevels = (int)levelCount;
+		_format = srgb ? toSrgb((VkFormat)header.vkFormat) : (VkFormat)header.vkFormat;
+		if (!isFormatSupported(_format))
+		{
+			std::cout << __FUNCTION__ << ": format not supported by the device: " << fileName << std::endl;
+			return false;
+		}
+
+		// the levels above the size cap are not uploaded at all
+		const uint32_t firstLevel = (uint32_t)numLevelsToSkip(_width, _height, _numMipMapLevels);
+		_width = std::max(1, _width >> firstLevel);
+		_height = std::max(1, _height >> firstLevel);
+		_numMipMapLevels -= (int)firstLevel;
+		const uint32_t numLevels = levelCount - firstLevel;
+
+		// the faces of a level are stored one after the other
+		std::vector<int> dataOffsets(numLevels * numFaces);
+		for (uint32_t level = firstLevel; level < levelCount; ++level)
+		{
+			Ktx2LevelIndex levelIndex;
+			memcpy(&levelIndex, fileData.data() + sizeof(header) + level * sizeof(Ktx2LevelIndex), sizeof(levelIndex));
+			if (levelIndex.byteOffset + levelIndex.byteLength > fileData.size())
+			{
+				std::cout << __FUNCTION__ << ": level " << level << " is outside the file: " << fileName << std::endl;
+				return false;
+			}
+			const uint64_t faceSize = levelIndex.byteLength / numFaces;
+			for (uint32_t face = 0; face < numFaces; ++face)
+			{
+				dataOffsets[face * numLevels + level - firstLevel] = (int)(levelIndex.byteOffset + face * faceSize);
+			}
+		}
+
+		return copyFromRawDataIntoImage(fileData.data(), fileData.size(), dataOffsets, numFaces);
+	}
+
+	//! the basic data format descriptor block of the khronos data format specification, for the bc formats
+	static bool blockCompressedDfd(VkFormat format, std::vector<uint32_t>& dfd)
+	{
+		// channel ids of the samples, from khr_df.h
+		static const uint32_t s_colorChannel = 0;
+		static const uint32_t s_alphaPresentChannel = 1;
+		static const uint32_t s_redChannel = 0;
+		static const uint32_t s_greenChannel = 1;
+		static const uint32_t s_alphaChannel = 15;
+		static const uint32_t s_linearQualifier = 0x10;
+
+		struct Sample
+		{
+			uint32_t bitOffset;
+			uint32_t bitLength;
+			uint32_t channelType;
+		};
+		std::vector<Sample> samples;
+
+		const bool srgb = format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK
+			|| format == VK_FORMAT_BC2_SRGB_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK;
+
+		uint32_t colorModel = 0;
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+			colorModel = 128;
+			samples = { { 0, 64, s_colorChannel } };
+			break;
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+			colorModel = 128;
+			samples = { { 0, 64, s_alphaPresentChannel } };
+			break;
+		case VK_FORMAT_BC2_SRGB_BLOCK:
+		case VK_FORMAT_BC2_UNORM_BLOCK:
+			colorModel = 129;
+			samples = { { 0, 64, s_alphaChannel }, { 64, 64, s_colorChannel } };
+			break;
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+			colorModel = 130;
+			samples = { { 0, 64, s_alphaChannel }, { 64, 64, s_colorChannel } };
+			break;
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+			colorModel = 131;
+			samples = { { 0, 64, s_redChannel } };
+			break;
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+			colorModel = 132;
+			samples = { { 0, 64, s_redChannel }, { 64, 64, s_greenChannel } };
+			break;
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+			colorModel = 134;
+			samples = { { 0, 128, s_colorChannel } };
+			break;
+		default:
+			return false;
+		}
+
+		// bt709 primaries, the transfer function is srgb (2) or linear (1). alpha is always linear
+		const uint32_t descriptorBlockSize = 24 + 16 * (uint32_t)samples.size();
+		dfd.clear();
+		dfd.push_back(4 + descriptorBlockSize);
+		dfd.push_back(0);
+		dfd.push_back(2 | (descriptorBlockSize << 16));
+		dfd.push_back(colorModel | (1 << 8) | ((srgb ? 2u : 1u) << 16));
+		dfd.push_back(3 | (3 << 8));
+		dfd.push_back((uint32_t)Image::blockSizeInBytes(format));
+		dfd.push_back(0);
+		for (const Sample& sample : samples)
+		{
+			const uint32_t qualifiers = (srgb && sample.channelType == s_alphaChannel) ? s_linearQualifier : 0;
+			dfd.push_back(sample.bitOffset | ((sample.bitLength - 1) << 16) | ((sample.channelType | qualifiers) << 24));
+			dfd.push_back(0);
+			dfd.push_back(0);
+			dfd.push_back(0xFFFFFFFF);
+		}
+		return true;
+	}
+
+	bool Image::saveToKtx2(const std::string& fileName, VkFormat format, int width, int height, const void* data, size_t dataSize, const std::vector<int>& mipMapDataOffsets)
+	{
+		const uint32_t levelCount = (uint32_t)mipMapDataOffsets.size();
+
+		std::vector<uint32_t> dfd;
+		if (!blockCompressedDfd(format, dfd))
+		{
+			std::cout << __FUNCTION__ << ": no data format descriptor for format " << format << ": " << fileName << std::endl;
+			return false;
+		}
+
+		Ktx2Header header = {};
+		memcpy(header.identifier, s_ktx2Identifier, sizeof(s_ktx2Identifier));
+		header.vkFormat = (uint32_t)format;
+		header.typeSize = 1;
+		header.pixelWidth = (uint32_t)width;
+		header.pixelHeight = (uint32_t)height;
+		header.faceCount = 1;
+		header.levelCount = levelCount;
+
+		// the descriptor follows the level index
+		header.dfdByteOffset = (uint32_t)(sizeof(header) + levelCount * sizeof(Ktx2LevelIndex));
+		header.dfdByteLength = (uint32_t)(dfd.size() * sizeof(uint32_t));
+
+		// ktx2 stores the smallest level first, each level aligned to the block size (a multiple of 4 for the bc formats)
+		const size_t alignment = (size_t)blockSizeInBytes(format);
+		std::vector<Ktx2LevelIndex> levelIndices(levelCount);
+		size_t offset = header.dfdByteOffset + header.dfdByteLength;
+		for (int level = (int)levelCount - 1; level >= 0; --level)
+		{
+			const size_t levelEnd = (level + 1 < (int)levelCount) ? (size_t)mipMapDataOffsets[level + 1] : dataSize;
+			offset = (offset + alignment - 1) / alignment * alignment;
+			levelIndices[level].byteOffset = offset;
+			levelIndices[level].byteLength = levelEnd - mipMapDataOffsets[level];
+			levelIndices[level].uncompressedByteLength = levelIndices[level].byteLength;
+			offset += (size_t)levelIndices[level].byteLength;
+		}
+
+		std::vector<std::uint8_t> fileData(offset, 0);
+		memcpy(fileData.data(), &header, sizeof(header));
+		memcpy(fileData.data() + sizeof(header), levelIndices.data(), levelCount * sizeof(Ktx2LevelIndex));
+		memcpy(fileData.data() + header.dfdByteOffset, dfd.data(), header.dfdByteLength);
+		for (uint32_t level = 0; level < levelCount; ++level)
+		{
+			memcpy(fileData.data() + levelIndices[level].byteOffset, (const std::uint8_t*)data + mipMapDataOffsets[level], (size_t)levelIndices[level].byteLength);
+		}
+
+		std::ofstream file(fileName.c_str(), std::ios::binary);
+		if (file.fail())
+		{
+			std::cout << __FUNCTION__ << ": could not write: " << fileName << std::endl;
+			return false;
+		}
+		file.write((const char*)fileData.data(), fileData.size());
+		return file.good();
+	}
+
 	bool Image::copyFromFileIntoImage(const std::string& fileName, bool srgb, uint32_t numFaces)
 	{
 		bool ok = false;
-		if (fileName.find(".ktx") != std::string::npos)
+		if (fileName.find(".ktx2") != std::string::npos)
+		{
+			ok = copyFromFileIntoImageKtx2(fileName, srgb, numFaces);
+		}
+		else if (fileName.find(".ktx") != std::string::npos)
 		{
 			 ok = copyFromFileIntoImageKtx(fileName, srgb, numFaces);
 		}
@@ -538,13 +1394,25 @@ namespace genesis
 		_height = height;
 		_format = format;
 
+		if (isBlockCompressed(format))
+		{
+			if (!isFormatSupported(format))
+			{
+				std::cout << __FUNCTION__ << ": format not supported by the device" << std::endl;
+				return false;
+			}
+			// blits can not write block compressed formats, the mips have to come with the data
+			_numMipMapLevels = (int)mipMapDataOffsets.size();
+		}
+
 		bool ok = copyFromRawDataIntoImage(buffer, bufferSize, mipMapDataOffsets, 1);
 		if (!ok)
 		{
 			return false;
 		}
 
-		if (_numMipMapLevels != mipMapDataOffsets.size())
+		// streamed images come with all their levels
+		if (_numMipMapLevels != mipMapDataOffsets.size() && _mipMapsPending == false && _streamedLevelOffsets.empty())
 		{
 			std::cout << "_numMipMapLevels != mipMapDataOffsets.size(), will generate mip maps" << std::endl;
 			generateMipMaps();
@@ -593,6 +1461,96 @@ namespace genesis
 		return _isCubeMap;
 	}
 
+	bool Image::isBlockCompressed(void) const
+	{
+		return isBlockCompressed(_format);
+	}
+
+	void Image::setDeferMipMapGeneration(bool defer)
+	{
+		_deferMipMapGeneration = defer;
+	}
+
+	bool Image::mipMapsPending(void) const
+	{
+		return _mipMapsPending;
+	}
+
+	void Image::setMipMapsGenerated(void)
+	{
+		_mipMapsPending = false;
+	}
+
+	int Image::firstResidentLevel(void) const
+	{
+		return _firstResidentLevel;
+	}
+
+	const std::vector<std::uint8_t>& Image::streamedLevelData(void) const
+	{
+		return _streamedLevelData;
+	}
+
+	const std::vector<VkDeviceSize>& Image::streamedLevelOffsets(void) const
+	{
+		return _streamedLevelOffsets;
+	}
+
+	void Image::setFirstResidentLevel(int firstLevel, VkCommandBuffer commandBuffer, VkBuffer stagingBuffer, const std::vector<VkDeviceSize>& stagingOffsets
+		, VkImage& previousImage, VkDeviceMemory& previousDeviceMemory)
+	{
+		previousImage = _image;
+		previousDeviceMemory = _deviceMemory;
+
+		const int previousFirstLevel = _firstResidentLevel;
+		const int previousNumLevels = _numMipMapLevels - previousFirstLevel;
+
+		const int fullWidth = _width;
+		const int fullHeight = _height;
+		const int fullNumMipMapLevels = _numMipMapLevels;
+		allocateImageAndMemoryFromLevel(firstLevel, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		_firstResidentLevel = firstLevel;
+
+		const VkImageSubresourceRange previousRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, (uint32_t)previousNumLevels, 0, 1 };
+		const VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, (uint32_t)(fullNumMipMapLevels - firstLevel), 0, 1 };
+		transitions::setImageLayout(commandBuffer, previousImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, previousRange);
+		transitions::setImageLayout(commandBuffer, _image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, range);
+
+		std::vector<VkImageCopy> imageCopies;
+		std::vector<VkBufferImageCopy> bufferCopies;
+		for (int level = firstLevel; level < fullNumMipMapLevels; ++level)
+		{
+			const VkExtent3D extent = { (uint32_t)std::max(1, fullWidth >> level), (uint32_t)std::max(1, fullHeight >> level), 1 };
+			if (level >= previousFirstLevel)
+			{
+				VkImageCopy imageCopy = {};
+				imageCopy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)(level - previousFirstLevel), 0, 1 };
+				imageCopy.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)(level - firstLevel), 0, 1 };
+				imageCopy.extent = extent;
+				imageCopies.push_back(imageCopy);
+			}
+			else
+			{
+				VkBufferImageCopy bufferCopy = {};
+				bufferCopy.bufferOffset = stagingOffsets[level];
+				bufferCopy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)(level - firstLevel), 0, 1 };
+				bufferCopy.imageExtent = extent;
+				bufferCopies.push_back(bufferCopy);
+			}
+		}
+
+		if (imageCopies.empty() == false)
+		{
+			vkCmdCopyImage(commandBuffer, previousImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)imageCopies.size(), imageCopies.data());
+		}
+		if (bufferCopies.empty() == false)
+		{
+			vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, _image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)bufferCopies.size(), bufferCopies.data());
+		}
+
+		transitions::setImageLayout(commandBuffer, _image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range);
+	}
+
 	VkFormat Image::vulkanFormat(void) const
 	{
 		return _format;
@@ -7,12 +7,14 @@
 
 #include <vulkan/vulkan.h>
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 namespace genesis
 {
    class Device;
+   class VulkanBuffer;
 
    class Image
    {
@@ -40,6 +42,37 @@ namespace genesis
       virtual int height(void) const;
       virtual bool isCubeMap(void) const;
 
+      //! whether the format is one of the block compressed ones (BCn, ETC2, ASTC)
+      virtual bool isBlockCompressed(void) const;
+
+      //! loadFromBuffer leaves the mip levels to a MipMapGenerator instead of blitting them.
+      //! the image is then created with storage usage, and level 0 is left in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+      virtual void setDeferMipMapGeneration(bool defer);
+
+      //! whether the levels after the first one still have to be generated
+      virtual bool mipMapsPending(void) const;
+
+      //! called by the MipMapGenerator once all the levels are filled and in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+      virtual void setMipMapsGenerated(void);
+
+      //! texture streaming: the image only holds the levels from this one on.
+      //! width, height and numMipMapLevels stay those of the full chain
+      virtual int firstResidentLevel(void) const;
+
+      //! texture streaming: the levels finer than the ones made resident on load (see Device::setStreamedTextureSize),
+      //! kept in system memory. one after the other, tightly packed, the offsets end with the total size.
+      //! empty if the image was loaded whole
+      virtual const std::vector<std::uint8_t>& streamedLevelData(void) const;
+      virtual const std::vector<VkDeviceSize>& streamedLevelOffsets(void) const;
+
+      //! texture streaming: reallocates the image with only the levels from firstLevel on.
+      //! levels that stay resident are copied over, the others are uploaded from stagingBuffer
+      //! at stagingOffsets (one per level of the full chain). everything is recorded into commandBuffer,
+      //! which leaves the image in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL. the previous image and memory
+      //! are handed back, they have to be destroyed once the command buffer has executed
+      virtual void setFirstResidentLevel(int firstLevel, VkCommandBuffer commandBuffer, VkBuffer stagingBuffer, const std::vector<VkDeviceSize>& stagingOffsets
+         , VkImage& previousImage, VkDeviceMemory& previousDeviceMemory);
+
       //! get Vulkan internal
       virtual VkFormat vulkanFormat(void) const;
       virtual VkImage vulkanImage(void) const;
@@ -48,44 +81,103 @@ namespace genesis
    public:
       //! convert an integer sample count to the flag bits that is recognized by Vulkan
       static VkSampleCountFlagBits toSampleCountFlagBits(int sampleCount);
+
+      //! texel block size of a format: 1x1 for uncompressed ones
+      static VkExtent2D blockExtent(VkFormat format);
+      static bool isBlockCompressed(VkFormat format);
+
+      //! bytes per texel block (per texel for uncompressed formats), 0 for the formats that are not known here
+      static VkDeviceSize blockSizeInBytes(VkFormat format);
+
+      //! tightly packed size of one level, 0 for the formats that are not known here
+      static VkDeviceSize levelSizeInBytes(VkFormat format, int width, int height);
+
+      //! halves the pixels in place (2x2 box filter) until neither side is larger than maxSize.
+      //! rgba and bgra 8 bit (srgb ones averaged in linear space), rgba 16 bit unorm, 16 and 32 bit float.
+      //! false, with the pixels untouched, for the other formats
+      static bool downsampleToMaxSize(void* pixels, VkFormat format, int& width, int& height, int maxSize);
+
+      //! writes the mip levels of a 2d image into a ktx2 file that copyFromFileIntoImageKtx2 can read back.
+      //! bc1 to bc5 and bc7 only, the formats a basic data format descriptor is written for
+      static bool saveToKtx2(const std::string& fileName, VkFormat format, int width, int height, const void* data, size_t dataSize, const std::vector<int>& mipMapDataOffsets);
    protected:
       //! internal
       bool copyFromFileIntoImage(const std::string& fileName, bool srgb, uint32_t numFaces);
 
       bool copyFromFileIntoImageKtx(const std::string& fileName, bool srgb, uint32_t numFaces);
 
+      //! ktx2 files that are not supercompressed: the vulkan format is taken from the file and the levels are uploaded as they are.
+      //! basis universal files are refused, they need a transcoder
+      bool copyFromFileIntoImageKtx2(const std::string& fileName, bool srgb, uint32_t numFaces);
+
       bool copyFromFileIntoImageViaFreeImage(const std::string& fileName, bool srgb, uint32_t numFaces);
 
+      //! strips or tiles, decoded in parallel. 8 and 16 bit unsigned and 16 and 32 bit float samples, 1 to 4 per pixel
       bool copyFromFileIntoImageViaLibTiff(const std::string& fileName, bool srgb, uint32_t numFaces);
 
       //! internal
       virtual bool copyFromRawDataIntoImage(void* buffer, VkDeviceSize bufferSize, const std::vector<int>& mipMapDataOffsets, uint32_t numFaces);
 
+      //! host visible buffer, already mapped, for decoders to write into directly
+      virtual VulkanBuffer* createStagingBuffer(VkDeviceSize sizeInBytes);
+
+      //! uploads a buffer from createStagingBuffer and deletes it
+      virtual bool copyFromStagingBufferIntoImage(VulkanBuffer* stagingBuffer, const std::vector<int>& mipMapDataOffsets, uint32_t numFaces);
+
       //! internal
       virtual void allocateImageAndMemory(VkImageUsageFlags usageFlags
          , VkMemoryPropertyFlags memoryPropertyFlags
          , VkImageTiling imageTiling
-         , int arrayLayers, int sampleCount, bool exportMemory);
+         , int arrayLayers, int sampleCount, bool exportMemory
+         , VkImageCreateFlags imageCreateFlags = 0);
 
       //! internal
       virtual void generateMipMaps(void);
 
+      //! whether the device can sample the format with optimal tiling
+      virtual bool isFormatSupported(VkFormat format) const;
+
+      //! top levels of a file's mip chain to skip to stay within Device::maxTextureSize. the last level is always kept
+      virtual int numLevelsToSkip(int width, int height, int numLevels) const;
+
+      //! levels above Device::streamedTextureSize, which are not made resident on load. 0 if the image is not streamed
+      virtual int numLevelsToStream(void) const;
+
+      //! uploads only the levels from numLevelsToStream on and keeps the others in system memory. the levels that do not come
+      //! with the data are generated on the cpu. false, with nothing done, if the image can not be streamed
+      virtual bool copyFromStagingBufferIntoImageStreamed(VulkanBuffer* stagingBuffer, const std::vector<int>& mipMapDataOffsets);
+
+      //! an image with the levels from firstLevel on, in the format of this one
+      virtual void allocateImageAndMemoryFromLevel(int firstLevel, VkImageUsageFlags usageFlags);
+
+      //! applies Device::maxTextureSize to pixels that are about to be uploaded, updating _width and _height
+      virtual void capResolution(void* pixels, const std::string& fileName);
+
    protected:
       Device* _device;
 
       VkFormat _format;
 
-      VkImage _image;
-      VkDeviceMemory _deviceMemory;
+      VkImage _image = VK_NULL_HANDLE;
+      VkDeviceMemory _deviceMemory = VK_NULL_HANDLE;
 
       int _width;
       int _height;
       int _numMipMapLevels;
       bool _isCubeMap = false;
 
+      int _firstResidentLevel = 0;
+
+      //! see streamedLevelData
+      std::vector<std::uint8_t> _streamedLevelData;
+      std::vector<VkDeviceSize> _streamedLevelOffsets;
+
+      bool _deferMipMapGeneration = false;
+      bool _mipMapsPending = false;
+
       VkDeviceSize _allocationSize = 0;
 
       static bool s_FreeImageInitialized;
-      const bool s_TifPreferLibTiff = false;
+      const bool s_TifPreferLibTiff = true;
    };
 }
\ No newline at end of file
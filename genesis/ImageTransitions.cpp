@@ -69,6 +69,12 @@ namespace genesis
             // Make sure any shader reads from the image have been finished
             imageMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
             break;
+
+         case VK_IMAGE_LAYOUT_GENERAL:
+            // Image is a storage image
+            // Make sure any shader writes to the image have been finished
+            imageMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            break;
          default:
             // Other source layouts aren't handled (yet)
             break;
@@ -111,6 +117,11 @@ namespace genesis
             }
             imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
             break;
+
+         case VK_IMAGE_LAYOUT_GENERAL:
+            // Image will be read and written as a storage image
+            imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            break;
          default:
             // Other source layouts aren't handled (yet)
             break;
@@ -1,5 +1,6 @@
 #include "IndirectLayout.h"
 #include "Device.h"
+#include "PhysicalDevice.h"
 #include "VulkanInitializers.h"
 #include "VulkanGltf.h"
 #include "Texture.h"
@@ -14,6 +15,7 @@
 
 #include <deque>
 #include <utility>
+#include <algorithm>
 
 namespace genesis
 {
@@ -45,10 +47,33 @@ namespace genesis
       return buffer;
    }
 
+   void IndirectLayout::gatherUniqueTextures(const std::vector<const VulkanGltfModel*>& gltfModels)
+   {
+      for (const VulkanGltfModel* model : gltfModels)
+      {
+         for (Texture* texture : model->textures())
+         {
+            if (_mapTextureToUniqueIndex.insert({ texture, (int)_uniqueTextures.size() }).second)
+            {
+               _uniqueTextures.push_back(texture);
+            }
+         }
+      }
+   }
+
+   int IndirectLayout::uniqueTextureIndex(const VulkanGltfModel* model, int textureIndex) const
+   {
+      const auto& textures = model->textures();
+      if (textureIndex < 0 || textureIndex >= (int)textures.size())
+      {
+         return -1;
+      }
+      return _mapTextureToUniqueIndex.find(textures[textureIndex])->second;
+   }
+
    void IndirectLayout::createGpuSideBuffers(const std::vector<const VulkanGltfModel*>& gltfModels)
    {
       std::vector<ModelDesc> models;
-      int currentTextureOffset = 0;
       for (const VulkanGltfModel* model : gltfModels)
       {
          // clear it before the next model
@@ -57,15 +82,24 @@ namespace genesis
 
          fillIndexAndMaterialIndices(model);
 
-         const auto& materials = model->materials();
+         // the texture indices are rewritten to point straight into the (deduplicated) sampler array,
+         // models that share textures could not be given a contiguous range each
+         std::vector<Material> materials = model->materials();
+         for (Material& material : materials)
+         {
+            material.baseColorTextureIndex = uniqueTextureIndex(model, material.baseColorTextureIndex);
+            material.emissiveTextureIndex = uniqueTextureIndex(model, material.emissiveTextureIndex);
+            material.occlusionRoughnessMetalnessTextureIndex = uniqueTextureIndex(model, material.occlusionRoughnessMetalnessTextureIndex);
+            material.normalTextureIndex = uniqueTextureIndex(model, material.normalTextureIndex);
+            material.transmissionTextureIndex = uniqueTextureIndex(model, material.transmissionTextureIndex);
+         }
 
          Buffer* materialIndicesGpu = createFillAndPush(_scratchMaterialIndices, BT_SBO, "MaterialsIndicesGpu", _device, _buffersCreatedHere);
          Buffer* indexIndicesGpu = createFillAndPush(_scratchIndexIndices, BT_SBO, "IndexIndicesGpu", _device, _buffersCreatedHere);
          Buffer* materialsGpu = createFillAndPush(materials, BT_SBO, "MaterialsGpu", _device, _buffersCreatedHere);
 
          ModelDesc modelDesc;
-         modelDesc.textureOffset = currentTextureOffset;
-         currentTextureOffset += (int)model->textures().size();
+         modelDesc.textureOffset = 0;
          modelDesc.vertexBufferAddress = model->vertexBuffer()->bufferAddress();
          modelDesc.indexBufferAddress = model->indexBuffer()->bufferAddress();
          modelDesc.indexIndicesAddress = indexIndicesGpu->bufferAddress();
@@ -75,6 +109,32 @@ namespace genesis
          models.push_back(modelDesc);
       }
 
+      // coarser lods get a copy of each model desc pointing at the index offsets of that lod.
+      // the copy for a lod lives at lod*numModels + modelId, which is what Tlas puts
+      // in the instance custom index. materials are the same across lods
+      int numLods = 1;
+      for (const VulkanGltfModel* model : gltfModels)
+      {
+         numLods = std::max(numLods, model->numLods());
+      }
+      const size_t numModels = models.size();
+      for (int lod = 1; lod < numLods; ++lod)
+      {
+         for (size_t i = 0; i < numModels; ++i)
+         {
+            _scratchMaterialIndices.clear();
+            _scratchIndexIndices.clear();
+
+            fillIndexAndMaterialIndices(gltfModels[i], lod);
+
+            Buffer* indexIndicesGpu = createFillAndPush(_scratchIndexIndices, BT_SBO, "IndexIndicesGpu", _device, _buffersCreatedHere);
+
+            ModelDesc modelDesc = models[i];
+            modelDesc.indexIndicesAddress = indexIndicesGpu->bufferAddress();
+            models.push_back(modelDesc);
+         }
+      }
+
       _modelsGpu = createFillAndPush(models, BT_SBO, "ModelsGpu", _device, _buffersCreatedHere);
    }
 
@@ -87,15 +147,17 @@ namespace genesis
       _buffersCreatedHere.clear();
    }
 
+   void IndirectLayout::setImmutableSamplers(bool immutableSamplers)
+   {
+      _immutableSamplers = immutableSamplers;
+   }
+
    void IndirectLayout::build(const std::vector<const VulkanGltfModel*>& gltfModels)
    {
+      gatherUniqueTextures(gltfModels);
       createGpuSideBuffers(gltfModels);
 
-      int totalNumTextures = 0;
-      for (const VulkanGltfModel* model : gltfModels)
-      {
-         totalNumTextures += (int)model->textures().size();
-      }
+      const int totalNumTextures = (int)_uniqueTextures.size();
 
       setupDescriptorPool(totalNumTextures);
       setupDescriptorSetLayout(totalNumTextures);
@@ -122,7 +184,12 @@ namespace genesis
 
       VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo;
 
-      VkShaderStageFlags rayTracingFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR;
+      // without the ray tracing pipeline, the path tracer runs in a compute shader (softwareRaytrace.comp)
+      VkShaderStageFlags rayTracingFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      if (_device->physicalDevice()->extensionSupported(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME))
+      {
+         rayTracingFlags |= VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR;
+      }
       VkShaderStageFlags rasterizationFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
       // model buffer
@@ -132,6 +199,17 @@ namespace genesis
       // samplers
       setBindings.push_back(genesis::vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, rayTracingFlags | rasterizationFlags, bindingIndex++, totalNumTextures));
 
+      // one per texture, the sampler cache makes most of them the same handle
+      std::vector<VkSampler> immutableSamplers;
+      if (_immutableSamplers)
+      {
+         for (const Texture* texture : _uniqueTextures)
+         {
+            immutableSamplers.push_back(texture->vulkanSampler());
+         }
+         setBindings.back().pImmutableSamplers = immutableSamplers.data();
+      }
+
       descriptorSetLayoutCreateInfo = genesis::vkInitializers::descriptorSetLayoutCreateInfo(setBindings.data(), static_cast<uint32_t>(setBindings.size()));
 
       // additional flags to specify the last variable binding point
@@ -145,8 +223,8 @@ namespace genesis
       descriptorBindingFlags.push_back(0);
       // instances buffer
       descriptorBindingFlags.push_back(0);
-      // samplers
-      descriptorBindingFlags.push_back(VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+      // samplers. with immutable samplers the count is fixed by the layout
+      descriptorBindingFlags.push_back(_immutableSamplers ? VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT : (VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT));
 
       setLayoutBindingFlags.pBindingFlags = descriptorBindingFlags.data();
 
@@ -158,7 +236,7 @@ namespace genesis
 
    static void writeAndUpdateDescriptorSet(VkDescriptorSet dstSet
       , uint32_t binding
-      , const std::vector<const Texture*>& textures
+      , const std::vector<Texture*>& textures
       , VkDevice device)
    {
       VkWriteDescriptorSet writeDescriptorSet{};
@@ -183,17 +261,7 @@ namespace genesis
 
    void IndirectLayout::updateDescriptorSets(const std::vector<const VulkanGltfModel*>& gltfModels)
    {
-      std::vector<const Texture*> allTextures;
-      for (const VulkanGltfModel* model : gltfModels)
-      {
-         const auto& textures = model->textures();
-         for (const Texture* texture : textures)
-         {
-            allTextures.push_back(texture);
-         }
-      }
-
-      uint32_t variableDescCounts[] = { uint32_t(allTextures.size()) };
+      uint32_t variableDescCounts[] = { uint32_t(_uniqueTextures.size()) };
       VkDescriptorSetVariableDescriptorCountAllocateInfo variableDescriptorCountAllocInfo = {};
       variableDescriptorCountAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
       variableDescriptorCountAllocInfo.descriptorSetCount = 1;
@@ -212,11 +280,26 @@ namespace genesis
 
       vkUpdateDescriptorSets(_device->vulkanDevice(), (int)writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
 
-      writeAndUpdateDescriptorSet(descriptorSet, bindingIndex++, allTextures, _device->vulkanDevice());
+      writeAndUpdateDescriptorSet(descriptorSet, bindingIndex++, _uniqueTextures, _device->vulkanDevice());
 
       _vecDescriptorSets.push_back(descriptorSet);
    }
 
+   const std::vector<Texture*>& IndirectLayout::textures(void) const
+   {
+      return _uniqueTextures;
+   }
+
+   void IndirectLayout::updateTextureDescriptors(void) const
+   {
+      // the samplers come right after the model and instance buffers
+      const uint32_t samplersBinding = 2;
+      for (VkDescriptorSet descriptorSet : _vecDescriptorSets)
+      {
+         writeAndUpdateDescriptorSet(descriptorSet, samplersBinding, _uniqueTextures, _device->vulkanDevice());
+      }
+   }
+
    void IndirectLayout::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const
    {
       for (int i = 0; i < _flattenedModels.size(); ++i)
@@ -236,13 +319,13 @@ namespace genesis
       }
    }
 
-   void IndirectLayout::fillIndexAndMaterialIndices(const VulkanGltfModel* model)
+   void IndirectLayout::fillIndexAndMaterialIndices(const VulkanGltfModel* model, int lod)
    {
       model->forEachPrimitive(
          [&](const Primitive& primitive)
          {
             _scratchMaterialIndices.push_back(primitive.materialIndex);
-            _scratchIndexIndices.push_back(primitive.firstIndex);
+            _scratchIndexIndices.push_back(primitive.lodFirstIndex(lod));
          }
       );
    }
@@ -261,17 +344,45 @@ namespace genesis
    {
       _indirectBufferGpu = createFillAndPush(_indirectCommands, BT_INDIRECT_BUFFER, "IndirectBufferGpu", _device, _buffersCreatedHere);
       _flattenedInstancesGpu = createFillAndPush(_flattenedInstances, BT_SBO, "FlattenedInstances", _device, _buffersCreatedHere);
+
+      // the instances buffer is bound by the descriptor set, if build already made it
+      for (VkDescriptorSet descriptorSet : _vecDescriptorSets)
+      {
+         const uint32_t instancesBinding = 1;
+         VkWriteDescriptorSet writeDescriptorSet = vkInitializers::writeDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, instancesBinding, &_flattenedInstancesGpu->descriptor());
+         vkUpdateDescriptorSets(_device->vulkanDevice(), 1, &writeDescriptorSet, 0, nullptr);
+      }
+   }
+
+   void IndirectLayout::destroyGpuSideDrawBuffers()
+   {
+      for (Buffer* buffer : { _indirectBufferGpu, _flattenedInstancesGpu })
+      {
+         if (buffer == nullptr)
+         {
+            continue;
+         }
+         _buffersCreatedHere.erase(std::remove(_buffersCreatedHere.begin(), _buffersCreatedHere.end(), buffer), _buffersCreatedHere.end());
+         delete buffer;
+      }
+      _indirectBufferGpu = nullptr;
+      _flattenedInstancesGpu = nullptr;
+
+      _indirectCommands.clear();
+      _flattenedInstances.clear();
+      _flattenedModels.clear();
+      _modelDrawOffsetAndSize.clear();
    }
 
-   void IndirectLayout::fillIndirectCommands(const VulkanGltfModel* model, int firstInstance, int instanceCount)
+   void IndirectLayout::fillIndirectCommands(const VulkanGltfModel* model, int firstInstance, int instanceCount, int lod)
    {
       int numFilled = 0;
          model->forEachPrimitive([&](const Primitive& primitive)
          {
             VkDrawIndexedIndirectCommand command;
-            command.indexCount = primitive.indexCount;
+            command.indexCount = primitive.lodIndexCount(lod);
             command.instanceCount = instanceCount;
-            command.firstIndex = primitive.firstIndex;
+            command.firstIndex = primitive.lodFirstIndex(lod);
             command.vertexOffset = 0;
             command.firstInstance = firstInstance;
             _indirectCommands.push_back(command);
@@ -283,11 +394,27 @@ namespace genesis
          }
    }
 
-   void IndirectLayout::buildDrawBuffer(const ModelRegistry* modelRegistry, const InstanceContainer* instanceContainer)
+   bool IndirectLayout::buildDrawBuffer(const ModelRegistry* modelRegistry, const InstanceContainer* instanceContainer, const LodSelection& lodSelection)
    {
       const auto& mapModelIdsToInstances = instanceContainer->mapModelIdsToInstances();
       const auto& instances = instanceContainer->instances();
 
+      // instances added since the last build start at full detail
+      std::vector<int> instanceLods(instances.size(), 0);
+      for (size_t i = 0; i < instances.size(); ++i)
+      {
+         const ModelInfo* modelInfo = modelRegistry->findModel(instances[i]._modelId);
+         const int currentLod = (i < _instanceLods.size()) ? _instanceLods[i] : 0;
+         instanceLods[i] = (modelInfo) ? selectLod(modelInfo->model(), instances[i]._xform, lodSelection, currentLod) : 0;
+      }
+      if (_indirectBufferGpu != nullptr && instanceLods == _instanceLods)
+      {
+         return false;
+      }
+      _instanceLods.swap(instanceLods);
+
+      destroyGpuSideDrawBuffers();
+
       // Models have been registered in order with a running model id that's incremented
       // so, push them in order onto this vector
       int firstInstanceForThisModel = 0;
@@ -295,6 +422,7 @@ namespace genesis
       for (int i = 0; i < modelRegistry->numModels(); ++i)
       {
          const ModelInfo* modelInfo = modelRegistry->findModel(i);
+         const VulkanGltfModel* model = modelInfo->model();
 
          auto instanceIter = mapModelIdsToInstances.find(modelInfo->modelId());
          if (instanceIter == mapModelIdsToInstances.end())
@@ -303,24 +431,42 @@ namespace genesis
             continue;
          }
 
-         // Put the instances of this model in order
+         // Group the instances of this model by lod. Each group is drawn over all the
+         // primitives of the model, so gl_DrawID stays the index of the primitive
          const auto& setOfInstancesForThisModel = instanceIter->second;
-         for (int instanceIndex : setOfInstancesForThisModel)
+         std::vector< std::vector<uint32_t> > instancesPerLod(model->numLods());
+         for (uint32_t instanceIndex : setOfInstancesForThisModel)
          {
-            _flattenedInstances.push_back(instances[instanceIndex]);
+            instancesPerLod[_instanceLods[instanceIndex]].push_back(instanceIndex);
          }
 
-         fillIndirectCommands(modelInfo->model(), firstInstanceForThisModel, (uint32_t)setOfInstancesForThisModel.size());
+         for (int lod = 0; lod < (int)instancesPerLod.size(); ++lod)
+         {
+            const auto& instancesForThisLod = instancesPerLod[lod];
+            if (instancesForThisLod.empty())
+            {
+               continue;
+            }
+
+            // Put the instances of this model in order
+            for (uint32_t instanceIndex : instancesForThisLod)
+            {
+               _flattenedInstances.push_back(instances[instanceIndex]);
+            }
 
-         firstInstanceForThisModel += (int)setOfInstancesForThisModel.size();
+            fillIndirectCommands(model, firstInstanceForThisModel, (uint32_t)instancesForThisLod.size(), lod);
 
-         _flattenedModels.push_back(modelInfo->model());
+            firstInstanceForThisModel += (int)instancesForThisLod.size();
 
-         _modelDrawOffsetAndSize.push_back({ (int)(drawCommandOffset*sizeof(VkDrawIndexedIndirectCommand)), (int)modelInfo->model()->numPrimitives() });
+            _flattenedModels.push_back(model);
 
-         drawCommandOffset += modelInfo->model()->numPrimitives();
+            _modelDrawOffsetAndSize.push_back({ (int)(drawCommandOffset*sizeof(VkDrawIndexedIndirectCommand)), (int)model->numPrimitives() });
+
+            drawCommandOffset += model->numPrimitives();
+         }
       }
 
       createGpuSideDrawBuffers();
+      return true;
    }
 }
\ No newline at end of file
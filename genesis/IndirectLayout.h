@@ -6,8 +6,10 @@
 #include <vector>
 #include <functional>
 #include <tuple>
+#include <unordered_map>
 
 #include "InstanceContainer.h"
+#include "LodSelection.h"
 
 namespace genesis
 {
@@ -15,6 +17,7 @@ namespace genesis
    class VulkanGltfModel;
    class Buffer;
    class ModelRegistry;
+   class Texture;
 
    struct Node;
    struct Primitive;
@@ -25,11 +28,24 @@ namespace genesis
       IndirectLayout(Device* device);
       virtual ~IndirectLayout();
    public:
+      //! bake the texture samplers into the descriptor set layout. call before build
+      virtual void setImmutableSamplers(bool immutableSamplers);
+
       virtual void build(const std::vector<const VulkanGltfModel*>& models);
       virtual const std::vector<VkDescriptorSet>& descriptorSets(void) const;
       virtual VkDescriptorSetLayout vulkanDescriptorSetLayout(void) const;
+
+      //! what is in the bindless sampler array, in order. material texture indices point into it
+      virtual const std::vector<Texture*>& textures(void) const;
+
+      //! writes the sampler array again, for textures whose image view changed.
+      //! command buffers that bound the descriptor set have to be recorded again
+      virtual void updateTextureDescriptors(void) const;
       
-      virtual void buildDrawBuffer(const ModelRegistry* modelRegistry, const InstanceContainer* instanceContainer);
+      //! instances are drawn with the lod picked by lodSelection (full detail if not enabled), with the hysteresis
+      //! against the lods of the last build. the draw buffers of that build are replaced, so the gpu has to be done with them
+      //! and command buffers that drew them have to be recorded again. false, with nothing rebuilt, if no instance changed lod
+      virtual bool buildDrawBuffer(const ModelRegistry* modelRegistry, const InstanceContainer* instanceContainer, const LodSelection& lodSelection = LodSelection());
       virtual void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
 
    protected:
@@ -37,11 +53,16 @@ namespace genesis
       virtual void setupDescriptorSetLayout(int totalNumTextures);
       virtual void updateDescriptorSets(const std::vector<const VulkanGltfModel*>& models);
       virtual void createGpuSideBuffers(const std::vector<const VulkanGltfModel*>& models);
+      //! fills _uniqueTextures, a texture shared by several models gets one slot
+      virtual void gatherUniqueTextures(const std::vector<const VulkanGltfModel*>& models);
+      //! index into _uniqueTextures for a texture index of the model, -1 stays -1
+      virtual int uniqueTextureIndex(const VulkanGltfModel* model, int textureIndex) const;
       virtual void destroyGpuSideBuffers(void);
-      virtual void fillIndexAndMaterialIndices(const VulkanGltfModel* model);
+      virtual void fillIndexAndMaterialIndices(const VulkanGltfModel* model, int lod = 0);
 
-      virtual void fillIndirectCommands(const VulkanGltfModel* model, int firstInstance, int instanceCount);
+      virtual void fillIndirectCommands(const VulkanGltfModel* model, int firstInstance, int instanceCount, int lod = 0);
       virtual void createGpuSideDrawBuffers();
+      virtual void destroyGpuSideDrawBuffers();
    protected:
       Device* _device;
 
@@ -49,6 +70,12 @@ namespace genesis
       VkDescriptorSetLayout _descriptorSetLayout;
       std::vector<VkDescriptorSet> _vecDescriptorSets;
 
+      //! what goes into the bindless sampler array
+      std::vector<Texture*> _uniqueTextures;
+      std::unordered_map<const Texture*, int> _mapTextureToUniqueIndex;
+
+      bool _immutableSamplers = false;
+
       std::vector<std::uint32_t> _scratchIndexIndices;
 
       //! Nodes to be rendered, correspond to meshes.
@@ -71,12 +98,15 @@ namespace genesis
       //! same as above, but on the gpu
       Buffer* _flattenedInstancesGpu = nullptr;;
 
-      //! flattened list of models
+      //! flattened list of models, one entry per draw (a model is drawn once per lod in use)
       std::vector<const VulkanGltfModel*> _flattenedModels;
       Buffer* _modelsGpu = nullptr;
 
       //! for each model, offset into the _indirectBufferGpu (in bytes) where that model starts
       //! And the size (equal to the num of primitives in the model)
-      std::vector< std::tuple<int, int> > _modelDrawOffsetAndSize;      
+      std::vector< std::tuple<int, int> > _modelDrawOffsetAndSize;
+
+      //! of the last buildDrawBuffer, for each instance of the container
+      std::vector<int> _instanceLods;
    };
 }
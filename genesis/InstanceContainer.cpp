@@ -14,7 +14,7 @@ namespace genesis
       // nothing else to do
    }
 
-   uint32_t InstanceContainer::addInstance(int modelId, const glm::mat4& xform)
+   uint32_t InstanceContainer::addInstance(int modelId, const glm::mat4& xform, bool dynamic)
    {
       const uint32_t instanceId = _nextInstanceId++;
 
@@ -22,6 +22,8 @@ namespace genesis
       instance._modelId = modelId;
       instance._xform = xform;
       instance._instanceId = instanceId;
+      instance._dynamic = dynamic ? 1 : 0;
+      instance.pad1 = 0;
 
       _instances.push_back(instance);
 
@@ -36,6 +38,12 @@ namespace genesis
       return _instances;
    }
 
+   void InstanceContainer::setTransform(uint32_t instanceId, const glm::mat4& xform)
+   {
+      // ids are handed out in order, starting at 0
+      _instances[instanceId]._xform = xform;
+   }
+
    const std::unordered_map<uint32_t, std::unordered_set<uint32_t> >& InstanceContainer::mapModelIdsToInstances(void) const
    {
       return _mapModelIdToInstanceIds;
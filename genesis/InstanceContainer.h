@@ -19,7 +19,8 @@ namespace genesis
       glm::mat4 _xform;
       int _instanceId;
       int _modelId;
-      int pad0;
+      //! non zero if the instance is going to be moved, it is then never merged (see clusterInstances)
+      int _dynamic;
       int pad1;
    };
 
@@ -29,10 +30,13 @@ namespace genesis
       InstanceContainer(Device* device);
       virtual ~InstanceContainer();
    public:
-      virtual uint32_t addInstance(int modelId, const glm::mat4& xform);
+      //! dynamic: the instance is going to be moved with setTransform
+      virtual uint32_t addInstance(int modelId, const glm::mat4& xform, bool dynamic = false);
 
       virtual const std::vector<Instance>& instances(void) const;
 
+      virtual void setTransform(uint32_t instanceId, const glm::mat4& xform);
+
       virtual const std::unordered_map<uint32_t, std::unordered_set<uint32_t> >& mapModelIdsToInstances(void) const;
    protected:
       Device* _device;
@@ -0,0 +1,101 @@
+#include "InstanceMerging.h"
+#include "InstanceContainer.h"
+#include "ModelRegistry.h"
+#include "ModelInfo.h"
+#include "VulkanGltf.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace genesis
+{
+   std::vector<std::vector<size_t> > clusterInstances(const std::vector<Instance>& instances, const ModelRegistry* modelRegistry, const InstanceMerging& instanceMerging)
+   {
+      std::vector<std::vector<size_t> > clusters;
+      if (instanceMerging._enabled == false || instanceMerging._clusterSize <= 0.0f)
+      {
+         return clusters;
+      }
+
+      // grid cell to cluster, the clusters are in the order their first instance comes in
+      std::unordered_map<uint64_t, size_t> mapCellToCluster;
+      std::vector<std::vector<size_t> > cellInstances;
+
+      for (size_t i = 0; i < instances.size(); ++i)
+      {
+         // merged instances can not be moved
+         if (instances[i]._dynamic)
+         {
+            continue;
+         }
+         const ModelInfo* modelInfo = modelRegistry->findModel(instances[i]._modelId);
+         if (modelInfo == nullptr)
+         {
+            continue;
+         }
+         const VulkanGltfModel* model = modelInfo->model();
+         const Matrix4_32& xform = instances[i]._xform;
+
+         // as in selectLod
+         const Vector3_32 localCenter = (model->boundsMin() + model->boundsMax()) * 0.5f;
+         const Vector3_32 center = Vector3_32(xform * Vector4_32(localCenter, 1.0f));
+         const float scale = std::max(glm::length(Vector3_32(xform[0])), std::max(glm::length(Vector3_32(xform[1])), glm::length(Vector3_32(xform[2]))));
+         const float radius = 0.5f * glm::length(model->boundsMax() - model->boundsMin()) * scale;
+         if (radius >= instanceMerging._maxInstanceRadius)
+         {
+            continue;
+         }
+
+         // 21 bits per axis
+         const Vector3_32 cell = glm::floor(center / instanceMerging._clusterSize);
+         uint64_t key = 0;
+         for (int axis = 0; axis < 3; ++axis)
+         {
+            key = (key << 21) | (uint64_t((int64_t)cell[axis] + (1 << 20)) & 0x1fffff);
+         }
+
+         auto it = mapCellToCluster.find(key);
+         if (it == mapCellToCluster.end())
+         {
+            it = mapCellToCluster.insert({ key, cellInstances.size() }).first;
+            cellInstances.push_back(std::vector<size_t>());
+         }
+         cellInstances[it->second].push_back(i);
+      }
+
+      for (const std::vector<size_t>& cell : cellInstances)
+      {
+         std::vector<size_t> cluster;
+         int numTriangles = 0;
+         for (size_t instanceIndex : cell)
+         {
+            // full detail, whatever lod is picked has no more
+            int instanceTriangles = 0;
+            modelRegistry->findModel(instances[instanceIndex]._modelId)->model()->forEachPrimitive(
+               [&](const Primitive& primitive)
+               {
+                  instanceTriangles += primitive.lodIndexCount(0) / 3;
+               }
+            );
+            if (!cluster.empty() && numTriangles + instanceTriangles > instanceMerging._maxTrianglesPerCluster)
+            {
+               if ((int)cluster.size() >= instanceMerging._minInstancesPerCluster)
+               {
+                  clusters.push_back(cluster);
+               }
+               cluster.clear();
+               numTriangles = 0;
+            }
+            cluster.push_back(instanceIndex);
+            numTriangles += instanceTriangles;
+         }
+         if ((int)cluster.size() >= instanceMerging._minInstancesPerCluster)
+         {
+            clusters.push_back(cluster);
+         }
+      }
+
+      return clusters;
+   }
+}
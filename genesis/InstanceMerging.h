@@ -0,0 +1,35 @@
+#pragma once
+
+#include "GenMath.h"
+
+#include <vector>
+
+namespace genesis
+{
+   class Instance;
+   class ModelRegistry;
+
+   //! parameters for baking small static instances into shared blases (see Tlas::addMergedInstances).
+   //! the tlas then has one entry per cluster instead of one per instance
+   struct InstanceMerging
+   {
+   public:
+      bool _enabled = false;
+
+      //! instances whose bounding sphere has a smaller radius than this (in world units) can be merged
+      float _maxInstanceRadius = 1.0f;
+
+      //! clusters are the cells of a grid with this spacing (in world units)
+      float _clusterSize = 10.0f;
+
+      //! a cluster with more triangles than this is split
+      int _maxTrianglesPerCluster = 1 << 20;
+
+      //! clusters with fewer instances than this are left alone
+      int _minInstancesPerCluster = 4;
+   };
+
+   //! groups the small static instances by where they are. returns indices into instances,
+   //! the instances in none of the clusters are not to be merged
+   std::vector<std::vector<size_t> > clusterInstances(const std::vector<Instance>& instances, const ModelRegistry* modelRegistry, const InstanceMerging& instanceMerging);
+}
@@ -0,0 +1,68 @@
+#include "LodSelection.h"
+#include "VulkanGltf.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace genesis
+{
+   float LodSelection::projectionScale(const Matrix4_32& projectionMatrix, float viewportHeight)
+   {
+      // [1][1] is 1/tan(fovY/2), possibly negated for a flipped y
+      return std::fabs(projectionMatrix[1][1]) * 0.5f * viewportHeight;
+   }
+
+   static int selectLodWithThreshold(const VulkanGltfModel* model, const Matrix4_32& xform, const LodSelection& lodSelection, float pixelErrorThreshold)
+   {
+      if (lodSelection._enabled == false || model->numLods() <= 1)
+      {
+         return 0;
+      }
+
+      const Vector3_32 localCenter = (model->boundsMin() + model->boundsMax()) * 0.5f;
+      const Vector3_32 center = Vector3_32(xform * Vector4_32(localCenter, 1.0f));
+
+      // errors are in model units, so scale them by the largest axis scale of the instance
+      const float scale = std::max(glm::length(Vector3_32(xform[0])), std::max(glm::length(Vector3_32(xform[1])), glm::length(Vector3_32(xform[2]))));
+      const float radius = 0.5f * glm::length(model->boundsMax() - model->boundsMin()) * scale;
+
+      // distance to the bounding sphere, the eye inside it means full detail
+      const float distance = glm::length(lodSelection._eyePosition - center) - radius;
+      if (distance <= 0.0f)
+      {
+         return 0;
+      }
+
+      int lod = 0;
+      for (int i = 1; i < model->numLods(); ++i)
+      {
+         const float projectedError = model->lodError(i) * scale * lodSelection._projectionScale / distance;
+         if (projectedError > pixelErrorThreshold)
+         {
+            break;
+         }
+         lod = i;
+      }
+      return lod;
+   }
+
+   int selectLod(const VulkanGltfModel* model, const Matrix4_32& xform, const LodSelection& lodSelection)
+   {
+      return selectLodWithThreshold(model, xform, lodSelection, lodSelection._pixelErrorThreshold);
+   }
+
+   int selectLod(const VulkanGltfModel* model, const Matrix4_32& xform, const LodSelection& lodSelection, int currentLod)
+   {
+      if (lodSelection._hysteresis > 0.0f)
+      {
+         // a larger threshold allows coarser lods
+         const int finest = selectLodWithThreshold(model, xform, lodSelection, lodSelection._pixelErrorThreshold * (1.0f - lodSelection._hysteresis));
+         const int coarsest = selectLodWithThreshold(model, xform, lodSelection, lodSelection._pixelErrorThreshold * (1.0f + lodSelection._hysteresis));
+         if (currentLod >= finest && currentLod <= coarsest)
+         {
+            return currentLod;
+         }
+      }
+      return selectLod(model, xform, lodSelection);
+   }
+}
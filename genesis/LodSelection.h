@@ -0,0 +1,37 @@
+#pragma once
+
+#include "GenMath.h"
+
+namespace genesis
+{
+   class VulkanGltfModel;
+
+   //! parameters for picking a level of detail for an instance
+   //! from the projected size of the simplification error
+   struct LodSelection
+   {
+   public:
+      //! pixels covered by one unit at a distance of one unit
+      static float projectionScale(const Matrix4_32& projectionMatrix, float viewportHeight);
+   public:
+      bool _enabled = false;
+
+      Vector3_32 _eyePosition = Vector3_32(0.0f);
+
+      //! see projectionScale
+      float _projectionScale = 1.0f;
+
+      //! the coarsest lod whose error projects to fewer pixels than this is picked
+      float _pixelErrorThreshold = 1.0f;
+
+      //! when picking again, the current lod is kept as long as it would be picked with the threshold
+      //! anywhere within this fraction of it, so instances near a switch do not flip back and forth
+      float _hysteresis = 0.0f;
+   };
+
+   //! the lod to use for model, placed with xform
+   int selectLod(const VulkanGltfModel* model, const Matrix4_32& xform, const LodSelection& lodSelection);
+
+   //! same, for an instance that has currentLod so far (see LodSelection::_hysteresis)
+   int selectLod(const VulkanGltfModel* model, const Matrix4_32& xform, const LodSelection& lodSelection, int currentLod);
+}
@@ -0,0 +1,336 @@
+#include "MeshSimplifier.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace genesis
+{
+   //! symmetric 4x4 matrix: sum of the squared distances to a set of planes
+   struct Quadric
+   {
+      double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+      double a11 = 0, a12 = 0, a13 = 0;
+      double a22 = 0, a23 = 0;
+      double a33 = 0;
+
+      void addPlane(double a, double b, double c, double d)
+      {
+         a00 += a * a; a01 += a * b; a02 += a * c; a03 += a * d;
+         a11 += b * b; a12 += b * c; a13 += b * d;
+         a22 += c * c; a23 += c * d;
+         a33 += d * d;
+      }
+
+      void add(const Quadric& q)
+      {
+         a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+         a11 += q.a11; a12 += q.a12; a13 += q.a13;
+         a22 += q.a22; a23 += q.a23;
+         a33 += q.a33;
+      }
+
+      double evaluate(const Vector3_32& p) const
+      {
+         const double x = p.x, y = p.y, z = p.z;
+         return a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+            + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+            + a22 * z * z + 2 * a23 * z
+            + a33;
+      }
+   };
+
+   struct Collapse
+   {
+      double cost;
+      uint32_t from;
+      uint32_t to;
+   };
+
+   //! bit exact position key, -0 and +0 are folded together
+   struct PositionKey
+   {
+      uint32_t bits[3];
+
+      bool operator==(const PositionKey& rhs) const
+      {
+         return bits[0] == rhs.bits[0] && bits[1] == rhs.bits[1] && bits[2] == rhs.bits[2];
+      }
+   };
+
+   struct PositionKeyHash
+   {
+      size_t operator()(const PositionKey& key) const
+      {
+         return (key.bits[0] * 73856093u) ^ (key.bits[1] * 19349663u) ^ (key.bits[2] * 83492791u);
+      }
+   };
+
+   static PositionKey makePositionKey(const Vector3_32& p)
+   {
+      PositionKey key;
+      const float components[3] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f };
+      memcpy(key.bits, components, sizeof(key.bits));
+      return key;
+   }
+
+   static uint64_t edgeKey(uint32_t a, uint32_t b)
+   {
+      if (a > b)
+      {
+         std::swap(a, b);
+      }
+      return (uint64_t(a) << 32) | b;
+   }
+
+   MeshSimplifier::MeshSimplifier(const std::vector<Vertex>& vertices)
+      : _vertices(vertices)
+   {
+      // nothing else to do
+   }
+
+   MeshSimplifier::~MeshSimplifier()
+   {
+      // nothing to do
+   }
+
+   float MeshSimplifier::simplify(const uint32_t* indices, size_t indexCount, size_t targetIndexCount, float maxError, std::vector<uint32_t>& result) const
+   {
+      result.clear();
+
+      const size_t numTriangles = indexCount / 3;
+
+      // work on compact local vertex ids of the vertices this list uses
+      std::unordered_map<uint32_t, uint32_t> globalToLocal;
+      std::vector<uint32_t> localToGlobal;
+      std::vector<uint32_t> triangles(numTriangles * 3);
+      for (size_t i = 0; i < triangles.size(); ++i)
+      {
+         auto inserted = globalToLocal.insert({ indices[i], (uint32_t)localToGlobal.size() });
+         if (inserted.second)
+         {
+            localToGlobal.push_back(indices[i]);
+         }
+         triangles[i] = inserted.first->second;
+      }
+      const uint32_t numLocal = (uint32_t)localToGlobal.size();
+
+      std::vector<Vector3_32> positions(numLocal);
+      for (uint32_t v = 0; v < numLocal; ++v)
+      {
+         positions[v] = _vertices[localToGlobal[v]].position;
+      }
+
+      // vertices that share a position but differ in the other attributes are wedges of a seam.
+      // canonical is the first wedge at each position
+      std::unordered_map<PositionKey, uint32_t, PositionKeyHash> positionToCanonical;
+      std::vector<uint32_t> canonical(numLocal);
+      std::vector<uint32_t> wedgeCount(numLocal, 0);
+      for (uint32_t v = 0; v < numLocal; ++v)
+      {
+         auto inserted = positionToCanonical.insert({ makePositionKey(positions[v]), v });
+         canonical[v] = inserted.first->second;
+         ++wedgeCount[canonical[v]];
+      }
+
+      // edges used by just one triangle are on an open border, edges used
+      // by more than two are non manifold: the end points of both stay put
+      std::unordered_map<uint64_t, uint32_t> edgeUse;
+      for (size_t t = 0; t < numTriangles; ++t)
+      {
+         for (int e = 0; e < 3; ++e)
+         {
+            const uint32_t a = canonical[triangles[t * 3 + e]];
+            const uint32_t b = canonical[triangles[t * 3 + (e + 1) % 3]];
+            ++edgeUse[edgeKey(a, b)];
+         }
+      }
+      std::vector<bool> borderLocked(numLocal, false);
+      for (const auto& keyVal : edgeUse)
+      {
+         if (keyVal.second != 2)
+         {
+            borderLocked[(uint32_t)(keyVal.first >> 32)] = true;
+            borderLocked[(uint32_t)(keyVal.first & 0xffffffff)] = true;
+         }
+      }
+      std::vector<bool> locked(numLocal, false);
+      for (uint32_t v = 0; v < numLocal; ++v)
+      {
+         locked[v] = borderLocked[canonical[v]] || wedgeCount[canonical[v]] > 1;
+      }
+
+      std::vector<Quadric> quadrics(numLocal);
+      for (size_t t = 0; t < numTriangles; ++t)
+      {
+         const Vector3_32& p0 = positions[triangles[t * 3 + 0]];
+         const Vector3_32& p1 = positions[triangles[t * 3 + 1]];
+         const Vector3_32& p2 = positions[triangles[t * 3 + 2]];
+         Vector3_32 n = glm::cross(p1 - p0, p2 - p0);
+         const float length = glm::length(n);
+         if (length == 0.0f)
+         {
+            continue;
+         }
+         n /= length;
+         const float d = -glm::dot(n, p0);
+         for (int c = 0; c < 3; ++c)
+         {
+            quadrics[canonical[triangles[t * 3 + c]]].addPlane(n.x, n.y, n.z, d);
+         }
+      }
+
+      const size_t targetTriangles = targetIndexCount / 3;
+      const double maxCost = double(maxError) * double(maxError);
+      double resultCost = 0.0;
+
+      std::vector<uint32_t> remap(numLocal);
+      std::vector<uint32_t> adjacencyOffsets(numLocal + 1);
+      std::vector<uint32_t> adjacency;
+      std::vector<Collapse> collapses;
+      std::vector<bool> touched(numLocal);
+
+      while (triangles.size() / 3 > targetTriangles)
+      {
+         const size_t liveTriangles = triangles.size() / 3;
+
+         // vertex to triangle adjacency
+         std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+         for (uint32_t v : triangles)
+         {
+            ++adjacencyOffsets[v + 1];
+         }
+         for (uint32_t v = 0; v < numLocal; ++v)
+         {
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+         }
+         adjacency.resize(triangles.size());
+         std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+         for (size_t i = 0; i < triangles.size(); ++i)
+         {
+            adjacency[cursor[triangles[i]]++] = (uint32_t)(i / 3);
+         }
+
+         // only collapse unlocked vertices onto vertices that are not on a seam,
+         // so that every triangle around 'from' can simply be re-pointed to 'to'
+         collapses.clear();
+         for (size_t i = 0; i < triangles.size(); ++i)
+         {
+            const uint32_t a = triangles[i];
+            const uint32_t b = triangles[(i % 3 == 2) ? i - 2 : i + 1];
+            const uint32_t directions[2][2] = { { a, b }, { b, a } };
+            for (const auto& direction : directions)
+            {
+               const uint32_t from = direction[0];
+               const uint32_t to = direction[1];
+               if (locked[from] || wedgeCount[canonical[to]] > 1)
+               {
+                  continue;
+               }
+               Quadric q = quadrics[canonical[from]];
+               q.add(quadrics[canonical[to]]);
+               const double cost = std::max(0.0, q.evaluate(positions[to]));
+               if (cost <= maxCost)
+               {
+                  collapses.push_back({ cost, from, to });
+               }
+            }
+         }
+         if (collapses.empty())
+         {
+            break;
+         }
+         std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; });
+
+         for (uint32_t v = 0; v < numLocal; ++v)
+         {
+            remap[v] = v;
+         }
+         std::fill(touched.begin(), touched.end(), false);
+
+         // collapses within a pass never share a neighbourhood
+         const size_t trianglesToRemove = liveTriangles - targetTriangles;
+         size_t trianglesRemoved = 0;
+         size_t numCollapsed = 0;
+         for (const Collapse& collapse : collapses)
+         {
+            if (trianglesRemoved >= trianglesToRemove)
+            {
+               break;
+            }
+            if (touched[collapse.from] || touched[collapse.to])
+            {
+               continue;
+            }
+
+            // reject collapses that flip a surviving triangle
+            bool flips = false;
+            size_t removedByThis = 0;
+            for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1] && !flips; ++j)
+            {
+               const uint32_t* tri = &triangles[adjacency[j] * 3];
+               if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+               {
+                  ++removedByThis;
+                  continue;
+               }
+               Vector3_32 p[3];
+               Vector3_32 q[3];
+               for (int c = 0; c < 3; ++c)
+               {
+                  p[c] = positions[tri[c]];
+                  q[c] = (tri[c] == collapse.from) ? positions[collapse.to] : p[c];
+               }
+               const Vector3_32 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+               const Vector3_32 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+               flips = glm::dot(before, after) <= 0.0f;
+            }
+            if (flips)
+            {
+               continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; ++j)
+            {
+               const uint32_t* tri = &triangles[adjacency[j] * 3];
+               touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+            }
+            quadrics[canonical[collapse.to]].add(quadrics[canonical[collapse.from]]);
+            resultCost = std::max(resultCost, collapse.cost);
+            trianglesRemoved += removedByThis;
+            ++numCollapsed;
+         }
+         if (numCollapsed == 0)
+         {
+            break;
+         }
+
+         // apply, dropping triangles that became degenerate
+         size_t write = 0;
+         for (size_t t = 0; t < liveTriangles; ++t)
+         {
+            const uint32_t a = remap[triangles[t * 3 + 0]];
+            const uint32_t b = remap[triangles[t * 3 + 1]];
+            const uint32_t c = remap[triangles[t * 3 + 2]];
+            if (a == b || b == c || a == c)
+            {
+               continue;
+            }
+            triangles[write++] = a;
+            triangles[write++] = b;
+            triangles[write++] = c;
+         }
+         triangles.resize(write);
+      }
+
+      result.reserve(triangles.size());
+      for (uint32_t v : triangles)
+      {
+         result.push_back(localToGlobal[v]);
+      }
+
+      return (float)std::sqrt(resultCost);
+   }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Vertex.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace genesis
+{
+   //! quadric error based triangle list simplification.
+   //! vertices are only ever collapsed onto other existing vertices
+   //! (half edge collapse), so the simplified index lists keep
+   //! indexing the same vertex pool as the original.
+   //! vertices on uv/normal seams (same position, different attributes)
+   //! and on open borders are never moved
+   class MeshSimplifier
+   {
+   public:
+      MeshSimplifier(const std::vector<Vertex>& vertices);
+      virtual ~MeshSimplifier();
+   public:
+      //! simplify the triangle list in indices towards targetIndexCount.
+      //! collapses costing more than maxError (model units) are not done.
+      //! returns the error of the result
+      virtual float simplify(const uint32_t* indices, size_t indexCount, size_t targetIndexCount, float maxError, std::vector<uint32_t>& result) const;
+   protected:
+      const std::vector<Vertex>& _vertices;
+   };
+}
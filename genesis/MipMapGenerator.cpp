@@ -0,0 +1,256 @@
+#include "MipMapGenerator.h"
+#include "Device.h"
+#include "PhysicalDevice.h"
+#include "Image.h"
+#include "Shader.h"
+#include "Buffer.h"
+#include "VulkanInitializers.h"
+#include "VulkanDebug.h"
+#include "ImageTransitions.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+namespace genesis
+{
+   const int MipMapGenerator::s_maxLevels = 15;
+   const int MipMapGenerator::s_counterStride = 256;
+
+   //! same layout as the push constants in mipmapgen.comp
+   struct MipMapGeneratorPushConstants
+   {
+      int32_t width;
+      int32_t height;
+      int32_t numLevels;
+      int32_t srgb;
+      int32_t normalMap;
+      uint32_t numWorkGroups;
+   };
+
+   //! the shader works on 64x64 tiles of level 0
+   static const uint32_t s_tileSize = 64;
+
+   MipMapGenerator::MipMapGenerator(Device* device, const std::string& shaderFileName)
+      : _device(device)
+      , _shader(nullptr)
+      , _descriptorSetLayout(VK_NULL_HANDLE)
+      , _pipelineLayout(VK_NULL_HANDLE)
+      , _pipeline(VK_NULL_HANDLE)
+   {
+      createPipeline(shaderFileName);
+   }
+
+   MipMapGenerator::~MipMapGenerator()
+   {
+      VkDevice vulkanDevice = _device->vulkanDevice();
+      vkDestroyPipeline(vulkanDevice, _pipeline, nullptr);
+      vkDestroyPipelineLayout(vulkanDevice, _pipelineLayout, nullptr);
+      vkDestroyDescriptorSetLayout(vulkanDevice, _descriptorSetLayout, nullptr);
+      delete _shader;
+   }
+
+   void MipMapGenerator::createPipeline(const std::string& shaderFileName)
+   {
+      if (std::ifstream(shaderFileName.c_str()).good() == false)
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "could not find " << shaderFileName << ", mip maps will be blitted" << std::endl;
+         return;
+      }
+
+      _shader = new Shader(_device);
+      _shader->loadFromFile(shaderFileName, ST_COMPUTE_SHADER);
+      if (_shader->valid() == false)
+      {
+         return;
+      }
+
+      VkDevice vulkanDevice = _device->vulkanDevice();
+
+      std::vector<VkDescriptorSetLayoutBinding> setBindings;
+      // level 0
+      setBindings.push_back(vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0, 1));
+      // the other levels
+      setBindings.push_back(vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1, s_maxLevels - 1));
+      // finished workgroup counter
+      setBindings.push_back(vkInitializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2, 1));
+
+      VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = vkInitializers::descriptorSetLayoutCreateInfo(setBindings);
+      VK_CHECK_RESULT(vkCreateDescriptorSetLayout(vulkanDevice, &descriptorSetLayoutCreateInfo, nullptr, &_descriptorSetLayout));
+
+      VkPushConstantRange pushConstantRange = vkInitializers::pushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(MipMapGeneratorPushConstants), 0);
+      VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = vkInitializers::pipelineLayoutCreateInfo(&_descriptorSetLayout, 1);
+      pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+      pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+      VK_CHECK_RESULT(vkCreatePipelineLayout(vulkanDevice, &pipelineLayoutCreateInfo, nullptr, &_pipelineLayout));
+
+      VkComputePipelineCreateInfo computePipelineCreateInfo = vkInitializers::computePipelineCreateInfo(_pipelineLayout);
+      computePipelineCreateInfo.stage = _shader->pipelineShaderStageCreateInfo();
+      VK_CHECK_RESULT(vkCreateComputePipelines(vulkanDevice, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &_pipeline));
+   }
+
+   bool MipMapGenerator::valid(void) const
+   {
+      return _pipeline != VK_NULL_HANDLE;
+   }
+
+   bool MipMapGenerator::supports(VkFormat format, int width, int height) const
+   {
+      if (valid() == false || (format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB))
+      {
+         return false;
+      }
+
+      const int numLevels = (int)std::floor(std::log2(std::max(width, height))) + 1;
+      if (numLevels > s_maxLevels)
+      {
+         return false;
+      }
+
+      // the shader writes through unorm views
+      VkFormatProperties formatProperties;
+      vkGetPhysicalDeviceFormatProperties(_device->physicalDevice()->vulkanPhysicalDevice(), VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+      return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+   }
+
+   void MipMapGenerator::generate(const std::vector<Image*>& allImages, const std::vector<bool>& allNormalMaps)
+   {
+      std::vector<Image*> images;
+      std::vector<bool> normalMaps;
+      for (size_t i = 0; i < allImages.size(); ++i)
+      {
+         if (allImages[i] && allImages[i]->mipMapsPending())
+         {
+            images.push_back(allImages[i]);
+            normalMaps.push_back(i < allNormalMaps.size() && allNormalMaps[i]);
+         }
+      }
+      if (images.empty())
+      {
+         return;
+      }
+      if (valid() == false)
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "no pipeline, mips can not be generated" << std::endl;
+         return;
+      }
+
+      VkDevice vulkanDevice = _device->vulkanDevice();
+      const uint32_t numImages = (uint32_t)images.size();
+
+      std::vector<VkDescriptorPoolSize> poolSizes;
+      poolSizes.push_back(vkInitializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, numImages * s_maxLevels));
+      poolSizes.push_back(vkInitializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, numImages));
+      VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = vkInitializers::descriptorPoolCreateInfo(poolSizes, numImages);
+      VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+      VK_CHECK_RESULT(vkCreateDescriptorPool(vulkanDevice, &descriptorPoolCreateInfo, nullptr, &descriptorPool));
+
+      std::vector<VkDescriptorSetLayout> setLayouts(numImages, _descriptorSetLayout);
+      std::vector<VkDescriptorSet> descriptorSets(numImages);
+      VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = vkInitializers::descriptorSetAllocateInfo(descriptorPool, setLayouts.data(), numImages);
+      VK_CHECK_RESULT(vkAllocateDescriptorSets(vulkanDevice, &descriptorSetAllocateInfo, descriptorSets.data()));
+
+      VulkanBuffer* counters = new VulkanBuffer(_device
+         , VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+         , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+         , numImages * s_counterStride);
+
+      // one single level view per level, all unorm
+      std::vector<VkImageView> imageViews;
+      for (uint32_t i = 0; i < numImages; ++i)
+      {
+         const Image* image = images[i];
+         std::vector<VkDescriptorImageInfo> levelInfos;
+         for (int level = 0; level < image->numMipMapLevels(); ++level)
+         {
+            VkImageViewCreateInfo imageViewCreateInfo = vkInitializers::imageViewCreateInfo();
+            imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            imageViewCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+            imageViewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, (uint32_t)level, 1, 0, 1 };
+            imageViewCreateInfo.image = image->vulkanImage();
+
+            VkImageView imageView = VK_NULL_HANDLE;
+            VK_CHECK_RESULT(vkCreateImageView(vulkanDevice, &imageViewCreateInfo, nullptr, &imageView));
+            imageViews.push_back(imageView);
+            levelInfos.push_back(vkInitializers::descriptorImageInfo(VK_NULL_HANDLE, imageView, VK_IMAGE_LAYOUT_GENERAL));
+         }
+         // every array element has to be valid, the ones past the last level are never touched
+         while ((int)levelInfos.size() < s_maxLevels)
+         {
+            levelInfos.push_back(levelInfos.back());
+         }
+
+         VkDescriptorBufferInfo counterInfo = { counters->vulkanBuffer(), (VkDeviceSize)i * s_counterStride, sizeof(uint32_t) };
+
+         std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+         writeDescriptorSets.push_back(vkInitializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0, &levelInfos[0]));
+         writeDescriptorSets.push_back(vkInitializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &levelInfos[1], s_maxLevels - 1));
+         writeDescriptorSets.push_back(vkInitializers::writeDescriptorSet(descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &counterInfo));
+         vkUpdateDescriptorSets(vulkanDevice, (uint32_t)writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
+      }
+
+      VkCommandBuffer commandBuffer = _device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+      vkCmdFillBuffer(commandBuffer, counters->vulkanBuffer(), 0, VK_WHOLE_SIZE, 0);
+      VkMemoryBarrier memoryBarrier = vkInitializers::memoryBarrier();
+      memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+      for (const Image* image : images)
+      {
+         // level 0 was just copied in, the rest has never been written
+         const VkImageSubresourceRange level0 = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+         const VkImageSubresourceRange otherLevels = { VK_IMAGE_ASPECT_COLOR_BIT, 1, (uint32_t)image->numMipMapLevels() - 1, 0, 1 };
+         transitions::setImageLayout(commandBuffer, image->vulkanImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, level0
+            , VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+         transitions::setImageLayout(commandBuffer, image->vulkanImage(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, otherLevels
+            , VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+      }
+
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+
+      // the images are independent, no barriers between the dispatches
+      for (uint32_t i = 0; i < numImages; ++i)
+      {
+         const Image* image = images[i];
+
+         const uint32_t groupsX = (image->width() + s_tileSize - 1) / s_tileSize;
+         const uint32_t groupsY = (image->height() + s_tileSize - 1) / s_tileSize;
+
+         MipMapGeneratorPushConstants pushConstants;
+         pushConstants.width = image->width();
+         pushConstants.height = image->height();
+         pushConstants.numLevels = image->numMipMapLevels();
+         pushConstants.srgb = (image->vulkanFormat() == VK_FORMAT_R8G8B8A8_SRGB) ? 1 : 0;
+         pushConstants.normalMap = normalMaps[i] ? 1 : 0;
+         pushConstants.numWorkGroups = groupsX * groupsY;
+
+         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &descriptorSets[i], 0, nullptr);
+         vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+         vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+      }
+
+      for (const Image* image : images)
+      {
+         const VkImageSubresourceRange allLevels = { VK_IMAGE_ASPECT_COLOR_BIT, 0, (uint32_t)image->numMipMapLevels(), 0, 1 };
+         transitions::setImageLayout(commandBuffer, image->vulkanImage(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, allLevels
+            , VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+      }
+
+      _device->flushCommandBuffer(commandBuffer);
+
+      for (Image* image : images)
+      {
+         image->setMipMapsGenerated();
+      }
+
+      for (VkImageView imageView : imageViews)
+      {
+         vkDestroyImageView(vulkanDevice, imageView, nullptr);
+      }
+      delete counters;
+      vkDestroyDescriptorPool(vulkanDevice, descriptorPool, nullptr);
+   }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+namespace genesis
+{
+   class Device;
+   class Image;
+   class Shader;
+
+   //! generates the mip chains of a batch of images with a compute shader (mipmapgen.comp):
+   //! one dispatch per image, all of them in one command buffer.
+   //! srgb images are averaged in linear space, normal maps are renormalized.
+   //! only rgba8 images whose unorm format can be a storage image are handled,
+   //! the others blit their own mips (see Image::setDeferMipMapGeneration)
+   class MipMapGenerator
+   {
+   public:
+      MipMapGenerator(Device* device, const std::string& shaderFileName);
+      virtual ~MipMapGenerator();
+   public:
+      //! false if the shader could not be loaded
+      virtual bool valid(void) const;
+
+      //! whether images of this format and size can be deferred to the generator
+      virtual bool supports(VkFormat format, int width, int height) const;
+
+      //! images that have no pending mips are skipped. normalMaps is parallel to images.
+      //! waits for the gpu to finish
+      virtual void generate(const std::vector<Image*>& images, const std::vector<bool>& normalMaps);
+   protected:
+      virtual void createPipeline(const std::string& shaderFileName);
+   protected:
+      Device* _device;
+
+      Shader* _shader;
+
+      VkDescriptorSetLayout _descriptorSetLayout;
+      VkPipelineLayout _pipelineLayout;
+      VkPipeline _pipeline;
+
+      //! has to match MAX_LEVELS in the shader
+      static const int s_maxLevels;
+
+      //! each image gets its own counter, at the largest alignment storage buffers can ask for
+      static const int s_counterStride;
+   };
+}
@@ -1,13 +1,16 @@
 #include "ModelInfo.h"
 #include "VulkanGltf.h"
+#include "Device.h"
 
 namespace genesis
 {
-   ModelInfo::ModelInfo(Device* device, const std::string& modelFileName, int modelId, int modelLoadingFlags)
+   ModelInfo::ModelInfo(Device* device, const std::string& modelFileName, int modelId, int modelLoadingFlags, TextureCache* textureCache)
       : _device(device)
       , _modelId(modelId)
    {
-      _model = new VulkanGltfModel(_device, modelLoadingFlags);
+      // the geometry buffers are build inputs of the blases only if the device can build them
+      _model = new VulkanGltfModel(_device, _device->extensionEnabled(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME));
+      _model->setTextureCache(textureCache);
       _model->loadFromFile(modelFileName, modelLoadingFlags);
    }
 
@@ -6,11 +6,13 @@ namespace genesis
 {
    class Device;
    class VulkanGltfModel;
+   class TextureCache;
 
    class ModelInfo
    {
    public:
-      ModelInfo(Device* device, const std::string& modelFileName, int modelId, int modelLoadingFlags);
+      //! textureCache can be nullptr, the model then owns its textures
+      ModelInfo(Device* device, const std::string& modelFileName, int modelId, int modelLoadingFlags, TextureCache* textureCache = nullptr);
       virtual ~ModelInfo();
 
    public:
@@ -1,8 +1,12 @@
 #include "ModelRegistry.h"
 #include "VulkanGltf.h"
 #include "ModelInfo.h"
+#include "TextureCache.h"
+#include "Texture.h"
+#include "Image.h"
 
 #include <iostream>
+#include <unordered_set>
 
 namespace genesis
 {
@@ -11,7 +15,7 @@ namespace genesis
       , _modelLoadingFlags(modelLoadingFlags)
       , _nextModelId(0)
    {
-      // nothing to do
+      _textureCache = new TextureCache();
    }
 
    ModelRegistry::~ModelRegistry()
@@ -21,6 +25,9 @@ namespace genesis
          ModelInfo* modelInfo = keyAndVal.second;
          delete modelInfo;
       }
+
+      // after the models, they hold references into it
+      delete _textureCache;
    }
 
    bool ModelRegistry::findModel(const std::string& modelName) const
@@ -62,7 +69,7 @@ namespace genesis
 
       const int modelId = _nextModelId++;
 
-      ModelInfo* modelInfo = new ModelInfo(_device, modelFileName, modelId, _modelLoadingFlags);
+      ModelInfo* modelInfo = new ModelInfo(_device, modelFileName, modelId, _modelLoadingFlags, _textureCache);
       _mapModelIdToModelInfo.insert({ modelId, modelInfo });
       _mapModelNameToId.insert({ modelFileName, modelId });
    }
@@ -71,4 +78,54 @@ namespace genesis
    {
       return (int)_mapModelIdToModelInfo.size();
    }
+
+   int ModelRegistry::modelLoadingFlags(void) const
+   {
+      return _modelLoadingFlags;
+   }
+
+   const TextureCache* ModelRegistry::textureCache(void) const
+   {
+      return _textureCache;
+   }
+
+   bool ModelRegistry::hasAlphaMaskedPrimitives(void) const
+   {
+      for (const auto& idAndModelInfo : _mapModelIdToModelInfo)
+      {
+         const ModelInfo* modelInfo = idAndModelInfo.second;
+         if (modelInfo && modelInfo->model() && modelInfo->model()->hasAlphaMaskedPrimitives())
+         {
+            return true;
+         }
+      }
+      return false;
+   }
+
+   void ModelRegistry::reportTextureMemory(void) const
+   {
+      const double megaByte = 1024.0 * 1024.0;
+
+      std::unordered_set<const Texture*> counted;
+      VkDeviceSize totalBytes = 0;
+      for (const auto& nameAndId : _mapModelNameToId)
+      {
+         const ModelInfo* modelInfo = findModel(nameAndId.second);
+         if (modelInfo == nullptr || modelInfo->model() == nullptr)
+         {
+            continue;
+         }
+         const VulkanGltfModel* model = modelInfo->model();
+         std::cout << "texture memory: " << nameAndId.first << ": " << model->textureMemoryInBytes() / megaByte << " MB" << std::endl;
+
+         for (const Texture* texture : model->textures())
+         {
+            if (counted.insert(texture).second)
+            {
+               totalBytes += texture->image()->allocationSize();
+            }
+         }
+      }
+      std::cout << "texture memory: scene: " << totalBytes / megaByte << " MB in " << counted.size() << " textures" << std::endl;
+   }
 }
\ No newline at end of file
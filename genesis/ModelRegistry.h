@@ -14,6 +14,7 @@ namespace genesis
    class Device;
    class VulkanGltfModel;
    class ModelInfo;
+   class TextureCache;
 
    class ModelRegistry
    {
@@ -28,6 +29,18 @@ namespace genesis
 
       virtual const ModelInfo* findModel(int modelId) const;
       virtual int numModels(void) const;
+
+      //! VulkanGltfModel::FileLoadingFlags the models are loaded with
+      virtual int modelLoadingFlags(void) const;
+
+      //! shared by all the registered models, a file used by several models is uploaded once
+      virtual const TextureCache* textureCache(void) const;
+
+      //! whether any registered model has a primitive to alpha test
+      virtual bool hasAlphaMaskedPrimitives(void) const;
+
+      //! prints the resident texture memory of each model, and of all of them with shared textures counted once
+      virtual void reportTextureMemory(void) const;
    protected:
       Device* _device;
 
@@ -37,5 +50,7 @@ namespace genesis
 
       std::unordered_map<int, ModelInfo*> _mapModelIdToModelInfo;
       const int _modelLoadingFlags;
+
+      TextureCache* _textureCache;
    };
 }
\ No newline at end of file
@@ -0,0 +1,29 @@
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace genesis
+{
+   void parallelFor(size_t count, size_t minCountPerThread, const std::function<void(size_t, size_t)>& func)
+   {
+      const size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+      const size_t countPerThread = std::max(minCountPerThread, (count + numThreads - 1) / numThreads);
+      if (count <= countPerThread)
+      {
+         func(0, count);
+         return;
+      }
+
+      std::vector<std::thread> threads;
+      for (size_t begin = 0; begin < count; begin += countPerThread)
+      {
+         threads.push_back(std::thread(func, begin, std::min(count, begin + countPerThread)));
+      }
+      for (std::thread& thread : threads)
+      {
+         thread.join();
+      }
+   }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace genesis
+{
+   //! splits [0, count) into one range per hardware thread and calls func(begin, end) for each, from a thread of its own.
+   //! ranges are at least minCountPerThread long, small counts are done on the calling thread
+   void parallelFor(size_t count, size_t minCountPerThread, const std::function<void(size_t, size_t)>& func);
+}
@@ -40,6 +40,8 @@ namespace genesis
 
       // Get ray tracing pipeline properties, which will be used later on in the sample
       _rayTracingPipelineProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+      _rayTracingPipelineProperties.pNext = &_accelerationStructureProperties;
+      _accelerationStructureProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
       VkPhysicalDeviceProperties2 deviceProperties2{};
       deviceProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
       deviceProperties2.pNext = &_rayTracingPipelineProperties;
@@ -253,6 +255,11 @@ namespace genesis
       return _accelerationStructureFeatures;
    }
 
+   const VkPhysicalDeviceAccelerationStructurePropertiesKHR& PhysicalDevice::accelerationStructureProperties(void) const
+   {
+      return _accelerationStructureProperties;
+   }
+
    const ApiInstance* PhysicalDevice::instance(void) const
    {
       return _instance;
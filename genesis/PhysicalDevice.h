@@ -48,6 +48,9 @@ namespace genesis
       //! ray tracing acceleration properties.
       virtual const VkPhysicalDeviceAccelerationStructureFeaturesKHR& rayTracingAccelerationStructureFeatures(void) const;
 
+      //! acceleration structure limits (scratch alignment etc.)
+      virtual const VkPhysicalDeviceAccelerationStructurePropertiesKHR& accelerationStructureProperties(void) const;
+
       //! Get the parent instance
       virtual const ApiInstance* instance(void) const;
       
@@ -71,6 +74,8 @@ namespace genesis
 
       VkPhysicalDeviceAccelerationStructureFeaturesKHR _accelerationStructureFeatures{};
 
+      VkPhysicalDeviceAccelerationStructurePropertiesKHR _accelerationStructureProperties{};
+
       VkPhysicalDeviceMeshShaderPropertiesEXT _meshShaderProperties{};
 
       // back pointer to parent instance
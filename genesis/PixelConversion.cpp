@@ -0,0 +1,474 @@
+#include "PixelConversion.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define GEN_PIXELS_SIMD 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(GEN_PIXELS_SIMD) && (defined(__GNUC__) || defined(__clang__))
+#define GEN_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define GEN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GEN_TARGET_SSSE3
+#define GEN_TARGET_AVX2
+#endif
+
+namespace genesis
+{
+   namespace pixelconversion
+   {
+      enum InstructionSet
+      {
+           IS_SCALAR = 0
+         , IS_SSSE3 = 1
+         , IS_AVX2 = 2
+      };
+
+      static const char* s_instructionSetNames[] = { "scalar", "ssse3", "avx2" };
+
+      static InstructionSet bestInstructionSet(void)
+      {
+#if defined(GEN_PIXELS_SIMD)
+#if defined(_MSC_VER)
+         int info[4];
+         __cpuid(info, 1);
+         const bool hasSsse3 = (info[2] & (1 << 9)) != 0;
+         // avx has to be enabled by the os as well
+         const bool hasAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+         __cpuidex(info, 7, 0);
+         const bool hasAvx2 = hasAvx && (info[1] & (1 << 5)) != 0;
+#else
+         const bool hasSsse3 = __builtin_cpu_supports("ssse3") != 0;
+         const bool hasAvx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+         if (hasAvx2)
+         {
+            return IS_AVX2;
+         }
+         if (hasSsse3)
+         {
+            return IS_SSSE3;
+         }
+#endif
+         return IS_SCALAR;
+      }
+
+      static const InstructionSet s_instructionSet = bestInstructionSet();
+
+      //! below this, splitting the work across threads costs more than it saves
+      static const size_t s_minPixelsPerThread = 1 << 18;
+
+      void forRowRanges(int numRows, size_t rowSizeInBytes, const std::function<void(int, int)>& func)
+      {
+         const size_t minRowsPerThread = std::max((size_t)1, s_minPixelsPerThread * 4 / std::max((size_t)1, rowSizeInBytes));
+         parallelFor((size_t)std::max(0, numRows), minRowsPerThread, [&](size_t begin, size_t end)
+         {
+            func((int)begin, (int)end);
+         });
+      }
+
+      // expand
+
+      static void expandScalar(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, std::uint8_t alpha)
+      {
+         for (size_t i = 0; i < numPixels; ++i)
+         {
+            dst[4 * i + 0] = src[3 * i + 0];
+            dst[4 * i + 1] = src[3 * i + 1];
+            dst[4 * i + 2] = src[3 * i + 2];
+            dst[4 * i + 3] = alpha;
+         }
+      }
+
+#if defined(GEN_PIXELS_SIMD)
+      //! the simd loops return the number of pixels they did, the scalar ones do the rest.
+      //! loads and stores are full registers, so they stop while there is enough of src and dst left
+
+      GEN_TARGET_SSSE3 static size_t expandSsse3(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, std::uint8_t alpha)
+      {
+         const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+         const __m128i alphaMask = _mm_set1_epi32((int)((std::uint32_t)alpha << 24));
+         size_t i = 0;
+         for (; i + 6 <= numPixels; i += 4)
+         {
+            const __m128i in = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+            _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_or_si128(_mm_shuffle_epi8(in, shuffle), alphaMask));
+         }
+         return i;
+      }
+
+      GEN_TARGET_AVX2 static size_t expandAvx2(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, std::uint8_t alpha)
+      {
+         // bytes 0-11 to the low lane and 12-23 to the high lane, then the same shuffle in both lanes
+         const __m256i permute = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+         const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+            , 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+         const __m256i alphaMask = _mm256_set1_epi32((int)((std::uint32_t)alpha << 24));
+         size_t i = 0;
+         for (; i + 11 <= numPixels; i += 8)
+         {
+            const __m256i in = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(src + 3 * i)), permute);
+            _mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_or_si256(_mm256_shuffle_epi8(in, shuffle), alphaMask));
+         }
+         return i;
+      }
+#endif
+
+      static void expandRange(InstructionSet instructionSet, const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, std::uint8_t alpha)
+      {
+         size_t done = 0;
+#if defined(GEN_PIXELS_SIMD)
+         if (instructionSet == IS_AVX2)
+         {
+            done = expandAvx2(src, dst, numPixels, alpha);
+         }
+         else if (instructionSet == IS_SSSE3)
+         {
+            done = expandSsse3(src, dst, numPixels, alpha);
+         }
+#endif
+         expandScalar(src + 3 * done, dst + 4 * done, numPixels - done, alpha);
+      }
+
+      void expandRgbToRgba(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, std::uint8_t alpha)
+      {
+         parallelFor(numPixels, s_minPixelsPerThread, [&](size_t begin, size_t end)
+         {
+            expandRange(s_instructionSet, src + 3 * begin, dst + 4 * begin, end - begin, alpha);
+         });
+      }
+
+      // swap red and blue
+
+      static void swapRedBlueScalar(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels)
+      {
+         for (size_t i = 0; i < numPixels; ++i)
+         {
+            const std::uint8_t red = src[4 * i + 0];
+            dst[4 * i + 0] = src[4 * i + 2];
+            dst[4 * i + 1] = src[4 * i + 1];
+            dst[4 * i + 2] = red;
+            dst[4 * i + 3] = src[4 * i + 3];
+         }
+      }
+
+#if defined(GEN_PIXELS_SIMD)
+      GEN_TARGET_SSSE3 static size_t swapRedBlueSsse3(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels)
+      {
+         const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+         size_t i = 0;
+         for (; i + 4 <= numPixels; i += 4)
+         {
+            const __m128i in = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+            _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_shuffle_epi8(in, shuffle));
+         }
+         return i;
+      }
+
+      GEN_TARGET_AVX2 static size_t swapRedBlueAvx2(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels)
+      {
+         const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+            , 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+         size_t i = 0;
+         for (; i + 8 <= numPixels; i += 8)
+         {
+            const __m256i in = _mm256_loadu_si256((const __m256i*)(src + 4 * i));
+            _mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_shuffle_epi8(in, shuffle));
+         }
+         return i;
+      }
+#endif
+
+      static void swapRedBlueRange(InstructionSet instructionSet, const std::uint8_t* src, std::uint8_t* dst, size_t numPixels)
+      {
+         size_t done = 0;
+#if defined(GEN_PIXELS_SIMD)
+         if (instructionSet == IS_AVX2)
+         {
+            done = swapRedBlueAvx2(src, dst, numPixels);
+         }
+         else if (instructionSet == IS_SSSE3)
+         {
+            done = swapRedBlueSsse3(src, dst, numPixels);
+         }
+#endif
+         swapRedBlueScalar(src + 4 * done, dst + 4 * done, numPixels - done);
+      }
+
+      void swapRedBlue(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels)
+      {
+         parallelFor(numPixels, s_minPixelsPerThread, [&](size_t begin, size_t end)
+         {
+            swapRedBlueRange(s_instructionSet, src + 4 * begin, dst + 4 * begin, end - begin);
+         });
+      }
+
+      // pack rgba to rgb
+
+      static void packScalar(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, bool swapRedBlue)
+      {
+         const int red = swapRedBlue ? 2 : 0;
+         const int blue = swapRedBlue ? 0 : 2;
+         for (size_t i = 0; i < numPixels; ++i)
+         {
+            dst[3 * i + 0] = src[4 * i + red];
+            dst[3 * i + 1] = src[4 * i + 1];
+            dst[3 * i + 2] = src[4 * i + blue];
+         }
+      }
+
+#if defined(GEN_PIXELS_SIMD)
+      GEN_TARGET_SSSE3 static size_t packSsse3(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, bool swapRedBlue)
+      {
+         const __m128i shuffle = swapRedBlue ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+            : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+         size_t i = 0;
+         for (; i + 6 <= numPixels; i += 4)
+         {
+            const __m128i in = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+            _mm_storeu_si128((__m128i*)(dst + 3 * i), _mm_shuffle_epi8(in, shuffle));
+         }
+         return i;
+      }
+
+      GEN_TARGET_AVX2 static size_t packAvx2(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, bool swapRedBlue)
+      {
+         // 12 bytes at the start of each lane, then the two lanes next to each other
+         const __m256i shuffle = swapRedBlue ? _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+            , 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+            : _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1
+            , 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+         const __m256i permute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+         size_t i = 0;
+         for (; i + 11 <= numPixels; i += 8)
+         {
+            const __m256i in = _mm256_loadu_si256((const __m256i*)(src + 4 * i));
+            _mm256_storeu_si256((__m256i*)(dst + 3 * i), _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(in, shuffle), permute));
+         }
+         return i;
+      }
+#endif
+
+      static void packRange(InstructionSet instructionSet, const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, bool swapRedBlue)
+      {
+         size_t done = 0;
+#if defined(GEN_PIXELS_SIMD)
+         if (instructionSet == IS_AVX2)
+         {
+            done = packAvx2(src, dst, numPixels, swapRedBlue);
+         }
+         else if (instructionSet == IS_SSSE3)
+         {
+            done = packSsse3(src, dst, numPixels, swapRedBlue);
+         }
+#endif
+         packScalar(src + 4 * done, dst + 3 * done, numPixels - done, swapRedBlue);
+      }
+
+      void packRgbaToRgb(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, bool swapRedBlue)
+      {
+         parallelFor(numPixels, s_minPixelsPerThread, [&](size_t begin, size_t end)
+         {
+            packRange(s_instructionSet, src + 4 * begin, dst + 3 * begin, end - begin, swapRedBlue);
+         });
+      }
+
+      // flip
+
+      static void flipRowsScalar(std::uint8_t* pixels, size_t rowSizeInBytes, int numRows, int beginPair, int endPair)
+      {
+         for (int y = beginPair; y < endPair; ++y)
+         {
+            std::uint8_t* top = pixels + y * rowSizeInBytes;
+            std::uint8_t* bottom = pixels + (numRows - 1 - y) * rowSizeInBytes;
+            for (size_t x = 0; x < rowSizeInBytes; ++x)
+            {
+               std::swap(top[x], bottom[x]);
+            }
+         }
+      }
+
+      //! the rows are swapped through a small buffer with memcpy, which is already vectorized
+      static void flipRowsRange(InstructionSet instructionSet, std::uint8_t* pixels, size_t rowSizeInBytes, int numRows, int beginPair, int endPair)
+      {
+         if (instructionSet == IS_SCALAR)
+         {
+            flipRowsScalar(pixels, rowSizeInBytes, numRows, beginPair, endPair);
+            return;
+         }
+
+         std::uint8_t buffer[4096];
+         for (int y = beginPair; y < endPair; ++y)
+         {
+            std::uint8_t* top = pixels + y * rowSizeInBytes;
+            std::uint8_t* bottom = pixels + (numRows - 1 - y) * rowSizeInBytes;
+            for (size_t x = 0; x < rowSizeInBytes; x += sizeof(buffer))
+            {
+               const size_t size = std::min(sizeof(buffer), rowSizeInBytes - x);
+               memcpy(buffer, top + x, size);
+               memcpy(top + x, bottom + x, size);
+               memcpy(bottom + x, buffer, size);
+            }
+         }
+      }
+
+      //! only timed by benchmark, the loaders write the rows flipped as they decode them
+      static void flipRows(std::uint8_t* pixels, size_t rowSizeInBytes, int numRows)
+      {
+         forRowRanges(numRows / 2, rowSizeInBytes * 2, [&](int begin, int end)
+         {
+            flipRowsRange(s_instructionSet, pixels, rowSizeInBytes, numRows, begin, end);
+         });
+      }
+
+      // srgb to linear
+
+      //! srgb to linear for the color channels, then the alpha channel scaled to [0,1]
+      struct LinearTable
+      {
+         float values[512];
+
+         LinearTable()
+         {
+            for (int i = 0; i < 256; ++i)
+            {
+               const float c = i / 255.0f;
+               values[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+               values[256 + i] = c;
+            }
+         }
+      };
+
+      static const LinearTable s_linearTable;
+
+      static void srgbToLinearScalar(const std::uint8_t* src, float* dst, size_t numPixels)
+      {
+         for (size_t i = 0; i < numPixels; ++i)
+         {
+            dst[4 * i + 0] = s_linearTable.values[src[4 * i + 0]];
+            dst[4 * i + 1] = s_linearTable.values[src[4 * i + 1]];
+            dst[4 * i + 2] = s_linearTable.values[src[4 * i + 2]];
+            dst[4 * i + 3] = s_linearTable.values[256 + src[4 * i + 3]];
+         }
+      }
+
+#if defined(GEN_PIXELS_SIMD)
+      //! two pixels per gather, alpha indexes the second half of the table
+      GEN_TARGET_AVX2 static size_t srgbToLinearAvx2(const std::uint8_t* src, float* dst, size_t numPixels)
+      {
+         const __m256i alphaOffset = _mm256_setr_epi32(0, 0, 0, 256, 0, 0, 0, 256);
+         size_t i = 0;
+         for (; i + 2 <= numPixels; i += 2)
+         {
+            const __m256i indices = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + 4 * i))), alphaOffset);
+            _mm256_storeu_ps(dst + 4 * i, _mm256_i32gather_ps(s_linearTable.values, indices, 4));
+         }
+         return i;
+      }
+#endif
+
+      //! there is no gather before avx2, the ssse3 path is the scalar one
+      static void srgbToLinearRange(InstructionSet instructionSet, const std::uint8_t* src, float* dst, size_t numPixels)
+      {
+         size_t done = 0;
+#if defined(GEN_PIXELS_SIMD)
+         if (instructionSet == IS_AVX2)
+         {
+            done = srgbToLinearAvx2(src, dst, numPixels);
+         }
+#endif
+         srgbToLinearScalar(src + 4 * done, dst + 4 * done, numPixels - done);
+      }
+
+      void srgbToLinear(const std::uint8_t* src, float* dst, size_t numPixels)
+      {
+         parallelFor(numPixels, s_minPixelsPerThread, [&](size_t begin, size_t end)
+         {
+            srgbToLinearRange(s_instructionSet, src + 4 * begin, dst + 4 * begin, end - begin);
+         });
+      }
+
+      // benchmark
+
+      static double timeMs(int numIterations, const std::function<void(void)>& func)
+      {
+         typedef std::chrono::high_resolution_clock Clock;
+         const auto start = Clock::now();
+         for (int i = 0; i < numIterations; ++i)
+         {
+            func();
+         }
+         return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / numIterations;
+      }
+
+      void benchmark(int width, int height, int numIterations)
+      {
+         numIterations = std::max(1, numIterations);
+         const size_t numPixels = (size_t)width * height;
+
+         std::vector<std::uint8_t> rgb(numPixels * 3);
+         std::vector<std::uint8_t> rgba(numPixels * 4);
+         std::vector<float> linear(numPixels * 4);
+         std::uint32_t random = 12345;
+         for (std::uint8_t& value : rgb)
+         {
+            random = random * 1664525u + 1013904223u;
+            value = (std::uint8_t)(random >> 24);
+         }
+         expandRange(IS_SCALAR, rgb.data(), rgba.data(), numPixels, 255);
+
+         struct Kernel
+         {
+            const char* _name;
+            std::function<void(InstructionSet)> _singleThreaded;
+            std::function<void(void)> _threaded;
+         };
+         const std::vector<Kernel> kernels = {
+              { "expand rgb to rgba"
+            , [&](InstructionSet is) { expandRange(is, rgb.data(), rgba.data(), numPixels, 255); }
+            , [&]() { expandRgbToRgba(rgb.data(), rgba.data(), numPixels); } }
+            , { "swap red and blue"
+            , [&](InstructionSet is) { swapRedBlueRange(is, rgba.data(), rgba.data(), numPixels); }
+            , [&]() { swapRedBlue(rgba.data(), rgba.data(), numPixels); } }
+            , { "pack rgba to rgb"
+            , [&](InstructionSet is) { packRange(is, rgba.data(), rgb.data(), numPixels, true); }
+            , [&]() { packRgbaToRgb(rgba.data(), rgb.data(), numPixels, true); } }
+            , { "flip rows"
+            , [&](InstructionSet is) { flipRowsRange(is, rgba.data(), (size_t)width * 4, height, 0, height / 2); }
+            , [&]() { flipRows(rgba.data(), (size_t)width * 4, height); } }
+            , { "srgb to linear"
+            , [&](InstructionSet is) { srgbToLinearRange(is, rgba.data(), linear.data(), numPixels); }
+            , [&]() { srgbToLinear(rgba.data(), linear.data(), numPixels); } }
+         };
+
+         std::cout << "pixel conversion: " << width << "x" << height << " (" << numIterations << " iterations)" << std::endl;
+         for (const Kernel& kernel : kernels)
+         {
+            std::cout << "\t " << kernel._name << ":" << std::endl;
+            double scalarMs = 0.0;
+            for (int is = IS_SCALAR; is <= s_instructionSet; ++is)
+            {
+               const double ms = timeMs(numIterations, [&]() { kernel._singleThreaded((InstructionSet)is); });
+               if (is == IS_SCALAR)
+               {
+                  scalarMs = ms;
+               }
+               std::cout << "\t\t " << s_instructionSetNames[is] << ": " << ms << " ms (" << (ms > 0.0 ? scalarMs / ms : 0.0) << "x)" << std::endl;
+            }
+            const double threadedMs = timeMs(numIterations, kernel._threaded);
+            std::cout << "\t\t " << s_instructionSetNames[s_instructionSet] << ", threaded: " << threadedMs << " ms (" << (threadedMs > 0.0 ? scalarMs / threadedMs : 0.0) << "x)" << std::endl;
+         }
+      }
+   }
+}
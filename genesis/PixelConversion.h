@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace genesis
+{
+   //! conversions between the 8 bit pixel layouts the loaders and the screen shots deal with.
+   //! avx2 or ssse3 is picked at runtime where available, the scalar loops handle the rest.
+   //! large ranges are split across threads
+   namespace pixelconversion
+   {
+      //! rgb (or bgr) to rgba (or bgra), the fourth channel is set to alpha
+      void expandRgbToRgba(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, std::uint8_t alpha = 255);
+
+      //! rgba to bgra and back. src and dst can be the same
+      void swapRedBlue(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels);
+
+      //! rgba (or bgra) to rgb, dropping the fourth channel. swapRedBlue also reverses the first three
+      void packRgbaToRgb(const std::uint8_t* src, std::uint8_t* dst, size_t numPixels, bool swapRedBlue);
+
+      //! rgba8 with srgb encoded color to linear floats (4 per pixel), alpha is only scaled
+      void srgbToLinear(const std::uint8_t* src, float* dst, size_t numPixels);
+
+      //! calls func(beginRow, endRow) from several threads if the image is large enough to be worth it
+      void forRowRanges(int numRows, size_t rowSizeInBytes, const std::function<void(int, int)>& func);
+
+      //! times the scalar loops against the simd ones (single threaded), and the threaded versions
+      void benchmark(int width, int height, int numIterations);
+   }
+}
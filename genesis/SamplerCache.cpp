@@ -0,0 +1,76 @@
+#include "SamplerCache.h"
+#include "Device.h"
+#include "VulkanDebug.h"
+
+#include <iostream>
+#include <cstring>
+
+namespace genesis
+{
+   SamplerCache::SamplerCache(Device* device)
+      : _device(device)
+   {
+      // nothing else to do
+   }
+
+   SamplerCache::~SamplerCache()
+   {
+      for (auto& keyAndSampler : _mapKeyToSampler)
+      {
+         vkDestroySampler(_device->vulkanDevice(), keyAndSampler.second, nullptr);
+      }
+   }
+
+   std::string SamplerCache::key(const VkSamplerCreateInfo& samplerCreateInfo)
+   {
+      VkSamplerCreateInfo canonical;
+      memset(&canonical, 0, sizeof(canonical));
+      canonical.flags = samplerCreateInfo.flags;
+      canonical.magFilter = samplerCreateInfo.magFilter;
+      canonical.minFilter = samplerCreateInfo.minFilter;
+      canonical.mipmapMode = samplerCreateInfo.mipmapMode;
+      canonical.addressModeU = samplerCreateInfo.addressModeU;
+      canonical.addressModeV = samplerCreateInfo.addressModeV;
+      canonical.addressModeW = samplerCreateInfo.addressModeW;
+      canonical.mipLodBias = samplerCreateInfo.mipLodBias;
+      canonical.anisotropyEnable = samplerCreateInfo.anisotropyEnable;
+      canonical.maxAnisotropy = samplerCreateInfo.maxAnisotropy;
+      canonical.compareEnable = samplerCreateInfo.compareEnable;
+      canonical.compareOp = samplerCreateInfo.compareOp;
+      canonical.minLod = samplerCreateInfo.minLod;
+      canonical.maxLod = samplerCreateInfo.maxLod;
+      canonical.borderColor = samplerCreateInfo.borderColor;
+      canonical.unnormalizedCoordinates = samplerCreateInfo.unnormalizedCoordinates;
+      return std::string((const char*)&canonical, sizeof(canonical));
+   }
+
+   VkSampler SamplerCache::sampler(const VkSamplerCreateInfo& samplerCreateInfo)
+   {
+      if (samplerCreateInfo.pNext)
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "samplerCreateInfo.pNext != nullptr" << std::endl;
+         return VK_NULL_HANDLE;
+      }
+
+      const std::string samplerKey = key(samplerCreateInfo);
+
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      auto it = _mapKeyToSampler.find(samplerKey);
+      if (it != _mapKeyToSampler.end())
+      {
+         return it->second;
+      }
+
+      VkSampler sampler = VK_NULL_HANDLE;
+      VK_CHECK_RESULT(vkCreateSampler(_device->vulkanDevice(), &samplerCreateInfo, nullptr, &sampler));
+      _mapKeyToSampler.insert({ samplerKey, sampler });
+      return sampler;
+   }
+
+   int SamplerCache::numSamplers(void) const
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return (int)_mapKeyToSampler.size();
+   }
+}
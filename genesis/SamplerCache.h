@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
+namespace genesis
+{
+   class Device;
+
+   //! one VkSampler per distinct VkSamplerCreateInfo. drivers cap the number of samplers
+   //! (often at 4000), while a scene rarely needs more than a handful of different ones.
+   //! the samplers live as long as the cache, the device owns one
+   class SamplerCache
+   {
+   public:
+      SamplerCache(Device* device);
+      virtual ~SamplerCache();
+   public:
+      //! pNext chains are not part of the key, they are refused
+      virtual VkSampler sampler(const VkSamplerCreateInfo& samplerCreateInfo);
+
+      virtual int numSamplers(void) const;
+   protected:
+      //! the create info with sType, pNext and any padding zeroed, as bytes
+      static std::string key(const VkSamplerCreateInfo& samplerCreateInfo);
+   protected:
+      Device* _device;
+
+      std::unordered_map<std::string, VkSampler> _mapKeyToSampler;
+
+      mutable std::mutex _mutex;
+   };
+}
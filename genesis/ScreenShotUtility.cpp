@@ -9,6 +9,7 @@
 #include "StorageImage.h"
 #include "PhysicalDevice.h"
 #include "Device.h"
+#include "PixelConversion.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
@@ -137,30 +138,15 @@ namespace genesis
       }
 
       unsigned char* swizzledData = new unsigned char[swapChainWidth * swapChainHeight * 3];
-      unsigned char* dstPtr = swizzledData;
       // ppm binary pixel data
-      for (uint32_t y = 0; y < (uint32_t)swapChainHeight; y++)
+      pixelconversion::forRowRanges(swapChainHeight, (size_t)subResourceLayout.rowPitch, [&](int begin, int end)
       {
-         unsigned int* row = (unsigned int*)data;
-         for (uint32_t x = 0; x < (uint32_t)swapChainWidth; x++)
+         for (int y = begin; y < end; ++y)
          {
-            if (colorSwizzle)
-            {
-               dstPtr[0] = *((char*)row + 2);
-               dstPtr[1] = *((char*)row + 1);
-               dstPtr[2] = *((char*)row + 0);
-            }
-            else
-            {
-               dstPtr[0] = *((char*)row + 0);
-               dstPtr[1] = *((char*)row + 1);
-               dstPtr[2] = *((char*)row + 2);
-            }
-            dstPtr += 3;
-            row++;
+            const std::uint8_t* row = (const std::uint8_t*)data + y * subResourceLayout.rowPitch;
+            pixelconversion::packRgbaToRgb(row, swizzledData + y * swapChainWidth * 3, swapChainWidth, colorSwizzle);
          }
-         data += subResourceLayout.rowPitch;
-      }
+      });
 
       if (fileName.find(".png") != std::string::npos )
       {
@@ -85,6 +85,10 @@ namespace genesis
       case ST_MESH_SHADER:
          _shaderStageInfo.stage = VK_SHADER_STAGE_MESH_BIT_EXT;
          break;
+
+      case ST_COMPUTE_SHADER:
+         _shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+         break;
       default:
          break;
       }
@@ -22,6 +22,8 @@ namespace genesis
       // mesh shaders
       , ST_TASK_SHADER
       , ST_MESH_SHADER
+
+      , ST_COMPUTE_SHADER
    };
 
    class Shader
@@ -50,6 +50,22 @@ namespace genesis
          shaderGroup.anyHitShader = VK_SHADER_UNUSED_KHR;
          shaderGroup.intersectionShader = VK_SHADER_UNUSED_KHR;
       }
+      else if (shaderType == ST_RT_ANY_HIT)
+      {
+         const bool joinLastGroup = !_shaderGroups.empty()
+            && _shaderGroups.back().type == VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR
+            && _shaderGroups.back().anyHitShader == VK_SHADER_UNUSED_KHR;
+         if (joinLastGroup)
+         {
+            _shaderGroups.back().anyHitShader = static_cast<uint32_t>(_shaderStages.size()) - 1;
+            return;
+         }
+         shaderGroup.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
+         shaderGroup.generalShader = VK_SHADER_UNUSED_KHR;
+         shaderGroup.closestHitShader = VK_SHADER_UNUSED_KHR;
+         shaderGroup.anyHitShader = static_cast<uint32_t>(_shaderStages.size()) - 1;
+         shaderGroup.intersectionShader = VK_SHADER_UNUSED_KHR;
+      }
       else if (shaderType == ST_RT_CLOSEST_HIT)
       {
          shaderGroup.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
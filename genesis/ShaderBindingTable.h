@@ -25,7 +25,7 @@ namespace genesis
       virtual ~ShaderBindingTable();
 
    public:
-      //! add a shader
+      //! add a shader. an any hit shader joins the hit group added last, if that has none yet
       virtual void addShader(const std::string& shaderFileName, ShaderType shaderType);
       //! build using the ray tracing pipeline input
       virtual void build(VkPipeline raytracingPipeline);
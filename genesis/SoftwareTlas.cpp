@@ -0,0 +1,187 @@
+#include "SoftwareTlas.h"
+#include "CpuBvh.h"
+#include "Buffer.h"
+#include "Cell.h"
+#include "GenAssert.h"
+#include "InstanceContainer.h"
+#include "ModelRegistry.h"
+#include "ModelInfo.h"
+#include "VulkanGltf.h"
+#include "Vertex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+namespace genesis
+{
+   // the nodes go up as they are
+   static_assert(sizeof(BvhNode) == sizeof(CpuBvh::Node), "BvhNode does not match CpuBvh::Node");
+   static_assert(sizeof(BvhTriangle) == 48, "BvhTriangle is not packed like the scalar layout");
+
+   SoftwareTlas::SoftwareTlas(Device* device)
+      : _device(device)
+   {
+   }
+
+   SoftwareTlas::~SoftwareTlas()
+   {
+      delete _nodeBuffer;
+      delete _triangleBuffer;
+      delete _instanceBuffer;
+   }
+
+   void SoftwareTlas::build(const Cell* cell)
+   {
+      const auto start = std::chrono::high_resolution_clock::now();
+
+      struct ModelData
+      {
+         std::vector<Vertex> _vertices;
+         std::vector<uint32_t> _indices;
+      };
+      std::unordered_map<int, ModelData> modelData;
+
+      std::vector<glm::vec3> positions;
+      std::vector<uint32_t> indices;
+
+      // the ids of the triangles in the order given to the bvh, the vertices are filled in from its leaves
+      std::vector<BvhTriangle> sourceTriangles;
+      std::vector<BvhInstance> instances;
+
+      for (const Instance& instance : cell->instanceContainer()->instances())
+      {
+         const VulkanGltfModel* model = cell->modelRegistry()->findModel(instance._modelId)->model();
+
+         auto found = modelData.find(instance._modelId);
+         if (found == modelData.end())
+         {
+            found = modelData.insert({ instance._modelId, ModelData() }).first;
+            if (!model->readBackGeometry(found->second._vertices, found->second._indices))
+            {
+               std::cout << "Warning: " << __FUNCTION__ << ": " << "no geometry for model " << instance._modelId << std::endl;
+            }
+         }
+         const ModelData& data = found->second;
+         if (data._indices.empty())
+         {
+            continue;
+         }
+
+         // lod 0 of a model is the row of the model buffer with its model id, as in the tlas
+         BvhInstance bvhInstance;
+         bvhInstance.objectToWorld = glm::mat4x3(instance._xform);
+         bvhInstance.worldToObject = glm::mat4x3(glm::inverse(instance._xform));
+         bvhInstance.modelIndex = (uint32_t)instance._modelId;
+         const uint32_t instanceIndex = (uint32_t)instances.size();
+         instances.push_back(bvhInstance);
+
+         const uint32_t firstVertex = (uint32_t)positions.size();
+         for (const Vertex& vertex : data._vertices)
+         {
+            positions.push_back(glm::vec3(instance._xform * glm::vec4(vertex.position, 1.0f)));
+         }
+
+         // one geometry per primitive, in the order Blas adds them
+         uint32_t geometryIndex = 0;
+         model->forEachPrimitive(
+            [&](const Primitive& primitive)
+            {
+               const uint32_t alphaMaskedBit = model->alphaMasked(primitive) ? BVH_ALPHA_MASKED_BIT : 0;
+               for (uint32_t i = 0; i + 3 <= primitive.indexCount; i += 3)
+               {
+                  for (uint32_t j = 0; j < 3; ++j)
+                  {
+                     indices.push_back(firstVertex + data._indices[primitive.firstIndex + i + j]);
+                  }
+                  BvhTriangle sourceTriangle{};
+                  sourceTriangle.instanceIndex = instanceIndex | alphaMaskedBit;
+                  sourceTriangle.geometryIndex = geometryIndex;
+                  sourceTriangle.primitiveIndex = i / 3;
+                  sourceTriangles.push_back(sourceTriangle);
+               }
+               ++geometryIndex;
+            }
+         );
+      }
+
+      // the alpha masked bit tells the shader, the bvh does not run the any hit itself
+      CpuBvh bvh;
+      bvh.setMaxStackSize(BVH_STACK_SIZE);
+      bvh.build(positions, indices, std::vector<uint8_t>());
+      GEN_ASSERT(3 * bvh.depth() - 2 <= BVH_STACK_SIZE);
+
+      std::vector<BvhTriangle> triangles(bvh.triangles().size());
+      for (size_t i = 0; i < triangles.size(); ++i)
+      {
+         const CpuBvh::Triangle& triangle = bvh.triangles()[i];
+         triangles[i] = sourceTriangles[bvh.triangleIds()[i]];
+         triangles[i].v0 = triangle._v0;
+         triangles[i].e1 = triangle._e1;
+         triangles[i].e2 = triangle._e2;
+      }
+
+      // an empty cell still needs a root for the traversal to start from, one that nothing hits
+      std::vector<CpuBvh::Node> nodes = bvh.nodes();
+      if (nodes.empty())
+      {
+         CpuBvh::Node emptyNode;
+         for (int i = 0; i < 4; ++i)
+         {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+               emptyNode._bounds[axis][i] = std::numeric_limits<float>::max();
+               emptyNode._bounds[3 + axis][i] = -std::numeric_limits<float>::max();
+            }
+            emptyNode._children[i] = -1;
+            emptyNode._counts[i] = 0;
+         }
+         nodes.push_back(emptyNode);
+      }
+
+      delete _nodeBuffer;
+      delete _triangleBuffer;
+      delete _instanceBuffer;
+      _nodeBuffer = createBuffer(nodes.data(), nodes.size() * sizeof(CpuBvh::Node), sizeof(BvhNode));
+      _triangleBuffer = createBuffer(triangles.data(), triangles.size() * sizeof(BvhTriangle), sizeof(BvhTriangle));
+      _instanceBuffer = createBuffer(instances.data(), instances.size() * sizeof(BvhInstance), sizeof(BvhInstance));
+
+      const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+      if (cell->modelRegistry()->modelLoadingFlags() & VulkanGltfModel::PrintStats)
+      {
+         std::cout << "software tlas: " << instances.size() << " instances, " << triangles.size() << " triangles, " << nodes.size() << " nodes, "
+            << bvh.depth() << " deep, built in " << ms << " ms" << std::endl;
+      }
+   }
+
+   Buffer* SoftwareTlas::createBuffer(const void* data, size_t sizeInBytes, size_t minSizeInBytes)
+   {
+      const size_t bufferSizeInBytes = std::max(sizeInBytes, minSizeInBytes);
+      Buffer* buffer = new Buffer(_device, BT_SBO, (int)bufferSizeInBytes, true);
+      memset(buffer->stagingBuffer(), 0, bufferSizeInBytes);
+      if (sizeInBytes > 0)
+      {
+         memcpy(buffer->stagingBuffer(), data, sizeInBytes);
+      }
+      buffer->syncToGpu(true);
+      return buffer;
+   }
+
+   const VkDescriptorBufferInfo* SoftwareTlas::nodesDescriptorPtr(void) const
+   {
+      return _nodeBuffer->descriptorPtr();
+   }
+
+   const VkDescriptorBufferInfo* SoftwareTlas::trianglesDescriptorPtr(void) const
+   {
+      return _triangleBuffer->descriptorPtr();
+   }
+
+   const VkDescriptorBufferInfo* SoftwareTlas::instancesDescriptorPtr(void) const
+   {
+      return _instanceBuffer->descriptorPtr();
+   }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "GenMath.h"
+
+#include <vulkan/vulkan.h>
+
+#define CPU_SIDE_COMPILATION 1
+#include "../data/shaders/glsl/common/softwareBvh.h"
+
+namespace genesis
+{
+   class Device;
+   class Buffer;
+   class Cell;
+
+   //! stands in for the Tlas when the device can not trace rays: the instances of a cell are flattened into
+   //! one CpuBvh that a compute shader traverses (see softwareRayTracing.glsl).
+   //! the triangles keep their instance, geometry and primitive, so the hit is shaded from the same model buffers
+   class SoftwareTlas
+   {
+   public:
+      SoftwareTlas(Device* device);
+      virtual ~SoftwareTlas();
+   public:
+      //! lod 0 of every instance, with the transforms they have now. geometry only on the gpu is read back
+      virtual void build(const Cell* cell);
+
+      //! BvhNode, BvhTriangle and BvhInstance, valid after build
+      virtual const VkDescriptorBufferInfo* nodesDescriptorPtr(void) const;
+      virtual const VkDescriptorBufferInfo* trianglesDescriptorPtr(void) const;
+      virtual const VkDescriptorBufferInfo* instancesDescriptorPtr(void) const;
+   protected:
+      //! at least one element, the buffers can not be empty
+      virtual Buffer* createBuffer(const void* data, size_t sizeInBytes, size_t minSizeInBytes);
+   protected:
+      Device* _device;
+
+      Buffer* _nodeBuffer = nullptr;
+      Buffer* _triangleBuffer = nullptr;
+      Buffer* _instanceBuffer = nullptr;
+   };
+}
@@ -1,6 +1,7 @@
 #include "Texture.h"
 #include "Image.h"
 #include "Device.h"
+#include "SamplerCache.h"
 
 #include "VulkanInitializers.h"
 #include "VulkanDebug.h"
@@ -8,8 +9,9 @@
 namespace genesis
 {
 
-   Texture::Texture(Image* image)
+   Texture::Texture(Image* image, const SamplerModes& samplerModes)
       : _image(image)
+      , _samplerModes(samplerModes)
    {
       createSampler();
       createImageView();
@@ -21,29 +23,29 @@ namespace genesis
    {
       VkDevice vulkanDevice = _image->device()->vulkanDevice();
       vkDestroyImageView(vulkanDevice, imageView, nullptr);
-      vkDestroySampler(vulkanDevice, sampler, nullptr);
    }
 
    void Texture::createSampler()
    {
       VkSamplerCreateInfo samplerInfo = vkInitializers::samplerCreateInfo();
-      samplerInfo.magFilter = VK_FILTER_LINEAR;
-      samplerInfo.minFilter = VK_FILTER_LINEAR;
-      samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-      samplerInfo.addressModeU = (!_image->isCubeMap())? VK_SAMPLER_ADDRESS_MODE_REPEAT: VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-      samplerInfo.addressModeV = samplerInfo.addressModeU;
+      samplerInfo.magFilter = _samplerModes._magFilter;
+      samplerInfo.minFilter = _samplerModes._minFilter;
+      samplerInfo.mipmapMode = _samplerModes._mipmapMode;
+      samplerInfo.addressModeU = (!_image->isCubeMap()) ? _samplerModes._addressModeU : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      samplerInfo.addressModeV = (!_image->isCubeMap()) ? _samplerModes._addressModeV : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
       samplerInfo.addressModeW = samplerInfo.addressModeV;
       samplerInfo.mipLodBias = 0.0f;
       samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
       samplerInfo.minLod = 0.0f;
-      // Set max level-of-detail to mip level count of the texture
-      samplerInfo.maxLod = (float)(_image->numMipMapLevels());
+      // the image view already limits the levels, so the sampler does not have to.
+      // that way textures of different sizes end up with the same sampler
+      samplerInfo.maxLod = _samplerModes._useMipMaps ? VK_LOD_CLAMP_NONE : 0.0f;
 
       samplerInfo.maxAnisotropy = 1.0;
       samplerInfo.anisotropyEnable = VK_FALSE;
       samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 
-      VK_CHECK_RESULT(vkCreateSampler(_image->device()->vulkanDevice(), &samplerInfo, nullptr, &sampler));
+      sampler = _image->device()->samplerCache()->sampler(samplerInfo);
    }
 
    void Texture::createImageView()
@@ -59,7 +61,7 @@ namespace genesis
       imageViewInfo.subresourceRange.baseArrayLayer = 0;
       imageViewInfo.subresourceRange.layerCount = (!_image->isCubeMap()) ? 1 : 6;
 
-      imageViewInfo.subresourceRange.levelCount = _image->numMipMapLevels();
+      imageViewInfo.subresourceRange.levelCount = _image->numMipMapLevels() - _image->firstResidentLevel();
       // The view will be based on the texture's image
       imageViewInfo.image = _image->vulkanImage();
       VK_CHECK_RESULT(vkCreateImageView(_image->device()->vulkanDevice(), &imageViewInfo, nullptr, &imageView));
@@ -74,4 +76,24 @@ namespace genesis
    {
       return &_descriptor;
    }
+
+   VkSampler Texture::vulkanSampler(void) const
+   {
+      return sampler;
+   }
+
+   const Image* Texture::image(void) const
+   {
+      return _image;
+   }
+
+   void Texture::setFirstResidentLevel(int firstLevel, VkCommandBuffer commandBuffer, VkBuffer stagingBuffer, const std::vector<VkDeviceSize>& stagingOffsets
+      , VkImageView& previousImageView, VkImage& previousImage, VkDeviceMemory& previousDeviceMemory)
+   {
+      _image->setFirstResidentLevel(firstLevel, commandBuffer, stagingBuffer, stagingOffsets, previousImage, previousDeviceMemory);
+
+      previousImageView = imageView;
+      createImageView();
+      _descriptor.imageView = imageView;
+   }
 }
\ No newline at end of file
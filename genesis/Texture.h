@@ -10,10 +10,24 @@ namespace genesis
    class Device;
    class Image;
 
+   //! how a texture is filtered and wrapped. cube maps are always clamped
+   struct SamplerModes
+   {
+   public:
+      VkFilter _magFilter = VK_FILTER_LINEAR;
+      VkFilter _minFilter = VK_FILTER_LINEAR;
+      VkSamplerMipmapMode _mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+      //! false when the min filter has no mip mapping, only level 0 is sampled then
+      bool _useMipMaps = true;
+      VkSamplerAddressMode _addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+      VkSamplerAddressMode _addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+   };
+
    class Texture
    {
    public:
-      Texture(Image* image);
+      //! the sampler comes from the device's SamplerCache, it is not owned by the texture
+      Texture(Image* image, const SamplerModes& samplerModes = SamplerModes());
       virtual ~Texture();
 
    public:
@@ -21,12 +35,22 @@ namespace genesis
 
       virtual const VkDescriptorImageInfo* descriptorPtr(void) const;
 
+      virtual VkSampler vulkanSampler(void) const;
+
+      virtual const Image* image(void) const;
+
+      //! texture streaming: see Image::setFirstResidentLevel. the descriptor gets a view of the new image right away.
+      //! the previous view is handed back with the previous image and memory, frames already submitted can still be using them
+      virtual void setFirstResidentLevel(int firstLevel, VkCommandBuffer commandBuffer, VkBuffer stagingBuffer, const std::vector<VkDeviceSize>& stagingOffsets
+         , VkImageView& previousImageView, VkImage& previousImage, VkDeviceMemory& previousDeviceMemory);
+
    protected:
       virtual void createSampler(void);
 
       virtual void createImageView(void);
    protected:
-      const Image* _image;
+      Image* _image;
+      const SamplerModes _samplerModes;
       VkSampler sampler;
       VkImageView imageView;
       VkDescriptorImageInfo _descriptor;
@@ -0,0 +1,105 @@
+#include "TextureCache.h"
+#include "Image.h"
+#include "Texture.h"
+
+#include <iostream>
+
+namespace genesis
+{
+   TextureCache::TextureCache()
+      : _numHits(0)
+   {
+      // nothing else to do
+   }
+
+   TextureCache::~TextureCache()
+   {
+      if (_mapKeyToEntry.empty() == false)
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << _mapKeyToEntry.size() << " textures still referenced" << std::endl;
+      }
+      for (auto& keyAndEntry : _mapKeyToEntry)
+      {
+         Entry* entry = keyAndEntry.second;
+         delete entry->_texture;
+         delete entry->_image;
+         delete entry;
+      }
+   }
+
+   Texture* TextureCache::acquire(const std::string& key)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      auto it = _mapKeyToEntry.find(key);
+      if (it == _mapKeyToEntry.end())
+      {
+         return nullptr;
+      }
+      ++it->second->_refCount;
+      ++_numHits;
+      return it->second->_texture;
+   }
+
+   Texture* TextureCache::insert(const std::string& key, Image* image, const SamplerModes& samplerModes)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      auto it = _mapKeyToEntry.find(key);
+      if (it != _mapKeyToEntry.end())
+      {
+         // another model got there first
+         delete image;
+         ++it->second->_refCount;
+         return it->second->_texture;
+      }
+
+      Entry* entry = new Entry();
+      entry->_key = key;
+      entry->_image = image;
+      entry->_texture = new Texture(image, samplerModes);
+      entry->_refCount = 1;
+
+      _mapKeyToEntry.insert({ key, entry });
+      _mapTextureToEntry.insert({ entry->_texture, entry });
+
+      return entry->_texture;
+   }
+
+   void TextureCache::release(const Texture* texture)
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+
+      auto it = _mapTextureToEntry.find(texture);
+      if (it == _mapTextureToEntry.end())
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "texture is not in the cache" << std::endl;
+         return;
+      }
+
+      Entry* entry = it->second;
+      if (--entry->_refCount > 0)
+      {
+         return;
+      }
+
+      _mapTextureToEntry.erase(it);
+      _mapKeyToEntry.erase(entry->_key);
+
+      delete entry->_texture;
+      delete entry->_image;
+      delete entry;
+   }
+
+   int TextureCache::numEntries(void) const
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return (int)_mapKeyToEntry.size();
+   }
+
+   int TextureCache::numHits(void) const
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _numHits;
+   }
+}
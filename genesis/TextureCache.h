@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
+namespace genesis
+{
+   class Image;
+   class Texture;
+   struct SamplerModes;
+
+   //! textures shared between models. entries are keyed by a string that identifies
+   //! both the source (resolved path or content hash) and how it was uploaded (srgb, compressed format).
+   //! entries are reference counted, the image and texture go away with the last reference
+   class TextureCache
+   {
+   public:
+      TextureCache();
+      virtual ~TextureCache();
+   public:
+      //! the texture for this key with one more reference, nullptr if there is none
+      virtual Texture* acquire(const std::string& key);
+
+      //! takes ownership of the image. the new entry starts with one reference.
+      //! if the key is already there the image is deleted and the existing texture is acquired
+      virtual Texture* insert(const std::string& key, Image* image, const SamplerModes& samplerModes);
+
+      //! drops one reference
+      virtual void release(const Texture* texture);
+
+      virtual int numEntries(void) const;
+
+      //! number of times acquire found an entry
+      virtual int numHits(void) const;
+   protected:
+      struct Entry
+      {
+         std::string _key;
+         Image* _image;
+         Texture* _texture;
+         int _refCount;
+      };
+   protected:
+      std::unordered_map<std::string, Entry*> _mapKeyToEntry;
+      std::unordered_map<const Texture*, Entry*> _mapTextureToEntry;
+
+      int _numHits;
+
+      mutable std::mutex _mutex;
+   };
+}
@@ -0,0 +1,343 @@
+#include "TextureStreamer.h"
+#include "Device.h"
+#include "Texture.h"
+#include "Image.h"
+#include "Buffer.h"
+#include "VulkanInitializers.h"
+#include "VulkanDebug.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace genesis
+{
+   const int TextureStreamer::s_framesUntilUnused = 120;
+
+   TextureStreamer::TextureStreamer(Device* device, VkDeviceSize budgetInBytes)
+      : _device(device)
+      , _budget(budgetInBytes)
+      , _maxUploadPerFrame(32 * 1024 * 1024)
+   {
+      _feedbackDescriptor = {};
+   }
+
+   TextureStreamer::~TextureStreamer()
+   {
+      destroyRetired(true);
+      delete _feedbackBuffer;
+   }
+
+   static int log2Floor(int value)
+   {
+      int result = 0;
+      while (value > 1)
+      {
+         value >>= 1;
+         ++result;
+      }
+      return result;
+   }
+
+   void TextureStreamer::setTextures(const std::vector<Texture*>& textures)
+   {
+      destroyRetired(true);
+
+      _textures.clear();
+      _textures.resize(textures.size());
+
+      // the enable flag, then one requested resolution per texture
+      delete _feedbackBuffer;
+      const VkDeviceSize feedbackSize = (1 + textures.size()) * sizeof(std::uint32_t);
+      _feedbackBuffer = new VulkanBuffer(_device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+         , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, feedbackSize);
+      VK_CHECK_RESULT(_feedbackBuffer->map());
+      memset(_feedbackBuffer->_mapped, 0, (size_t)feedbackSize);
+      ((std::uint32_t*)_feedbackBuffer->_mapped)[0] = 1;
+      _feedbackDescriptor = { _feedbackBuffer->vulkanBuffer(), 0, feedbackSize };
+
+      for (size_t i = 0; i < textures.size(); ++i)
+      {
+         const Image* image = textures[i]->image();
+         const std::vector<VkDeviceSize>& streamedLevelOffsets = image->streamedLevelOffsets();
+         if (streamedLevelOffsets.empty())
+         {
+            continue;
+         }
+         const int coarsestLevel = (int)streamedLevelOffsets.size() - 1;
+         if (image->firstResidentLevel() != coarsestLevel)
+         {
+            std::cout << "Warning: " << __FUNCTION__ << ": " << "texture is already streamed by someone else" << std::endl;
+            continue;
+         }
+
+         StreamedTexture& streamedTexture = _textures[i];
+         streamedTexture._texture = textures[i];
+         streamedTexture._log2Size = log2Floor(std::max(image->width(), image->height()));
+         streamedTexture._coarsestLevel = coarsestLevel;
+
+         streamedTexture._levelOffsets.push_back(0);
+         for (int level = 0; level < image->numMipMapLevels(); ++level)
+         {
+            const int width = std::max(1, image->width() >> level);
+            const int height = std::max(1, image->height() >> level);
+            streamedTexture._levelOffsets.push_back(streamedTexture._levelOffsets.back() + Image::levelSizeInBytes(image->vulkanFormat(), width, height));
+         }
+      }
+   }
+
+   int TextureStreamer::wantedLevel(const StreamedTexture& streamedTexture) const
+   {
+      if (streamedTexture._lastRequestedFrame < 0 || _frame - streamedTexture._lastRequestedFrame > s_framesUntilUnused)
+      {
+         return streamedTexture._coarsestLevel;
+      }
+      // level n has 2^(log2Size - n) texels across
+      const int level = streamedTexture._log2Size - (int)streamedTexture._requestedResolution;
+      return std::max(0, std::min(level, streamedTexture._coarsestLevel));
+   }
+
+   VkDeviceSize TextureStreamer::sizeFromLevel(const StreamedTexture& streamedTexture, int firstLevel) const
+   {
+      return streamedTexture._levelOffsets.back() - streamedTexture._levelOffsets[firstLevel];
+   }
+
+   bool TextureStreamer::update(void)
+   {
+      destroyRetired(false);
+
+      if (_feedbackBuffer == nullptr)
+      {
+         return false;
+      }
+
+      ++_frame;
+
+      // take in and clear the feedback. requests stick around for a while, the shaders only write from some pixels
+      std::uint32_t* feedback = (std::uint32_t*)_feedbackBuffer->_mapped + 1;
+      VkDeviceSize residentSize = 0;
+      for (size_t i = 0; i < _textures.size(); ++i)
+      {
+         StreamedTexture& streamedTexture = _textures[i];
+         const std::uint32_t requested = feedback[i];
+         feedback[i] = 0;
+         if (streamedTexture._texture == nullptr)
+         {
+            continue;
+         }
+
+         residentSize += sizeFromLevel(streamedTexture, streamedTexture._texture->image()->firstResidentLevel());
+
+         if (requested == 0)
+         {
+            continue;
+         }
+         const bool stale = (_frame - streamedTexture._lastRequestedFrame > s_framesUntilUnused);
+         streamedTexture._requestedResolution = stale ? requested : std::max(requested, streamedTexture._requestedResolution);
+         streamedTexture._lastRequestedFrame = _frame;
+      }
+
+      // textures missing the most levels go first. the ones that can give up levels, least recently requested first
+      std::vector<StreamedTexture*> streamIn;
+      std::vector<StreamedTexture*> evictable;
+      for (StreamedTexture& streamedTexture : _textures)
+      {
+         if (streamedTexture._texture == nullptr)
+         {
+            continue;
+         }
+         const int firstResidentLevel = streamedTexture._texture->image()->firstResidentLevel();
+         const int wanted = wantedLevel(streamedTexture);
+         if (wanted < firstResidentLevel)
+         {
+            streamIn.push_back(&streamedTexture);
+         }
+         else if (wanted > firstResidentLevel)
+         {
+            evictable.push_back(&streamedTexture);
+         }
+      }
+      std::sort(streamIn.begin(), streamIn.end(), [this](const StreamedTexture* a, const StreamedTexture* b)
+         {
+            return (a->_texture->image()->firstResidentLevel() - wantedLevel(*a)) > (b->_texture->image()->firstResidentLevel() - wantedLevel(*b));
+         });
+      std::sort(evictable.begin(), evictable.end(), [](const StreamedTexture* a, const StreamedTexture* b)
+         {
+            return a->_lastRequestedFrame < b->_lastRequestedFrame;
+         });
+
+      std::vector<ResidencyChange> changes;
+      size_t nextEvictable = 0;
+      VkDeviceSize uploadSize = 0;
+      for (StreamedTexture* streamedTexture : streamIn)
+      {
+         const int firstResidentLevel = streamedTexture->_texture->image()->firstResidentLevel();
+         const VkDeviceSize currentSize = sizeFromLevel(*streamedTexture, firstResidentLevel);
+
+         int level = wantedLevel(*streamedTexture);
+         if (uploadSize > 0 && uploadSize + sizeFromLevel(*streamedTexture, level) - currentSize > _maxUploadPerFrame)
+         {
+            break;
+         }
+
+         // make room, then settle for the finest level that fits
+         while (residentSize + sizeFromLevel(*streamedTexture, level) - currentSize > _budget && nextEvictable < evictable.size())
+         {
+            StreamedTexture* victim = evictable[nextEvictable++];
+            const int victimLevel = wantedLevel(*victim);
+            residentSize -= sizeFromLevel(*victim, victim->_texture->image()->firstResidentLevel()) - sizeFromLevel(*victim, victimLevel);
+            changes.push_back({ victim, victimLevel });
+         }
+         while (level < firstResidentLevel && residentSize + sizeFromLevel(*streamedTexture, level) - currentSize > _budget)
+         {
+            ++level;
+         }
+         if (level == firstResidentLevel)
+         {
+            continue;
+         }
+
+         const VkDeviceSize addedSize = sizeFromLevel(*streamedTexture, level) - currentSize;
+         residentSize += addedSize;
+         uploadSize += addedSize;
+         changes.push_back({ streamedTexture, level });
+      }
+
+      if (changes.empty())
+      {
+         return false;
+      }
+
+      changeResidency(changes);
+      return true;
+   }
+
+   void TextureStreamer::changeResidency(const std::vector<ResidencyChange>& changes)
+   {
+      // the levels that are not resident yet go into one staging buffer.
+      // offsets are aligned for the largest texel block
+      const VkDeviceSize alignment = 16;
+      std::vector<std::vector<VkDeviceSize> > stagingOffsets(changes.size());
+      VkDeviceSize stagingSize = 0;
+      for (size_t i = 0; i < changes.size(); ++i)
+      {
+         const StreamedTexture* streamedTexture = changes[i].first;
+         const int firstResidentLevel = streamedTexture->_texture->image()->firstResidentLevel();
+         stagingOffsets[i].resize(streamedTexture->_levelOffsets.size(), 0);
+         for (int level = changes[i].second; level < firstResidentLevel; ++level)
+         {
+            stagingSize = (stagingSize + alignment - 1) / alignment * alignment;
+            stagingOffsets[i][level] = stagingSize;
+            stagingSize += streamedTexture->_levelOffsets[level + 1] - streamedTexture->_levelOffsets[level];
+         }
+      }
+
+      Submission submission;
+      VkBuffer stagingBuffer = VK_NULL_HANDLE;
+      if (stagingSize > 0)
+      {
+         // the levels the images kept in system memory on load
+         submission._stagingBuffer = new VulkanBuffer(_device, VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+            , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingSize);
+         VK_CHECK_RESULT(submission._stagingBuffer->map());
+         for (size_t i = 0; i < changes.size(); ++i)
+         {
+            const Image* image = changes[i].first->_texture->image();
+            const std::vector<std::uint8_t>& levelData = image->streamedLevelData();
+            const std::vector<VkDeviceSize>& levelOffsets = image->streamedLevelOffsets();
+            for (int level = changes[i].second; level < image->firstResidentLevel(); ++level)
+            {
+               const VkDeviceSize levelSize = levelOffsets[level + 1] - levelOffsets[level];
+               memcpy((std::uint8_t*)submission._stagingBuffer->_mapped + stagingOffsets[i][level], levelData.data() + levelOffsets[level], (size_t)levelSize);
+            }
+         }
+         submission._stagingBuffer->unmap();
+         stagingBuffer = submission._stagingBuffer->vulkanBuffer();
+      }
+
+      submission._commandBuffer = _device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+      for (size_t i = 0; i < changes.size(); ++i)
+      {
+         RetiredImage retired;
+         changes[i].first->_texture->setFirstResidentLevel(changes[i].second, submission._commandBuffer, stagingBuffer, stagingOffsets[i]
+            , retired._imageView, retired._image, retired._deviceMemory);
+         submission._retiredImages.push_back(retired);
+      }
+      VK_CHECK_RESULT(vkEndCommandBuffer(submission._commandBuffer));
+
+      // not waited for here: the image barriers order it before whatever is submitted next
+      VkFenceCreateInfo fenceCreateInfo = vkInitializers::fenceCreateInfo(0);
+      VK_CHECK_RESULT(vkCreateFence(_device->vulkanDevice(), &fenceCreateInfo, nullptr, &submission._fence));
+      VkSubmitInfo submitInfo = vkInitializers::submitInfo();
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers = &submission._commandBuffer;
+      VK_CHECK_RESULT(vkQueueSubmit(_device->graphicsQueue(), 1, &submitInfo, submission._fence));
+
+      _submissions.push_back(submission);
+   }
+
+   void TextureStreamer::destroyRetired(bool wait)
+   {
+      VkDevice vulkanDevice = _device->vulkanDevice();
+
+      // in submission order, so the first one that is not done ends it
+      size_t numDone = 0;
+      for (; numDone < _submissions.size(); ++numDone)
+      {
+         Submission& submission = _submissions[numDone];
+         if (wait)
+         {
+            VK_CHECK_RESULT(vkWaitForFences(vulkanDevice, 1, &submission._fence, VK_TRUE, UINT64_MAX));
+         }
+         else if (vkGetFenceStatus(vulkanDevice, submission._fence) != VK_SUCCESS)
+         {
+            break;
+         }
+
+         vkDestroyFence(vulkanDevice, submission._fence, nullptr);
+         vkFreeCommandBuffers(vulkanDevice, _device->graphicsCommandPool(), 1, &submission._commandBuffer);
+         delete submission._stagingBuffer;
+
+         for (const RetiredImage& retired : submission._retiredImages)
+         {
+            vkDestroyImageView(vulkanDevice, retired._imageView, nullptr);
+            vkDestroyImage(vulkanDevice, retired._image, nullptr);
+            vkFreeMemory(vulkanDevice, retired._deviceMemory, nullptr);
+         }
+      }
+      _submissions.erase(_submissions.begin(), _submissions.begin() + numDone);
+   }
+
+   const VkDescriptorBufferInfo* TextureStreamer::feedbackDescriptorPtr(void) const
+   {
+      return &_feedbackDescriptor;
+   }
+
+   VkDeviceSize TextureStreamer::budget(void) const
+   {
+      return _budget;
+   }
+
+   void TextureStreamer::setBudget(VkDeviceSize budgetInBytes)
+   {
+      _budget = budgetInBytes;
+   }
+
+   void TextureStreamer::setMaxUploadPerFrame(VkDeviceSize bytes)
+   {
+      _maxUploadPerFrame = bytes;
+   }
+
+   VkDeviceSize TextureStreamer::residentBytes(void) const
+   {
+      VkDeviceSize bytes = 0;
+      for (const StreamedTexture& streamedTexture : _textures)
+      {
+         if (streamedTexture._texture)
+         {
+            bytes += streamedTexture._texture->image()->allocationSize();
+         }
+      }
+      return bytes;
+   }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace genesis
+{
+   class Device;
+   class Texture;
+   class VulkanBuffer;
+
+   //! streams the mip levels of textures in and out of video memory.
+   //! the shaders write the resolution each texture is sampled at into a feedback buffer (see textureFeedback.glsl),
+   //! which gives every texture the first level it needs. missing levels are uploaded a few at a time, within a budget.
+   //! to make room, the least recently requested textures give up the levels they do not need.
+   //! the textures are loaded with only their coarse levels resident (Device::setStreamedTextureSize),
+   //! the finer ones come from the system memory copy the image kept on load (Image::streamedLevelData)
+   class TextureStreamer
+   {
+   public:
+      TextureStreamer(Device* device, VkDeviceSize budgetInBytes);
+      virtual ~TextureStreamer();
+   public:
+      //! the textures of the bindless sampler array (IndirectLayout::textures), in that order.
+      //! the ones whose images were loaded without their finer levels are streamed, the others are left alone
+      virtual void setTextures(const std::vector<Texture*>& textures);
+
+      //! for the shaders: an enable flag, then one uint per texture
+      virtual const VkDescriptorBufferInfo* feedbackDescriptorPtr(void) const;
+
+      //! once per frame, before the frame is recorded. nothing is waited for: the uploads are submitted to the graphics queue,
+      //! and the image views, images and memory they replace are destroyed by a later update, once the fence of that submit
+      //! has signaled. the fence also covers every frame submitted before, the only ones that can still use them.
+      //! true if image views changed: the sampler array has to be written again (IndirectLayout::updateTextureDescriptors)
+      //! before the next frame is submitted, and the descriptor set must not be in use by a pending frame then
+      virtual bool update(void);
+
+      virtual VkDeviceSize budget(void) const;
+      virtual void setBudget(VkDeviceSize budgetInBytes);
+
+      //! limits what is uploaded in one frame. the largest missing texture still goes through on its own
+      virtual void setMaxUploadPerFrame(VkDeviceSize bytes);
+
+      //! video memory of the streamed textures
+      virtual VkDeviceSize residentBytes(void) const;
+   protected:
+      struct StreamedTexture
+      {
+         //! nullptr if the texture is not streamed
+         Texture* _texture = nullptr;
+
+         //! where the levels would be if they were all packed one after the other, ending with the total size
+         std::vector<VkDeviceSize> _levelOffsets;
+
+         //! log2 of the larger dimension of level 0
+         int _log2Size = 0;
+
+         //! the first level that was resident on load, levels are never evicted past this one
+         int _coarsestLevel = 0;
+
+         //! from the feedback, in log2 texels per texture coordinate unit
+         std::uint32_t _requestedResolution = 0;
+         std::int64_t _lastRequestedFrame = -1;
+      };
+
+      //! a texture and its new first resident level
+      typedef std::pair<StreamedTexture*, int> ResidencyChange;
+
+      //! what a texture used before a residency change
+      struct RetiredImage
+      {
+         VkImageView _imageView;
+         VkImage _image;
+         VkDeviceMemory _deviceMemory;
+      };
+
+      //! a submit of changeResidency, and what it is still using or replaced
+      struct Submission
+      {
+         VkFence _fence = VK_NULL_HANDLE;
+         VkCommandBuffer _commandBuffer = VK_NULL_HANDLE;
+         VulkanBuffer* _stagingBuffer = nullptr;
+         std::vector<RetiredImage> _retiredImages;
+      };
+   protected:
+      //! first level the feedback asks for, the coarsest one once the texture has not been requested for a while
+      virtual int wantedLevel(const StreamedTexture& streamedTexture) const;
+
+      //! tightly packed size of the levels from firstLevel on
+      virtual VkDeviceSize sizeFromLevel(const StreamedTexture& streamedTexture, int firstLevel) const;
+
+      //! records and submits the changes, without waiting for them
+      virtual void changeResidency(const std::vector<ResidencyChange>& changes);
+
+      //! frees what the submissions whose fence has signaled used and replaced. wait: for all of them to be done first
+      virtual void destroyRetired(bool wait);
+   protected:
+      Device* _device;
+
+      //! indexed like the feedback
+      std::vector<StreamedTexture> _textures;
+
+      VulkanBuffer* _feedbackBuffer = nullptr;
+      VkDescriptorBufferInfo _feedbackDescriptor;
+
+      VkDeviceSize _budget;
+      VkDeviceSize _maxUploadPerFrame;
+
+      std::int64_t _frame = 0;
+
+      //! oldest first
+      std::vector<Submission> _submissions;
+
+      //! frames without feedback after which a texture counts as unused
+      static const int s_framesUntilUnused;
+   };
+}
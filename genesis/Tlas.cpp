@@ -8,11 +8,22 @@
 #include "InstanceContainer.h"
 #include "ModelRegistry.h"
 #include "ModelInfo.h"
+#include "PhysicalDevice.h"
+#include "VulkanInitializers.h"
+#include "VulkanDebug.h"
+#include "AccelerationStructureCache.h"
+#include "LodSelection.h"
 
 #include <iostream>
+#include <algorithm>
+#include <limits>
 
 namespace genesis
 {
+   const VkBuildAccelerationStructureFlagsKHR Tlas::s_buildFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+   const int Tlas::s_maxRefitsBeforeRebuild = 600;
+   const float Tlas::s_maxRefitAreaGrowth = 1.5f;
+
    Tlas::Tlas(Device* device, const ModelRegistry* modelRegistry)
       : _device(device)
       , _modelRegistry(modelRegistry)
@@ -21,42 +32,68 @@ namespace genesis
    }
    Tlas::~Tlas()
    {
+      finishAsyncBuild();
+      finishLodBuild(true);
+
       for (auto& keyVal : _mapModelToBlas)
       {
          delete keyVal.second;
       }
 
       delete _tlas;
-   }
-
-   void Tlas::addInstance(const Instance& instance)
-   {
-      const int modelId = instance._modelId;
 
-      auto it = _mapModelToBlas.find(modelId);
+      if (_instancesBuffer)
+      {
+         _instancesBuffer->unmap();
+      }
+      delete _instancesBuffer;
+      delete _scratchBuffer;
 
-      Blas* blas = nullptr;
-      if (it == _mapModelToBlas.end())
+      for (Blas* blas : _mergedBlases)
       {
-         const ModelInfo* modelInfo = _modelRegistry->findModel(modelId);
-         if (modelInfo == nullptr)
-         {
-            std::cout << __FUNCTION__ << "warning: " << "modelInfo == nullptr" << std::endl;
-            return;
-         }
+         delete blas;
+      }
+      delete _mergedGeometryBuffer;
+   }
 
-         blas = new Blas(_device, modelInfo->model());
-         _mapModelToBlas.insert({ modelId, blas });
+   Blas* Tlas::findOrCreateBlas(int modelId, int lod, std::vector<Blas*>& pendingBlases)
+   {
+      const uint64_t blasKey = (uint64_t(modelId) << 32) | uint32_t(lod);
+      auto it = _mapModelToBlas.find(blasKey);
+      if (it != _mapModelToBlas.end())
+      {
+         return it->second;
       }
-      else
+
+      const ModelInfo* modelInfo = _modelRegistry->findModel(modelId);
+      if (modelInfo == nullptr)
       {
-         blas = it->second;
+         std::cout << __FUNCTION__ << "warning: " << "modelInfo == nullptr" << std::endl;
+         return nullptr;
       }
+
+      Blas* blas = new Blas(_device, modelInfo->model(), lod);
+      _mapModelToBlas.insert({ blasKey, blas });
+      pendingBlases.push_back(blas);
+      return blas;
+   }
+
+   void Tlas::addInstance(const Instance& instance, int lod)
+   {
+      // built along with the tlas
+      Blas* blas = findOrCreateBlas(instance._modelId, lod, _pendingBlases);
       if (!blas)
       {
          std::cout << "Could not find or created blas" << std::endl;
          return;
       }
+      // a lod selectLods is still building, needed by the next tlas build
+      while (isLodBlasBuilding(blas))
+      {
+         finishLodBuild(true);
+         buildLodBlases();
+         _waitValue = std::max(_waitValue, _lodBuiltValue);
+      }
 
       VkTransformMatrixKHR vkTransform;
       glm::mat4 incomingTranspose = glm::transpose(instance._xform);
@@ -68,33 +105,425 @@ namespace genesis
       vulkanInstance.mask = 0xFF;
       vulkanInstance.instanceShaderBindingTableRecordOffset = 0;
       vulkanInstance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-      vulkanInstance.accelerationStructureReference = blas->deviceAddress();
+      // the reference is filled in by build, compaction moves the blases
+      vulkanInstance.accelerationStructureReference = 0;
       // store the model id as the custom index, so we can access the model
-      // this instance refers to from the model buffer in the shader
-      vulkanInstance.instanceCustomIndex = instance._modelId;  
+      // this instance refers to from the model buffer in the shader.
+      // coarser lods have their own copies of the models after the full detail ones
+      // (see IndirectLayout::createGpuSideBuffers)
+      vulkanInstance.instanceCustomIndex = lod * _modelRegistry->numModels() + instance._modelId;
+
+      _mapInstanceIdToIndex[instance._instanceId] = (uint32_t)_vulkanInstances.size();
+      _vulkanInstances.push_back(vulkanInstance);
+      _instanceBlases.push_back(blas);
+      _instanceLods.push_back({ instance._modelId, lod, instance._xform });
+   }
+
+   void Tlas::addMergedInstances(const std::vector<const Instance*>& instances, const std::vector<int>& lods)
+   {
+      const uint32_t firstMergedGeometry = (uint32_t)_mergedGeometries.size();
+      if (firstMergedGeometry >= MERGED_INSTANCE_BIT)
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "too many merged geometries, the instances are added separately" << std::endl;
+         for (size_t i = 0; i < instances.size(); ++i)
+         {
+            addInstance(*instances[i], lods[i]);
+         }
+         return;
+      }
+
+      std::vector<Blas::Part> parts;
+      for (size_t i = 0; i < instances.size(); ++i)
+      {
+         const ModelInfo* modelInfo = _modelRegistry->findModel(instances[i]->_modelId);
+         if (modelInfo == nullptr)
+         {
+            std::cout << "Warning: " << __FUNCTION__ << ": " << "modelInfo == nullptr" << std::endl;
+            continue;
+         }
+
+         Blas::Part part;
+         part._model = modelInfo->model();
+         part._lod = lods[i];
+         glm::mat4 incomingTranspose = glm::transpose(instances[i]->_xform);
+         memcpy(&part._transform, &incomingTranspose, sizeof(VkTransformMatrixKHR));
+         parts.push_back(part);
+
+         MergedGeometry mergedGeometry;
+         mergedGeometry.objectToWorld = glm::mat4x3(instances[i]->_xform);
+         mergedGeometry.worldToObject = glm::mat4x3(glm::inverse(instances[i]->_xform));
+         mergedGeometry.modelIndex = lods[i] * _modelRegistry->numModels() + instances[i]->_modelId;
+         mergedGeometry.geometryIndex = 0;
+         part._model->forEachPrimitive(
+            [&](const Primitive& primitive)
+            {
+               _mergedGeometries.push_back(mergedGeometry);
+               ++mergedGeometry.geometryIndex;
+            }
+         );
+      }
+      if (parts.empty())
+      {
+         return;
+      }
+
+      Blas* blas = new Blas(_device, parts);
+      _mergedBlases.push_back(blas);
+      _pendingBlases.push_back(blas);
+
+      // the triangles are already in world space
+      VkAccelerationStructureInstanceKHR vulkanInstance{};
+      vulkanInstance.transform.matrix[0][0] = 1.0f;
+      vulkanInstance.transform.matrix[1][1] = 1.0f;
+      vulkanInstance.transform.matrix[2][2] = 1.0f;
+      vulkanInstance.mask = 0xFF;
+      vulkanInstance.instanceShaderBindingTableRecordOffset = 0;
+      vulkanInstance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+      vulkanInstance.accelerationStructureReference = 0;
+      vulkanInstance.instanceCustomIndex = MERGED_INSTANCE_BIT | firstMergedGeometry;
 
       _vulkanInstances.push_back(vulkanInstance);
+      _instanceBlases.push_back(blas);
+      _instanceLods.push_back({ -1, 0, glm::mat4(1.0f) });
+   }
+
+   const VkDescriptorBufferInfo* Tlas::mergedGeometryDescriptorPtr(void) const
+   {
+      return _mergedGeometryBuffer->descriptorPtr();
+   }
+
+   void Tlas::buildPendingBlases()
+   {
+      if (_pendingBlases.empty())
+      {
+         return;
+      }
+
+      // the ones in the cache are copied in, the rest are built
+      AccelerationStructureCache* cache = _device->accelerationStructureCache();
+      std::vector<Blas*> blasesToBuild;
+      std::vector<Blas*> cachedBlases;
+      std::vector<std::vector<uint8_t> > serialized;
+      splitPendingBlases(cachedBlases, serialized, blasesToBuild);
+
+      // Build the acceleration structures on the device via a one-time command buffer submission
+      // Some implementations may support acceleration structure building on the host (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands), but we prefer device builds
+      VkCommandBuffer commandBuffer = _device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+      VulkanBuffer* serializedBuffer = Blas::recordDeserializations(_device, commandBuffer, cachedBlases, serialized);
+      VulkanBuffer* scratchBuffer = Blas::recordBuilds(_device, commandBuffer, blasesToBuild);
+      VkQueryPool queryPool = Blas::recordCompactedSizeQueries(_device, commandBuffer, blasesToBuild);
+      _device->flushCommandBuffer(commandBuffer);
+
+      delete serializedBuffer;
+      delete scratchBuffer;
+
+      Blas::compact(_device, queryPool, blasesToBuild);
+
+      if (cache)
+      {
+         // compacted first, so the cache holds the smaller ones
+         Blas::serialize(_device, blasesToBuild, serialized);
+         for (size_t i = 0; i < blasesToBuild.size(); ++i)
+         {
+            cache->store(blasesToBuild[i]->cacheKey(), serialized[i]);
+         }
+         std::cout << "Acceleration structure cache: " << cachedBlases.size() << " blases loaded, " << blasesToBuild.size() << " built and stored" << std::endl;
+      }
+
+      _pendingBlases.clear();
+   }
+
+   void Tlas::splitPendingBlases(std::vector<Blas*>& cachedBlases, std::vector<std::vector<uint8_t> >& serialized, std::vector<Blas*>& blasesToBuild) const
+   {
+      AccelerationStructureCache* cache = _device->accelerationStructureCache();
+      for (Blas* blas : _pendingBlases)
+      {
+         std::vector<uint8_t> data;
+         if (cache && cache->load(blas->cacheKey(), data))
+         {
+            cachedBlases.push_back(blas);
+            serialized.push_back(std::move(data));
+         }
+         else
+         {
+            blasesToBuild.push_back(blas);
+         }
+      }
+   }
+
+   void Tlas::uploadMergedGeometries(void)
+   {
+      // never empty, it is bound either way
+      delete _mergedGeometryBuffer;
+      const size_t numMergedGeometries = std::max<size_t>(1, _mergedGeometries.size());
+      _mergedGeometryBuffer = new Buffer(_device, BT_SBO, (int)(numMergedGeometries * sizeof(MergedGeometry)), true);
+      memset(_mergedGeometryBuffer->stagingBuffer(), 0, numMergedGeometries * sizeof(MergedGeometry));
+      memcpy(_mergedGeometryBuffer->stagingBuffer(), _mergedGeometries.data(), _mergedGeometries.size() * sizeof(MergedGeometry));
+      _mergedGeometryBuffer->syncToGpu(true);
    }
 
    void Tlas::build()
    {
-      // Buffer for instance data
-      genesis::VulkanBuffer* instancesBuffer = new genesis::VulkanBuffer(_device
+      // the instance buffer is about to be written again
+      finishAsyncBuild();
+
+      buildPendingBlases();
+
+      uploadMergedGeometries();
+
+      // Build the acceleration structure on the device via a one-time command buffer submission
+      // Some implementations may support acceleration structure building on the host (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands), but we prefer device builds
+      VkCommandBuffer commandBuffer = _device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+      recordBuild(commandBuffer, false);
+      _device->flushCommandBuffer(commandBuffer);
+   }
+
+   void Tlas::buildAsync(void)
+   {
+      if (!_device->asyncComputeSupported())
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "no timeline semaphore, building on the graphics queue" << std::endl;
+         build();
+         return;
+      }
+
+      finishAsyncBuild();
+
+      std::vector<Blas*> blasesToBuild;
+      std::vector<Blas*> cachedBlases;
+      std::vector<std::vector<uint8_t> > serialized;
+      splitPendingBlases(cachedBlases, serialized, blasesToBuild);
+
+      // small, not worth its own submit
+      uploadMergedGeometries();
+
+      VkCommandBuffer commandBuffer = _device->createAsyncComputeCommandBuffer();
+      _asyncBuildBuffers.push_back(Blas::recordDeserializations(_device, commandBuffer, cachedBlases, serialized));
+      _asyncBuildBuffers.push_back(Blas::recordBuilds(_device, commandBuffer, blasesToBuild));
+
+      // the tlas build reads the blases
+      VkMemoryBarrier memoryBarrier = vkInitializers::memoryBarrier();
+      memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+      memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+      recordBuild(commandBuffer, false);
+
+      _asyncBuildValue = _device->submitAsyncCompute(commandBuffer);
+      _waitValue = _asyncBuildValue;
+
+      _pendingBlases.clear();
+   }
+
+   uint64_t Tlas::takeWaitValue(void)
+   {
+      const uint64_t waitValue = _waitValue;
+      _waitValue = 0;
+      return waitValue;
+   }
+
+   void Tlas::finishAsyncBuild(void)
+   {
+      if (_asyncBuildValue == 0)
+      {
+         return;
+      }
+
+      _device->waitForAsyncCompute(_asyncBuildValue);
+      for (VulkanBuffer* buffer : _asyncBuildBuffers)
+      {
+         delete buffer;
+      }
+      _asyncBuildBuffers.clear();
+      _asyncBuildValue = 0;
+   }
+
+   void Tlas::updateInstanceTransform(uint32_t instanceId, const glm::mat4& xform)
+   {
+      auto it = _mapInstanceIdToIndex.find(instanceId);
+      if (it == _mapInstanceIdToIndex.end())
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "no instance with id " << instanceId << " (merged instances can not be moved, add it as dynamic)" << std::endl;
+         return;
+      }
+
+      glm::mat4 incomingTranspose = glm::transpose(xform);
+      memcpy(&_vulkanInstances[it->second].transform, &incomingTranspose, sizeof(VkTransformMatrixKHR));
+      _instanceLods[it->second]._xform = xform;
+      _instancesChanged = true;
+   }
+
+   int Tlas::selectLods(const LodSelection& lodSelection)
+   {
+      finishLodBuild(false);
+
+      int numChanged = 0;
+      for (size_t i = 0; i < _instanceLods.size(); ++i)
+      {
+         InstanceLod& instanceLod = _instanceLods[i];
+         if (instanceLod._modelId < 0)
+         {
+            continue;
+         }
+         const ModelInfo* modelInfo = _modelRegistry->findModel(instanceLod._modelId);
+         if (modelInfo == nullptr)
+         {
+            continue;
+         }
+
+         const int lod = selectLod(modelInfo->model(), instanceLod._xform, lodSelection, instanceLod._lod);
+         if (lod == instanceLod._lod)
+         {
+            continue;
+         }
+         Blas* blas = findOrCreateBlas(instanceLod._modelId, lod, _pendingLodBlases);
+         if (!blas || isLodBlasBuilding(blas))
+         {
+            // the current lod until the new one is built
+            continue;
+         }
+
+         instanceLod._lod = lod;
+         _instanceBlases[i] = blas;
+         // see addInstance
+         _vulkanInstances[i].instanceCustomIndex = lod * _modelRegistry->numModels() + instanceLod._modelId;
+         ++numChanged;
+      }
+
+      if (numChanged > 0)
+      {
+         _referencesChanged = true;
+         _waitValue = std::max(_waitValue, _lodBuiltValue);
+      }
+
+      buildLodBlases();
+
+      return numChanged;
+   }
+
+   void Tlas::buildLodBlases(void)
+   {
+      if (_pendingLodBlases.empty() || _lodBuildValue != 0)
+      {
+         return;
+      }
+
+      // not compacted or stored to the cache, both need the results back on the cpu
+      if (!_device->asyncComputeSupported())
+      {
+         VkCommandBuffer commandBuffer = _device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+         VulkanBuffer* scratchBuffer = Blas::recordBuilds(_device, commandBuffer, _pendingLodBlases);
+         _device->flushCommandBuffer(commandBuffer);
+         delete scratchBuffer;
+         _pendingLodBlases.clear();
+         return;
+      }
+
+      VkCommandBuffer commandBuffer = _device->createAsyncComputeCommandBuffer();
+      _lodBuildScratchBuffer = Blas::recordBuilds(_device, commandBuffer, _pendingLodBlases);
+      _lodBuildValue = _device->submitAsyncCompute(commandBuffer);
+      _lodBuildBlases.swap(_pendingLodBlases);
+      _pendingLodBlases.clear();
+   }
+
+   void Tlas::finishLodBuild(bool wait)
+   {
+      if (_lodBuildValue == 0)
+      {
+         return;
+      }
+
+      if (wait)
+      {
+         _device->waitForAsyncCompute(_lodBuildValue);
+      }
+      else if (!_device->asyncComputeDone(_lodBuildValue))
+      {
+         return;
+      }
+
+      delete _lodBuildScratchBuffer;
+      _lodBuildScratchBuffer = nullptr;
+      _lodBuildBlases.clear();
+      _lodBuiltValue = _lodBuildValue;
+      _lodBuildValue = 0;
+   }
+
+   bool Tlas::isLodBlasBuilding(const Blas* blas) const
+   {
+      return std::find(_pendingLodBlases.begin(), _pendingLodBlases.end(), blas) != _pendingLodBlases.end()
+         || std::find(_lodBuildBlases.begin(), _lodBuildBlases.end(), blas) != _lodBuildBlases.end();
+   }
+
+   bool Tlas::recordUpdate(VkCommandBuffer commandBuffer)
+   {
+      const bool instancesAdded = (_vulkanInstances.size() != _numBuiltInstances);
+      if (!_instancesChanged && !instancesAdded && !_referencesChanged)
+      {
+         return false;
+      }
+
+      if (_asyncBuildValue != 0)
+      {
+         // the build still reads the instance buffer
+         if (!_device->asyncComputeDone(_asyncBuildValue))
+         {
+            return false;
+         }
+         finishAsyncBuild();
+      }
+
+      buildPendingBlases();
+
+      // refits keep the tree of the last build and only grow its boxes, which gets worse the more things move.
+      // so once the instance boxes have grown too much, and whenever the instance count or the blases they refer to change,
+      // build from scratch. the refit count is only a backstop for movements that do not grow the boxes
+      bool refit = !instancesAdded && !_referencesChanged && _numRefits < s_maxRefitsBeforeRebuild;
+      if (refit)
+      {
+         float rootArea = 0.0f;
+         float summedArea = 0.0f;
+         instanceAreas(rootArea, summedArea);
+         refit = rootArea <= _builtRootArea * s_maxRefitAreaGrowth && summedArea <= _builtSummedArea * s_maxRefitAreaGrowth;
+      }
+
+      VkAccelerationStructureKHR oldHandle = _tlas ? _tlas->handle() : VK_NULL_HANDLE;
+      recordBuild(commandBuffer, refit);
+
+      // the tracing that follows reads the tlas
+      VkMemoryBarrier memoryBarrier = vkInitializers::memoryBarrier();
+      memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+      memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+      return _tlas->handle() != oldHandle;
+   }
+
+   static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+   {
+      return (value + alignment - 1) & ~(alignment - 1);
+   }
+
+   void Tlas::reallocate(uint32_t numInstances)
+   {
+      delete _tlas;
+      if (_instancesBuffer)
+      {
+         _instancesBuffer->unmap();
+      }
+      delete _instancesBuffer;
+      delete _scratchBuffer;
+
+      _capacity = numInstances;
+
+      // Buffer for instance data, stays mapped so moved instances only need a copy
+      _instancesBuffer = new genesis::VulkanBuffer(_device
          , VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR
          , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-         , _vulkanInstances.size()*sizeof(VkAccelerationStructureInstanceKHR)
-         , _vulkanInstances.data());
+         , std::max<VkDeviceSize>(1, _capacity) * sizeof(VkAccelerationStructureInstanceKHR));
+      VK_CHECK_RESULT(_instancesBuffer->map());
 
-      VkDeviceOrHostAddressConstKHR instanceDataDeviceAddress{};
-      instanceDataDeviceAddress.deviceAddress = instancesBuffer->deviceAddress();
-
-      VkAccelerationStructureGeometryKHR accelerationStructureGeometry {};
-      accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-      accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
-      accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
-      accelerationStructureGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
-      accelerationStructureGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
-      accelerationStructureGeometry.geometry.instances.data = instanceDataDeviceAddress;
+      VkAccelerationStructureGeometryKHR accelerationStructureGeometry = instancesGeometry();
 
       // Get size info
       /*
@@ -103,37 +532,72 @@ namespace genesis
       VkAccelerationStructureBuildGeometryInfoKHR accelerationStructureBuildGeometryInfo{};
       accelerationStructureBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
       accelerationStructureBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-      accelerationStructureBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+      accelerationStructureBuildGeometryInfo.flags = s_buildFlags;
       accelerationStructureBuildGeometryInfo.geometryCount = 1;
       accelerationStructureBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
 
-      const uint32_t numInstances = (uint32_t)_vulkanInstances.size();
-
       VkAccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo{};
       accelerationStructureBuildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
       _device->extensions().vkGetAccelerationStructureBuildSizesKHR(
          _device->vulkanDevice(),
          VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
          &accelerationStructureBuildGeometryInfo,
-         &numInstances,
+         &_capacity,
          &accelerationStructureBuildSizesInfo);
 
       _tlas = new genesis::AccelerationStructure(_device, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, accelerationStructureBuildSizesInfo.accelerationStructureSize);
 
-      // Create a small scratch buffer used during build of the top level acceleration structure
-      VulkanBuffer* scratchBuffer = new VulkanBuffer(_device
+      // scratch for both builds and refits, with room to align the start
+      _scratchAlignment = std::max<VkDeviceSize>(1, _device->physicalDevice()->accelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment);
+      const VkDeviceSize scratchSize = std::max(accelerationStructureBuildSizesInfo.buildScratchSize, accelerationStructureBuildSizesInfo.updateScratchSize);
+      _scratchBuffer = new VulkanBuffer(_device
          , VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
-         , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, accelerationStructureBuildSizesInfo.buildScratchSize);;
+         , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, scratchSize + _scratchAlignment);
+   }
+
+   VkAccelerationStructureGeometryKHR Tlas::instancesGeometry(void) const
+   {
+      VkDeviceOrHostAddressConstKHR instanceDataDeviceAddress{};
+      instanceDataDeviceAddress.deviceAddress = _instancesBuffer->deviceAddress();
+
+      VkAccelerationStructureGeometryKHR accelerationStructureGeometry {};
+      accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+      accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+      accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+      accelerationStructureGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+      accelerationStructureGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
+      accelerationStructureGeometry.geometry.instances.data = instanceDataDeviceAddress;
+      return accelerationStructureGeometry;
+   }
+
+   void Tlas::recordBuild(VkCommandBuffer commandBuffer, bool refit)
+   {
+      const uint32_t numInstances = (uint32_t)_vulkanInstances.size();
+      if (_tlas == nullptr || numInstances > _capacity)
+      {
+         reallocate(numInstances);
+         refit = false;
+      }
+
+      for (size_t i = 0; i < _vulkanInstances.size(); ++i)
+      {
+         _vulkanInstances[i].accelerationStructureReference = _instanceBlases[i]->deviceAddress();
+      }
+      // the gpu is done with the previous build, and host writes are visible to the submit
+      memcpy(_instancesBuffer->_mapped, _vulkanInstances.data(), _vulkanInstances.size() * sizeof(VkAccelerationStructureInstanceKHR));
+
+      VkAccelerationStructureGeometryKHR accelerationStructureGeometry = instancesGeometry();
 
       VkAccelerationStructureBuildGeometryInfoKHR accelerationBuildGeometryInfo{};
       accelerationBuildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
       accelerationBuildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-      accelerationBuildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
-      accelerationBuildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+      accelerationBuildGeometryInfo.flags = s_buildFlags;
+      accelerationBuildGeometryInfo.mode = refit ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+      accelerationBuildGeometryInfo.srcAccelerationStructure = refit ? _tlas->handle() : VK_NULL_HANDLE;
       accelerationBuildGeometryInfo.dstAccelerationStructure = _tlas->handle();
       accelerationBuildGeometryInfo.geometryCount = 1;
       accelerationBuildGeometryInfo.pGeometries = &accelerationStructureGeometry;
-      accelerationBuildGeometryInfo.scratchData.deviceAddress = scratchBuffer->deviceAddress();
+      accelerationBuildGeometryInfo.scratchData.deviceAddress = alignUp(_scratchBuffer->deviceAddress(), _scratchAlignment);
 
       VkAccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo{};
       accelerationStructureBuildRangeInfo.primitiveCount = numInstances;
@@ -142,19 +606,59 @@ namespace genesis
       accelerationStructureBuildRangeInfo.transformOffset = 0;
       std::vector<VkAccelerationStructureBuildRangeInfoKHR*> accelerationBuildStructureRangeInfos = { &accelerationStructureBuildRangeInfo };
 
-      // Build the acceleration structure on the device via a one-time command buffer submission
-      // Some implementations may support acceleration structure building on the host (VkPhysicalDeviceAccelerationStructureFeaturesKHR->accelerationStructureHostCommands), but we prefer device builds
-      VkCommandBuffer commandBuffer = _device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
       _device->extensions().vkCmdBuildAccelerationStructuresKHR(
          commandBuffer,
          1,
          &accelerationBuildGeometryInfo,
          accelerationBuildStructureRangeInfos.data());
-      _device->flushCommandBuffer(commandBuffer);
 
-      delete scratchBuffer;
+      if (!refit)
+      {
+         instanceAreas(_builtRootArea, _builtSummedArea);
+      }
 
-      delete instancesBuffer;
+      _numBuiltInstances = numInstances;
+      _numRefits = refit ? _numRefits + 1 : 0;
+      _instancesChanged = false;
+      _referencesChanged = false;
+   }
+
+   static float halfArea(const glm::vec3& min, const glm::vec3& max)
+   {
+      const glm::vec3 extent = max - min;
+      return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+   }
+
+   void Tlas::instanceAreas(float& rootArea, float& summedArea) const
+   {
+      glm::vec3 rootMin(std::numeric_limits<float>::max());
+      glm::vec3 rootMax(-std::numeric_limits<float>::max());
+      summedArea = 0.0f;
+      for (const InstanceLod& instanceLod : _instanceLods)
+      {
+         const ModelInfo* modelInfo = (instanceLod._modelId >= 0) ? _modelRegistry->findModel(instanceLod._modelId) : nullptr;
+         if (modelInfo == nullptr)
+         {
+            continue;
+         }
+         const VulkanGltfModel* model = modelInfo->model();
+
+         // the box around the transformed model box
+         const glm::vec3 localCenter = (model->boundsMin() + model->boundsMax()) * 0.5f;
+         const glm::vec3 localHalfExtent = (model->boundsMax() - model->boundsMin()) * 0.5f;
+         const glm::vec3 center = glm::vec3(instanceLod._xform * glm::vec4(localCenter, 1.0f));
+         const glm::mat3 rotationScale(instanceLod._xform);
+         glm::vec3 halfExtent(0.0f);
+         for (int column = 0; column < 3; ++column)
+         {
+            halfExtent += glm::abs(rotationScale[column]) * localHalfExtent[column];
+         }
+
+         summedArea += halfArea(center - halfExtent, center + halfExtent);
+         rootMin = glm::min(rootMin, center - halfExtent);
+         rootMax = glm::max(rootMax, center + halfExtent);
+      }
+      rootArea = (rootMin.x <= rootMax.x) ? halfArea(rootMin, rootMax) : 0.0f;
    }
 
    const VkAccelerationStructureKHR& Tlas::handle(void) const
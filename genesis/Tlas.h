@@ -5,6 +5,10 @@
 #include <vulkan/vulkan.h>
 
 #include <unordered_map>
+#include <vector>
+
+#define CPU_SIDE_COMPILATION 1
+#include "../data/shaders/glsl/common/mergedGeometry.h"
 
 namespace genesis
 {
@@ -14,8 +18,10 @@ namespace genesis
    class AccelerationStructure;
    class VulkanBuffer;
    class ModelRegistry;
+   class Buffer;
 
    class Instance;
+   struct LodSelection;
 
    class Tlas
    {
@@ -23,12 +29,83 @@ namespace genesis
       Tlas(Device* device, const ModelRegistry* modelRegistry);
       virtual ~Tlas();
    public:
-      virtual void addInstance(const Instance& instance);
+      //! lod selects which blas of the model the instance refers to
+      virtual void addInstance(const Instance& instance, int lod = 0);
+
+      //! bakes the instances, with their transforms, into one blas that gets a single tlas entry.
+      //! the hit shader finds their models and transforms through the merged geometry buffer.
+      //! merged instances can not be moved
+      virtual void addMergedInstances(const std::vector<const Instance*>& instances, const std::vector<int>& lods);
+
+      //! one MergedGeometry per geometry of the merged blases, valid after build
+      virtual const VkDescriptorBufferInfo* mergedGeometryDescriptorPtr(void) const;
 
+      //! builds and compacts the blases added since the last build, then builds the tlas
       virtual void build();
 
+      //! like build, but on the async compute queue (see Device::submitAsyncCompute) and without waiting.
+      //! the blases are not compacted or stored to the cache, both need the results back on the cpu.
+      //! falls back to build if the device has no timeline semaphore
+      virtual void buildAsync(void);
+
+      //! the value of Device::asyncComputeTimeline the next submit tracing against the tlas has to wait for,
+      //! 0 for nothing. only the first use after buildAsync waits, so this resets it
+      virtual uint64_t takeWaitValue(void);
+
+      //! moves an instance (by its id in the instance container). takes effect with the next recordUpdate
+      virtual void updateInstanceTransform(uint32_t instanceId, const glm::mat4& xform);
+
+      //! picks the lod of every instance again (see selectLod, with the hysteresis), for example after the eye moved.
+      //! the instances that change refer to the blas of their new lod from the next recordUpdate on, which then
+      //! rebuilds instead of refitting. merged instances keep theirs.
+      //! blases of lods not used before are built on the async compute queue, without compaction, and the instances
+      //! keep their current lod until a later call finds that build done. returns how many instances changed
+      virtual int selectLods(const LodSelection& lodSelection);
+
+      //! records a refit for the moved instances, or a full build when their boxes have grown too much since the last one
+      //! (see instanceAreas), refits have been going on for too long or instances were added, followed by a barrier
+      //! for the ray tracing shaders. nothing if nothing changed, or while an async build is still going (the updates are kept for later).
+      //! the gpu has to be done with the previous frame. true if handle() changed and has to be written to the descriptors again
+      virtual bool recordUpdate(VkCommandBuffer commandBuffer);
+
       virtual const VkAccelerationStructureKHR& handle(void) const;
    protected:
+      //! all of them in one submit, then compacted
+      virtual void buildPendingBlases(void);
+
+      //! the blas shared by the instances of the model at this lod, created (and added to pendingBlases) the first time
+      virtual Blas* findOrCreateBlas(int modelId, int lod, std::vector<Blas*>& pendingBlases);
+
+      //! submits the builds of _pendingLodBlases to the async compute queue, if no other lod build is going on.
+      //! on the graphics queue, waiting for it, if the device has no timeline semaphore
+      virtual void buildLodBlases(void);
+
+      //! frees what the lod build used once it is done, its blases can be referred to from then on. wait: for it to be done
+      virtual void finishLodBuild(bool wait);
+
+      //! a blas of selectLods that is not built yet
+      virtual bool isLodBlasBuilding(const Blas* blas) const;
+
+      //! the pending blases the cache has data for, with that data, and the ones to build
+      virtual void splitPendingBlases(std::vector<Blas*>& cachedBlases, std::vector<std::vector<uint8_t> >& serialized, std::vector<Blas*>& blasesToBuild) const;
+
+      virtual void uploadMergedGeometries(void);
+
+      //! waits for the async build if there is one, and frees what it used
+      virtual void finishAsyncBuild(void);
+
+      //! acceleration structure, instance and scratch buffers for this many instances
+      virtual void reallocate(uint32_t numInstances);
+
+      virtual VkAccelerationStructureGeometryKHR instancesGeometry(void) const;
+
+      //! copies the instances and records a build or a refit
+      virtual void recordBuild(VkCommandBuffer commandBuffer, bool refit);
+
+      //! surface areas (halved) of the world space box around all the instances, and the sum of those of each instance.
+      //! merged instances do not move and are left out
+      virtual void instanceAreas(float& rootArea, float& summedArea) const;
+   protected:
 
       Device* _device = nullptr;
 
@@ -36,8 +113,78 @@ namespace genesis
 
       std::vector<VkAccelerationStructureInstanceKHR> _vulkanInstances;
 
+      //! the blas each instance refers to
+      std::vector<const Blas*> _instanceBlases;
+
+      //! what selectLods needs for each instance, the model id is -1 for merged ones
+      struct InstanceLod
+      {
+         int _modelId;
+         int _lod;
+         glm::mat4 _xform;
+      };
+      std::vector<InstanceLod> _instanceLods;
+
+      //! blases of addMergedInstances, not shared through _mapModelToBlas
+      std::vector<Blas*> _mergedBlases;
+      std::vector<MergedGeometry> _mergedGeometries;
+      Buffer* _mergedGeometryBuffer = nullptr;
+
+      //! instance container ids to indices into _vulkanInstances
+      std::unordered_map<uint32_t, uint32_t> _mapInstanceIdToIndex;
+
+      //! persistently mapped
+      VulkanBuffer* _instancesBuffer = nullptr;
+      VulkanBuffer* _scratchBuffer = nullptr;
+      VkDeviceSize _scratchAlignment = 1;
+
+      //! instances the buffers are sized for
+      uint32_t _capacity = 0;
+
+      uint32_t _numBuiltInstances = 0;
+      int _numRefits = 0;
+      bool _instancesChanged = false;
+
+      //! instances refer to other blases since the last build, refitting is not enough
+      bool _referencesChanged = false;
+
+      static const VkBuildAccelerationStructureFlagsKHR s_buildFlags;
+
+      //! instanceAreas at the last full build. a refit keeps that tree, the more the boxes have grown since, the worse it is
+      float _builtRootArea = 0.0f;
+      float _builtSummedArea = 0.0f;
+
+      //! refits in a row after which the next update is a full build, however little the boxes have grown
+      static const int s_maxRefitsBeforeRebuild;
+
+      //! growth of either instanceArea, relative to the last full build, past which the next update is a full build
+      static const float s_maxRefitAreaGrowth;
+
       const ModelRegistry* _modelRegistry;
 
-      std::unordered_map<int, Blas*> _mapModelToBlas;
+      //! keyed by model id and lod
+      std::unordered_map<uint64_t, Blas*> _mapModelToBlas;
+
+      //! created by addInstance, not built yet
+      std::vector<Blas*> _pendingBlases;
+
+      //! timeline value of the async build still going on, 0 if none. the buffers are freed when it is done
+      uint64_t _asyncBuildValue = 0;
+      std::vector<VulkanBuffer*> _asyncBuildBuffers;
+
+      //! see takeWaitValue
+      uint64_t _waitValue = 0;
+
+      //! blases of lods selectLods switches to, not submitted yet
+      std::vector<Blas*> _pendingLodBlases;
+
+      //! the lod build still going on: its timeline value (0 if none), what it builds and its scratch
+      uint64_t _lodBuildValue = 0;
+      std::vector<Blas*> _lodBuildBlases;
+      VulkanBuffer* _lodBuildScratchBuffer = nullptr;
+
+      //! of the last lod build that is done. the first frame referring to its blases waits for it on the gpu,
+      //! which makes its writes visible to the graphics queue
+      uint64_t _lodBuiltValue = 0;
    };
 }
\ No newline at end of file
@@ -11,9 +11,30 @@
 #include "VkExtensions.h"
 #include "VulkanInitializers.h"
 #include "AccelerationStructure.h"
+#include "MeshSimplifier.h"
+#include "GltfJsonParser.h"
+#include "BlockCompression.h"
+#include "TextureCache.h"
+#include "MipMapGenerator.h"
+#include "PixelConversion.h"
+#include "ParallelFor.h"
 
 #include <iostream>
 #include <deque>
+#include <unordered_set>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
@@ -25,10 +46,21 @@
 
 namespace genesis
 {
+   const int VulkanGltfModel::s_maxLods = 5;
+   const float VulkanGltfModel::s_lodMaxRelativeError = 0.05f;
+
    VulkanGltfModel::VulkanGltfModel(Device* device, bool rayTracing)
       : _device(device)
-      , _rayTracing(rayTracing)
+      , _compressedTextureCacheDirectory("textureCache")
+      , _textureCache(nullptr)
+      , _vertexBufferGpu(nullptr)
+      , _indexBufferGpu(nullptr)
+      , _numVertices(0)
+      , _numIndices(0)
+      , _boundsMin(0.0f)
+      , _boundsMax(0.0f)
       , _lightInstancesGpu(nullptr)
+      , _rayTracing(rayTracing)
    {
       // nothing else to do
    }
@@ -37,7 +69,14 @@ namespace genesis
    {
       for (Texture* texture : _textures)
       {
-         delete texture;
+         if (_textureCache)
+         {
+            _textureCache->release(texture);
+         }
+         else
+         {
+            delete texture;
+         }
       }
 
       for (Image* image : _images)
@@ -55,6 +94,22 @@ namespace genesis
       delete _indexBufferGpu;
    }
 
+   bool VulkanGltfModel::isNormalMap(uint32_t index) const
+   {
+      const auto it = _imageIndexToWhetherNormalMap.find(index);
+      return it != _imageIndexToWhetherNormalMap.end() && it->second;
+   }
+
+   void VulkanGltfModel::setCompressedTextureCacheDirectory(const std::string& directory)
+   {
+      _compressedTextureCacheDirectory = directory;
+   }
+
+   void VulkanGltfModel::setTextureCache(TextureCache* textureCache)
+   {
+      _textureCache = textureCache;
+   }
+
    bool VulkanGltfModel::isSrgb(uint32_t index) const
    {
       const auto it = _imageIndexToWhetherSrgb.find(index);
@@ -65,17 +120,96 @@ namespace genesis
       return false;
    }
 
-   void VulkanGltfModel::loadImages(tinygltf::Model& glTfModel, bool srgbProcessing)
+   static VkSamplerAddressMode toVulkanAddressMode(int wrap)
+   {
+      switch (wrap)
+      {
+      case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE:
+         return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT:
+         return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+      default:
+         return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+      }
+   }
+
+   //! the modes of the first gltf texture that samples this image.
+   //! there is one Texture per image, so an image sampled in two different ways gets the first one
+   static SamplerModes samplerModesForImage(const tinygltf::Model& glTfModel, int imageIndex)
+   {
+      SamplerModes samplerModes;
+      for (const tinygltf::Texture& glTfTexture : glTfModel.textures)
+      {
+         if (glTfTexture.source != imageIndex)
+         {
+            continue;
+         }
+         if (glTfTexture.sampler < 0 || glTfTexture.sampler >= (int)glTfModel.samplers.size())
+         {
+            break;
+         }
+         const tinygltf::Sampler& glTfSampler = glTfModel.samplers[glTfTexture.sampler];
+
+         // unspecified filters stay linear
+         samplerModes._magFilter = (glTfSampler.magFilter == TINYGLTF_TEXTURE_FILTER_NEAREST) ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+         switch (glTfSampler.minFilter)
+         {
+         case TINYGLTF_TEXTURE_FILTER_NEAREST:
+            samplerModes._minFilter = VK_FILTER_NEAREST;
+            samplerModes._useMipMaps = false;
+            break;
+         case TINYGLTF_TEXTURE_FILTER_LINEAR:
+            samplerModes._useMipMaps = false;
+            break;
+         case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST:
+            samplerModes._minFilter = VK_FILTER_NEAREST;
+            samplerModes._mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+            break;
+         case TINYGLTF_TEXTURE_FILTER_LINEAR_MIPMAP_NEAREST:
+            samplerModes._mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+            break;
+         case TINYGLTF_TEXTURE_FILTER_NEAREST_MIPMAP_LINEAR:
+            samplerModes._minFilter = VK_FILTER_NEAREST;
+            break;
+         default:
+            break;
+         }
+         samplerModes._addressModeU = toVulkanAddressMode(glTfSampler.wrapS);
+         samplerModes._addressModeV = toVulkanAddressMode(glTfSampler.wrapT);
+         break;
+      }
+      return samplerModes;
+   }
+
+   //! an image of the model, either found in the texture cache or loaded
+   struct LoadedImage
+   {
+      Texture* _cachedTexture;
+      Image* _image;
+      std::string _cacheKey;
+      SamplerModes _samplerModes;
+      bool _normalMap;
+   };
+
+   void VulkanGltfModel::loadImages(tinygltf::Model& glTfModel, bool srgbProcessing, uint32_t fileLoadingFlags)
    {
+      const bool compress = (fileLoadingFlags & FileLoadingFlags::CompressTextures) != 0;
+
+      // the mips of all the images are generated together once they are loaded
+      MipMapGenerator* mipMapGenerator = _device->mipMapGenerator();
+
+      std::vector<LoadedImage> loadedImages;
+
       int index = -1;
       for (auto& glTFImage : glTfModel.images)
       {
          ++index;
 
          bool isKtx = false;
-         // Image points to an external ktx file
+         // Image points to an external ktx (or ktx2) file
          if (glTFImage.uri.find_last_of(".") != std::string::npos) {
-            if (glTFImage.uri.substr(glTFImage.uri.find_last_of(".") + 1) == "ktx") {
+            const std::string extension = glTFImage.uri.substr(glTFImage.uri.find_last_of(".") + 1);
+            if (extension == "ktx" || extension == "ktx2") {
                isKtx = true;
             }
          }
@@ -83,6 +217,31 @@ namespace genesis
          const bool srgb = (srgbProcessing && isSrgb(index));
          const VkFormat format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
 
+         const SamplerModes samplerModes = samplerModesForImage(glTfModel, index);
+         const bool normalMap = isNormalMap(index);
+
+         std::string cacheKey;
+         if (_textureCache)
+         {
+            cacheKey = textureCacheKey(glTFImage, srgb, compress && isKtx == false, normalMap, samplerModes);
+            Texture* texture = _textureCache->acquire(cacheKey);
+            if (texture)
+            {
+               loadedImages.push_back({ texture, nullptr, cacheKey, samplerModes, normalMap });
+               continue;
+            }
+         }
+
+         if (isKtx == false && compress)
+         {
+            Image* image = loadCompressedImage(glTFImage, index, srgb);
+            if (image)
+            {
+               loadedImages.push_back({ nullptr, image, cacheKey, samplerModes, normalMap });
+               continue;
+            }
+         }
+
          if (isKtx == false)
          {
             // Get the image data from the glTF loader
@@ -93,13 +252,7 @@ namespace genesis
             if (glTFImage.component == 3) {
                bufferSize = glTFImage.width * glTFImage.height * 4;
                buffer = new unsigned char[bufferSize];
-               unsigned char* rgba = buffer;
-               const unsigned char* rgb = &glTFImage.image[0];
-               for (size_t i = 0; i < glTFImage.width * glTFImage.height; ++i) {
-                  memcpy(rgba, rgb, sizeof(unsigned char) * 3);
-                  rgba += 4;
-                  rgb += 3;
-               }
+               pixelconversion::expandRgbToRgba(&glTFImage.image[0], buffer, (size_t)glTFImage.width * glTFImage.height);
                deleteBuffer = true;
             }
             else {
@@ -112,11 +265,20 @@ namespace genesis
                }
             }
 
+            // the decoded pixels are not needed afterwards, they are downsampled in place
+            int width = glTFImage.width;
+            int height = glTFImage.height;
+            if (Image::downsampleToMaxSize(buffer, format, width, height, _device->maxTextureSize()))
+            {
+               bufferSize = (VkDeviceSize)width * height * 4;
+            }
+
             Image* image = new Image(_device);
             std::vector<int> dataOffets = { 0 };
 
-            image->loadFromBuffer(buffer, bufferSize, format, glTFImage.width, glTFImage.height, dataOffets);
-            _images.push_back(image);
+            image->setDeferMipMapGeneration(mipMapGenerator && mipMapGenerator->supports(format, width, height));
+            image->loadFromBuffer(buffer, bufferSize, format, width, height, dataOffets);
+            loadedImages.push_back({ nullptr, image, cacheKey, samplerModes, normalMap });
 
             if (deleteBuffer) {
                delete[] buffer;
@@ -126,15 +288,230 @@ namespace genesis
          {
             Image* image = new Image(_device);
             image->loadFromFile(_basePath + "/" + glTFImage.uri, srgb);
-            _images.push_back(image);
+            loadedImages.push_back({ nullptr, image, cacheKey, samplerModes, normalMap });
          }
       }
 
       // default white image
+      const std::string whiteCacheKey = "default white";
+      Texture* whiteTexture = _textureCache ? _textureCache->acquire(whiteCacheKey) : nullptr;
+      if (whiteTexture)
+      {
+         loadedImages.push_back({ whiteTexture, nullptr, whiteCacheKey, SamplerModes(), false });
+      }
+      else
+      {
+         Image* image = new Image(_device);
+         std::array<std::uint8_t, 4> buffer = { 255,255,255,255 };
+         image->loadFromBuffer(buffer.data(), sizeof(std::uint8_t) * 4, VK_FORMAT_R8G8B8A8_UNORM, 1, 1, { 0 });
+         loadedImages.push_back({ nullptr, image, whiteCacheKey, SamplerModes(), false });
+      }
+
+      if (mipMapGenerator)
+      {
+         std::vector<Image*> images;
+         std::vector<bool> normalMaps;
+         for (const LoadedImage& loadedImage : loadedImages)
+         {
+            images.push_back(loadedImage._image);
+            normalMaps.push_back(loadedImage._normalMap);
+         }
+         mipMapGenerator->generate(images, normalMaps);
+      }
+
+      for (const LoadedImage& loadedImage : loadedImages)
+      {
+         if (loadedImage._cachedTexture)
+         {
+            _textures.push_back(loadedImage._cachedTexture);
+         }
+         else
+         {
+            addImage(loadedImage._image, loadedImage._cacheKey, loadedImage._samplerModes);
+         }
+      }
+   }
+
+   void VulkanGltfModel::addImage(Image* image, const std::string& textureCacheKey, const SamplerModes& samplerModes)
+   {
+      if (_textureCache)
+      {
+         _textures.push_back(_textureCache->insert(textureCacheKey, image, samplerModes));
+      }
+      else
+      {
+         _images.push_back(image);
+      }
+   }
+
+   //! collapses "." and ".." and unifies the separators, so that the same file
+   //! reached from two models in different directories gives the same string
+   static std::string normalizePath(const std::string& path)
+   {
+      std::vector<std::string> parts;
+      std::string part;
+      for (size_t i = 0; i <= path.size(); ++i)
+      {
+         const char c = (i < path.size()) ? path[i] : '/';
+         if (c != '/' && c != '\\')
+         {
+            part += c;
+            continue;
+         }
+         if (part == ".." && parts.empty() == false && parts.back() != "..")
+         {
+            parts.pop_back();
+         }
+         else if (part.empty() == false && part != ".")
+         {
+            parts.push_back(part);
+         }
+         part.clear();
+      }
+
+      std::string normalized = (path.empty() == false && (path[0] == '/' || path[0] == '\\')) ? "/" : "";
+      for (size_t i = 0; i < parts.size(); ++i)
+      {
+         normalized += (i == 0) ? parts[i] : "/" + parts[i];
+      }
+      return normalized;
+   }
+
+   //! bump when the encoders or the file layout change, so that stale cache entries are not picked up
+   static const uint64_t s_compressedTextureCacheVersion = 2;
+
+   static uint64_t hashBytes(const uint8_t* data, size_t size, uint64_t seed)
+   {
+      const uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+      uint64_t hash = seed ^ (size * multiplier);
+      size_t i = 0;
+      for (; i + 8 <= size; i += 8)
+      {
+         uint64_t word;
+         memcpy(&word, data + i, sizeof(word));
+         word *= multiplier;
+         word ^= word >> 29;
+         hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+      }
+      for (; i < size; ++i)
+      {
+         hash = (hash ^ data[i]) * 0x94d049bb133111ebull;
+      }
+      hash ^= hash >> 31;
+      return hash;
+   }
+
+   static void makeDirectory(const std::string& directory)
+   {
+#if defined(_WIN32)
+      _mkdir(directory.c_str());
+#else
+      mkdir(directory.c_str(), 0755);
+#endif
+   }
+
+   std::string VulkanGltfModel::textureCacheKey(const tinygltf::Image& glTFImage, bool srgb, bool compressed, bool normalMap, const SamplerModes& samplerModes) const
+   {
+      std::stringstream ss;
+      if (glTFImage.uri.empty() == false && glTFImage.uri.compare(0, 5, "data:") != 0)
+      {
+         ss << normalizePath(_basePath + "/" + glTFImage.uri);
+      }
+      else
+      {
+         // embedded in a buffer or a data uri, only the pixels identify it
+         const uint64_t description[] = { (uint64_t)glTFImage.width, (uint64_t)glTFImage.height, (uint64_t)glTFImage.component, (uint64_t)glTFImage.bits };
+         const uint64_t hash = hashBytes(glTFImage.image.data(), glTFImage.image.size(), hashBytes((const uint8_t*)description, sizeof(description), 0));
+         ss << "embedded:" << std::hex << std::setw(16) << std::setfill('0') << hash;
+      }
+      ss << (srgb ? "|srgb" : "|unorm");
+      if (compressed)
+      {
+         ss << (normalMap ? "|bc5" : "|bc7");
+      }
+      // the sampler is part of the shared texture
+      ss << std::dec << "|sampler" << samplerModes._magFilter << "," << samplerModes._minFilter << "," << samplerModes._mipmapMode
+         << "," << samplerModes._useMipMaps << "," << samplerModes._addressModeU << "," << samplerModes._addressModeV;
+      return ss.str();
+   }
+
+   Image* VulkanGltfModel::loadCompressedImage(const tinygltf::Image& glTFImage, uint32_t imageIndex, bool srgb)
+   {
+      if (glTFImage.bits != 8 || glTFImage.image.empty() || (glTFImage.component != 3 && glTFImage.component != 4))
+      {
+         return nullptr;
+      }
+
+      int width = glTFImage.width;
+      int height = glTFImage.height;
+
+      std::vector<uint8_t> pixels;
+      if (glTFImage.component == 3)
+      {
+         pixels.resize((size_t)width * height * 4);
+         pixelconversion::expandRgbToRgba(glTFImage.image.data(), pixels.data(), (size_t)width * height);
+      }
+      else
+      {
+         pixels = glTFImage.image;
+      }
+      Image::downsampleToMaxSize(pixels.data(), srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM, width, height, _device->maxTextureSize());
+
+      // normal maps only need x and y, the shader can rebuild z
+      const bool normalMap = isNormalMap(imageIndex);
+      const blockcompression::Codec codec = normalMap ? blockcompression::CODEC_BC5 : blockcompression::CODEC_BC7;
+      const VkFormat format = normalMap ? VK_FORMAT_BC5_UNORM_BLOCK : (srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK);
+
+      const uint64_t description[] = { s_compressedTextureCacheVersion, (uint64_t)width, (uint64_t)height, (uint64_t)format };
+      const uint64_t key = hashBytes(pixels.data(), pixels.size(), hashBytes((const uint8_t*)description, sizeof(description), 0));
+      std::stringstream ss;
+      ss << _compressedTextureCacheDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".ktx2";
+      const std::string cacheFileName = ss.str();
+
       Image* image = new Image(_device);
-      std::array<std::uint8_t, 4> buffer = { 255,255,255,255 };
-      image->loadFromBuffer(buffer.data(), sizeof(std::uint8_t) * 4, VK_FORMAT_R8G8B8A8_UNORM, 1, 1, { 0 });
-      _images.push_back(image);
+      if (std::ifstream(cacheFileName.c_str()).good() && image->loadFromFile(cacheFileName, false))
+      {
+         return image;
+      }
+
+      // the whole mip chain is encoded here, blits can not generate block compressed mips
+      std::vector<uint8_t> compressed;
+      std::vector<int> mipMapDataOffsets;
+      std::vector<uint8_t> nextLevel;
+      int levelWidth = width;
+      int levelHeight = height;
+      while (true)
+      {
+         const size_t offset = compressed.size();
+         mipMapDataOffsets.push_back((int)offset);
+         compressed.resize(offset + blockcompression::levelSize(codec, levelWidth, levelHeight));
+
+         const size_t blockRows = (levelHeight + 3) / 4;
+         parallelFor(blockRows, 16, [&](size_t begin, size_t end)
+         {
+            blockcompression::encodeBlockRows(codec, pixels.data(), levelWidth, levelHeight, (int)begin, (int)end, compressed.data() + offset);
+         });
+
+         if (levelWidth == 1 && levelHeight == 1)
+         {
+            break;
+         }
+         blockcompression::downsample(pixels.data(), levelWidth, levelHeight, srgb && !normalMap, normalMap, nextLevel);
+         pixels.swap(nextLevel);
+         levelWidth = std::max(1, levelWidth / 2);
+         levelHeight = std::max(1, levelHeight / 2);
+      }
+
+      if (!image->loadFromBuffer(compressed.data(), compressed.size(), format, width, height, mipMapDataOffsets))
+      {
+         delete image;
+         return nullptr;
+      }
+
+      makeDirectory(_compressedTextureCacheDirectory);
+      Image::saveToKtx2(cacheFileName, format, width, height, compressed.data(), compressed.size(), mipMapDataOffsets);
+
+      return image;
    }
 
    void VulkanGltfModel::loadTextures(tinygltf::Model& gltfModel)
@@ -142,7 +519,7 @@ namespace genesis
       int imageIndex = 0;
       for (const auto& image : _images)
       {
-         _textures.push_back(new Texture(_images[imageIndex]));
+         _textures.push_back(new Texture(_images[imageIndex], samplerModesForImage(gltfModel, imageIndex)));
          ++imageIndex;
       }
    }
@@ -228,8 +605,23 @@ namespace genesis
             currentMaterial.transmissionTextureIndex = (int)transmissionIter->second.Get("transmissionTexture").GetNumberAsInt();
          }
 
+         // blend is treated as opaque, only mask gets alpha tested
+         if (glTfMaterial.alphaMode == "MASK")
+         {
+            currentMaterial.alphaMode = ALPHA_MASK;
+         }
+         else if (glTfMaterial.alphaMode == "BLEND")
+         {
+            currentMaterial.alphaMode = ALPHA_BLEND;
+         }
+         currentMaterial.alphaCutoff = (float)glTfMaterial.alphaCutoff;
+
          // Normals
          currentMaterial.normalTextureIndex = glTfMaterial.normalTexture.index;
+         if (currentMaterial.normalTextureIndex != -1)
+         {
+            _imageIndexToWhetherNormalMap[currentMaterial.normalTextureIndex] = true;
+         }
 
          _materials.push_back(currentMaterial);
       }
@@ -480,7 +872,8 @@ namespace genesis
    {
       // KTX files will be handled by our own code
       if (image->uri.find_last_of(".") != std::string::npos) {
-         if (image->uri.substr(image->uri.find_last_of(".") + 1) == "ktx") {
+         const std::string extension = image->uri.substr(image->uri.find_last_of(".") + 1);
+         if (extension == "ktx" || extension == "ktx2") {
             return true;
          }
       }
@@ -511,15 +904,28 @@ namespace genesis
       tinygltf::TinyGLTF gltfContext;
       std::string error, warning;
 
-      if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
-         gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
-      }
-      else {
-         gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
-      }
+      _printStats = (fileLoadingFlags & FileLoadingFlags::PrintStats) != 0;
+
+      const tinygltf::LoadImageDataFunction imageLoader = (fileLoadingFlags & FileLoadingFlags::DontLoadImages) ? loadImageDataFuncEmpty : loadImageDataFunc;
+      gltfContext.SetImageLoader(imageLoader, nullptr);
 
       bool fileLoaded = false;
-      if (fileName.find(".gltf") != std::string::npos)
+      if ((fileLoadingFlags & FileLoadingFlags::FastJsonParser) && fileName.find(".gltf") != std::string::npos)
+      {
+         GltfJsonParser parser;
+         fileLoaded = parser.loadFromFile(&glTfModel, fileName, imageLoader, nullptr, &error);
+         if (fileLoaded == false)
+         {
+            std::cout << "Warning: " << __FUNCTION__ << ": " << "falling back to tinygltf: " << error << std::endl;
+            error.clear();
+         }
+      }
+
+      if (fileLoaded)
+      {
+         // already parsed
+      }
+      else if (fileName.find(".gltf") != std::string::npos)
       {
          fileLoaded = gltfContext.LoadASCIIFromFile(&glTfModel, &error, &warning, fileName);
       }
@@ -542,7 +948,7 @@ namespace genesis
 
       if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages))
       {
-         loadImages(glTfModel, srgbProcessing);
+         loadImages(glTfModel, srgbProcessing, fileLoadingFlags);
       }
 
       loadTextures(glTfModel);
@@ -550,13 +956,377 @@ namespace genesis
       loadScenes(glTfModel, fileLoadingFlags);
 
       buildLightInstancesBuffer();
-      
-      VkBufferUsageFlags additionalFlags = 0;
-      //if (_rayTracing)
+
+      // welding has to happen first, the passes after it work on the index buffer.
+      // the simplifier locks the vertices on borders and attribute seams, which is all of them in a triangle soup,
+      // so the lods need it as well
+      if (fileLoadingFlags & (FileLoadingFlags::WeldVertices | FileLoadingFlags::GenerateLods))
+      {
+         weldVertices();
+      }
+
+      if (fileLoadingFlags & FileLoadingFlags::MergePrimitivesByMaterial)
+      {
+         mergePrimitivesByMaterial();
+      }
+
+      if (fileLoadingFlags & FileLoadingFlags::GenerateLods)
+      {
+         generateLods();
+      }
+
+      computeGeometryMetaData();
+      createGpuGeometryBuffers();
+
+      if (fileLoadingFlags & FileLoadingFlags::ReleaseCpuGeometry)
+      {
+         releaseCpuGeometry();
+      }
+   }
+
+   static uint64_t hashVertex(const Vertex& vertex)
+   {
+      uint32_t words[sizeof(Vertex) / sizeof(uint32_t)];
+      memcpy(words, &vertex, sizeof(words));
+
+      uint64_t hash = 0xcbf29ce484222325ull;
+      for (uint32_t word : words)
+      {
+         hash = (hash ^ word) * 0x100000001b3ull;
+         hash ^= hash >> 29;
+      }
+      return hash;
+   }
+
+   struct PrehashedKeyHash
+   {
+      size_t operator()(uint64_t hash) const
+      {
+         return (size_t)hash;
+      }
+   };
+
+   void VulkanGltfModel::weldVertices(void)
+   {
+      const size_t numVerticesBefore = _vertexBuffer.size();
+
+      // hash the full attribute tuple of every vertex
+      std::vector<uint64_t> hashes(numVerticesBefore);
+      parallelFor(numVerticesBefore, 1 << 16,
+         [&](size_t begin, size_t end)
+         {
+            for (size_t i = begin; i < end; ++i)
+            {
+               hashes[i] = hashVertex(_vertexBuffer[i]);
+            }
+         }
+      );
+
+      // for every vertex, the first vertex in its primitive with identical attributes.
+      // large primitives are split into partitions on the hash, which are welded independently
+      std::vector<uint32_t> weldedTo(numVerticesBefore);
+      const uint32_t numPartitions = std::max(1u, std::thread::hardware_concurrency());
+      forEachMesh(
+         [&](Mesh& mesh)
+         {
+            for (const Primitive& primitive : mesh.primitives)
+            {
+               const uint32_t firstVertex = primitive.firstVertex;
+               const uint32_t endVertex = primitive.firstVertex + primitive.vertexCount;
+               const uint32_t partitions = (primitive.vertexCount > (1 << 16)) ? numPartitions : 1;
+               parallelFor(partitions, 1,
+                  [&](size_t beginPartition, size_t endPartition)
+                  {
+                     for (size_t partition = beginPartition; partition < endPartition; ++partition)
+                     {
+                        std::unordered_multimap<uint64_t, uint32_t, PrehashedKeyHash> firstWithHash;
+                        for (uint32_t v = firstVertex; v < endVertex; ++v)
+                        {
+                           if ((hashes[v] >> 32) % partitions != partition)
+                           {
+                              continue;
+                           }
+                           weldedTo[v] = v;
+                           auto range = firstWithHash.equal_range(hashes[v]);
+                           for (auto it = range.first; it != range.second; ++it)
+                           {
+                              if (memcmp(&_vertexBuffer[it->second], &_vertexBuffer[v], sizeof(Vertex)) == 0)
+                              {
+                                 weldedTo[v] = it->second;
+                                 break;
+                              }
+                           }
+                           if (weldedTo[v] == v)
+                           {
+                              firstWithHash.insert({ hashes[v], v });
+                           }
+                        }
+                     }
+                  }
+               );
+            }
+         }
+      );
+
+      // compact, primitives keep contiguous vertex ranges
+      std::vector<Vertex> weldedVertices;
+      weldedVertices.reserve(numVerticesBefore);
+      std::vector<uint32_t> newIndex(numVerticesBefore, 0);
+      forEachMesh(
+         [&](Mesh& mesh)
+         {
+            for (Primitive& primitive : mesh.primitives)
+            {
+               const uint32_t newFirstVertex = (uint32_t)weldedVertices.size();
+               for (uint32_t v = primitive.firstVertex; v < primitive.firstVertex + primitive.vertexCount; ++v)
+               {
+                  // welded vertices always point back, so their new index is already known
+                  if (weldedTo[v] == v)
+                  {
+                     newIndex[v] = (uint32_t)weldedVertices.size();
+                     weldedVertices.push_back(_vertexBuffer[v]);
+                  }
+                  else
+                  {
+                     newIndex[v] = newIndex[weldedTo[v]];
+                  }
+               }
+               primitive.firstVertex = newFirstVertex;
+               primitive.vertexCount = (uint32_t)weldedVertices.size() - newFirstVertex;
+
+               for (int lod = 0; lod <= (int)primitive.lods.size(); ++lod)
+               {
+                  uint32_t* indices = _indexBuffer.data() + primitive.lodFirstIndex(lod);
+                  parallelFor(primitive.lodIndexCount(lod), 1 << 16,
+                     [&](size_t begin, size_t end)
+                     {
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                           indices[i] = newIndex[indices[i]];
+                        }
+                     }
+                  );
+               }
+            }
+         }
+      );
+      _vertexBuffer.swap(weldedVertices);
+
+      if (_printStats)
+      {
+         std::cout << "weld: vertices: " << numVerticesBefore << " -> " << _vertexBuffer.size() << std::endl;
+      }
+   }
+
+   void VulkanGltfModel::mergePrimitivesByMaterial(void)
+   {
+      // rebuild the index buffer so that the indices of each merged primitive are contiguous
+      std::vector<uint32_t> mergedIndices;
+      mergedIndices.reserve(_indexBuffer.size());
+
+      const int numPrimitivesBefore = numPrimitives();
+
+      forEachMesh(
+         [&](Mesh& mesh)
+         {
+            // groups in order of first appearance of the material. primitives without indices have nothing
+            // to concatenate, they are kept as they are
+            std::vector< std::vector<const Primitive*> > groups;
+            std::unordered_map<int32_t, size_t> materialToGroup;
+            std::vector<Primitive> unindexedPrimitives;
+            for (const Primitive& primitive : mesh.primitives)
+            {
+               if (primitive.indexCount == 0)
+               {
+                  unindexedPrimitives.push_back(primitive);
+                  continue;
+               }
+               auto inserted = materialToGroup.insert({ primitive.materialIndex, groups.size() });
+               if (inserted.second)
+               {
+                  groups.push_back({});
+               }
+               groups[inserted.first->second].push_back(&primitive);
+            }
+
+            std::vector<Primitive> mergedPrimitives;
+            mergedPrimitives.reserve(groups.size());
+            for (const auto& group : groups)
+            {
+               Primitive merged{};
+               merged.firstIndex = (uint32_t)mergedIndices.size();
+               merged.materialIndex = group.front()->materialIndex;
+
+               // the vertex range has to be the parts' own. if other vertices lie in between, the parts' vertices
+               // are copied to the end of the vertex buffer, one after the other, and their indices rebased
+               std::vector< std::pair<uint32_t, uint32_t> > ranges;
+               for (const Primitive* part : group)
+               {
+                  ranges.push_back({ part->firstVertex, part->firstVertex + part->vertexCount });
+               }
+               std::sort(ranges.begin(), ranges.end());
+               uint32_t endVertex = ranges.front().second;
+               bool contiguous = true;
+               for (size_t i = 1; i < ranges.size(); ++i)
+               {
+                  contiguous = contiguous && ranges[i].first <= endVertex;
+                  endVertex = std::max(endVertex, ranges[i].second);
+               }
+
+               merged.firstVertex = contiguous ? ranges.front().first : (uint32_t)_vertexBuffer.size();
+               for (const Primitive* part : group)
+               {
+                  const size_t firstMergedIndex = mergedIndices.size();
+                  mergedIndices.insert(mergedIndices.end()
+                     , _indexBuffer.begin() + part->firstIndex
+                     , _indexBuffer.begin() + part->firstIndex + part->indexCount);
+                  if (!contiguous)
+                  {
+                     // a range of the vector can not be inserted into itself, it may reallocate
+                     const uint32_t newFirstVertex = (uint32_t)_vertexBuffer.size();
+                     const std::vector<Vertex> partVertices(_vertexBuffer.begin() + part->firstVertex
+                        , _vertexBuffer.begin() + part->firstVertex + part->vertexCount);
+                     _vertexBuffer.insert(_vertexBuffer.end(), partVertices.begin(), partVertices.end());
+                     for (size_t i = firstMergedIndex; i < mergedIndices.size(); ++i)
+                     {
+                        mergedIndices[i] = mergedIndices[i] - part->firstVertex + newFirstVertex;
+                     }
+                  }
+               }
+               merged.indexCount = (uint32_t)mergedIndices.size() - merged.firstIndex;
+               merged.vertexCount = contiguous ? endVertex - merged.firstVertex : (uint32_t)_vertexBuffer.size() - merged.firstVertex;
+               mergedPrimitives.push_back(merged);
+            }
+            mergedPrimitives.insert(mergedPrimitives.end(), unindexedPrimitives.begin(), unindexedPrimitives.end());
+            mesh.primitives.swap(mergedPrimitives);
+         }
+      );
+
+      _indexBuffer.swap(mergedIndices);
+
+      if (_printStats)
+      {
+         std::cout << "merge: primitives: " << numPrimitivesBefore << " -> " << numPrimitives() << std::endl;
+      }
+   }
+
+   void VulkanGltfModel::generateLods(void)
+   {
+      // need the bounds for the error limit
+      computeGeometryMetaData();
+
+      const float maxError = s_lodMaxRelativeError * glm::length(_boundsMax - _boundsMin);
+
+      MeshSimplifier simplifier(_vertexBuffer);
+      std::vector<uint32_t> simplified;
+
+      _lodErrors.assign(s_maxLods - 1, 0.0f);
+      std::vector<size_t> numTrianglesPerLod(s_maxLods, 0);
+
+      forEachMesh(
+         [&](Mesh& mesh)
+         {
+            for (Primitive& primitive : mesh.primitives)
+            {
+               if (primitive.indexCount == 0)
+               {
+                  continue;
+               }
+
+               // each lod is simplified from the previous one, halving the triangle count
+               uint32_t sourceFirstIndex = primitive.firstIndex;
+               uint32_t sourceIndexCount = primitive.indexCount;
+               float accumulatedError = 0.0f;
+               for (int lod = 1; lod < s_maxLods; ++lod)
+               {
+                  const size_t targetIndexCount = ((primitive.indexCount >> lod) / 3) * 3;
+                  accumulatedError += simplifier.simplify(&_indexBuffer[sourceFirstIndex], sourceIndexCount, targetIndexCount, maxError - accumulatedError, simplified);
+
+                  // stop when simplification stalls, a lod barely smaller than the previous one is not worth it
+                  if (simplified.empty() || simplified.size() * 10 > (size_t)sourceIndexCount * 9)
+                  {
+                     break;
+                  }
+
+                  PrimitiveLod primitiveLod;
+                  primitiveLod.firstIndex = (uint32_t)_indexBuffer.size();
+                  primitiveLod.indexCount = (uint32_t)simplified.size();
+                  _indexBuffer.insert(_indexBuffer.end(), simplified.begin(), simplified.end());
+                  primitive.lods.push_back(primitiveLod);
+
+                  _lodErrors[lod - 1] = std::max(_lodErrors[lod - 1], accumulatedError);
+
+                  sourceFirstIndex = primitiveLod.firstIndex;
+                  sourceIndexCount = primitiveLod.indexCount;
+               }
+
+               for (int lod = 0; lod < s_maxLods; ++lod)
+               {
+                  numTrianglesPerLod[lod] += primitive.lodIndexCount(lod) / 3;
+               }
+            }
+         }
+      );
+
+      // only keep as many lods as the most simplified primitive got
+      int numGeneratedLods = 0;
+      forEachPrimitive(
+         [&](const Primitive& primitive)
+         {
+            numGeneratedLods = std::max(numGeneratedLods, (int)primitive.lods.size());
+         }
+      );
+      _lodErrors.resize(numGeneratedLods);
+
+      if (_printStats)
+      {
+         // of the full detail triangles, so a lod that did not get much smaller shows
+         std::cout << "lods: triangles: " << numTrianglesPerLod[0];
+         for (int lod = 1; lod <= numGeneratedLods; ++lod)
+         {
+            std::cout << " -> " << numTrianglesPerLod[lod] << " (" << (int)(100.0 * numTrianglesPerLod[lod] / std::max<size_t>(1, numTrianglesPerLod[0]) + 0.5) << "%)";
+         }
+         if (numGeneratedLods == 0)
+         {
+            std::cout << ", none generated";
+         }
+         std::cout << std::endl;
+      }
+   }
+
+   void VulkanGltfModel::computeGeometryMetaData(void)
+   {
+      _numVertices = (int)_vertexBuffer.size();
+      _numIndices = (int)_indexBuffer.size();
+
+      _geometryHash = hashBytes((const uint8_t*)_vertexBuffer.data(), _vertexBuffer.size() * sizeof(Vertex), 0);
+      _geometryHash = hashBytes((const uint8_t*)_indexBuffer.data(), _indexBuffer.size() * sizeof(uint32_t), _geometryHash);
+
+      if (_vertexBuffer.empty())
+      {
+         _boundsMin = Vector3_32(0.0f);
+         _boundsMax = Vector3_32(0.0f);
+         return;
+      }
+
+      _boundsMin = Vector3_32(std::numeric_limits<float>::max());
+      _boundsMax = Vector3_32(-std::numeric_limits<float>::max());
+      for (const Vertex& vertex : _vertexBuffer)
+      {
+         _boundsMin = glm::min(_boundsMin, vertex.position);
+         _boundsMax = glm::max(_boundsMax, vertex.position);
+      }
+   }
+
+   void VulkanGltfModel::createGpuGeometryBuffers(void)
+   {
+      VkBufferUsageFlags additionalFlags = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT 
+         | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+         | VK_BUFFER_USAGE_TRANSFER_SRC_BIT; // for readBackGeometry
+      // not a valid usage without VK_KHR_acceleration_structure
+      if (_rayTracing)
       {
-         additionalFlags = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT 
-            | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR 
-            | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+         additionalFlags |= VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
       }
 
       {
@@ -580,6 +1350,69 @@ namespace genesis
       }
    }
 
+   void VulkanGltfModel::releaseCpuGeometry(void)
+   {
+      // swap with empty vectors so that the memory is actually returned
+      std::vector<Vertex>().swap(_vertexBuffer);
+      std::vector<uint32_t>().swap(_indexBuffer);
+   }
+
+   uint64_t VulkanGltfModel::geometryHash(void) const
+   {
+      return _geometryHash;
+   }
+
+   bool VulkanGltfModel::hasCpuGeometry(void) const
+   {
+      return _vertexBuffer.size() == (size_t)_numVertices && _indexBuffer.size() == (size_t)_numIndices;
+   }
+
+   bool VulkanGltfModel::readBackGeometry(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const
+   {
+      if (hasCpuGeometry())
+      {
+         vertices = _vertexBuffer;
+         indices = _indexBuffer;
+         return true;
+      }
+
+      if (_vertexBufferGpu == nullptr || _indexBufferGpu == nullptr)
+      {
+         std::cout << "Warning: " << __FUNCTION__ << ": " << "no gpu geometry to read back" << std::endl;
+         return false;
+      }
+
+      const VkDeviceSize sizeOfVertexBuffer = _numVertices * sizeof(Vertex);
+      const VkDeviceSize sizeOfIndexBuffer = _numIndices * sizeof(uint32_t);
+
+      VulkanBuffer readBackBuffer(_device, VK_BUFFER_USAGE_TRANSFER_DST_BIT
+         , VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+         , sizeOfVertexBuffer + sizeOfIndexBuffer);
+
+      VkCommandBuffer copyCmd = _device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+
+      VkBufferCopy bufferCopy = {};
+      bufferCopy.srcOffset = 0;
+      bufferCopy.dstOffset = 0;
+      bufferCopy.size = sizeOfVertexBuffer;
+      vkCmdCopyBuffer(copyCmd, _vertexBufferGpu->vulkanBuffer(), readBackBuffer.vulkanBuffer(), 1, &bufferCopy);
+
+      bufferCopy.dstOffset = sizeOfVertexBuffer;
+      bufferCopy.size = sizeOfIndexBuffer;
+      vkCmdCopyBuffer(copyCmd, _indexBufferGpu->vulkanBuffer(), readBackBuffer.vulkanBuffer(), 1, &bufferCopy);
+
+      _device->flushCommandBuffer(copyCmd);
+
+      VK_CHECK_RESULT(readBackBuffer.map());
+      vertices.resize(_numVertices);
+      indices.resize(_numIndices);
+      memcpy(vertices.data(), readBackBuffer._mapped, sizeOfVertexBuffer);
+      memcpy(indices.data(), (const uint8_t*)readBackBuffer._mapped + sizeOfVertexBuffer, sizeOfIndexBuffer);
+      readBackBuffer.unmap();
+
+      return true;
+   }
+
    const std::vector<Image*>& VulkanGltfModel::images(void) const
    {
       return _images;
@@ -596,7 +1429,54 @@ namespace genesis
 
    int VulkanGltfModel::numVertices() const
    {
-      return (int)_vertexBuffer.size();
+      return _numVertices;
+   }
+
+   int VulkanGltfModel::numIndices() const
+   {
+      return _numIndices;
+   }
+
+   const Vector3_32& VulkanGltfModel::boundsMin(void) const
+   {
+      return _boundsMin;
+   }
+
+   const Vector3_32& VulkanGltfModel::boundsMax(void) const
+   {
+      return _boundsMax;
+   }
+
+   int VulkanGltfModel::numLods(void) const
+   {
+      return (int)_lodErrors.size() + 1;
+   }
+
+   float VulkanGltfModel::lodError(int lod) const
+   {
+      if (lod <= 0 || _lodErrors.empty())
+      {
+         return 0.0f;
+      }
+      return _lodErrors[std::min(lod, (int)_lodErrors.size()) - 1];
+   }
+
+   uint32_t Primitive::lodFirstIndex(int lod) const
+   {
+      if (lod <= 0 || lods.empty())
+      {
+         return firstIndex;
+      }
+      return lods[std::min(lod, (int)lods.size()) - 1].firstIndex;
+   }
+
+   uint32_t Primitive::lodIndexCount(int lod) const
+   {
+      if (lod <= 0 || lods.empty())
+      {
+         return indexCount;
+      }
+      return lods[std::min(lod, (int)lods.size()) - 1].indexCount;
    }
 
    const std::vector<Node*>& VulkanGltfModel::linearNodes(void) const
@@ -609,11 +1489,43 @@ namespace genesis
       return _textures;
    }
 
+   VkDeviceSize VulkanGltfModel::textureMemoryInBytes(void) const
+   {
+      // the same cached texture can be behind several images
+      std::unordered_set<const Texture*> counted;
+      VkDeviceSize bytes = 0;
+      for (const Texture* texture : _textures)
+      {
+         if (counted.insert(texture).second)
+         {
+            bytes += texture->image()->allocationSize();
+         }
+      }
+      return bytes;
+   }
+
    const std::vector<Material>& VulkanGltfModel::materials(void) const
    {
       return _materials;
    }
 
+   bool VulkanGltfModel::alphaMasked(const Primitive& primitive) const
+   {
+      return _materials[primitive.materialIndex].alphaMode == ALPHA_MASK;
+   }
+
+   bool VulkanGltfModel::hasAlphaMaskedPrimitives(void) const
+   {
+      bool masked = false;
+      forEachPrimitive(
+         [&](const Primitive& primitive)
+         {
+            masked = masked || alphaMasked(primitive);
+         }
+      );
+      return masked;
+   }
+
    int VulkanGltfModel::numPrimitives(void) const
    {
       int count = 0;
@@ -656,4 +1568,28 @@ namespace genesis
       }
    }
 
+   void VulkanGltfModel::forEachMesh(const std::function<void(Mesh&)>& func)
+   {
+      std::deque<Node*> nodesToProcess;
+      for (Node* node : _linearNodes)
+      {
+         nodesToProcess.push_back(node);
+      }
+
+      while (!nodesToProcess.empty())
+      {
+         Node* node = nodesToProcess.front(); nodesToProcess.pop_front();
+
+         if (node->_mesh)
+         {
+            func(*node->_mesh);
+         }
+
+         for (Node* child : node->_children)
+         {
+            nodesToProcess.push_back(child);
+         }
+      }
+   }
+
 }
\ No newline at end of file
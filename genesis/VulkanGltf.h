@@ -18,6 +18,7 @@ namespace tinygltf
    class Model;
    class Node;
    struct Mesh;
+   struct Image;
 }
 
 namespace genesis
@@ -27,9 +28,24 @@ namespace genesis
    class Texture;
    class Buffer;
    class AccelerationStructure;
+   class TextureCache;
+   struct SamplerModes;
+
+   //! a simplified version of a primitive. indexes the same vertices
+   struct PrimitiveLod
+   {
+      uint32_t firstIndex;
+      uint32_t indexCount;
+   };
 
    struct Primitive
    {
+   public:
+      //! index range for a given lod. lod 0 is the primitive itself.
+      //! lods beyond the ones generated return the coarsest one
+      uint32_t lodFirstIndex(int lod) const;
+      uint32_t lodIndexCount(int lod) const;
+   public:
       uint32_t firstIndex;
       uint32_t indexCount;
 
@@ -37,6 +53,9 @@ namespace genesis
       uint32_t vertexCount;
 
       int32_t materialIndex;
+
+      //! simplified versions, coarser with each entry. lods[0] is lod 1
+      std::vector<PrimitiveLod> lods;
    };
 
    class Mesh
@@ -90,7 +109,24 @@ namespace genesis
          PreMultiplyVertexColors = 0x00000002,
          FlipY = 0x00000004,
          DontLoadImages = 0x00000008,
-         ColorTexturesAreSrgb = 0x00000010
+         ColorTexturesAreSrgb = 0x00000010,
+         //! free the cpu side copies of the vertex and index buffers
+         //! once they have been uploaded to the gpu.
+         //! counts and bounds are kept, use readBackGeometry to get the data back
+         ReleaseCpuGeometry = 0x00000020,
+         //! generate simplified index buffers for each primitive. implies WeldVertices
+         GenerateLods = 0x00000040,
+         //! merge vertices (within a primitive) whose attributes are identical
+         WeldVertices = 0x00000080,
+         //! primitives of a node that share a material become one primitive
+         MergePrimitivesByMaterial = 0x00000100,
+         //! parse .gltf files with GltfJsonParser, tinygltf is used if it refuses the file
+         FastJsonParser = 0x00000200,
+         //! block compress png/jpg textures on load (bc7 for color, bc5 for normal maps).
+         //! the results are cached on disk, see setCompressedTextureCacheDirectory
+         CompressTextures = 0x00000400,
+         //! print what the load passes (weld, merge, lods) did to the geometry
+         PrintStats = 0x00000800
       };
    public:
       VulkanGltfModel(Device* device, bool rayTracing);
@@ -98,19 +134,64 @@ namespace genesis
    public:
       virtual void loadFromFile(const std::string& fileName, uint32_t fileLoadingFlags);
 
+      //! where CompressTextures keeps the encoded textures, keyed by a hash of their content
+      virtual void setCompressedTextureCacheDirectory(const std::string& directory);
+
+      //! textures are taken from (and added to) this cache instead of being owned by the model,
+      //! so models that use the same files share them. call before loadFromFile
+      virtual void setTextureCache(TextureCache* textureCache);
+
       virtual const Buffer* vertexBuffer(void) const;
       virtual const Buffer* indexBuffer(void) const;
       virtual int numVertices() const;
+      virtual int numIndices() const;
+
+      //! object space bounds of all the vertices (after any pre-transformation)
+      virtual const Vector3_32& boundsMin(void) const;
+      virtual const Vector3_32& boundsMax(void) const;
+
+      //! identifies the vertices and indices (with all the lods), for caches of things built from them
+      virtual uint64_t geometryHash(void) const;
+
+      //! whether the cpu side copies are still resident
+      virtual bool hasCpuGeometry(void) const;
+
+      //! copies the vertex and index buffers back from the gpu.
+      //! slow, meant for tools that need the geometry after ReleaseCpuGeometry
+      virtual bool readBackGeometry(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) const;
 
       virtual const std::vector<Node*>& linearNodes(void) const;
       virtual const std::vector<Texture*>& textures(void) const;
+
+      //! video memory of the model's textures, as they are currently resident.
+      //! textures shared with other models through the texture cache are counted here too
+      virtual VkDeviceSize textureMemoryInBytes(void) const;
       virtual const std::vector<Material>& materials(void) const;
 
+      //! whether the primitive has to be alpha tested, the others are opaque
+      virtual bool alphaMasked(const Primitive& primitive) const;
+
+      //! whether any primitive is alpha masked
+      virtual bool hasAlphaMaskedPrimitives(void) const;
+
       virtual void forEachPrimitive(const std::function<void(const Primitive&)>& func) const;
       virtual int numPrimitives(void) const;
+
+      //! number of levels of detail, including the full detail one
+      virtual int numLods(void) const;
+
+      //! largest simplification error (model units) of any primitive at this lod
+      virtual float lodError(int lod) const;
    protected:
-      virtual void loadImages(tinygltf::Model& gltfModel, bool srgbProcessing);
+      virtual void loadImages(tinygltf::Model& gltfModel, bool srgbProcessing, uint32_t fileLoadingFlags);
+      //! nullptr if the image can not be compressed, the caller then uploads it uncompressed
+      virtual Image* loadCompressedImage(const tinygltf::Image& gltfImage, uint32_t imageIndex, bool srgb);
       virtual void loadTextures(tinygltf::Model& gltfModel);
+      //! the model owns the image, or hands it to the texture cache if there is one
+      virtual void addImage(Image* image, const std::string& textureCacheKey, const SamplerModes& samplerModes);
+      //! resolved path for external files, a hash of the pixels for embedded ones.
+      //! plus whatever changes what ends up on the gpu, including the sampler
+      virtual std::string textureCacheKey(const tinygltf::Image& gltfImage, bool srgb, bool compressed, bool normalMap, const SamplerModes& samplerModes) const;
       virtual void loadMaterials(tinygltf::Model& gltfModel, bool srgbProcessing);
       virtual void loadScenes(tinygltf::Model& gltfModel, uint32_t fileLoadingFlags);
       virtual void loadNode(const tinygltf::Node& inputNode, tinygltf::Model& gltfModel, Node* parent, uint32_t fileLoadingFlags);
@@ -122,6 +203,17 @@ namespace genesis
       virtual void buildLightInstancesBuffer(void);
       virtual void addSrgbIndexIfNecessary(bool srgbProcessing, uint32_t index, bool isSrgb);
       virtual bool isSrgb(uint32_t index) const;
+      virtual bool isNormalMap(uint32_t index) const;
+
+      virtual void forEachMesh(const std::function<void(Mesh&)>& func);
+
+      virtual void weldVertices(void);
+      virtual void mergePrimitivesByMaterial(void);
+      virtual void generateLods(void);
+
+      virtual void computeGeometryMetaData(void);
+      virtual void createGpuGeometryBuffers(void);
+      virtual void releaseCpuGeometry(void);
    protected:
       Device* _device;
 
@@ -129,7 +221,15 @@ namespace genesis
 
       std::unordered_map<uint32_t, bool> _imageIndexToWhetherSrgb;
 
+      //! images used as normal maps, these get a two channel compressed format
+      std::unordered_map<uint32_t, bool> _imageIndexToWhetherNormalMap;
+
+      std::string _compressedTextureCacheDirectory;
+
       std::vector<Texture*> _textures;
+
+      //! when set, _textures are references into it and _images stays empty
+      TextureCache* _textureCache;
       
       std::vector<Material> _materials;
 
@@ -143,6 +243,19 @@ namespace genesis
       Buffer* _vertexBufferGpu;
       Buffer* _indexBufferGpu;
 
+      // kept around so that the cpu copies can be released
+      int _numVertices;
+      int _numIndices;
+      uint64_t _geometryHash = 0;
+      Vector3_32 _boundsMin;
+      Vector3_32 _boundsMax;
+
+      //! error of each generated lod, _lodErrors[0] is lod 1
+      std::vector<float> _lodErrors;
+
+      //! FileLoadingFlags::PrintStats of the last load
+      bool _printStats = false;
+
       // original lights
       std::vector<Light*> _lights;
 
@@ -152,8 +265,15 @@ namespace genesis
       // same as above, but on the gpu
       Buffer* _lightInstancesGpu;
 
+      //! the device has VK_KHR_acceleration_structure, the geometry buffers are blas build inputs
       const bool _rayTracing;
 
       static const int s_maxBindlessTextures;
+
+      //! including the full detail one
+      static const int s_maxLods;
+
+      //! lods are not allowed to deviate more than this fraction of the bounding box diagonal
+      static const float s_lodMaxRelativeError;
    };
 }
\ No newline at end of file